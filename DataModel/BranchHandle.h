@@ -0,0 +1,106 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef BranchHandle_H
+#define BranchHandle_H
+
+#include <string>
+#include <vector>
+#include <utility>     // pair
+#include <cstdint>     // intptr_t
+#include <type_traits> // integral_constant
+
+#include "basic_array.h"
+#include "MTreeReader.h"
+
+/*
+A BranchHandle is a reference to an MTreeReader branch that has been looked up and type-checked
+in advance, via MTreeReader::GetBranchHandle. This should be done once (e.g. in Initialise).
+Retrieving the value for the current entry thereafter is just a pointer dereference,
+with no branch name lookups. Handles remain valid for the lifetime of the MTreeReader.
+In lazy reading mode, retrieving the value will also read the branch, if it has not yet
+been read for the current entry.
+
+Usage:
+	BranchHandle<int> num_pre_muons_h;                 // primitives
+	BranchHandle<Header> HEADER_h;                     // objects
+	BranchHandle<basic_array<float*>> dt_mu_lowe_h;    // c-style arrays, as for basic_array
+
+	myTreeReader->GetBranchHandle("nmusave_pre", num_pre_muons_h);  // in Initialise
+	...
+	int num_pre_muons = *num_pre_muons_h;                            // in Execute
+	const Header* HEADER = HEADER_h.Get();
+	basic_array<float*> dt_mu_lowe = dt_mu_lowe_h.Get();
+*/
+
+// primitives and objects
+template<typename T>
+class BranchHandle {
+	friend class MTreeReader;
+	public:
+	BranchHandle(){};
+
+	bool IsValid() const { return (info!=nullptr); }
+	std::string GetName() const { return info->name; }
+
+	const T* Get() const {
+		reader->LoadBranch(*info);
+		return reinterpret_cast<const T*>(info->value_pointer);
+	}
+	const T& operator*() const { return *Get(); }
+	const T* operator->() const { return Get(); }
+
+	private:
+	MTreeReader* reader=nullptr;
+	BranchInfo* info=nullptr;
+};
+
+// c-style arrays
+template<typename T, bool B>
+class BranchHandle<basic_array<T,B>> {
+	friend class MTreeReader;
+	public:
+	BranchHandle(){};
+
+	bool IsValid() const { return (info!=nullptr); }
+	std::string GetName() const { return info->name; }
+
+	// dimensions of the array for the current entry
+	size_t GetNDims() const { return dimensions.size(); }
+	size_t GetDim(size_t dim_i) const {
+		reader->LoadBranch(*info);  // also loads any branches holding the dimensions
+		return ReadDim(dim_i);
+	}
+	size_t size() const { return GetDim(0); }
+
+	basic_array<T,B> Get() const {
+		reader->LoadBranch(*info);
+		return MakeArray(std::integral_constant<bool,B>());
+	}
+	int Get(basic_array<T,B>& ref_in) const {
+		ref_in = Get();
+		return 1;
+	}
+
+	private:
+	size_t ReadDim(size_t dim_i) const {
+		const std::pair<const BranchInfo*, size_t>& adim = dimensions[dim_i];
+		// constant dimensions are stored directly, variable ones are read from the size branch
+		return (adim.first==nullptr) ? adim.second : *reinterpret_cast<const int*>(adim.first->value_pointer);
+	}
+	// 1D arrays only need the outer dimension
+	basic_array<T,B> MakeArray(std::false_type) const {
+		return basic_array<T,B>(info->value_pointer, ReadDim(0));
+	}
+	// arrays of arrays need all of them, which the reader caches for each entry
+	basic_array<T,B> MakeArray(std::true_type) const {
+		const BranchDims& dims = reader->GetBranchDims(*info);
+		return basic_array<T,B>(info->value_pointer, dims.data(), dims.size());
+	}
+
+	MTreeReader* reader=nullptr;
+	BranchInfo* info=nullptr;
+	// for each dimension, either the branch holding its size (variable size dimension)
+	// or nullptr and the size (constant size dimension)
+	std::vector<std::pair<const BranchInfo*, size_t>> dimensions;
+};
+
+#endif // defined BranchHandle_H
@@ -0,0 +1,83 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef ColumnIterator_H
+#define ColumnIterator_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm> // std::min
+
+#include "MTreeReader.h"
+
+/*
+A ColumnIterator reads one branch of an MTreeReader in chunks of contiguous values,
+using MTreeReader::ReadColumn. This allows scanning a whole branch with bounded memory.
+Like ReadColumn, it is intended for use outside the entry loop.
+
+Usage:
+	ColumnIterator<float> dts(myTreeReader, "dt");
+	while(dts.Next()){
+		for(float adt : dts.GetValues()) ...;
+	}
+
+	// for arrays, the values of chunk entry i are GetValues()[GetOffsets()[i]] to GetValues()[GetOffsets()[i+1]-1]
+	ColumnIterator<float> spadts(myTreeReader, "spadt");
+	while(spadts.Next()){
+		for(size_t entry_i=0; entry_i<spadts.GetNumEntries(); ++entry_i){
+			long entry_number = spadts.GetFirstEntry()+entry_i;
+			...
+		}
+	}
+*/
+
+template<typename T>
+class ColumnIterator {
+	public:
+	ColumnIterator(MTreeReader* readerin, std::string branchnamein, long chunk_sizein=100000,
+	               long first_entryin=0, long num_entriesin=-1) :
+	               reader(readerin), branchname(branchnamein), chunk_size(chunk_sizein){
+		next_entry = first_entryin;
+		last_entry = (num_entriesin<0) ? reader->GetEntries() : first_entryin+num_entriesin;
+		is_array = (reader->GetBranchType(branchname).find('[')!=std::string::npos);
+	}
+
+	// read the next chunk. Returns false when there are no more entries, or on error.
+	bool Next(){
+		if(next_entry>=last_entry) return false;
+		chunk_first = next_entry;
+		chunk_entries = std::min(chunk_size, last_entry-next_entry);
+		int get_ok;
+		if(is_array){
+			get_ok = reader->ReadColumn(branchname, chunk_first, chunk_entries, values, offsets);
+		} else {
+			get_ok = reader->ReadColumn(branchname, chunk_first, chunk_entries, values);
+		}
+		if(not get_ok){
+			std::cerr<<"ColumnIterator failed to read branch "<<branchname<<" entries "
+					 <<chunk_first<<" to "<<(chunk_first+chunk_entries)<<std::endl;
+			next_entry = last_entry;
+			return false;
+		}
+		next_entry += chunk_entries;
+		return true;
+	}
+
+	const std::vector<T>& GetValues() const { return values; }
+	const std::vector<size_t>& GetOffsets() const { return offsets; }  // arrays only
+	long GetFirstEntry() const { return chunk_first; }                 // entry number of the first value
+	long GetNumEntries() const { return chunk_entries; }                // entries in this chunk
+
+	private:
+	MTreeReader* reader=nullptr;
+	std::string branchname;
+	long chunk_size;
+	long next_entry=0;
+	long last_entry=0;
+	long chunk_first=0;
+	long chunk_entries=0;
+	bool is_array=false;
+	std::vector<T> values;
+	std::vector<size_t> offsets;
+};
+
+#endif // defined ColumnIterator_H
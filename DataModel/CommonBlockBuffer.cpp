@@ -0,0 +1,168 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "CommonBlockBuffer.h"
+
+#include <iostream>
+#include <algorithm> // std::sort, std::min, std::max
+#include <cstring>   // std::memcpy
+
+int CommonBlockBuffer::AddBlock(std::string name, void* block, size_t size){
+	if(num_slots>0){
+		std::cerr<<"CommonBlockBuffer::AddBlock called for "<<name<<" after Allocate"<<std::endl;
+		return 0;
+	}
+	if(block==nullptr || size==0){
+		std::cerr<<"CommonBlockBuffer::AddBlock called with no block for "<<name<<std::endl;
+		return 0;
+	}
+	CommonBlock ablock;
+	ablock.name = name;
+	ablock.live = static_cast<char*>(block);
+	ablock.size = size;
+	blocks.push_back(ablock);
+	return 1;
+}
+
+int CommonBlockBuffer::AddHitArray(std::string blockname, size_t offset, size_t element_size,
+                                   size_t capacity, const int* num_hits){
+	if(num_slots>0){
+		std::cerr<<"CommonBlockBuffer::AddHitArray called for "<<blockname<<" after Allocate"<<std::endl;
+		return 0;
+	}
+	auto it = std::find_if(blocks.begin(), blocks.end(),
+	                       [&blockname](const CommonBlock& ablock){ return ablock.name==blockname; });
+	if(it==blocks.end()){
+		// not an error: the block may not have been chosen for buffering
+		return 0;
+	}
+	if(num_hits==nullptr || (offset+element_size*capacity)>it->size){
+		std::cerr<<"CommonBlockBuffer::AddHitArray: invalid array at offset "<<offset
+				 <<" of block "<<blockname<<std::endl;
+		return 0;
+	}
+	for(auto&& another : it->hit_arrays){
+		if(offset<(another.offset+another.element_size*another.capacity)
+		   && another.offset<(offset+element_size*capacity)){
+			std::cerr<<"CommonBlockBuffer::AddHitArray: array at offset "<<offset<<" of block "<<blockname
+					 <<" overlaps another"<<std::endl;
+			return 0;
+		}
+	}
+	CommonBlockHitArray anarray;
+	anarray.offset = offset;
+	anarray.element_size = element_size;
+	anarray.capacity = capacity;
+	anarray.num_hits = num_hits;
+	it->hit_arrays.push_back(anarray);
+	std::sort(it->hit_arrays.begin(), it->hit_arrays.end(),
+	          [](const CommonBlockHitArray& a, const CommonBlockHitArray& b){ return a.offset<b.offset; });
+	return 1;
+}
+
+int CommonBlockBuffer::Allocate(size_t capacity){
+	if(capacity==0){
+		std::cerr<<"CommonBlockBuffer::Allocate called with capacity 0"<<std::endl;
+		return 0;
+	}
+	num_slots = capacity;
+	size_t num_arrays = 0;
+	for(auto&& ablock : blocks){
+		ablock.slots.assign(num_slots*ablock.size, 0);
+		ablock.slot_hits.assign(num_slots*ablock.hit_arrays.size(), 0);
+		ablock.scratch.assign(ablock.size, 0);
+		num_arrays += ablock.hit_arrays.size();
+	}
+	live_hits.resize(num_arrays);
+	Flush();
+	return 1;
+}
+
+size_t CommonBlockBuffer::NumHits(const CommonBlockHitArray& anarray) const {
+	// guard against garbage in the count
+	int num_hits = *anarray.num_hits;
+	return std::min(size_t(std::max(num_hits,0)), anarray.capacity);
+}
+
+void CommonBlockBuffer::CopyBlock(const CommonBlock& ablock, char* dest, const char* source, const int* num_hits){
+	// everything outside the hit arrays is copied whole, the hit arrays only up to their number of hits
+	size_t pos=0;
+	for(size_t array_i=0; array_i<ablock.hit_arrays.size(); ++array_i){
+		const CommonBlockHitArray& anarray = ablock.hit_arrays[array_i];
+		std::memcpy(dest+pos, source+pos, anarray.offset-pos);
+		std::memcpy(dest+anarray.offset, source+anarray.offset, num_hits[array_i]*anarray.element_size);
+		pos = anarray.offset+anarray.capacity*anarray.element_size;
+	}
+	std::memcpy(dest+pos, source+pos, ablock.size-pos);
+}
+
+int CommonBlockBuffer::Push(){
+	if(num_used==num_slots){
+		std::cerr<<"CommonBlockBuffer::Push: buffer is full ("<<num_slots<<" entries)"<<std::endl;
+		return 0;
+	}
+	size_t slot = (head+num_used)%num_slots;
+	for(auto&& ablock : blocks){
+		int* slot_hits = ablock.slot_hits.data()+slot*ablock.hit_arrays.size();
+		for(size_t array_i=0; array_i<ablock.hit_arrays.size(); ++array_i){
+			slot_hits[array_i] = NumHits(ablock.hit_arrays[array_i]);
+		}
+		CopyBlock(ablock, ablock.slots.data()+slot*ablock.size, ablock.live, slot_hits);
+	}
+	++num_used;
+	return 1;
+}
+
+int CommonBlockBuffer::Pop(bool oldest){
+	if(num_used==0){
+		std::cerr<<"CommonBlockBuffer::Pop called on an empty buffer"<<std::endl;
+		return 0;
+	}
+	if(oldest) head = (head+1)%num_slots;
+	--num_used;
+	return 1;
+}
+
+void CommonBlockBuffer::Flush(){
+	head = 0;
+	num_used = 0;
+}
+
+int CommonBlockBuffer::Load(size_t buffer_i){
+	if(buffer_i>=num_used){
+		std::cerr<<"CommonBlockBuffer::Load: no buffered entry "<<buffer_i<<", only "<<num_used<<std::endl;
+		return 0;
+	}
+	size_t slot = (head+buffer_i)%num_slots;
+
+	// the numbers of hits may be in other blocks, so get them all before swapping anything
+	size_t hits_i=0;
+	for(auto&& ablock : blocks){
+		for(auto&& anarray : ablock.hit_arrays) live_hits[hits_i++] = NumHits(anarray);
+	}
+
+	hits_i=0;
+	for(auto&& ablock : blocks){
+		char* slot_data = ablock.slots.data()+slot*ablock.size;
+		int* slot_hits = ablock.slot_hits.data()+slot*ablock.hit_arrays.size();
+		const int* block_live_hits = live_hits.data()+hits_i;
+		CopyBlock(ablock, ablock.scratch.data(), ablock.live, block_live_hits);
+		CopyBlock(ablock, ablock.live, slot_data, slot_hits);
+		CopyBlock(ablock, slot_data, ablock.scratch.data(), block_live_hits);
+		std::copy(block_live_hits, block_live_hits+ablock.hit_arrays.size(), slot_hits);
+		hits_i += ablock.hit_arrays.size();
+	}
+	return 1;
+}
+
+size_t CommonBlockBuffer::size() const {
+	return num_used;
+}
+
+size_t CommonBlockBuffer::capacity() const {
+	return num_slots;
+}
+
+std::vector<std::string> CommonBlockBuffer::GetBlockNames() const {
+	std::vector<std::string> names;
+	for(auto&& ablock : blocks) names.push_back(ablock.name);
+	return names;
+}
@@ -0,0 +1,78 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef CommonBlockBuffer_H
+#define CommonBlockBuffer_H
+
+#include <string>
+#include <vector>
+#include <cstddef> // size_t
+
+/*
+A CommonBlockBuffer keeps copies of a set of blocks of memory, such as the Fortran common blocks
+populated by skread, so that several events can be held at once (e.g. an SHE trigger and its AFT).
+Storage for a fixed number of copies is allocated once, and copies are kept in a ring.
+Arrays within a block that are only filled up to a number of hits can be registered, in which case
+only the filled elements are copied. The rest of each block is always copied whole.
+
+Usage:
+	CommonBlockBuffer buffer;
+	buffer.AddBlock("sktqz", &sktqz_, sizeof(sktqz_));
+	buffer.AddHitArray("sktqz", offsetof(sktqz_common, tiskz), sizeof(sktqz_.tiskz[0]),
+	                   sizeof(sktqz_.tiskz)/sizeof(sktqz_.tiskz[0]), &sktqz_.nqiskz);
+	buffer.Allocate(2);
+	buffer.Push();   // save the current event
+	...              // read the next event
+	buffer.Load(0);  // swap the saved event back in, and the next one into the buffer
+*/
+
+struct CommonBlockHitArray {
+	size_t offset=0;               // of the array within its block
+	size_t element_size=0;
+	size_t capacity=0;             // in elements
+	const int* num_hits=nullptr;   // the number of filled elements, in the live blocks
+};
+
+struct CommonBlock {
+	std::string name;
+	char* live=nullptr;                          // the block in use, e.g. the common block itself
+	size_t size=0;
+	std::vector<CommonBlockHitArray> hit_arrays; // in order of offset
+	std::vector<char> slots;                     // 'capacity' copies of the block
+	std::vector<int> slot_hits;                  // filled elements of each hit array in each slot
+	std::vector<char> scratch;                   // for swapping with a slot
+};
+
+class CommonBlockBuffer {
+	public:
+	CommonBlockBuffer(){};
+
+	// setup: register blocks and their hit arrays, then allocate the buffer
+	int AddBlock(std::string name, void* block, size_t size);
+	int AddHitArray(std::string blockname, size_t offset, size_t element_size, size_t capacity,
+	                const int* num_hits);
+	int Allocate(size_t capacity);
+
+	// copy the live blocks to the back of the buffer
+	int Push();
+	// drop the newest (or oldest) buffered entry
+	int Pop(bool oldest=false);
+	void Flush();
+	// swap the live blocks with buffered entry buffer_i, counting from the oldest
+	int Load(size_t buffer_i);
+
+	size_t size() const;
+	size_t capacity() const;
+	std::vector<std::string> GetBlockNames() const;
+
+	private:
+	// copy a block between the live memory and a slot, given the filled elements of each hit array
+	void CopyBlock(const CommonBlock& ablock, char* dest, const char* source, const int* num_hits);
+	size_t NumHits(const CommonBlockHitArray& anarray) const;
+
+	std::vector<CommonBlock> blocks;
+	size_t num_slots=0;
+	size_t head=0;       // slot of the oldest buffered entry
+	size_t num_used=0;   // number of buffered entries
+	std::vector<int> live_hits;
+};
+
+#endif // defined CommonBlockBuffer_H
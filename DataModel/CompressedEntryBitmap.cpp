@@ -0,0 +1,395 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "CompressedEntryBitmap.h"
+
+#include <iostream>
+#include <algorithm> // std::lower_bound, std::upper_bound, std::set_intersection, std::set_union, std::set_difference
+#include <iterator>  // std::back_inserter
+#include <utility>   // std::move
+#include <functional> // std::greater_equal
+
+#include "TTree.h"
+
+void CompressedEntryBitmap::Clear(){
+	chunks.clear();
+	ranks.clear();
+	ranks_valid=false;
+}
+
+size_t CompressedEntryBitmap::FindChunk(uint32_t key) const {
+	// entries are usually added and looked up in order, so check the last chunk first
+	if(chunks.empty() || chunks.back().key<key) return chunks.size();
+	if(chunks.back().key==key) return chunks.size()-1;
+	size_t first=0;
+	size_t last=chunks.size();
+	while(first<last){
+		size_t mid = first+(last-first)/2;
+		if(chunks[mid].key<key) first = mid+1;
+		else last = mid;
+	}
+	return first;
+}
+
+void CompressedEntryBitmap::Set(long entry){
+	if(entry<0) return;
+	uint32_t key = uint32_t(entry>>16);
+	uint16_t offset = uint16_t(entry & 0xFFFF);
+	size_t chunk_i = FindChunk(key);
+	if(chunk_i==chunks.size() || chunks[chunk_i].key!=key){
+		Chunk newchunk;
+		newchunk.key = key;
+		chunks.insert(chunks.begin()+chunk_i, newchunk);
+	}
+	Chunk& achunk = chunks[chunk_i];
+	if(achunk.IsBitmap()){
+		uint64_t bit = uint64_t(1)<<(offset%64);
+		if(achunk.words[offset/64] & bit) return;
+		achunk.words[offset/64] |= bit;
+	} else if(achunk.values.empty() || achunk.values.back()<offset){
+		achunk.values.push_back(offset);
+	} else {
+		auto it = std::lower_bound(achunk.values.begin(), achunk.values.end(), offset);
+		if(*it==offset) return;
+		achunk.values.insert(it, offset);
+	}
+	++achunk.count;
+	if(achunk.count>max_array_size && not achunk.IsBitmap()) ToBitmap(achunk);
+	ranks_valid=false;
+}
+
+bool CompressedEntryBitmap::ChunkTest(const Chunk& achunk, uint16_t offset){
+	if(achunk.IsBitmap()) return (achunk.words[offset/64]>>(offset%64)) & 1;
+	return std::binary_search(achunk.values.begin(), achunk.values.end(), offset);
+}
+
+bool CompressedEntryBitmap::Test(long entry) const {
+	if(entry<0) return false;
+	size_t chunk_i = FindChunk(uint32_t(entry>>16));
+	if(chunk_i==chunks.size() || chunks[chunk_i].key!=uint32_t(entry>>16)) return false;
+	return ChunkTest(chunks[chunk_i], uint16_t(entry & 0xFFFF));
+}
+
+long CompressedEntryBitmap::NextInChunk(const Chunk& achunk, uint32_t offset){
+	if(offset>0xFFFF) return -1;
+	if(not achunk.IsBitmap()){
+		auto it = std::lower_bound(achunk.values.begin(), achunk.values.end(), uint16_t(offset));
+		return (it==achunk.values.end()) ? -1 : long(*it);
+	}
+	// mask off the bits before the requested offset in its word, then find the first set bit
+	size_t word_i = offset/64;
+	uint64_t word = achunk.words[word_i] & (~uint64_t(0)<<(offset%64));
+	while(word==0){
+		if(++word_i==num_words) return -1;
+		word = achunk.words[word_i];
+	}
+	return long(word_i)*64 + __builtin_ctzll(word);
+}
+
+long CompressedEntryBitmap::Next(long entry) const {
+	if(entry<0) entry = 0;
+	uint32_t key = uint32_t(entry>>16);
+	for(size_t chunk_i=FindChunk(key); chunk_i<chunks.size(); ++chunk_i){
+		const Chunk& achunk = chunks[chunk_i];
+		// within the chunk of the requested entry start from its offset, in later chunks from the start
+		uint32_t offset = (achunk.key==key) ? uint32_t(entry & 0xFFFF) : 0;
+		long next_offset = NextInChunk(achunk, offset);
+		if(next_offset>=0) return (long(achunk.key)<<16) + next_offset;
+	}
+	return -1;
+}
+
+long CompressedEntryBitmap::Count() const {
+	long count=0;
+	for(auto&& achunk : chunks) count += achunk.count;
+	return count;
+}
+
+bool CompressedEntryBitmap::empty() const {
+	return chunks.empty();
+}
+
+void CompressedEntryBitmap::BuildRanks() const {
+	ranks.resize(chunks.size());
+	long count=0;
+	for(size_t chunk_i=0; chunk_i<chunks.size(); ++chunk_i){
+		ranks[chunk_i] = count;
+		count += chunks[chunk_i].count;
+	}
+	ranks_valid=true;
+}
+
+long CompressedEntryBitmap::Rank(long entry) const {
+	if(entry<=0) return 0;
+	if(not ranks_valid) BuildRanks();
+	uint32_t key = uint32_t(entry>>16);
+	size_t chunk_i = FindChunk(key);
+	if(chunk_i==chunks.size()) return Count();
+	if(chunks[chunk_i].key!=key) return ranks[chunk_i];
+	const Chunk& achunk = chunks[chunk_i];
+	uint16_t offset = uint16_t(entry & 0xFFFF);
+	long rank = ranks[chunk_i];
+	if(not achunk.IsBitmap()){
+		rank += std::lower_bound(achunk.values.begin(), achunk.values.end(), offset)-achunk.values.begin();
+	} else {
+		for(size_t word_i=0; word_i<offset/64u; ++word_i) rank += __builtin_popcountll(achunk.words[word_i]);
+		if(offset%64) rank += __builtin_popcountll(achunk.words[offset/64] & (~uint64_t(0)>>(64-offset%64)));
+	}
+	return rank;
+}
+
+long CompressedEntryBitmap::Select(long rank) const {
+	if(rank<0 || chunks.empty()) return -1;
+	if(not ranks_valid) BuildRanks();
+	// the chunk holding it is the last with fewer entries before it
+	size_t chunk_i = (std::upper_bound(ranks.begin(), ranks.end(), rank)-ranks.begin())-1;
+	const Chunk& achunk = chunks[chunk_i];
+	long base = long(achunk.key)<<16;
+	long rank_in_chunk = rank-ranks[chunk_i];
+	if(rank_in_chunk>=long(achunk.count)) return -1;
+	if(not achunk.IsBitmap()) return base + achunk.values[rank_in_chunk];
+	for(size_t word_i=0; word_i<num_words; ++word_i){
+		uint64_t word = achunk.words[word_i];
+		long word_count = __builtin_popcountll(word);
+		if(rank_in_chunk<word_count){
+			// clear the lower set bits until the one we want is the lowest
+			for(; rank_in_chunk>0; --rank_in_chunk) word &= word-1;
+			return base + long(word_i)*64 + __builtin_ctzll(word);
+		}
+		rank_in_chunk -= word_count;
+	}
+	return -1;
+}
+
+void CompressedEntryBitmap::ToBitmap(Chunk& achunk){
+	if(achunk.IsBitmap()) return;
+	achunk.words.assign(num_words, 0);
+	for(uint16_t offset : achunk.values) achunk.words[offset/64] |= uint64_t(1)<<(offset%64);
+	std::vector<uint16_t>().swap(achunk.values);
+}
+
+void CompressedEntryBitmap::Normalize(Chunk& achunk){
+	if(not achunk.IsBitmap()){
+		achunk.count = achunk.values.size();
+		if(achunk.count>max_array_size) ToBitmap(achunk);
+		return;
+	}
+	achunk.count=0;
+	for(auto&& word : achunk.words) achunk.count += __builtin_popcountll(word);
+	if(achunk.count>max_array_size) return;
+	// few enough entries to go back to an array
+	achunk.values.clear();
+	achunk.values.reserve(achunk.count);
+	for(size_t word_i=0; word_i<num_words; ++word_i){
+		for(uint64_t word=achunk.words[word_i]; word!=0; word &= (word-1)){
+			achunk.values.push_back(uint16_t(word_i*64 + __builtin_ctzll(word)));
+		}
+	}
+	std::vector<uint64_t>().swap(achunk.words);
+}
+
+CompressedEntryBitmap::Chunk CompressedEntryBitmap::ChunkAnd(const Chunk& a, const Chunk& b){
+	Chunk result;
+	result.key = a.key;
+	if(a.IsBitmap() && b.IsBitmap()){
+		result.words.resize(num_words);
+		for(size_t word_i=0; word_i<num_words; ++word_i) result.words[word_i] = a.words[word_i] & b.words[word_i];
+	} else if(a.IsBitmap() || b.IsBitmap()){
+		// keep the values of the array that are in the bitmap
+		const Chunk& array = (a.IsBitmap()) ? b : a;
+		const Chunk& bitmap = (a.IsBitmap()) ? a : b;
+		for(uint16_t offset : array.values){
+			if(ChunkTest(bitmap, offset)) result.values.push_back(offset);
+		}
+	} else {
+		std::set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+		                      std::back_inserter(result.values));
+	}
+	Normalize(result);
+	return result;
+}
+
+CompressedEntryBitmap::Chunk CompressedEntryBitmap::ChunkOr(const Chunk& a, const Chunk& b){
+	Chunk result;
+	result.key = a.key;
+	if(a.IsBitmap() || b.IsBitmap()){
+		result = (a.IsBitmap()) ? a : b;
+		const Chunk& other = (a.IsBitmap()) ? b : a;
+		if(other.IsBitmap()){
+			for(size_t word_i=0; word_i<num_words; ++word_i) result.words[word_i] |= other.words[word_i];
+		} else {
+			for(uint16_t offset : other.values) result.words[offset/64] |= uint64_t(1)<<(offset%64);
+		}
+	} else {
+		result.values.reserve(a.values.size()+b.values.size());
+		std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+		               std::back_inserter(result.values));
+	}
+	Normalize(result);
+	return result;
+}
+
+CompressedEntryBitmap::Chunk CompressedEntryBitmap::ChunkAndNot(const Chunk& a, const Chunk& b){
+	Chunk result;
+	result.key = a.key;
+	if(a.IsBitmap()){
+		result = a;
+		if(b.IsBitmap()){
+			for(size_t word_i=0; word_i<num_words; ++word_i) result.words[word_i] &= ~b.words[word_i];
+		} else {
+			for(uint16_t offset : b.values) result.words[offset/64] &= ~(uint64_t(1)<<(offset%64));
+		}
+	} else if(b.IsBitmap()){
+		for(uint16_t offset : a.values){
+			if(not ChunkTest(b, offset)) result.values.push_back(offset);
+		}
+	} else {
+		std::set_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+		                    std::back_inserter(result.values));
+	}
+	Normalize(result);
+	return result;
+}
+
+CompressedEntryBitmap CompressedEntryBitmap::And(const CompressedEntryBitmap& other) const {
+	CompressedEntryBitmap result;
+	size_t this_i=0, other_i=0;
+	while(this_i<chunks.size() && other_i<other.chunks.size()){
+		const Chunk& a = chunks[this_i];
+		const Chunk& b = other.chunks[other_i];
+		if(a.key<b.key){
+			++this_i;
+		} else if(b.key<a.key){
+			++other_i;
+		} else {
+			Chunk combined = ChunkAnd(a, b);
+			if(combined.count>0) result.chunks.push_back(std::move(combined));
+			++this_i;
+			++other_i;
+		}
+	}
+	return result;
+}
+
+CompressedEntryBitmap CompressedEntryBitmap::Or(const CompressedEntryBitmap& other) const {
+	CompressedEntryBitmap result;
+	result.chunks.reserve(std::max(chunks.size(), other.chunks.size()));
+	size_t this_i=0, other_i=0;
+	while(this_i<chunks.size() || other_i<other.chunks.size()){
+		if(other_i==other.chunks.size() || (this_i<chunks.size() && chunks[this_i].key<other.chunks[other_i].key)){
+			result.chunks.push_back(chunks[this_i++]);
+		} else if(this_i==chunks.size() || other.chunks[other_i].key<chunks[this_i].key){
+			result.chunks.push_back(other.chunks[other_i++]);
+		} else {
+			result.chunks.push_back(ChunkOr(chunks[this_i++], other.chunks[other_i++]));
+		}
+	}
+	return result;
+}
+
+CompressedEntryBitmap CompressedEntryBitmap::AndNot(const CompressedEntryBitmap& other) const {
+	CompressedEntryBitmap result;
+	size_t other_i=0;
+	for(auto&& achunk : chunks){
+		while(other_i<other.chunks.size() && other.chunks[other_i].key<achunk.key) ++other_i;
+		if(other_i==other.chunks.size() || other.chunks[other_i].key!=achunk.key){
+			result.chunks.push_back(achunk);
+			continue;
+		}
+		Chunk combined = ChunkAndNot(achunk, other.chunks[other_i]);
+		if(combined.count>0) result.chunks.push_back(std::move(combined));
+	}
+	return result;
+}
+
+bool CompressedEntryBitmap::operator==(const CompressedEntryBitmap& other) const {
+	// chunks are always normalized, so equal sets have identical chunks
+	if(chunks.size()!=other.chunks.size()) return false;
+	for(size_t chunk_i=0; chunk_i<chunks.size(); ++chunk_i){
+		const Chunk& a = chunks[chunk_i];
+		const Chunk& b = other.chunks[chunk_i];
+		if(a.key!=b.key || a.count!=b.count || a.values!=b.values || a.words!=b.words) return false;
+	}
+	return true;
+}
+
+size_t CompressedEntryBitmap::GetMemoryUsage() const {
+	size_t bytes = chunks.capacity()*sizeof(Chunk);
+	for(auto&& achunk : chunks){
+		bytes += achunk.values.capacity()*sizeof(uint16_t) + achunk.words.capacity()*sizeof(uint64_t);
+	}
+	return bytes;
+}
+
+int CompressedEntryBitmap::Write(const std::string& treename) const {
+	// one TTree entry per chunk, with either its array of offsets or its bitmap words
+	TTree* outtree = new TTree(treename.c_str(), "compressed entry bitmap");
+	UInt_t key=0, num_values=0, num_chunk_words=0;
+	std::vector<UShort_t> values(max_array_size);
+	std::vector<ULong64_t> words(num_words);
+	outtree->Branch("Key",&key,"Key/i");
+	outtree->Branch("NumValues",&num_values,"NumValues/i");
+	outtree->Branch("Values",values.data(),"Values[NumValues]/s");
+	outtree->Branch("NumWords",&num_chunk_words,"NumWords/i");
+	outtree->Branch("Words",words.data(),"Words[NumWords]/l");
+	for(auto&& achunk : chunks){
+		key = achunk.key;
+		num_values = achunk.values.size();
+		num_chunk_words = achunk.words.size();
+		std::copy(achunk.values.begin(), achunk.values.end(), values.begin());
+		std::copy(achunk.words.begin(), achunk.words.end(), words.begin());
+		outtree->Fill();
+	}
+	int nbytes = outtree->Write("",TObject::kOverwrite);
+	delete outtree;
+	if(nbytes<=0){
+		std::cerr<<"CompressedEntryBitmap::Write failed to write "<<treename<<std::endl;
+		return 0;
+	}
+	return 1;
+}
+
+int CompressedEntryBitmap::Read(TTree* intree){
+	Clear();
+	if(intree==nullptr) return 0;
+	UInt_t key=0, num_values=0, num_chunk_words=0;
+	std::vector<UShort_t> values(max_array_size);
+	std::vector<ULong64_t> words(num_words);
+	if(intree->SetBranchAddress("Key",&key)<0 || intree->SetBranchAddress("NumValues",&num_values)<0
+	   || intree->SetBranchAddress("Values",values.data())<0 || intree->SetBranchAddress("NumWords",&num_chunk_words)<0
+	   || intree->SetBranchAddress("Words",words.data())<0){
+		std::cerr<<"CompressedEntryBitmap::Read: "<<intree->GetName()<<" is not a CompressedEntryBitmap"<<std::endl;
+		intree->ResetBranchAddresses();
+		return 0;
+	}
+	bool ok=true;
+	for(Long64_t entry=0; entry<intree->GetEntries() && ok; ++entry){
+		if(intree->GetEntry(entry)<=0) ok=false;
+		// chunks are written in order, each either an array or a bitmap
+		if(ok && ((not chunks.empty() && key<=chunks.back().key) || num_values>max_array_size
+		   || (num_chunk_words!=0 && num_chunk_words!=num_words) || (num_values==0)==(num_chunk_words==0))){
+			ok=false;
+		}
+		if(not ok) break;
+		Chunk achunk;
+		achunk.key = key;
+		achunk.values.assign(values.begin(), values.begin()+num_values);
+		if(std::adjacent_find(achunk.values.begin(), achunk.values.end(), std::greater_equal<uint16_t>())
+		   !=achunk.values.end()){
+			ok=false;
+			break;
+		}
+		achunk.words.assign(words.begin(), words.begin()+num_chunk_words);
+		Normalize(achunk);
+		if(achunk.count==0){
+			ok=false;
+			break;
+		}
+		chunks.push_back(std::move(achunk));
+	}
+	intree->ResetBranchAddresses();
+	if(not ok){
+		std::cerr<<"CompressedEntryBitmap::Read: invalid chunk in "<<intree->GetName()<<std::endl;
+		Clear();
+		return 0;
+	}
+	return 1;
+}
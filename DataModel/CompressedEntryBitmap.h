@@ -0,0 +1,86 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef CompressedEntryBitmap_H
+#define CompressedEntryBitmap_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class TTree;
+
+/*
+A CompressedEntryBitmap is a set of TTree entry numbers, such as the entries passing an MTreeCut,
+for chains too long for a plain EntryBitmap. Entries are split into chunks of 65536, and each chunk
+with any entries set is stored either as a sorted array of 16-bit offsets, while it has at most 4096
+entries, or as a 65536-bit bitmap when it has more (as 'roaring' bitmaps). Sparse selections then
+take 2 bytes per entry and dense ones 1 bit, and combining selections runs over whole chunks:
+array chunks are merged, and bitmap chunks combined 64 bits at a time.
+Entries must be set in increasing order for the fastest filling, but any order works.
+
+Usage:
+	CompressedEntryBitmap passing;
+	passing.Set(entry);
+	CompressedEntryBitmap x_not_y = x_entries.AndNot(y_entries);
+	for(long entry=x_not_y.Next(0); entry>=0; entry=x_not_y.Next(entry+1)){ ... }
+	passing.Write("CutBitmap_mycut");   // as a TTree in the current ROOT directory
+*/
+
+class CompressedEntryBitmap {
+	public:
+	CompressedEntryBitmap(){};
+
+	void Clear();
+	void Set(long entry);
+	bool Test(long entry) const;
+	// the first set entry at or after the given one, or -1 if there are none
+	long Next(long entry) const;
+	long Count() const;
+	bool empty() const;
+	// the number of set entries before the given one, i.e. its position in a list of the set entries
+	long Rank(long entry) const;
+	// the set entry at a given position in the list of set entries, or -1 if there are fewer
+	long Select(long rank) const;
+
+	// combinations, returning the entries set in both, either, or this but not the other
+	CompressedEntryBitmap And(const CompressedEntryBitmap& other) const;
+	CompressedEntryBitmap Or(const CompressedEntryBitmap& other) const;
+	CompressedEntryBitmap AndNot(const CompressedEntryBitmap& other) const;
+	bool operator==(const CompressedEntryBitmap& other) const;
+
+	// persistence as a TTree with one entry per chunk, written to the current ROOT directory
+	int Write(const std::string& treename) const;
+	int Read(TTree* intree);
+
+	// memory used by the chunks, in bytes
+	size_t GetMemoryUsage() const;
+
+	private:
+	struct Chunk {
+		uint32_t key=0;                 // entry>>16
+		uint32_t count=0;               // number of set entries
+		std::vector<uint16_t> values;   // sorted offsets (entry&0xFFFF), for array chunks
+		std::vector<uint64_t> words;    // bits of each offset, for bitmap chunks
+		bool IsBitmap() const { return not words.empty(); }
+	};
+	static const uint32_t max_array_size = 4096;
+	static const uint32_t num_words = 1024;   // 65536 bits
+
+	// the chunk of a given key, or the position at which it would be inserted
+	size_t FindChunk(uint32_t key) const;
+	// the first set offset at or after the given offset within a chunk, or -1
+	static long NextInChunk(const Chunk& achunk, uint32_t offset);
+	// convert a chunk to the representation suited to its number of entries
+	static void Normalize(Chunk& achunk);
+	static void ToBitmap(Chunk& achunk);
+	static bool ChunkTest(const Chunk& achunk, uint16_t offset);
+	static Chunk ChunkAnd(const Chunk& a, const Chunk& b);
+	static Chunk ChunkOr(const Chunk& a, const Chunk& b);
+	static Chunk ChunkAndNot(const Chunk& a, const Chunk& b);
+	void BuildRanks() const;
+
+	std::vector<Chunk> chunks;          // in order of key, none empty
+	mutable std::vector<long> ranks;    // number of entries set in all preceding chunks
+	mutable bool ranks_valid=false;
+};
+
+#endif // defined CompressedEntryBitmap_H
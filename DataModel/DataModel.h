@@ -18,6 +18,7 @@
 class MTreeReader;
 class MTreeSelection;
 class TreeReader;
+class EventBatch;
 
 #include <zmq.hpp>
 
@@ -51,6 +52,7 @@ class DataModel {
   std::map<std::string,BoostStore*> Stores; ///< This is a map of named BooStore pointers which can be deffined to hold a nammed collection of any tipe of BoostStore. It is usefull to store data that needs subdividing into differnt stores.
   std::map<std::string,MTreeReader*> Trees; ///< A map of MTreeReader pointers, used to read ROOT trees
   std::map<std::string,MTreeSelection*> Selectors; ///< A map of MTreeSelection pointers used to read event selections
+  std::map<std::string,EventBatch*> Batches; ///< A map of EventBatch pointers, holding the events read by a TreeReader in one Execute call
 //  std::map<std::string,TreeReader*> TreeReaders; ///< A map of TreeReader tool pointers, used to invoke LoadSHE/AFT
   std::unordered_map<std::string, std::function<bool()>> hasAFTs;
   std::unordered_map<std::string, std::function<bool()>> loadSHEs;
@@ -0,0 +1,73 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "EntryBitmap.h"
+#include "SidecarFile.h"
+
+static const std::string sidecar_format = "EntryBitmap v1";
+
+EntryBitmap::EntryBitmap(long num_entries_in){
+	Resize(num_entries_in);
+}
+
+void EntryBitmap::Clear(){
+	words.clear();
+	num_entries = 0;
+}
+
+void EntryBitmap::Resize(long num_entries_in){
+	if(num_entries_in<0) num_entries_in = 0;
+	// clear any bits beyond the new end, so they aren't set if it grows again
+	for(long entry=num_entries_in; entry<num_entries && (entry%64)!=0; ++entry) Set(entry, false);
+	num_entries = num_entries_in;
+	words.resize((num_entries+63)/64, 0);
+}
+
+void EntryBitmap::Set(long entry, bool value){
+	if(entry<0 || entry>=num_entries) return;
+	uint64_t bit = uint64_t(1)<<(entry%64);
+	if(value) words[entry/64] |= bit;
+	else words[entry/64] &= ~bit;
+}
+
+bool EntryBitmap::Test(long entry) const {
+	if(entry<0 || entry>=num_entries) return false;
+	return (words[entry/64]>>(entry%64)) & 1;
+}
+
+long EntryBitmap::Next(long entry) const {
+	if(entry<0) entry = 0;
+	if(entry>=num_entries) return -1;
+	// mask off the bits before the requested entry in its word, then find the first set bit
+	size_t word_i = entry/64;
+	uint64_t word = words[word_i] & (~uint64_t(0)<<(entry%64));
+	while(word==0){
+		if(++word_i==words.size()) return -1;
+		word = words[word_i];
+	}
+	return long(word_i)*64 + __builtin_ctzll(word);
+}
+
+long EntryBitmap::Count() const {
+	long count=0;
+	for(auto&& word : words) count += __builtin_popcountll(word);
+	return count;
+}
+
+long EntryBitmap::size() const {
+	return num_entries;
+}
+
+int EntryBitmap::WriteSidecar(const std::string& sidecarname, const std::string& filekey) const {
+	return SidecarFile::Write(sidecarname, sidecar_format, filekey, num_entries, words.data(), words.size()*sizeof(uint64_t));
+}
+
+int EntryBitmap::ReadSidecar(const std::string& sidecarname, const std::string& filekey, long num_entries_in){
+	SidecarFile sidecar;
+	if(not sidecar.Open(sidecarname, sidecar_format, filekey) || sidecar.GetCount()!=num_entries_in) return 0;
+	Clear();
+	Resize(num_entries_in);
+	if(not sidecar.ReadPayload(words.data(), words.size()*sizeof(uint64_t))){
+		Clear();
+		return 0;
+	}
+	return 1;
+}
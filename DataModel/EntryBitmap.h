@@ -0,0 +1,47 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef EntryBitmap_H
+#define EntryBitmap_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+An EntryBitmap flags a subset of the entries of a TTree, one bit per entry, e.g. the physics
+event entries of an SKROOT file (as opposed to pedestal or status entries). Compared to a
+TEntryList it gives O(1) lookup of any entry and a fast scan to the next flagged entry, and it
+can be saved to a sidecar file alongside the tree so that it need only be built once per file.
+
+Usage:
+	EntryBitmap physics_entries(num_entries);
+	physics_entries.Set(entry);
+	physics_entries.WriteSidecar("file.root.tree.physidx", filekey);
+	for(long entry=physics_entries.Next(0); entry>=0; entry=physics_entries.Next(entry+1)){ ... }
+*/
+
+class EntryBitmap {
+	public:
+	EntryBitmap(){};
+	EntryBitmap(long num_entries);
+
+	void Clear();
+	void Resize(long num_entries);  // new entries are not set
+	void Set(long entry, bool value=true);
+	bool Test(long entry) const;
+	// the first set entry at or after the given one, or -1 if there are none
+	long Next(long entry) const;
+	long Count() const;
+	long size() const;
+
+	// persistence. The file key identifies the file contents (see MTreeReader::BuildEventIndex)
+	// so that a stale sidecar is not used. Reading returns 0 without complaint if there's
+	// no usable sidecar: the caller should then build the bitmap.
+	int WriteSidecar(const std::string& sidecarname, const std::string& filekey) const;
+	int ReadSidecar(const std::string& sidecarname, const std::string& filekey, long num_entries);
+
+	private:
+	std::vector<uint64_t> words;
+	long num_entries=0;
+};
+
+#endif // defined EntryBitmap_H
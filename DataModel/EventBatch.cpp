@@ -0,0 +1,53 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "EventBatch.h"
+
+EventBatch::EventBatch(){
+	Clear();
+}
+
+void EventBatch::Clear(){
+	// clearing keeps the capacity of the vectors, so batches after the first don't allocate
+	for(auto vec : {&run, &subrun, &event, &trigger_word, &bs_n50, &cable, &flags}) vec->clear();
+	for(auto vec : {&bs_x, &bs_y, &bs_z, &bs_t, &bs_dir_x, &bs_dir_y, &bs_dir_z, &bs_energy,
+	                &bs_goodness, &t, &q}) vec->clear();
+	hit_offsets.assign(1, 0);
+}
+
+void EventBatch::Reserve(size_t num_events, size_t num_hits){
+	for(auto vec : {&run, &subrun, &event, &trigger_word, &bs_n50}) vec->reserve(num_events);
+	for(auto vec : {&bs_x, &bs_y, &bs_z, &bs_t, &bs_dir_x, &bs_dir_y, &bs_dir_z, &bs_energy,
+	                &bs_goodness}) vec->reserve(num_events);
+	hit_offsets.reserve(num_events+1);
+	t.reserve(num_hits);
+	q.reserve(num_hits);
+	cable.reserve(num_hits);
+	flags.reserve(num_hits);
+}
+
+size_t EventBatch::AddEvent(){
+	for(auto vec : {&run, &subrun, &event, &trigger_word, &bs_n50}) vec->push_back(0);
+	for(auto vec : {&bs_x, &bs_y, &bs_z, &bs_t, &bs_dir_x, &bs_dir_y, &bs_dir_z, &bs_energy,
+	                &bs_goodness}) vec->push_back(0);
+	hit_offsets.push_back(hit_offsets.back());
+	return run.size()-1;
+}
+
+void EventBatch::AddHit(float t_in, float q_in, int cable_in, int flags_in){
+	t.push_back(t_in);
+	q.push_back(q_in);
+	cable.push_back(cable_in);
+	flags.push_back(flags_in);
+	++hit_offsets.back();
+}
+
+size_t EventBatch::size() const {
+	return run.size();
+}
+
+size_t EventBatch::NumHits(size_t event_i) const {
+	return hit_offsets.at(event_i+1)-hit_offsets.at(event_i);
+}
+
+size_t EventBatch::TotalHits() const {
+	return t.size();
+}
@@ -0,0 +1,67 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef EventBatch_H
+#define EventBatch_H
+
+#include <vector>
+#include <cstddef> // size_t
+
+/*
+An EventBatch holds a number of events in structure-of-arrays form, so that tools can process
+a whole batch per Execute call with simple loops over contiguous arrays. The hits of all events
+are concatenated: the hits of event i are hit indices hit_offsets[i] to hit_offsets[i+1]-1.
+Per-event values are indexed by event number within the batch. HitView::FromBatch gives a view
+of the hits of one event.
+TreeReader fills one per Execute call with entriesPerExecute>1, available as
+m_data->Batches.at(readerName).
+
+Usage:
+	EventBatch* batch = m_data->Batches.at("MyReader");
+	for(size_t event_i=0; event_i<batch->size(); ++event_i){
+		float qsum=0;
+		for(size_t hit_i=batch->hit_offsets[event_i]; hit_i<batch->hit_offsets[event_i+1]; ++hit_i){
+			qsum += batch->q[hit_i];
+		}
+	}
+*/
+
+class EventBatch {
+	public:
+	EventBatch();
+
+	void Clear();
+	void Reserve(size_t num_events, size_t num_hits);
+	// start a new event, with zeroed per-event values. Returns its index within the batch.
+	size_t AddEvent();
+	// add a hit to the most recently added event
+	void AddHit(float t_in, float q_in, int cable_in, int flags_in=0);
+	size_t size() const;
+	size_t NumHits(size_t event_i) const;
+	size_t TotalHits() const;
+
+	// per-event header values
+	std::vector<int> run;
+	std::vector<int> subrun;
+	std::vector<int> event;
+	std::vector<int> trigger_word;        // idtgsk
+
+	// per-event low-energy reconstruction values
+	std::vector<float> bs_x;
+	std::vector<float> bs_y;
+	std::vector<float> bs_z;
+	std::vector<float> bs_t;
+	std::vector<float> bs_dir_x;
+	std::vector<float> bs_dir_y;
+	std::vector<float> bs_dir_z;
+	std::vector<float> bs_energy;
+	std::vector<float> bs_goodness;
+	std::vector<int> bs_n50;
+
+	// hits of all events
+	std::vector<float> t;
+	std::vector<float> q;
+	std::vector<int> cable;
+	std::vector<int> flags;             // ihtiflz
+	std::vector<size_t> hit_offsets;      // size()+1 entries, starting with 0
+};
+
+#endif // defined EventBatch_H
@@ -0,0 +1,45 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "HitView.h"
+
+#include <algorithm> // std::min
+#include <stdexcept> // std::out_of_range
+#include <string>
+
+#include "EventBatch.h"
+#include "tqrealroot.h"
+#include "fortran_routines.h"
+
+HitView::HitView(const float* tin, const float* qin, const int* cablesin, const int* flagsin,
+                 size_t num_hitsin, bool packed_flagsin) :
+                 t(tin), q(qin), cables(cablesin), flags(flagsin), num_hits(num_hitsin),
+                 packed_flags(packed_flagsin){
+	if(packed_flags) flags = nullptr;
+}
+
+HitView::Hit HitView::at(size_t hit_i) const {
+	if(hit_i>=num_hits){
+		throw std::out_of_range("HitView::at: hit "+std::to_string(hit_i)+" of "+std::to_string(num_hits));
+	}
+	return (*this)[hit_i];
+}
+
+HitView HitView::FromTQReal(const TQReal* tqreal){
+	if(tqreal==nullptr) return HitView();
+	// the branch may not be fully populated, e.g. in rfm files
+	size_t num_hits = std::min(tqreal->cables.size(), std::min(tqreal->T.size(), tqreal->Q.size()));
+	return HitView(tqreal->T.data(), tqreal->Q.data(), tqreal->cables.data(), nullptr, num_hits, true);
+}
+
+HitView HitView::FromCommons(){
+	// sktqz_ lists all hits of the event, including those outside the trigger gate.
+	// (skq_ and skt_ are indexed by cable number, so can't be viewed as a list of hits)
+	int max_hits = sizeof(sktqz_.tiskz)/sizeof(sktqz_.tiskz[0]);
+	size_t num_hits = std::min(std::max(sktqz_.nqiskz, 0), max_hits);
+	return HitView(sktqz_.tiskz, sktqz_.qiskz, sktqz_.icabiz, sktqz_.ihtiflz, num_hits);
+}
+
+HitView HitView::FromBatch(const EventBatch& batch, size_t event_i){
+	size_t first_hit = batch.hit_offsets.at(event_i);
+	return HitView(batch.t.data()+first_hit, batch.q.data()+first_hit, batch.cable.data()+first_hit,
+	               batch.flags.data()+first_hit, batch.NumHits(event_i));
+}
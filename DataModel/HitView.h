@@ -0,0 +1,102 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef HitView_H
+#define HitView_H
+
+#include <cstddef>   // size_t
+#include <iterator>  // std::forward_iterator_tag
+
+class TQReal;
+class EventBatch;
+
+/*
+A HitView gives access to the hits of one event (time, charge, cable and hit flags) without copying
+them, wherever they are: the TQREAL branch of an SKROOT file, the sktqz_ common block filled by skread,
+or an event of a TreeReader EventBatch. It only holds pointers to the existing arrays, so it's
+invalidated when they change, e.g. when the next entry is read.
+In TQREAL the hit flags are packed into the upper 16 bits of the cable numbers; Cable and Flags
+separate them, so the interface is the same for every source.
+
+Usage:
+	HitView hits = HitView::FromCommons();   // or FromTQReal(myTQReal), FromBatch(*batch, event_i)
+	for(const HitView::Hit& ahit : hits){
+		if(ahit.flags & 0x1) qsum += ahit.q;   // in-gate hits
+	}
+	// or by index
+	for(size_t hit_i=0; hit_i<hits.size(); ++hit_i) tsum += hits.T(hit_i);
+*/
+
+class HitView {
+	public:
+	struct Hit {
+		float t;
+		float q;
+		int cable;
+		int flags;
+	};
+
+	class const_iterator {
+		public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef Hit value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const Hit* pointer;
+		typedef Hit reference;   // hits are assembled on access
+
+		const_iterator(const HitView* viewin, size_t hit_iin) : view(viewin), hit_i(hit_iin){};
+		Hit operator*() const { return (*view)[hit_i]; }
+		const_iterator& operator++(){ ++hit_i; return *this; }
+		const_iterator operator++(int){ const_iterator before=*this; ++hit_i; return before; }
+		bool operator==(const const_iterator& other) const { return hit_i==other.hit_i && view==other.view; }
+		bool operator!=(const const_iterator& other) const { return not (*this==other); }
+
+		private:
+		const HitView* view;
+		size_t hit_i;
+	};
+
+	HitView(){};
+	// a view of existing arrays. flags may be null if there are none.
+	// With packed_flags, the flags are in the upper 16 bits of the cables, as in TQREAL.
+	HitView(const float* tin, const float* qin, const int* cablesin, const int* flagsin, size_t num_hitsin,
+	        bool packed_flagsin=false);
+
+	// views of the hits of the current event from each source
+	static HitView FromTQReal(const TQReal* tqreal);
+	static HitView FromCommons();
+	static HitView FromBatch(const EventBatch& batch, size_t event_i);
+
+	size_t size() const { return num_hits; }
+	bool empty() const { return num_hits==0; }
+
+	float T(size_t hit_i) const { return t[hit_i]; }
+	float Q(size_t hit_i) const { return q[hit_i]; }
+	int Cable(size_t hit_i) const { return packed_flags ? (cables[hit_i] & 0xFFFF) : cables[hit_i]; }
+	int Flags(size_t hit_i) const {
+		if(packed_flags) return (cables[hit_i] >> 16) & 0xFFFF;
+		return (flags) ? flags[hit_i] : 0;
+	}
+	Hit operator[](size_t hit_i) const { return Hit{T(hit_i), Q(hit_i), Cable(hit_i), Flags(hit_i)}; }
+	// with bounds checking
+	Hit at(size_t hit_i) const;
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, num_hits); }
+
+	// the underlying arrays, e.g. for vectorised loops.
+	// If PackedFlags() the cables include the flags, and FlagsData() is null.
+	const float* TData() const { return t; }
+	const float* QData() const { return q; }
+	const int* CablesData() const { return cables; }
+	const int* FlagsData() const { return flags; }
+	bool PackedFlags() const { return packed_flags; }
+
+	private:
+	const float* t=nullptr;
+	const float* q=nullptr;
+	const int* cables=nullptr;
+	const int* flags=nullptr;
+	size_t num_hits=0;
+	bool packed_flags=false;
+};
+
+#endif // defined HitView_H
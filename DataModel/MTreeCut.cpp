@@ -8,7 +8,8 @@
 #include "TObjectTable.h"
 
 #include <iostream>
-#include <sstream> // std::stringstream
+#include <sstream>   // std::stringstream
+#include <algorithm> // std::lexicographical_compare, std::equal, std::max
 
 ////// debug
 //#include "Algorithms.h"         // for getOutputFromFunctionCall
@@ -18,12 +19,32 @@ MTreeCut::MTreeCut(TFile* outfilein, std::string cutname) : cut_name(cutname), o
 	serialise=true; // can't use uniform initialization for this!!
 }
 
-MTreeCut::MTreeCut(std::string cutname, TEntryList* inelist, TTree* intree){
+MTreeCut::MTreeCut(std::string cutname, TEntryList* inelist, TTree* intree, TTree* bitmaptree){
 	mode="read";
-	SetEntryList(inelist);
+	cut_name=cutname;
+	flat_layout=false;  // unless the file says otherwise: older files only have sets
+	if(inelist==nullptr){
+		// the bitmap is enough to find the passing entries, so the TEntryList needn't be read
+		// If it can't be read, the cut is empty until given a TEntryList by RebuildEntries.
+		if(bitmaptree!=nullptr && not entry_bitmap.Read(bitmaptree)){
+			std::cerr<<"MTreeCut: could not read the bitmap of passing entries of cut "<<cutname<<std::endl;
+			entry_bitmap.Clear();
+			entries_read = false;
+		}
+		total_entries = entry_bitmap.Count();
+	} else {
+		SetEntryList(inelist);
+		if(bitmaptree==nullptr || not entry_bitmap.Read(bitmaptree) || entry_bitmap.Count()!=total_entries){
+			// older files, and merged files, only have the TEntryList
+			BuildEntryBitmap();
+		}
+	}
+	// cuts that nothing passed have no tree of meta info and indices
 	SetTree(intree);
-	GetMetaInfo();
-	SetBranchAddresses();
+	if(additional_indices!=nullptr){
+		GetMetaInfo();
+		SetBranchAddresses();
+	}
 	GetNextEntry(); // load first entry
 }
 
@@ -44,7 +65,13 @@ void MTreeCut::SetBranchAddresses(){
 	if(type>0){
 		additional_indices->SetBranchAddress("TreeEntry",&current_entry);
 	}
-	if(type==1){
+	if(type>0 && flat_layout){
+		// the array branch is read into a buffer that is grown as needed, see ReadIndices
+		flat_indices.resize(16);
+		num_indices_branch = additional_indices->GetBranch("NumIndices");
+		additional_indices->SetBranchAddress("NumIndices",&num_indices);
+		additional_indices->SetBranchAddress("AdditionalIndices",flat_indices.data());
+	} else if(type==1){
 		indexes_this_entry_p = &indexes_this_entry;
 		additional_indices->SetBranchAddress("AdditionalIndices",&indexes_this_entry_p);
 	} else if(type==2){
@@ -99,7 +126,7 @@ void MTreeCut::Initialize(int type_in, std::string indexcutbranch, std::vector<s
 	// the TTree will store the additional indices required to specify array indices within this TTree entry
 	additional_indices = new TTree(cut_name.c_str(),cut_description.c_str());
 	additional_indices->Branch("TreeEntry",&current_entry);
-	additional_indices->Branch("AdditionalIndices",&indexes_this_entry);
+	AddIndexBranches();
 	
 	// store meta info
 	TNamed* thecutname = new TNamed("cut_name", cut_name.c_str());
@@ -149,11 +176,12 @@ void MTreeCut::Initialize(int type_in, std::vector<std::string> indexcutbranches
 	ttree_entries->SetName(TString::Format("TEntryList_%s",cut_name.c_str()));
 	additional_branchnames = indexcutbranches;
 	linked_branch_lists = linkedbranches;
+	index_width = indexcutbranches.size();
 	
 	// TTree to store additional indices
 	additional_indices = new TTree(cut_name.c_str(),cut_description.c_str());
 	additional_indices->Branch("TreeEntry",&current_entry);
-	additional_indices->Branch("AdditionalIndices",&indices_this_entry);
+	AddIndexBranches();
 	
 	// store meta info
 	TNamed* thecutname = new TNamed("cut_name", cut_name.c_str());
@@ -189,10 +217,33 @@ void MTreeCut::Initialize(int type_in, std::vector<std::string> indexcutbranches
 	}
 	additional_indices->GetUserInfo()->Add(linkarra);
 	
+	// with no cut branches the width of a combination is only known from the first Enter call
+	if(index_width>0) AddIndexWidth();
+	
 	currdir->cd();
 	
 };
 
+void MTreeCut::AddIndexWidth(){
+	TParameter<Int_t>* thewidth = new TParameter<Int_t>("index_width",index_width);
+	additional_indices->GetUserInfo()->Add(thewidth);
+}
+
+void MTreeCut::AddIndexBranches(){
+	// branches for the passing indices of each entry, as a plain array or as an STL set
+	if(flat_layout){
+		flat_indices.reserve(100);  // the branch address is updated if this moves, see FillIndices
+		additional_indices->Branch("NumIndices",&num_indices,"NumIndices/i");
+		additional_indices->Branch("AdditionalIndices",flat_indices.data(),"AdditionalIndices[NumIndices]/i");
+	} else if(type==1){
+		additional_indices->Branch("AdditionalIndices",&indexes_this_entry);
+	} else {
+		additional_indices->Branch("AdditionalIndices",&indices_this_entry);
+	}
+	TParameter<Int_t>* thelayout = new TParameter<Int_t>("index_layout",(flat_layout) ? 1 : 0);
+	additional_indices->GetUserInfo()->Add(thelayout);
+}
+
 // type 0
 bool MTreeCut::Enter(Long64_t entry_number, TTree* treeptr){
 	if(type!=0){
@@ -200,7 +251,9 @@ bool MTreeCut::Enter(Long64_t entry_number, TTree* treeptr){
 		         <<" but its type is "<<type<<"!"<<std::endl;
 		return false;
 	}
-	return ttree_entries->Enter(entry_number, treeptr);
+	bool newtreeentry = ttree_entries->Enter(entry_number, treeptr);
+	entry_bitmap.Set(entry_number);
+	return newtreeentry;
 };
 
 // type 1
@@ -211,10 +264,10 @@ bool MTreeCut::Enter(Long64_t entry_number, size_t index, TTree* treeptr){
 	}
 	// add the entry_number to the TEntryList, if it isn't already
 	bool newtreeentry = ttree_entries->Enter(entry_number, treeptr);
+	entry_bitmap.Set(entry_number);
 	// starting a new TTree entry, write out all passing indices for the last entry
-	if((current_entry!=entry_number)&&(indexes_this_entry.size()!=0)){
-		auto ret = additional_indices->Fill();
-		indexes_this_entry.clear();
+	if((current_entry!=entry_number)&&(indexes_this_entry.size()!=0 || num_indices!=0)){
+		FillIndices();
 	}
 	// sanity check
 	if((current_entry!=entry_number)&&(newtreeentry==false)){
@@ -227,6 +280,10 @@ bool MTreeCut::Enter(Long64_t entry_number, size_t index, TTree* treeptr){
 	}
 	current_entry=entry_number;
 	// add the passing index to the list of indices
+	if(flat_layout){
+		bool newindex = EnterFlat(&index, 1);
+		return (newtreeentry || newindex);
+	}
 	auto ret = indexes_this_entry.emplace(index);
 	// std::set::emplace returns a std::pair of an iterator to element and a boolean of whether it's new
 	// return whether this combination was a unique new combination
@@ -234,35 +291,75 @@ bool MTreeCut::Enter(Long64_t entry_number, size_t index, TTree* treeptr){
 };
 
 // type 2
-bool MTreeCut::Enter(Long64_t entry_number, std::vector<size_t>& indices, TTree* treeptr){
+bool MTreeCut::Enter(Long64_t entry_number, const std::vector<size_t>& indices, TTree* treeptr){
 	if(type!=2){
 		std::cerr<<"MTreeCut::Enter() called with a vector of indices on MTreeCut "<<cut_name
 		         <<" but its type is "<<type<<"!"<<std::endl;
 	}
+	if(flat_layout){
+		// every combination must have the same number of indices: one for each cut branch,
+		// or if no cut branches were given, as many as the first combination entered.
+		if(index_width==0 && indices.size()>0){
+			index_width = indices.size();
+			AddIndexWidth();
+		}
+		if(indices.size()!=index_width){
+			std::cerr<<"MTreeCut::Enter() called with "<<indices.size()<<" indices on MTreeCut "<<cut_name
+			         <<" but its combinations have "<<index_width<<" indices!"<<std::endl;
+			return false;
+		}
+	}
 	// starting a new TTree entry, write out all passing indices for the last entry
-	if((current_entry!=entry_number)&&(indices_this_entry.size()!=0)){
-		additional_indices->Fill();
-		indices_this_entry.clear();
+	if((current_entry!=entry_number)&&(indices_this_entry.size()!=0 || num_indices!=0)){
+		FillIndices();
 	}
 	// add the entry_number to the TEntryList, if it isn't already
 	bool newtreeentry = ttree_entries->Enter(entry_number, treeptr);
+	entry_bitmap.Set(entry_number);
 	// sanity check
 	if((current_entry!=entry_number)&&(newtreeentry==false)){
 		std::cerr<<"Out of order call to MTreeCut::Enter! All passing sub-indices for a given "
 		         <<"TTree entry must be given in sequence!"<<std::endl;
 	}
 	current_entry=entry_number;
+	if(flat_layout){
+		bool newindices = EnterFlat(indices.data(), indices.size());
+		return (newtreeentry || newindices);
+	}
 	auto ret = indices_this_entry.emplace(indices);
 	// return whether this combination was a unique new combination
 	return (newtreeentry || ret.second);
 };
 
+bool MTreeCut::EnterFlat(const size_t* indices, size_t width){
+	// insert the index (or combination of indices) in order, unless we already have it
+	MTreeIndexSpan current(flat_indices.data(), flat_indices.size(), width);
+	size_t offset = current.LowerBound(indices, width)*width;
+	if(offset<flat_indices.size() && std::equal(indices, indices+width, flat_indices.begin()+offset)){
+		return false;
+	}
+	flat_indices.insert(flat_indices.begin()+offset, indices, indices+width);
+	num_indices = flat_indices.size();
+	return true;
+}
+
+void MTreeCut::FillIndices(){
+	// write out the passing indices of the current entry, and clear them for the next
+	if(type>0 && flat_layout){
+		// the vector may have been reallocated since the last Fill
+		additional_indices->SetBranchAddress("AdditionalIndices",flat_indices.data());
+	}
+	additional_indices->Fill();
+	indexes_this_entry.clear();
+	indices_this_entry.clear();
+	flat_indices.clear();
+	num_indices=0;
+}
+
 bool MTreeCut::Flush(){
 	// call before saving to write out the last entry
 	if(additional_indices&&current_entry>=0){
-		additional_indices->Fill();
-		if(type==1) indexes_this_entry.clear();
-		if(type==2) indices_this_entry.clear();
+		FillIndices();
 		current_entry=-1;
 		return true;
 	}
@@ -281,6 +378,8 @@ void MTreeCut::Write(){
 		flag.Write(flagstring.c_str(), TObject::kOverwrite);
 	} else {
 		ttree_entries->Write("",TObject::kOverwrite);
+		// the bitmap has its own key, which older readers ignore
+		entry_bitmap.Write("CutBitmap_"+cut_name);
 		Flush();
 		additional_indices->Write("",TObject::kOverwrite);
 	}
@@ -305,6 +404,8 @@ bool MTreeCut::GetMetaInfo(){
 	// we need to retrieve:
 	// a TNamed with name = "cut_description" and title storing a description of the cut (e.g. threshold)
 	// a TParameter<Int_t> with name = "cut_type" and value of the cut type (0-2)
+	// for type 1 and 2 cuts, a TParameter<Int_t> with name = "index_layout", 1 if the indices are
+	// stored as a plain array. If absent (older files) they're stored as STL sets.
 	// for type 1 cuts we also have:
 	// a TNamed with name = "cut_branch" and title giving the name of the branch the index relates to
 	// a TObjArray with name = "linked_branch_list" that stores TObjStrings with the branches
@@ -324,6 +425,12 @@ bool MTreeCut::GetMetaInfo(){
 		} else if(obj_name=="cut_type"){
 			TParameter<Int_t>* thecuttype = (TParameter<Int_t>*)next_meta_info->At(obj_i);
 			type = thecuttype->GetVal();
+		} else if(obj_name=="index_layout"){
+			TParameter<Int_t>* thelayout = (TParameter<Int_t>*)next_meta_info->At(obj_i);
+			flat_layout = (thelayout->GetVal()==1);
+		} else if(obj_name=="index_width"){
+			TParameter<Int_t>* thewidth = (TParameter<Int_t>*)next_meta_info->At(obj_i);
+			index_width = thewidth->GetVal();
 		} else if(obj_name=="cut_branch"){
 			TNamed* this_cut_branch = (TNamed*)next_meta_info->At(obj_i);
 			additional_branchname = this_cut_branch->GetTitle();
@@ -357,23 +464,134 @@ Long64_t MTreeCut::GetNextEntry(){
 	if(mode=="read"){
 		if(tlist_entry>total_entries) return -1; // end of TEntryList
 		++tlist_entry;
-		current_entry = ttree_entries->GetEntry(tlist_entry);
+		// the passing entries are the same in the bitmap, which doesn't need the TEntryList
+		current_entry = (tlist_entry<total_entries) ? entry_bitmap.Next(current_entry+1) : -1;
 		if(type>0){
-			additional_indices->GetEntry(tlist_entry);
+			ReadIndices();
 		}
 	}
 	// bypass when writing
 	return current_entry;
 }
 
+Long64_t MTreeCut::PeekEntry(Long64_t num_ahead){
+	// get the entry num_ahead passing entries after the current one, without advancing to it
+	if(mode!="read") return -1;
+	Long64_t peek_entry = tlist_entry+num_ahead;
+	if(peek_entry<0 || peek_entry>=total_entries) return -1;
+	return entry_bitmap.Select(peek_entry);
+}
+
+bool MTreeCut::SeekEntry(Long64_t entry){
+	if(mode!="read" || not entry_bitmap.Test(entry)) return false;
+	if(entry==current_entry) return true;
+	// the passing entries are in order in the TEntryList, and in the tree of additional indices
+	tlist_entry = entry_bitmap.Rank(entry);
+	current_entry = entry;
+	if(type>0){
+		ReadIndices();
+	}
+	return true;
+}
+
+void MTreeCut::ReadIndices(){
+	// read the passing indices of the current entry. With the flat layout the number of indices
+	// is read first, so the buffer can be grown to hold them before the array is read.
+	if(flat_layout){
+		num_indices_branch->GetEntry(tlist_entry);
+		if(num_indices>flat_indices.size()){
+			flat_indices.resize(num_indices);
+			additional_indices->SetBranchAddress("AdditionalIndices",flat_indices.data());
+		}
+	}
+	additional_indices->GetEntry(tlist_entry);
+}
+
+bool MTreeCut::EntriesRead() const {
+	return entries_read;
+}
+
+void MTreeCut::RebuildEntries(TEntryList* inelist){
+	// take the passing entries from a TEntryList, and go back to the first of them
+	SetEntryList(inelist);
+	BuildEntryBitmap();
+	entries_read = true;
+	tlist_entry = -1;
+	current_entry = -1;
+	flattened_entry = -1;
+	GetNextEntry();
+}
+
+const CompressedEntryBitmap& MTreeCut::GetEntryBitmap() const {
+	return entry_bitmap;
+}
+
+void MTreeCut::BuildEntryBitmap(){
+	entry_bitmap.Clear();
+	for(Long64_t list_i=0; list_i<total_entries; ++list_i){
+		entry_bitmap.Set(ttree_entries->GetEntry(list_i));
+	}
+}
+
 Long64_t MTreeCut::GetCurrentEntry(){
 	return current_entry;
 }
 
-std::set<size_t> MTreeCut::GetPassingIndexes(){
-	return indexes_this_entry;
+MTreeIndexSpan MTreeCut::GetPassingIndexes(){
+	if(not flat_layout) FlattenSets();
+	return MTreeIndexSpan(flat_indices.data(), num_indices);
+}
+
+MTreeIndexSpan MTreeCut::GetPassingIndices(){
+	if(not flat_layout) FlattenSets();
+	size_t width = index_width;
+	if(width==0) width = additional_branchnames.size();  // files from before index_width was stored
+	if(not flat_layout && not indices_this_entry.empty()) width = indices_this_entry.begin()->size();
+	return MTreeIndexSpan(flat_indices.data(), num_indices, width);
+}
+
+void MTreeCut::FlattenSets(){
+	// copy the indices of the current entry from the sets into flat_indices, to give a common view.
+	// When reading, only once per entry.
+	if(mode=="read" && flattened_entry==current_entry) return;
+	flat_indices.clear();
+	if(type==1){
+		flat_indices.assign(indexes_this_entry.begin(), indexes_this_entry.end());
+	} else if(type==2){
+		for(auto&& acombination : indices_this_entry){
+			flat_indices.insert(flat_indices.end(), acombination.begin(), acombination.end());
+		}
+	}
+	num_indices = flat_indices.size();
+	flattened_entry = current_entry;
+}
+
+size_t MTreeIndexSpan::LowerBound(const size_t* indices, size_t num_indices) const {
+	// binary search for the first combination not less than the given one, comparing lexicographically
+	size_t first=0;
+	size_t last=size();
+	while(first<last){
+		size_t mid = first+(last-first)/2;
+		const UInt_t* combination = values+mid*combination_width;
+		if(std::lexicographical_compare(combination, combination+combination_width, indices, indices+num_indices)){
+			first = mid+1;
+		} else {
+			last = mid;
+		}
+	}
+	return first;
+}
+
+size_t MTreeIndexSpan::count(size_t index) const {
+	if(combination_width!=1) return 0;
+	size_t pos = LowerBound(&index, 1);
+	return (pos<size() && values[pos]==index) ? 1 : 0;
 }
 
-std::set<std::vector<size_t>> MTreeCut::GetPassingIndices(){
-	return indices_this_entry;
+size_t MTreeIndexSpan::count(const std::vector<size_t>& indices) const {
+	if(indices.size()!=combination_width) return 0;
+	size_t pos = LowerBound(indices.data(), indices.size());
+	if(pos>=size()) return 0;
+	const UInt_t* combination = values+pos*combination_width;
+	return std::equal(indices.begin(), indices.end(), combination) ? 1 : 0;
 }
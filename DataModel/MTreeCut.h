@@ -3,12 +3,46 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <cstddef> // size_t
 
 #include "TEntryList.h"
 #include "TTree.h"
 
+#include "CompressedEntryBitmap.h"
+
 #include<SerialisableObject.h>  // so we can put these in a BoostStore
 
+// A read-only view of the passing indices of the current TTree entry of a type 1 or 2 MTreeCut.
+// Indices are sorted and unique. For type 2 cuts each combination is width() consecutive values,
+// and combinations are in lexicographic order; begin() to end() then runs over all their values.
+// The view is only valid until the MTreeCut moves to another entry.
+class MTreeIndexSpan {
+	public:
+	typedef const UInt_t* const_iterator;
+	MTreeIndexSpan(){};
+	MTreeIndexSpan(const UInt_t* valuesin, size_t num_valuesin, size_t widthin=1) :
+	               values(valuesin), num_values(num_valuesin), combination_width((widthin>0) ? widthin : 1){};
+	const_iterator begin() const { return values; }
+	const_iterator end() const { return values+num_values; }
+	// number of indices (type 1) or combinations of indices (type 2)
+	size_t size() const { return num_values/combination_width; }
+	bool empty() const { return num_values==0; }
+	size_t width() const { return combination_width; }
+	// index i (type 1) or the first index of combination i (type 2)
+	UInt_t operator[](size_t i) const { return values[i*combination_width]; }
+	MTreeIndexSpan Combination(size_t i) const { return MTreeIndexSpan(values+i*combination_width, combination_width); }
+	// whether an index or combination of indices is present, as std::set::count
+	size_t count(size_t index) const;
+	size_t count(const std::vector<size_t>& indices) const;
+	// position at which a combination of indices is, or would be inserted
+	size_t LowerBound(const size_t* indices, size_t num_indices) const;
+	
+	private:
+	const UInt_t* values=nullptr;
+	size_t num_values=0;
+	size_t combination_width=1;
+};
+
 class MTreeCut : public SerialisableObject {
 	
 	friend class boost::serialization::access;
@@ -16,7 +50,9 @@ class MTreeCut : public SerialisableObject {
 	public:
 	// for all types
 	MTreeCut(TFile* outfilein, std::string cutname);
-	MTreeCut(std::string cutname, TEntryList* inelist, TTree* intree);
+	// bitmaptree is the cut's "CutBitmap_<cutname>" tree, if the file has one, in which case
+	// inelist may be null: the TEntryList is then never read. Both are null for empty cuts.
+	MTreeCut(std::string cutname, TEntryList* inelist, TTree* intree, TTree* bitmaptree=nullptr);
 	~MTreeCut();
 	std::string mode="";  // can be "read" or "write". Determines whether destructor performs cleanup.
 	std::string cut_name;
@@ -49,11 +85,25 @@ class MTreeCut : public SerialisableObject {
 	std::vector<std::vector<std::string>> linked_branch_lists;
 	std::set<std::vector<size_t>> indices_this_entry;
 	std::set<std::vector<size_t>>* indices_this_entry_p=nullptr;
+	size_t index_width=0;   // indices per combination: one per cut branch, or as in the first Enter call
+	
+	// for types 1 and 2: the passing indices of each entry can be stored as a plain array of the sorted
+	// indices (type 2: of each combination in turn), 'flat_indices[num_indices]', rather than as an STL set.
+	// This is the default for new cuts, set before calling Initialize. Files with sets can still be read.
+	bool flat_layout=true;
+	std::vector<UInt_t> flat_indices;   // when reading, grown to the longest entry read so far
+	UInt_t num_indices=0;
+	TBranch* num_indices_branch=nullptr;
+	
+	// the passing TTree entries, as in ttree_entries, for fast lookup and combination with other cuts
+	CompressedEntryBitmap entry_bitmap;
 	
 	private:
 	Long64_t current_entry=-1;
 	Long64_t tlist_entry=-1;
 	Long64_t total_entries=-1;
+	Long64_t flattened_entry=-1;   // entry whose sets were last copied to flat_indices
+	bool entries_read=true;        // false if the bitmap of passing entries could not be read
 	
 	public:
 	void Initialize(int type_in);
@@ -66,15 +116,30 @@ class MTreeCut : public SerialisableObject {
 	bool GetMetaInfo();
 	bool Enter(Long64_t entry_number, TTree* treeptr=nullptr);
 	bool Enter(Long64_t entry_number, size_t index, TTree* treeptr=nullptr);
-	bool Enter(Long64_t entry_number, std::vector<size_t>& indices, TTree* treeptr=nullptr);
+	bool Enter(Long64_t entry_number, const std::vector<size_t>& indices, TTree* treeptr=nullptr);
 	bool Flush();
 	void Write();
 	Long64_t GetCurrentEntry();
 	Long64_t GetNextEntry();
-	std::set<size_t> GetPassingIndexes();
-	std::set<std::vector<size_t>> GetPassingIndices();
+	Long64_t PeekEntry(Long64_t num_ahead);
+	// when reading, move to a given passing entry. Returns false if it doesn't pass the cut.
+	bool SeekEntry(Long64_t entry);
+	const CompressedEntryBitmap& GetEntryBitmap() const;
+	// when reading, whether the passing entries could be read. If not, they may be rebuilt from a TEntryList.
+	bool EntriesRead() const;
+	void RebuildEntries(TEntryList* inelist);
+	MTreeIndexSpan GetPassingIndexes();
+	MTreeIndexSpan GetPassingIndices();
 	
 	private:
+	void AddIndexBranches();
+	void AddIndexWidth();
+	bool EnterFlat(const size_t* indices, size_t width);
+	void FillIndices();
+	void ReadIndices();
+	void FlattenSets();
+	void BuildEntryBitmap();
+	
 	
 	// for writing to a BoostStore
 	template<class Archive> void serialize(Archive & ar, const unsigned int version){
@@ -95,6 +160,11 @@ class MTreeCut : public SerialisableObject {
 			ar & additional_branchnames;
 			ar & linked_branch_lists;
 			ar & indices_this_entry;
+			ar & index_width;
+			// for either type, with the flat layout
+			ar & flat_layout;
+			ar & flat_indices;
+			ar & num_indices;
 		}
 	}
 	
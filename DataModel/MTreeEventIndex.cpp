@@ -0,0 +1,115 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "MTreeEventIndex.h"
+#include "SidecarFile.h"
+
+#include <algorithm> // std::sort, std::lower_bound
+#include <climits>   // INT_MIN, INT_MAX, LONG_MAX
+#include <iterator>  // std::prev
+
+static const std::string sidecar_format = "MTreeEventIndex v1";
+
+void MTreeEventIndex::Clear(){
+	index.clear();
+	entry_ordered = true;
+}
+
+void MTreeEventIndex::AddKeys(const std::vector<int>& keys, long first_entry){
+	size_t num_entries = keys.size()/3;
+	index.reserve(index.size()+num_entries);
+	for(size_t entry_i=0; entry_i<num_entries; ++entry_i){
+		MTreeEventKey akey;
+		akey.run = keys[3*entry_i];
+		akey.subrun = keys[3*entry_i+1];
+		akey.event = keys[3*entry_i+2];
+		akey.entry = first_entry+entry_i;
+		index.push_back(akey);
+	}
+}
+
+void MTreeEventIndex::Sort(){
+	// data is normally already in run order, so this is usually just a check
+	if(not std::is_sorted(index.begin(), index.end())) std::sort(index.begin(), index.end());
+	// if the entries are then in order too, each run range is a contiguous range of entries
+	entry_ordered = true;
+	for(size_t key_i=1; key_i<index.size(); ++key_i){
+		if(index[key_i].entry<index[key_i-1].entry){
+			entry_ordered = false;
+			break;
+		}
+	}
+}
+
+long MTreeEventIndex::FindEntry(int run, int subrun, int event) const {
+	MTreeEventKey akey;
+	akey.run = run;
+	akey.subrun = subrun;
+	akey.event = event;
+	akey.entry = -1;
+	auto it = std::lower_bound(index.begin(), index.end(), akey);
+	if(it==index.end() || it->run!=run || it->subrun!=subrun || it->event!=event) return -1;
+	return it->entry;
+}
+
+std::pair<long,long> MTreeEventIndex::GetEntryRange(int run_min, int run_max) const {
+	MTreeEventKey lowkey;
+	lowkey.run = run_min;
+	lowkey.subrun = INT_MIN;
+	lowkey.event = INT_MIN;
+	lowkey.entry = -1;
+	MTreeEventKey highkey;
+	highkey.run = run_max;
+	highkey.subrun = INT_MAX;
+	highkey.event = INT_MAX;
+	highkey.entry = LONG_MAX;
+	auto first = std::lower_bound(index.begin(), index.end(), lowkey);
+	auto last = std::upper_bound(first, index.end(), highkey);
+	if(first==last) return std::pair<long,long>{-1,-1};
+	if(entry_ordered) return std::pair<long,long>{first->entry, std::prev(last)->entry+1};
+	// otherwise the entries of the range may be anywhere
+	long first_entry = first->entry;
+	long last_entry = first->entry;
+	for(auto it=first; it!=last; ++it){
+		first_entry = std::min(first_entry, it->entry);
+		last_entry = std::max(last_entry, it->entry);
+	}
+	return std::pair<long,long>{first_entry, last_entry+1};
+}
+
+std::vector<long> MTreeEventIndex::GetEntries(int run_min, int run_max) const {
+	std::vector<long> entries;
+	MTreeEventKey lowkey;
+	lowkey.run = run_min;
+	lowkey.subrun = INT_MIN;
+	lowkey.event = INT_MIN;
+	lowkey.entry = -1;
+	for(auto it=std::lower_bound(index.begin(), index.end(), lowkey); it!=index.end() && it->run<=run_max; ++it){
+		entries.push_back(it->entry);
+	}
+	if(not entry_ordered) std::sort(entries.begin(), entries.end());
+	return entries;
+}
+
+size_t MTreeEventIndex::size() const {
+	return index.size();
+}
+
+bool MTreeEventIndex::empty() const {
+	return index.empty();
+}
+
+int MTreeEventIndex::WriteSidecar(const std::string& sidecarname, const std::string& filekey,
+                                  const std::vector<int>& keys){
+	return SidecarFile::Write(sidecarname, sidecar_format, filekey, keys.size()/3, keys.data(), keys.size()*sizeof(int));
+}
+
+int MTreeEventIndex::ReadSidecar(const std::string& sidecarname, const std::string& filekey,
+                                 long num_entries, std::vector<int>& keys){
+	SidecarFile sidecar;
+	if(not sidecar.Open(sidecarname, sidecar_format, filekey) || sidecar.GetCount()!=num_entries) return 0;
+	keys.resize(3*num_entries);
+	if(not sidecar.ReadPayload(keys.data(), keys.size()*sizeof(int))){
+		keys.clear();
+		return 0;
+	}
+	return 1;
+}
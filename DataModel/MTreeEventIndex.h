@@ -0,0 +1,68 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef MTreeEventIndex_H
+#define MTreeEventIndex_H
+
+#include <string>
+#include <vector>
+#include <utility> // pair
+
+/*
+An MTreeEventIndex maps (run, subrun, event) keys to entry numbers of a TTree or TChain,
+so that the entries of a run range, or of a given event, can be found in O(log n) without
+scanning the tree. It's built by MTreeReader::BuildEventIndex, which reads only the branches
+holding the keys, and persists the keys of each file in a sidecar file so that later jobs
+on the same files need not read them again.
+
+Usage:
+	MTreeEventIndex index;
+	myTreeReader.BuildEventIndex(index);
+	std::pair<long,long> entries = index.GetEntryRange(61525, 73031);  // [first, last)
+	long entry = index.FindEntry(61525, 1, 2030);
+*/
+
+struct MTreeEventKey {
+	int run=0;
+	int subrun=0;
+	int event=0;
+	long entry=0;
+	bool operator<(const MTreeEventKey& other) const {
+		if(run!=other.run) return run<other.run;
+		if(subrun!=other.subrun) return subrun<other.subrun;
+		if(event!=other.event) return event<other.event;
+		return entry<other.entry;
+	}
+};
+
+class MTreeEventIndex {
+	public:
+	MTreeEventIndex(){};
+
+	// building: add the keys of one file (three ints per entry: run, subrun, event),
+	// whose first entry is the given entry number of the chain, then sort when all are added.
+	void Clear();
+	void AddKeys(const std::vector<int>& keys, long first_entry);
+	void Sort();
+
+	// lookups. Run ranges are inclusive, and the returned entry range is [first, last),
+	// which may also include entries of other runs if runs are not in entry order.
+	// Both return -1 (or {-1,-1}) if no entries match.
+	long FindEntry(int run, int subrun, int event) const;
+	std::pair<long,long> GetEntryRange(int run_min, int run_max) const;
+	// the exact entries of a run range, in entry order
+	std::vector<long> GetEntries(int run_min, int run_max) const;
+	size_t size() const;
+	bool empty() const;
+
+	// persistence of the keys of one file. The file key identifies the file contents
+	// (see MTreeReader::BuildEventIndex) so that a stale sidecar is not used.
+	static int WriteSidecar(const std::string& sidecarname, const std::string& filekey,
+	                        const std::vector<int>& keys);
+	static int ReadSidecar(const std::string& sidecarname, const std::string& filekey,
+	                       long num_entries, std::vector<int>& keys);
+
+	private:
+	std::vector<MTreeEventKey> index;  // sorted by key
+	bool entry_ordered=true;           // sorting by key also sorted the entries
+};
+
+#endif // defined MTreeEventIndex_H
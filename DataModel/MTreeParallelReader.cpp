@@ -0,0 +1,219 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "MTreeParallelReader.h"
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1.h"
+
+#include <iostream>
+#include <thread>
+#include <memory>    // unique_ptr
+#include <algorithm> // std::min, std::max
+
+MTreeParallelReader::MTreeParallelReader(std::vector<std::string> filelistin, std::string treenamein){
+	Load(filelistin, treenamein);
+}
+
+int MTreeParallelReader::Load(std::vector<std::string> filelistin, std::string treenamein){
+	if(filelistin.size()==0){
+		std::cerr<<"!!! MTreeParallelReader::Load called with empty file list !!!"<<std::endl;
+		return 0;
+	}
+	filelist = filelistin;
+	treename = treenamein;
+	ranges.clear();
+	return 1;
+}
+
+void MTreeParallelReader::SetVerbosity(int verbin){
+	verbosity = verbin;
+}
+
+void MTreeParallelReader::SetRangeEntries(long min_entriesin){
+	min_range_entries = min_entriesin;
+	ranges.clear();
+}
+
+void MTreeParallelReader::SetNumThreads(int num_threadsin){
+	num_threads = num_threadsin;
+}
+
+int MTreeParallelReader::GetNumThreads(){
+	if(num_threads>0) return num_threads;
+	// hardware_concurrency may return 0 if unknown
+	return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+void MTreeParallelReader::SetActiveBranches(std::vector<std::string> branchnamesin){
+	active_branches = branchnamesin;
+}
+
+const std::vector<MTreeRange>& MTreeParallelReader::GetRanges(){
+	if(ranges.empty()) MakeRanges();
+	return ranges;
+}
+
+long MTreeParallelReader::GetEntries(){
+	if(ranges.empty()) MakeRanges();
+	return total_entries;
+}
+
+int MTreeParallelReader::MakeRanges(){
+	// we need the number of entries in each file, and possibly its cluster boundaries,
+	// so open each file in turn. Only metadata is read.
+	ranges.clear();
+	total_entries = 0;
+	for(size_t file_i=0; file_i<filelist.size(); ++file_i){
+		const std::string& filename = filelist.at(file_i);
+		TFile* thefile = TFile::Open(filename.c_str());
+		if(thefile==nullptr || thefile->IsZombie()){
+			std::cerr<<"MTreeParallelReader failed to open file "<<filename<<", skipping it"<<std::endl;
+			if(thefile) delete thefile;
+			continue;
+		}
+		TTree* thetree = (TTree*)thefile->Get(treename.c_str());
+		if(thetree==nullptr){
+			std::cerr<<"MTreeParallelReader found no tree "<<treename<<" in file "<<filename
+					 <<", skipping it"<<std::endl;
+			thefile->Close();
+			delete thefile;
+			continue;
+		}
+		long file_entries = thetree->GetEntries();
+
+		// split into ranges
+		long range_start = 0;
+		if(min_range_entries>0){
+			// end each range on the first cluster boundary after the minimum number of entries,
+			// so that no two threads need to decompress the same baskets
+			TTree::TClusterIterator clusters = thetree->GetClusterIterator(0);
+			long cluster_start;
+			while((cluster_start=clusters())<file_entries){
+				long cluster_end = clusters.GetNextEntry();
+				if((cluster_end-range_start)<min_range_entries && cluster_end<file_entries) continue;
+				MTreeRange arange;
+				arange.first_entry = range_start;
+				arange.num_entries = std::min(cluster_end,file_entries)-range_start;
+				arange.global_first_entry = total_entries+range_start;
+				arange.filename = filename;
+				arange.file_index = file_i;
+				arange.range_index = ranges.size();
+				ranges.push_back(arange);
+				range_start = std::min(cluster_end,file_entries);
+			}
+		}
+		// one range for the whole file, or whatever's left after the last cluster boundary
+		if(range_start<file_entries){
+			MTreeRange arange;
+			arange.first_entry = range_start;
+			arange.num_entries = file_entries-range_start;
+			arange.global_first_entry = total_entries+range_start;
+			arange.filename = filename;
+			arange.file_index = file_i;
+			arange.range_index = ranges.size();
+			ranges.push_back(arange);
+		}
+		total_entries += file_entries;
+
+		thefile->Close();
+		delete thefile;
+	}
+	if(verbosity) std::cout<<"MTreeParallelReader split "<<total_entries<<" entries in "<<filelist.size()
+						   <<" files into "<<ranges.size()<<" ranges"<<std::endl;
+	return (ranges.size()>0);
+}
+
+int MTreeParallelReader::Process(range_processor process_range){
+	if(ranges.empty() && not MakeRanges()){
+		std::cerr<<"MTreeParallelReader::Process found no entries to process"<<std::endl;
+		return 0;
+	}
+
+	// each thread has its own TFiles, but ROOT has global state to protect
+	ROOT::EnableThreadSafety();
+
+	next_range = 0;
+	stop = false;
+	num_failed = 0;
+	int nthreads = std::min(size_t(GetNumThreads()), ranges.size());
+	if(verbosity) std::cout<<"MTreeParallelReader processing "<<ranges.size()<<" ranges on "
+						   <<nthreads<<" threads"<<std::endl;
+	std::vector<std::thread> workers;
+	for(int worker_i=0; worker_i<nthreads; ++worker_i){
+		workers.emplace_back(&MTreeParallelReader::Work, this, worker_i, std::cref(process_range));
+	}
+	for(auto&& aworker : workers) aworker.join();
+
+	if(num_failed>0){
+		std::cerr<<"MTreeParallelReader: processing failed for "<<num_failed<<" ranges"<<std::endl;
+		return 0;
+	}
+	return 1;
+}
+
+int MTreeParallelReader::ProcessEntries(entry_processor process_entry){
+	return Process([&process_entry](MTreeReader& reader, const MTreeRange& range, int worker_i){
+		long last_entry = range.first_entry+range.num_entries;
+		for(long entry_i=range.first_entry; entry_i<last_entry; ++entry_i){
+			if(reader.GetEntry(entry_i)<=0){
+				std::cerr<<"MTreeParallelReader error reading entry "<<entry_i<<" of file "
+						 <<range.filename<<std::endl;
+				return false;
+			}
+			if(not process_entry(reader, worker_i)) return false;
+		}
+		return true;
+	});
+}
+
+void MTreeParallelReader::Work(int worker_i, const range_processor& process_range){
+	// take ranges until there are none left. Consecutive ranges of the same file reuse the reader.
+	std::unique_ptr<MTreeReader> reader;
+	std::string loaded_file="";
+	while(not stop){
+		size_t range_i = next_range++;
+		if(range_i>=ranges.size()) break;
+		const MTreeRange& range = ranges.at(range_i);
+
+		if(range.filename!=loaded_file){
+			reader.reset(new MTreeReader);
+			reader->SetVerbosity(0);
+			loaded_file = range.filename;
+			int ok = reader->Load(range.filename, treename);
+			if(ok && active_branches.size()) ok = reader->OnlyEnableBranches(active_branches);
+			if(not ok){
+				std::cerr<<"MTreeParallelReader worker "<<worker_i<<" failed to load tree "<<treename
+						 <<" from file "<<range.filename<<std::endl;
+				++num_failed;
+				stop = true;
+				break;
+			}
+		}
+
+		if(verbosity>1) std::cout<<"MTreeParallelReader worker "<<worker_i<<" processing range "
+								 <<range_i<<" (entries "<<range.first_entry<<" to "
+								 <<(range.first_entry+range.num_entries)<<" of "<<range.filename<<")"<<std::endl;
+		if(not process_range(*reader, range, worker_i)){
+			++num_failed;
+			stop = true;
+		}
+	}
+}
+
+int MTreeParallelReader::MergeHistograms(const std::vector<TH1*>& per_thread){
+	if(per_thread.empty() || per_thread.front()==nullptr) return 0;
+	for(size_t thread_i=1; thread_i<per_thread.size(); ++thread_i){
+		if(per_thread.at(thread_i)==nullptr) continue;
+		if(not per_thread.front()->Add(per_thread.at(thread_i))) return 0;
+	}
+	return 1;
+}
+
+std::map<std::string,uint64_t> MTreeParallelReader::MergeCounts(const std::vector<std::map<std::string,uint64_t>>& per_thread){
+	std::map<std::string,uint64_t> merged;
+	for(auto&& counts : per_thread){
+		for(auto&& acount : counts) merged[acount.first] += acount.second;
+	}
+	return merged;
+}
@@ -0,0 +1,113 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef MTreeParallelReader_H
+#define MTreeParallelReader_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+#include "MTreeReader.h"
+
+class TH1;
+
+/*
+An MTreeParallelReader processes a set of files (as would be given to MTreeReader::Load to make a TChain)
+on several threads at once. The files are split into ranges of entries - either one range per file,
+or ranges of a minimum number of entries aligned to TTree cluster boundaries. Each worker thread takes
+the next unprocessed range, and processes it with its own MTreeReader (and so its own TFile and TTree).
+
+User code is given as a function called either once per range or once per entry. It's passed the
+index of the worker thread calling it, so that results can be accumulated per thread without locking,
+and merged once all threads are done (see the Merge functions below).
+Results whose order matters should instead be stored per range, using MTreeRange::range_index.
+
+Usage:
+	MTreeParallelReader myParallelReader(filelist, "data");
+	std::vector<std::vector<float>> dts(myParallelReader.GetNumThreads());
+	myParallelReader.ProcessEntries([&dts](MTreeReader& reader, int worker_i){
+		float dt;
+		reader.GetBranchValue("dt", dt);
+		dts[worker_i].push_back(dt);
+		return true;
+	});
+	std::vector<float> all_dts = MTreeParallelReader::MergeVectors(dts);
+*/
+
+// a range of entries within one file
+struct MTreeRange {
+	std::string filename;
+	size_t file_index=0;
+	size_t range_index=0;
+	long first_entry=0;          // entry number within the file
+	long num_entries=0;
+	long global_first_entry=0;   // entry number within the chain of all files
+};
+
+class MTreeParallelReader {
+	public:
+	MTreeParallelReader(){};
+	MTreeParallelReader(std::vector<std::string> filelist, std::string treename);
+	int Load(std::vector<std::string> filelist, std::string treename);
+
+	// configuration
+	void SetVerbosity(int verbin);
+	// split files into ranges of at least this many entries, on cluster boundaries.
+	// 0 (the default) makes one range per file.
+	void SetRangeEntries(long min_entriesin);
+	void SetNumThreads(int num_threadsin);  // default is the number of hardware threads
+	int GetNumThreads();
+	// branches to enable, as for MTreeReader::OnlyEnableBranches. All branches are enabled by default.
+	void SetActiveBranches(std::vector<std::string> branchnamesin);
+
+	// the ranges are made on first use, which requires opening each file
+	const std::vector<MTreeRange>& GetRanges();
+	long GetEntries();
+
+	// process each range. The function is given a reader on the file of the range, the range,
+	// and the index of the calling worker thread. Return false to stop processing.
+	typedef std::function<bool(MTreeReader& reader, const MTreeRange& range, int worker_i)> range_processor;
+	int Process(range_processor process_range);
+
+	// process each entry. The reader has been moved to the entry with GetEntry.
+	typedef std::function<bool(MTreeReader& reader, int worker_i)> entry_processor;
+	int ProcessEntries(entry_processor process_entry);
+
+	// merging of per-thread results
+	template<typename T>
+	static std::vector<T> MergeVectors(const std::vector<std::vector<T>>& per_thread){
+		size_t num_values=0;
+		for(auto&& avector : per_thread) num_values += avector.size();
+		std::vector<T> merged;
+		merged.reserve(num_values);
+		for(auto&& avector : per_thread) merged.insert(merged.end(), avector.begin(), avector.end());
+		return merged;
+	}
+	// histograms are added to the first histogram
+	static int MergeHistograms(const std::vector<TH1*>& per_thread);
+	// counters, such as the number of events passing each cut (see MTreeSelection::GetCutCounts)
+	static std::map<std::string,uint64_t> MergeCounts(const std::vector<std::map<std::string,uint64_t>>& per_thread);
+
+	private:
+	int MakeRanges();
+	void Work(int worker_i, const range_processor& process_range);
+
+	std::vector<std::string> filelist;
+	std::string treename;
+	std::vector<std::string> active_branches;
+	std::vector<MTreeRange> ranges;
+	long total_entries=0;
+	long min_range_entries=0;
+	int num_threads=0;
+	int verbosity=1;
+
+	// shared between worker threads during Process
+	std::atomic<size_t> next_range{0};
+	std::atomic<bool> stop{false};
+	std::atomic<int> num_failed{0};
+
+};
+
+#endif // defined MTreeParallelReader_H
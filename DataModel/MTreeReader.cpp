@@ -10,6 +10,19 @@
 #include "TBranch.h"
 #include "TLeaf.h"
 #include "TLeafElement.h"
+#include "TDataType.h"
+#include "TClass.h"
+#include "TObjArray.h"
+#include "TDirectory.h"
+#include "TMath.h"
+#include "RVersion.h"
+#include "TUUID.h"
+#include "TBufferFile.h"
+// bulk reading of branches is available from ROOT 6.20
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,20,0)
+#define MTREEREADER_BULKIO
+#include "ROOT/TBulkBranchRead.hxx"
+#endif
 //#include "TParameter.h"
 
 #include "type_name_as_string.h"
@@ -18,8 +31,228 @@
 #include <vector>
 #include <sstream>
 #include <algorithm> // std::find
+#include <cstring>   // std::memcpy
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <fstream>
+#include <cstdio>      // std::remove, std::rename
+#include <sys/mman.h>  // mmap
+#include <sys/stat.h>  // stat
+#include <fcntl.h>     // open
+#include <unistd.h>    // close
 
 #include "Algorithms.h"  // CheckPath
+#include "MTreeEventIndex.h"
+
+// state of the background prefetching thread.
+// Each slot is a complete secondary MTreeReader with its own TFile, so the worker thread
+// can read one entry while the main thread is using the buffers of another.
+struct MTreeReaderPrefetcher {
+	enum class SlotState { free, queued, reading, ready, inuse };
+	struct Slot {
+		MTreeReader* reader=nullptr;
+		long entry=-1;
+		long status=0;            // return from GetEntry
+		SlotState state=SlotState::free;
+	};
+	std::vector<Slot> slots;
+	std::deque<size_t> queue;     // slots waiting to be read, in order
+	int current_slot=-1;          // slot holding the entry currently being processed
+	int num_ahead=0;              // num entries to read ahead
+	long num_entries=0;
+	std::function<std::vector<long>(int)> upcoming_entries_fn;
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cv;   // signals both new requests and finished reads
+	bool stop=false;
+	
+	void Work();
+	Slot& Acquire(long entry_number, const std::vector<long>& upcoming);
+	void Drain();
+	int FindSlot(long entry_number);
+	void Request(size_t slot_i, long entry_number, bool urgent=false);
+};
+
+void MTreeReaderPrefetcher::Work(){
+	std::unique_lock<std::mutex> lock(mtx);
+	while(true){
+		cv.wait(lock, [this]{ return stop || not queue.empty(); });
+		if(stop) return;
+		Slot& slot = slots[queue.front()];
+		queue.pop_front();
+		slot.state = SlotState::reading;
+		// slots being read are left alone by the main thread, so we can read without the lock
+		lock.unlock();
+		long status = slot.reader->GetEntry(slot.entry);
+		lock.lock();
+		slot.status = status;
+		slot.state = SlotState::ready;
+		cv.notify_all();
+	}
+}
+
+MTreeReaderPrefetcher::Slot& MTreeReaderPrefetcher::Acquire(long entry_number, const std::vector<long>& upcoming){
+	std::unique_lock<std::mutex> lock(mtx);
+	// we're done with the previous entry, so its buffers can be reused
+	if(current_slot>=0) slots[current_slot].state = SlotState::free;
+	current_slot = -1;
+	
+	// drop any entries read or queued that we no longer expect to need
+	for(size_t slot_i=0; slot_i<slots.size(); ++slot_i){
+		Slot& slot = slots[slot_i];
+		if(slot.state!=SlotState::queued && slot.state!=SlotState::ready) continue;
+		if(slot.entry==entry_number) continue;
+		if(std::find(upcoming.begin(), upcoming.end(), slot.entry)!=upcoming.end()) continue;
+		if(slot.state==SlotState::queued) queue.erase(std::find(queue.begin(), queue.end(), slot_i));
+		slot.state = SlotState::free;
+	}
+	
+	// if this isn't an entry we anticipated, read it next.
+	// there is always a free slot for it: at most one slot can be busy reading an unneeded
+	// entry, and we have one slot more than the number of entries we read ahead.
+	int slot_i = FindSlot(entry_number);
+	if(slot_i<0){
+		slot_i = FindSlot(-1);
+		Request(slot_i, entry_number, true);
+	} else if(slots[slot_i].state==SlotState::queued){
+		// anticipated, but not yet started; make sure it's next
+		queue.erase(std::find(queue.begin(), queue.end(), size_t(slot_i)));
+		queue.push_front(slot_i);
+	}
+	
+	// queue up the following entries while there are buffers available
+	for(long next_entry : upcoming){
+		if(FindSlot(next_entry)>=0) continue;
+		int free_slot = FindSlot(-1);
+		if(free_slot<0) break;
+		Request(free_slot, next_entry);
+	}
+	cv.notify_all();
+	
+	// wait for our entry
+	Slot& slot = slots[slot_i];
+	cv.wait(lock, [&slot]{ return slot.state==SlotState::ready; });
+	slot.state = SlotState::inuse;
+	current_slot = slot_i;
+	return slot;
+}
+
+void MTreeReaderPrefetcher::Drain(){
+	// stop all background reading, e.g. before changing the configuration of the slot readers.
+	// Entries that have already been read are discarded.
+	std::unique_lock<std::mutex> lock(mtx);
+	for(size_t slot_i : queue) slots[slot_i].state = SlotState::free;
+	queue.clear();
+	cv.wait(lock, [this]{
+		for(auto&& slot : slots) if(slot.state==SlotState::reading) return false;
+		return true;
+	});
+	for(auto&& slot : slots) if(slot.state==SlotState::ready) slot.state = SlotState::free;
+}
+
+int MTreeReaderPrefetcher::FindSlot(long entry_number){
+	// find the slot holding (or due to hold) the given entry, or a free slot if entry_number<0
+	for(size_t slot_i=0; slot_i<slots.size(); ++slot_i){
+		const Slot& slot = slots[slot_i];
+		if(entry_number<0 && slot.state==SlotState::free) return slot_i;
+		if(entry_number>=0 && slot.state!=SlotState::free && slot.entry==entry_number) return slot_i;
+	}
+	return -1;
+}
+
+void MTreeReaderPrefetcher::Request(size_t slot_i, long entry_number, bool urgent){
+	// must be called with the lock held
+	slots[slot_i].entry = entry_number;
+	slots[slot_i].state = SlotState::queued;
+	if(urgent) queue.push_front(slot_i);
+	else queue.push_back(slot_i);
+}
+
+// branch properties that depend only on the structure of a tree. These are parsed once per
+// structure and shared by all readers of trees with that structure: successive trees of a TChain,
+// prefetch buffers, or the per-thread readers of an MTreeParallelReader.
+struct MTreeSchema {
+	std::string structure;                  // from GetTreeStructure
+	std::vector<BranchInfo> branch_infos;   // with no TBranch, TLeaf or value pointers
+	std::unordered_map<std::string,size_t> branch_indices;
+};
+
+// a column cache file mapped into memory (see MTreeReader::EnableColumnCache).
+// The file is a text header describing the columns, followed by the values of each column
+// and the offset of each entry within them, each section aligned to 8 bytes.
+struct MTreeColumnCache {
+	struct Column {
+		size_t branch_index=0;
+		TClass* objclass=nullptr;          // objects only: the class to stream them with
+		const char* data=nullptr;
+		const uint64_t* offsets=nullptr;   // values of entry i are data[offsets[i]] to data[offsets[i+1]-1]
+	};
+	std::vector<Column> columns;
+	long num_entries=0;
+	void* mapped=nullptr;
+	size_t mapped_size=0;
+	~MTreeColumnCache(){
+		if(mapped) munmap(mapped, mapped_size);
+	}
+};
+
+// first line of column cache files, for recognising them and their format
+static const std::string column_cache_header = "MTreeColumnCache v1";
+
+static uint64_t AlignColumn(uint64_t position){
+	return (position+7)/8*8;
+}
+
+// schemas parsed so far, by tree structure
+static std::mutex schema_cache_mutex;
+static std::unordered_map<std::string, std::shared_ptr<const MTreeSchema>> schema_cache;
+
+static std::string GetTreeStructure(TTree* atree){
+	// describe the name, title, type and kind of each branch of a tree.
+	// This is only metadata, so is cheap compared to parsing the branches.
+	std::string structure;
+	TObjArray* branches = atree->GetListOfBranches();
+	for(int i=0; i<branches->GetEntriesFast(); ++i){
+		TBranch* br=(TBranch*)branches->At(i);
+		TLeaf* lf = (TLeaf*)br->GetListOfLeaves()->At(0);
+		structure.append(lf->GetName()).append("\t").append(br->GetTitle()).append("\t")
+		         .append(lf->GetTypeName()).append("\t").append(br->ClassName()).append("\n");
+	}
+	return structure;
+}
+
+static size_t GetBufferSize(TBranch* br){
+	// the size of buffer needed to hold the largest entry of a branch of primitives,
+	// from the sizes of its leaves and the maximum value of any variable array sizes
+	size_t buffer_size=0;
+	size_t total_size=0;
+	TObjArray* leaves = br->GetListOfLeaves();
+	for(int leaf_i=0; leaf_i<leaves->GetEntriesFast(); ++leaf_i){
+		TLeaf* lf = (TLeaf*)leaves->At(leaf_i);
+		size_t len = std::max(lf->GetLenStatic(),1);
+		if(lf->GetLeafCount()) len *= std::max(lf->GetLeafCount()->GetMaximum(),1);
+		// one spare value, for the terminating null of strings
+		size_t leaf_size = (len+1)*lf->GetLenType();
+		total_size += leaf_size;
+		buffer_size = std::max(buffer_size, lf->GetOffset()+leaf_size);
+	}
+	return std::max(buffer_size, total_size);
+}
+
+static size_t GetEntrySize(TBranch* br){
+	// the number of bytes the current entry of a branch of primitives occupies in its buffer.
+	// For a leaf-list branch this spans all its leaves, which follow the first at their offsets.
+	size_t entry_size=0;
+	TObjArray* leaves = br->GetListOfLeaves();
+	for(int leaf_i=0; leaf_i<leaves->GetEntriesFast(); ++leaf_i){
+		TLeaf* lf = (TLeaf*)leaves->At(leaf_i);
+		entry_size = std::max(entry_size, lf->GetOffset()+size_t(lf->GetLen()*lf->GetLenType()));
+	}
+	return entry_size;
+}
 
 // TODO constructor/loader for tchains or tree pointers
 
@@ -144,10 +377,40 @@ int MTreeReader::LoadTree(std::string treename){
 
 int MTreeReader::ParseBranches(){
 	
-	// preload first entry to get branches
-	if(verbosity) std::cout<<"getting entry 0"<<std::endl;
-	thetree->GetEntry(0);
+	// TChains have no branches until a tree is loaded. This only reads the tree metadata.
+	if(thetree->GetTree()==nullptr && thetree->LoadTree(0)<0){
+		std::cerr<<"MTreeReader failed to load the first tree of "<<thetree->GetName()<<std::endl;
+		return 0;
+	}
+	currentTreeNumber = thetree->GetTreeNumber();
+	// no entry has been read yet
+	currentEntryNumber = static_cast<uint64_t>(-1);
+	clear_list_stale = true;
+	// forget the branches of any tree loaded before
+	schema.reset();
+	branch_infos.clear();
+	branch_indices.clear();
 	
+	// if we've already parsed a tree with the same structure, reuse its branch properties
+	std::string structure = GetTreeStructure(thetree);
+	{
+		std::unique_lock<std::mutex> lock(schema_cache_mutex);
+		auto it = schema_cache.find(structure);
+		if(it!=schema_cache.end()) schema = it->second;
+	}
+	if(schema){
+		if(verbosity) std::cout<<"using cached branch properties"<<std::endl;
+		branch_infos = schema->branch_infos;
+		branch_indices = schema->branch_indices;
+		TObjArray* branches = thetree->GetListOfBranches();
+		for(auto&& info : branch_infos){
+			info.branch = (TBranch*)branches->At(info.tree_index);
+			info.leaf = (TLeaf*)info.branch->GetListOfLeaves()->At(0);
+		}
+		return BindBranches();
+	}
+	
+	// otherwise everything is derived from the branch and leaf metadata: no entries are read
 	if(verbosity) std::cout<<"getting leaves"<<std::endl;
 	//for(int i=0; i<thetree->GetListOfLeaves()->GetEntriesFast(); ++i){
 	for(int i=0; i<thetree->GetListOfBranches()->GetEntriesFast(); ++i){
@@ -161,104 +424,174 @@ int MTreeReader::ParseBranches(){
 		// 'TBranch->GetListOfLeaves()==1'. .. are we safe to assume always 1?
 		TLeaf* lf = (TLeaf*)br->GetListOfLeaves()->At(0);
 		std::string branchname = lf->GetName();
-		leaf_pointers.emplace(branchname,lf);
-		branch_pointers.emplace(branchname,lf->GetBranch());
+		// skip any duplicates, as we would have done when these were maps
+		if(branch_indices.count(branchname)) continue;
+		BranchInfo info;
+		info.name = branchname;
+		info.leaf = lf;
+		info.branch = lf->GetBranch();
+		info.tree_index = i;
 		// the following is fine for objects, primitives or containers
 		// but only returns the primitive type for c-style arrays
-		branch_types.emplace(branchname,lf->GetTypeName());
+		info.type = lf->GetTypeName();
 		// the branch title includes dimensionality for c-style arrays
 		// e.g. "mybranchname     int[nparts][3]/F"
-		std::string branchtitle=lf->GetBranch()->GetTitle();
-		branch_titles.emplace(branchname,branchtitle);
+		info.title = lf->GetBranch()->GetTitle();
 		
 		// handle object pointers
 		if (lf->IsA() == TLeafElement::Class()) {
 			// could be TObjects, or could be stl containers
-			// is intptr_t any better than (void*)? probably not.
-			// note that 'lf->GetValuePointer()' returns 0 for objects!
-			TBranchElement* bev = (TBranchElement*)lf->GetBranch();
-			intptr_t objpp=reinterpret_cast<intptr_t>(bev->GetObject());
-			branch_value_pointers.emplace(branchname,objpp);
-			branch_isobject.emplace(branchname,true);
-			branch_isarray.emplace(branchname,false);
+			info.isobject = true;
 			
 			// both classes inheriting from TObject and STL containers
 			// are flagged as TLeafElements, so need further check
 			TClass* ac = TClass::GetClass(lf->GetTypeName());
 			if(ac!=nullptr){
-				branch_istobject.emplace(branchname,ac->InheritsFrom("TObject"));
+				info.istobject = ac->InheritsFrom("TObject");
 			} else {
 				std::cerr<<"Unknown class for branch "<<lf->GetBranch()->GetTitle()
 						 <<"! Please make a dictionary."<<std::endl;
 				// what are the consequences of this? Do we need to remove it from
 				// the maps? Will the TreeReader fail if we do not?
 				// is it sufficient simply to instead just say it does not inherit from TObject?
-				branch_istobject.emplace(branchname,false);
+				info.istobject = false;
 			}
 		}
 		// handle arrays
 		//else if(lf->GetLen()>1){  // flattened length. Unsuitable when dynamic size happens to be 1!
-		else if(branchtitle.find_first_of("[",0)!=std::string::npos){  // hope for no '[' in branch names
+		else if(info.title.find_first_of("[",0)!=std::string::npos){  // hope for no '[' in branch names
 			// we'll need to parse the title to retrieve the actual dimensions
-			intptr_t objpp=reinterpret_cast<intptr_t>(lf->GetValuePointer());
-			branch_value_pointers.emplace(branchname,objpp);
-			branch_isobject.emplace(branchname,false);
-			branch_isarray.emplace(branchname,true);
-			branch_istobject.emplace(branchname,false);
-		}
-		// handle basic types
-		else {
-			intptr_t objpp=reinterpret_cast<intptr_t>(lf->GetValuePointer());
-			branch_value_pointers.emplace(branchname,objpp);
-			branch_isobject.emplace(branchname,false);
-			branch_isarray.emplace(branchname,false);
-			branch_istobject.emplace(branchname,false);
+			info.isarray = true;
 		}
+		branch_indices.emplace(branchname,branch_infos.size());
+		branch_infos.push_back(info);
 	}
 	
 	// for all array branches, parse their titles to extract information about dimensions
-	for(auto&& abranch : branch_isarray){
-		if(abranch.second) ParseBranchDims(abranch.first);
+	// (this needs all branches to be known, as dimensions may refer to other branches)
+	for(auto&& info : branch_infos){
+		if(info.isarray) ParseBranchDims(info);
+	}
+	
+	// cache the results for other trees of the same structure
+	std::shared_ptr<MTreeSchema> newschema = std::make_shared<MTreeSchema>();
+	newschema->structure = structure;
+	newschema->branch_infos = branch_infos;
+	newschema->branch_indices = branch_indices;
+	for(auto&& info : newschema->branch_infos){
+		info.branch = nullptr;
+		info.leaf = nullptr;
+	}
+	{
+		std::unique_lock<std::mutex> lock(schema_cache_mutex);
+		schema = schema_cache.emplace(structure, newschema).first->second;
+	}
+	
+	// finally, somewhere to put the values
+	return BindBranches();
+}
+
+int MTreeReader::BindBranches(){
+	// set up the buffers that the branches of the current tree will be read into.
+	// This is done from the branch metadata, without reading any entries.
+	for(auto&& info : branch_infos){
+		if(info.branch->IsA()==TBranch::Class()){
+			// primitives and c-style arrays are read into our own buffers, sized for the largest
+			// entry of the tree. A later tree of a TChain may need a larger buffer.
+			// (TChains keep the address for subsequent trees, so we only set it when it changes)
+			// If someone else has already given the branch a buffer (e.g. an SKROOT TreeManager), use theirs.
+			bool external_buffer = (info.buffer.empty() && info.branch->GetAddress()!=nullptr);
+			size_t buffer_size = GetBufferSize(info.branch);
+			if(not external_buffer && buffer_size>info.buffer.size()){
+				info.buffer.resize(buffer_size);
+				thetree->SetBranchAddress(info.name.c_str(), static_cast<void*>(info.buffer.data()));
+			}
+		} else {
+			// objects (and anything else) are made by their branch
+			info.branch->SetupAddresses();
+		}
+		UpdateBranchPointer(info);
 	}
 	return 1;
 }
 
-int MTreeReader::UpdateBranchPointer(std::string branchname){
-	if(leaf_pointers.count(branchname)==0) return 0;
-	TLeaf* lf = leaf_pointers.at(branchname);
+BranchInfo* MTreeReader::GetBranchInfo(const std::string& branchname){
+	auto it = branch_indices.find(branchname);
+	if(it==branch_indices.end()) return nullptr;
+	return &branch_infos[it->second];
+}
+
+int MTreeReader::UpdateBranchPointer(BranchInfo& info){
+	// when reading from a column cache, primitives point into the mapped cache: see GetCachedEntry
+	if(column_cache && not info.isobject) return 1;
 	intptr_t objpp;
-	if(branch_isobject.at(branchname)){
+	if(info.isobject){
 		// objects need another level of indirection
-		TBranchElement* bev = (TBranchElement*)lf->GetBranch();
+		TBranchElement* bev = (TBranchElement*)info.branch;
 		objpp=reinterpret_cast<intptr_t>(bev->GetObject());
 	} else {
-		objpp=reinterpret_cast<intptr_t>(lf->GetValuePointer());
+		objpp=reinterpret_cast<intptr_t>(info.leaf->GetValuePointer());
 	}
-	branch_value_pointers.at(branchname)=objpp;
+	info.value_pointer=objpp;
 	return 1;
 }
 
-int MTreeReader::UpdateBranchPointers(){
+int MTreeReader::UpdateBranchPointers(bool all){
 	// assume we only need to re-check dynamic arrays? Objects won't move, right?
 	// dynamically sized arrays may do, if more space is required...
-	for(auto&& abranch : branch_isarray){
-		if(abranch.second){
-			// fixed sized arrays won't need to be reallocated
-			// so only update pointers if we don't have a cached (constant) size
-			if(branch_dims_cache.count(abranch.first)==0){
-				int ok = UpdateBranchPointer(abranch.first);
-				if(not ok) return ok;
-			}
+	// (everything moves if we've moved to a new tree in a TChain, in which case update 'all')
+	for(auto&& info : branch_infos){
+		// fixed sized arrays won't need to be reallocated
+		// so only update pointers if we don't have a cached (constant) size
+		if(all || (info.isarray && not info.static_dims)){
+			int ok = UpdateBranchPointer(info);
+			if(not ok) return ok;
 		}
 	}
 	return 1;
 }
 
-int MTreeReader::ParseBranchDims(std::string branchname){
+int MTreeReader::CheckBranchType(const BranchInfo& info, const std::type_info& requested_type){
+	// check that a requested type is compatible with the type held by a branch.
+	// this is done once when obtaining a BranchHandle, so needn't be fast.
+	// for arrays the requested type should be the array element type.
+	const std::string& branchname = info.name;
+	std::string leaftype = info.leaf->GetTypeName();
+	if(info.isobject){
+		// objects: the branch class must be, or inherit from, the requested class
+		TClass* requested_class = TClass::GetClass(requested_type);
+		TClass* branch_class = TClass::GetClass(leaftype.c_str());
+		if(requested_class==nullptr || branch_class==nullptr){
+			// no dictionary for one or the other; can't check
+			if(verbosity) std::cerr<<"Warning: unable to check type for branch "<<branchname
+									<<" of type "<<leaftype<<"; no dictionary?"<<std::endl;
+			return 1;
+		}
+		if(branch_class==requested_class || branch_class->InheritsFrom(requested_class)) return 1;
+		std::cerr<<"Branch "<<branchname<<" holds type "<<leaftype<<" which is not a "
+				 <<requested_class->GetName()<<std::endl;
+		return 0;
+	}
+	// primitives and arrays of primitives: compare the basic data type
+	EDataType requested_datatype = TDataType::GetType(requested_type);
+	TDataType* branch_datatype = gROOT->GetType(leaftype.c_str());
+	if(requested_datatype==kOther_t || branch_datatype==nullptr){
+		if(verbosity) std::cerr<<"Warning: unable to check type for branch "<<branchname
+								<<" of type "<<leaftype<<std::endl;
+		return 1;
+	}
+	if(requested_datatype==static_cast<EDataType>(branch_datatype->GetType())) return 1;
+	std::cerr<<"Branch "<<branchname<<" holds type "<<leaftype<<" which does not match requested type "
+			 <<TDataType::GetTypeName(requested_datatype)<<std::endl;
+	return 0;
+}
+
+int MTreeReader::ParseBranchDims(BranchInfo& info){
 	// parse branch title for sequences of type '[X]' suggesting an array.
 	// extract 'X'. Scan the list of branch names for 'X', in which case
 	// this is a variable length array, otherwise it's a fixed size so use stoi.
-	std::string branchtitle = branch_titles.at(branchname);
+	const std::string& branchname = info.name;
+	const std::string& branchtitle = info.title;
 	size_t startpos = 0;
 	size_t endpos = 0;
 	// each subsequent entry of the array represents a dimension
@@ -278,9 +611,10 @@ int MTreeReader::ParseBranchDims(std::string branchname){
 		//std::cout<<"extracted array size label "<<sizestring<<" for branch "<<branchname
 		//		 <<" dimension "<<this_branch_dimensions.size()<<std::endl;
 		// check if this string is the name of another branch - i.e. variable size array
-		if(branch_pointers.count(sizestring)){
+		if(branch_indices.count(sizestring)){
 			// it is - we'll need to retrieve the corresponding branch entry to get the size on each entry
 			this_branch_dimensions.emplace_back(std::pair<std::string, int>{sizestring,0});
+			info.dim_branch_indices.push_back(branch_indices.at(sizestring));
 		} else {
 			// it ought to be a static size, try to convert from string to int
 			// catch the exception thrown in the event that it can't be converted
@@ -289,6 +623,7 @@ int MTreeReader::ParseBranchDims(std::string branchname){
 			// after the first non-digit character.
 			try{
 				this_branch_dimensions.emplace_back(std::pair<std::string,int>{"",std::stoi(sizestring)});
+				info.dim_branch_indices.push_back(0); // unused
 			}
 			catch(const std::invalid_argument& ia) {
 				std::cerr<<"Failed to extract array dimension from branch title "<<branchtitle
@@ -305,88 +640,103 @@ int MTreeReader::ParseBranchDims(std::string branchname){
 		}
 		// loop back round for any further dimensions
 	}
-	branch_dimensions.emplace(branchname,this_branch_dimensions);
-	if(branch_dimensions.at(branchname).size()==0){
+	if(this_branch_dimensions.size()==0){
 		std::cerr<<"Failed to identify any dimensions for branch "<<branchname
 				 <<" despite TLeaf::GetLength() returning >1"<<std::endl;
 		return 0;
 	}
+	if(this_branch_dimensions.size()>BranchDims::max_dims){
+		std::cerr<<"Branch "<<branchname<<" has "<<this_branch_dimensions.size()
+				 <<" dimensions; MTreeReader supports at most "<<BranchDims::max_dims<<std::endl;
+		info.dim_branch_indices.clear();
+		return 0;
+	}
+	info.dimensions = this_branch_dimensions;
 	
 	int vlevel=2;
 	if(verbosity>vlevel) std::cout<<"end of branch title parsing, found "
-								  <<branch_dimensions.at(branchname).size()<<" dimensions, [";
+								  <<info.dimensions.size()<<" dimensions, [";
 	// loop over the vector of dimensions
 	std::string dims_string = "";
 	bool allstatics=true;
-	std::vector<size_t> cached_dims;
-	for(auto&& dims_pair : branch_dimensions.at(branchname)){
+	for(auto&& dims_pair : info.dimensions){
 		if(dims_pair.first==""){
 			if(verbosity>vlevel) std::cout<<"(N)"<<dims_pair.second;  // static numeric size
-			cached_dims.push_back(dims_pair.second);
+			info.dims_cache.dims[info.dims_cache.ndims++] = dims_pair.second;
 			dims_string.append(std::string("[") + std::to_string(dims_pair.second) + std::string("]"));
 		} else {
 			if(verbosity>vlevel) std::cout<<"(B)"<<dims_pair.first; // name of branch that stores variable size
 			dims_string.append(std::string("[") + dims_pair.first + std::string("]"));
 			allstatics=false;
 		}
-		if((verbosity>vlevel)&&(dims_pair!=(branch_dimensions.at(branchname).back()))) std::cout<<"], [";
+		if((verbosity>vlevel)&&(dims_pair!=(info.dimensions.back()))) std::cout<<"], [";
 	}
 	// if all dimensions are static we can cache the results for quicker lookup
-	if(allstatics){ branch_dims_cache.emplace(branchname,cached_dims); }
-	// append dimensions to the type string, since they aren't properly indicated by TLeaf::GetTypeName
-	if(branch_types.count(branchname)){
-		branch_types.at(branchname).append(dims_string);
+	if(allstatics){
+		info.static_dims = true;
+	} else {
+		info.dims_cache.ndims = 0;
 	}
+	// append dimensions to the type string, since they aren't properly indicated by TLeaf::GetTypeName
+	info.type.append(dims_string);
 	
 	return 1;
 }
 
 std::vector<size_t> MTreeReader::GetBranchDims(std::string branchname){
+	BranchInfo* info = GetBranchInfo(branchname);
+	if(info==nullptr){
+		std::cerr<<"No such branch "<<branchname<<std::endl;
+		return std::vector<size_t>{};
+	}
+	const BranchDims& dims = GetBranchDims(*info);
+	return std::vector<size_t>(dims.begin(), dims.end());
+}
+
+const BranchDims& MTreeReader::GetBranchDims(BranchInfo& info){
 	// get the dimensions of the array for this entry
-	// if all dimensions are constant we should have them cached
-	if(branch_dims_cache.count(branchname)) return branch_dims_cache.at(branchname);
+	// if all dimensions are constant we should have them cached, otherwise
+	// they're cached the first time they're requested after each GetEntry
+	if(info.static_dims || info.dims_generation==dims_generation) return info.dims_cache;
 	
 	// otherwise we must retrieve at least one size from another branch
-	std::vector<size_t> dimstemp;  // dimensions for this entry
-	if(branch_dimensions.count(branchname)==0){
+	if(info.dimensions.size()==0){
 		std::cerr<<"GetBranchDims called but no dimensions for this branch!"<<std::endl;
-		return dimstemp;
+		return info.dims_cache;
 	}
 	// loop over dimensions
-	for(auto&& adim : branch_dimensions.at(branchname)){
+	for(size_t dim_i=0; dim_i<info.dimensions.size(); ++dim_i){
+		const std::pair<std::string,int>& adim = info.dimensions[dim_i];
 		if(adim.first==""){
 			// this dimension is constant
-			dimstemp.push_back(adim.second);
+			info.dims_cache.dims[dim_i] = adim.second;
 		} else {
 			// this dimensions is a branch name - get the entry value of that branch
-			std::string sizebranchname = adim.first;
-			int lengththisentry;
-			int get_ok = GetBranchValue(sizebranchname, lengththisentry);
-			if(not get_ok){
-				std::cerr<<"Failed to retrieve value for branch "<<sizebranchname
-						 <<" required while obtaining this entry's dimensions for array in branch "
-						 <<branchname<<std::endl;
-				return dimstemp; // TODO throw an exception? We should do more than just print an error...
-			}
-			dimstemp.push_back(lengththisentry);
+			BranchInfo& sizebranch = branch_infos[info.dim_branch_indices[dim_i]];
+			LoadBranch(sizebranch);
+			info.dims_cache.dims[dim_i] = *reinterpret_cast<int*>(sizebranch.value_pointer);
 		}
 	}
-	return dimstemp;
+	info.dims_cache.ndims = info.dimensions.size();
+	info.dims_generation = dims_generation;
+	return info.dims_cache;
 }
 
 int MTreeReader::Clear(){
-	// loop over all branches
-	for(auto&& isobject : branch_istobject){
-		// skip if doesn't inherit from TObject so may not have Clear() method
-		// XXX note, maybe we should check if it has a 'clear' method (stl container)
-		// and invoke that if not? Should be safe even without doing that though.
-		if(not isobject.second) continue;
-		// get pointer to the object otherwise
-		TObject* theobject = reinterpret_cast<TObject*>(branch_value_pointers.at(isobject.first));
+	// the branches to consider are only redetermined when branch status changes
+	if(clear_list_stale) MakeClearList();
+	// in lazy mode, only branches read for the current entry need clearing:
+	// any others were cleared before the entry in which they were last read
+	bool loaded_only = (clear_policy==ClearPolicy::loaded && lazy_reading);
+	for(size_t branch_i : clear_list){
+		BranchInfo& info = branch_infos[branch_i];
+		if(loaded_only && info.loaded_entry!=static_cast<long>(currentEntryNumber)) continue;
+		// get pointer to the object
+		TObject* theobject = reinterpret_cast<TObject*>(info.value_pointer);
 		if(not theobject){
 			// no object... is this an error?
 			std::cerr<<"MTreeReader AutoClear error: failure to get pointer to TObject "
-					 <<"for branch "<<isobject.second<<std::endl;
+					 <<"for branch "<<info.name<<std::endl;
 			continue;  // TODO throw suitable exception
 		}
 		theobject->Clear();
@@ -394,12 +744,51 @@ int MTreeReader::Clear(){
 	return 1; // TODO check for errs
 }
 
+void MTreeReader::MakeClearList(){
+	clear_list.clear();
+	for(size_t branch_i=0; branch_i<branch_infos.size(); ++branch_i){
+		const BranchInfo& info = branch_infos[branch_i];
+		// skip if doesn't inherit from TObject so may not have Clear() method
+		// XXX note, maybe we should check if it has a 'clear' method (stl container)
+		// and invoke that if not? Should be safe even without doing that though.
+		if(not info.istobject) continue;
+		// disabled branches aren't read, so don't need clearing
+		if(clear_policy!=ClearPolicy::all && not info.enabled) continue;
+		clear_list.push_back(branch_i);
+	}
+	clear_list_stale = false;
+}
+
+void MTreeReader::SetClearPolicy(ClearPolicy policyin){
+	clear_policy = policyin;
+	clear_list_stale = true;
+	// when prefetching, clearing is done by the readers of each buffer
+	if(prefetcher){
+		prefetcher->Drain();
+		for(auto&& aslot : prefetcher->slots) aslot.reader->SetClearPolicy(clear_policy);
+	}
+}
+
 int MTreeReader::GetEntry(long entry_number){
 	// in case we've already got this entry loaded, nothing to do
 	if(currentEntryNumber==entry_number) return 1;
 	
-	// if we've been requested to invoke Clear() on all objects before each Get, do so
 	if(verbosity>3) std::cout<<"MTreeReader GetEntry "<<entry_number<<std::endl;
+	
+	// any cached array dimensions are for the previous entry
+	++dims_generation;
+	
+	// values may be served from a column cache, without reading the tree
+	if(column_cache) return GetCachedEntry(entry_number);
+	
+	// if prefetching, the entry has been (or is being) read in the background
+	if(prefetcher){
+		int bytesread = GetPrefetchedEntry(entry_number);
+		if(bytesread>0) CountLearnedEntry();
+		return bytesread;
+	}
+	
+	// if we've been requested to invoke Clear() on all objects before each Get, do so
 	if(autoclear){
 		int clear_ok = Clear();
 		if(not clear_ok){ return -10; }
@@ -431,23 +820,936 @@ int MTreeReader::GetEntry(long entry_number){
 		return bytesread;
 	}
 	
+	// LoadTree returns the entry number within the current tree
+	currentLocalEntry = status;
+	
 	// check for tree changes
+	bool newtree = false;
 	if(currentTreeNumber!=thetree->GetTreeNumber()){
 		// new tree
 		currentTreeNumber = thetree->GetTreeNumber();
 		thefile = thetree->GetCurrentFile();
+		// the TBranches of the previous tree are gone, so update ours
+		RefreshBranches();
+		newtree = true;
 		// TODO maybe implement some mechanism of notifying requestors?
 		// maybe build a list of function pointers to invoke?
 	}
 	
-	// load data from tree
-	// The function returns the number of bytes read from the input buffer.
-	// If entry does not exist the function returns 0. If an I/O error occurs, the function returns -1.
-	auto bytesread = thetree->GetEntry(entry_number);
-	if(bytesread>0) currentEntryNumber = entry_number;
+	long bytesread;
+	if(lazy_reading){
+		// branches will be read as they are accessed. LoadTree succeeded, so the entry exists.
+		currentEntryNumber = entry_number;
+		bytesread = 1;
+	} else {
+		// load data from tree
+		// The function returns the number of bytes read from the input buffer.
+		// If entry does not exist the function returns 0. If an I/O error occurs, the function returns -1.
+		bytesread = thetree->GetEntry(entry_number);
+		if(bytesread>0){
+			currentEntryNumber = entry_number;
+			// dynamic arrays may have been reallocated; refresh our pointers so that
+			// any BranchHandles given out remain valid without further lookups
+			UpdateBranchPointers(newtree);
+		}
+	}
+	
+	if(bytesread>0) CountLearnedEntry();
+	
 	return bytesread;
 }
 
+void MTreeReader::CountLearnedEntry(){
+	// if learning which branches are used, check if we're done
+	if(learning_entries==0) return;
+	--learning_entries;
+	if(learning_entries==0) StopLearning();
+}
+
+int MTreeReader::EnablePrefetch(int num_entries){
+	if(prefetcher) DisablePrefetch();
+	if(num_entries<=0) return 1;
+	if(column_cache){
+		std::cerr<<"MTreeReader warning: prefetching is not needed when reading from a column cache, "
+				 <<"ignoring EnablePrefetch"<<std::endl;
+		return 0;
+	}
+	if(lazy_reading){
+		std::cerr<<"MTreeReader warning: lazy reading is not compatible with prefetching, "
+				 <<"disabling lazy reading"<<std::endl;
+		SetLazyReading(false);
+	}
+	
+	// each set of buffers needs its own TTree, so find out where ours came from
+	std::vector<std::string> filelist;
+	std::string treename = thetree->GetName();
+	TChain* chain = dynamic_cast<TChain*>(thetree);
+	if(chain){
+		TObjArray* chainfiles = chain->GetListOfFiles();
+		for(int file_i=0; file_i<chainfiles->GetEntriesFast(); ++file_i){
+			filelist.push_back(chainfiles->At(file_i)->GetTitle());
+		}
+	} else if(thetree->GetCurrentFile()){
+		filelist.push_back(thetree->GetCurrentFile()->GetName());
+		// the tree may be in a subdirectory: path is of the form "file.root:/dir"
+		std::string treepath = thetree->GetDirectory()->GetPath();
+		treepath = treepath.substr(treepath.find(":/")+2);
+		if(treepath!="") treename = treepath+"/"+treename;
+	}
+	if(filelist.empty()){
+		std::cerr<<"MTreeReader::EnablePrefetch error: prefetching requires a tree read from file"<<std::endl;
+		return 0;
+	}
+	
+	// the background thread will be reading files while the main thread is using ROOT
+	ROOT::EnableThreadSafety();
+	
+	// one slot for the current entry, one for each entry read ahead,
+	// and a spare in case the worker is busy reading an entry we turn out not to need
+	prefetcher = new MTreeReaderPrefetcher;
+	prefetcher->num_ahead = num_entries;
+	prefetcher->num_entries = thetree->GetEntries();
+	prefetcher->slots.resize(num_entries+2);
+	for(auto&& aslot : prefetcher->slots){
+		MTreeReader* slotreader = new MTreeReader;
+		aslot.reader = slotreader;
+		slotreader->SetVerbosity(0);
+		int ok = (chain) ? slotreader->Load(filelist, treename) : slotreader->Load(filelist.front(), treename);
+		// the slots must have the same branches, in the same order, as we do
+		bool matched = (ok && slotreader->branch_infos.size()==branch_infos.size());
+		for(size_t branch_i=0; matched && branch_i<branch_infos.size(); ++branch_i){
+			matched = (slotreader->branch_infos[branch_i].name==branch_infos[branch_i].name);
+		}
+		if(not matched){
+			std::cerr<<"MTreeReader::EnablePrefetch error: failed to open a matching copy of tree "
+					 <<treename<<" for prefetching"<<std::endl;
+			StopPrefetchThread();
+			return 0;
+		}
+		// with the same branch status and options
+		for(size_t branch_i=0; branch_i<branch_infos.size(); ++branch_i){
+			if(not branch_infos[branch_i].enabled){
+				slotreader->SetBranchStatus(slotreader->branch_infos[branch_i], false);
+			}
+		}
+		slotreader->SetAutoClear(autoclear);
+		slotreader->SetClearPolicy(clear_policy);
+	}
+	
+	prefetcher->worker = std::thread(&MTreeReaderPrefetcher::Work, prefetcher);
+	if(verbosity) std::cout<<"MTreeReader prefetching "<<num_entries<<" entries"<<std::endl;
+	
+	return 1;
+}
+
+void MTreeReader::DisablePrefetch(){
+	if(prefetcher==nullptr) return;
+	StopPrefetchThread();
+	// go back to our own buffers. Anything obtained for the current entry is invalidated.
+	// (our TBranches were those of the prefetch readers, so force them to be refreshed)
+	currentTreeNumber = -1;
+	ReloadCurrentEntry();
+}
+
+int MTreeReader::ReloadCurrentEntry(){
+	// re-read the current entry into our buffers, after they've been used for something else
+	// (if no entry has been read yet, just make sure we have the first tree)
+	bool have_entry = (currentEntryNumber!=static_cast<uint64_t>(-1));
+	int status = thetree->LoadTree((have_entry) ? currentEntryNumber : 0);
+	if(status<0){
+		std::cerr<<"MTreeReader error reloading entry "<<currentEntryNumber<<std::endl;
+		return 0;
+	}
+	currentLocalEntry = status;
+	if(currentTreeNumber!=thetree->GetTreeNumber()){
+		currentTreeNumber = thetree->GetTreeNumber();
+		thefile = thetree->GetCurrentFile();
+		RefreshBranches();
+	}
+	// in lazy mode branches will be re-read as they're accessed
+	for(auto&& info : branch_infos) info.loaded_entry = -1;
+	++dims_generation;
+	if(column_cache) return (have_entry) ? GetCachedEntry(currentEntryNumber) : 1;
+	if(lazy_reading || not have_entry) return 1;
+	if(thetree->GetEntry(currentEntryNumber)<0) return 0;
+	for(auto&& info : branch_infos) info.loaded_entry = currentEntryNumber;
+	UpdateBranchPointers(true);
+	return 1;
+}
+
+void MTreeReader::StopPrefetchThread(){
+	if(prefetcher==nullptr) return;
+	if(prefetcher->worker.joinable()){
+		{
+			std::unique_lock<std::mutex> lock(prefetcher->mtx);
+			prefetcher->stop = true;
+		}
+		prefetcher->cv.notify_all();
+		prefetcher->worker.join();
+	}
+	for(auto&& aslot : prefetcher->slots) delete aslot.reader;
+	delete prefetcher;
+	prefetcher = nullptr;
+}
+
+bool MTreeReader::GetPrefetching(){
+	return (prefetcher!=nullptr);
+}
+
+void MTreeReader::SetPrefetchSource(std::function<std::vector<long>(int)> upcoming_entries_fn){
+	if(prefetcher==nullptr){
+		std::cerr<<"MTreeReader::SetPrefetchSource called, but prefetching is not enabled"<<std::endl;
+		return;
+	}
+	// the change only affects which entries we queue next, so no need to stop the worker
+	std::unique_lock<std::mutex> lock(prefetcher->mtx);
+	prefetcher->upcoming_entries_fn = upcoming_entries_fn;
+}
+
+int MTreeReader::GetPrefetchedEntry(long entry_number){
+	// work out which entries come next, so they can be read while this one is processed
+	std::vector<long> upcoming;
+	if(prefetcher->upcoming_entries_fn){
+		upcoming = prefetcher->upcoming_entries_fn(prefetcher->num_ahead);
+	} else {
+		for(long next_entry=entry_number+1; next_entry<=entry_number+prefetcher->num_ahead; ++next_entry){
+			upcoming.push_back(next_entry);
+		}
+	}
+	// don't try to read off the end of the tree
+	long num_entries = prefetcher->num_entries;
+	upcoming.erase(std::remove_if(upcoming.begin(), upcoming.end(),
+	               [num_entries](long next_entry){ return next_entry<0 || next_entry>=num_entries; }),
+	               upcoming.end());
+	if(upcoming.size()>size_t(prefetcher->num_ahead)) upcoming.resize(prefetcher->num_ahead);
+	
+	// get the slot with our entry, waiting for it to be read if necessary
+	MTreeReaderPrefetcher::Slot& slot = prefetcher->Acquire(entry_number, upcoming);
+	if(slot.status>0) FlipBuffers(*slot.reader);
+	return slot.status;
+}
+
+void MTreeReader::FlipBuffers(const MTreeReader& source){
+	// point our branches at the buffers of the reader holding the new entry.
+	// The TBranches and TLeaves are taken too, so that pointer updates and reads of
+	// individual branches (e.g. when re-enabling a branch after learning) use the right buffers.
+	for(size_t branch_i=0; branch_i<branch_infos.size(); ++branch_i){
+		BranchInfo& info = branch_infos[branch_i];
+		const BranchInfo& sourceinfo = source.branch_infos[branch_i];
+		info.branch = sourceinfo.branch;
+		info.leaf = sourceinfo.leaf;
+		info.value_pointer = sourceinfo.value_pointer;
+		info.loaded_entry = source.currentEntryNumber;
+	}
+	currentEntryNumber = source.currentEntryNumber;
+	currentLocalEntry = source.currentLocalEntry;
+	currentTreeNumber = source.currentTreeNumber;
+}
+
+int MTreeReader::RefreshBranches(){
+	// when a TChain moves to a new TTree, get the TBranches and TLeaves of the new tree.
+	// If it has the same structure as the tree we parsed, they can be found by position.
+	TTree* currenttree = thetree->GetTree();
+	TObjArray* branches = currenttree->GetListOfBranches();
+	bool same_structure = (schema && GetTreeStructure(currenttree)==schema->structure);
+	int success=1;
+	for(auto&& info : branch_infos){
+		TBranch* br = (same_structure) ? (TBranch*)branches->At(info.tree_index)
+		                               : currenttree->GetBranch(info.name.c_str());
+		if(br==nullptr){
+			std::cerr<<"MTreeReader error: no branch "<<info.name<<" in tree "
+					 <<currentTreeNumber<<" of TChain!"<<std::endl;
+			success=0;
+			continue;
+		}
+		info.branch = br;
+		info.leaf = (TLeaf*)br->GetListOfLeaves()->At(0);
+		info.loaded_entry = -1;
+	}
+	if(not success) return success;
+	// the new tree may have larger arrays, and will have new objects
+	return BindBranches();
+}
+
+int MTreeReader::EnableColumnCache(std::string cachefile){
+	DisableColumnCache();
+	// the file format is little-endian, and values are used in place
+	uint16_t endian_test = 1;
+	if(*reinterpret_cast<char*>(&endian_test)!=1){
+		std::cerr<<"MTreeReader::EnableColumnCache: column caches are only supported on little-endian hosts"<<std::endl;
+		return 0;
+	}
+	if(learning_entries>0){
+		std::cerr<<"MTreeReader::EnableColumnCache: please finish learning branches before enabling"
+				 <<" the column cache"<<std::endl;
+		return 0;
+	}
+	// every entry will be read from the cache, so there's nothing to read ahead or skip
+	if(prefetcher){
+		std::cerr<<"MTreeReader::EnableColumnCache: disabling prefetching"<<std::endl;
+		DisablePrefetch();
+	}
+	if(lazy_reading){
+		std::cerr<<"MTreeReader::EnableColumnCache: disabling lazy reading"<<std::endl;
+		SetLazyReading(false);
+	}
+	
+	std::string cachekey = GetColumnCacheKey();
+	if(cachekey=="") return 0;
+	if(not MapColumnCache(cachefile, cachekey)){
+		if(verbosity) std::cout<<"MTreeReader building column cache "<<cachefile<<std::endl;
+		if(not BuildColumnCache(cachefile, cachekey) || not MapColumnCache(cachefile, cachekey)){
+			std::cerr<<"MTreeReader::EnableColumnCache failed to build column cache "<<cachefile<<std::endl;
+			return 0;
+		}
+	}
+	if(verbosity) std::cout<<"MTreeReader reading "<<column_cache->columns.size()<<" branches of "
+						   <<column_cache->num_entries<<" entries from column cache "<<cachefile<<std::endl;
+	// branches not in the cache can't be read, so don't need tracking
+	track_access = false;
+	// switch the current entry over to the cache
+	return ReloadCurrentEntry();
+}
+
+void MTreeReader::DisableColumnCache(){
+	if(column_cache==nullptr) return;
+	delete column_cache;
+	column_cache = nullptr;
+	// point our branches back at our own buffers, and re-read the current entry into them
+	for(auto&& info : branch_infos) if(info.learned_disabled) track_access = true;
+	currentTreeNumber = -1;
+	ReloadCurrentEntry();
+}
+
+bool MTreeReader::GetColumnCaching(){
+	return (column_cache!=nullptr);
+}
+
+std::string MTreeReader::GetColumnCacheKey(){
+	// a cache is valid for the same input files, unchanged, and the same enabled branches
+	std::vector<std::string> filenames;
+	TChain* achain = dynamic_cast<TChain*>(thetree);
+	if(achain){
+		TObjArray* files = achain->GetListOfFiles();
+		for(int file_i=0; file_i<files->GetEntriesFast(); ++file_i){
+			filenames.push_back(files->At(file_i)->GetTitle());
+		}
+	} else if(thetree->GetCurrentFile()){
+		filenames.push_back(thetree->GetCurrentFile()->GetName());
+	}
+	std::string cachekey = thetree->GetName();
+	for(auto&& afile : filenames){
+		struct stat filestat;
+		if(stat(afile.c_str(), &filestat)!=0){
+			std::cerr<<"MTreeReader column cache: could not stat input file "<<afile
+					 <<"; column caches require local input files"<<std::endl;
+			return "";
+		}
+		cachekey += " "+afile+" "+std::to_string(filestat.st_size)+" "+std::to_string(filestat.st_mtime);
+	}
+	for(auto&& info : branch_infos){
+		if(info.enabled) cachekey += " "+info.name+":"+info.type+":"+info.title;
+	}
+	// the key is one line of the file header
+	std::replace(cachekey.begin(), cachekey.end(), '\n', ' ');
+	return cachekey;
+}
+
+int MTreeReader::BuildColumnCache(const std::string& cachefile, const std::string& cachekey){
+	// the columns are all enabled branches
+	std::vector<size_t> column_branches;
+	std::vector<TClass*> column_classes;
+	for(size_t branch_i=0; branch_i<branch_infos.size(); ++branch_i){
+		const BranchInfo& info = branch_infos[branch_i];
+		if(not info.enabled) continue;
+		TClass* objclass = nullptr;
+		if(info.isobject){
+			objclass = TClass::GetClass(info.type.c_str());
+			if(objclass==nullptr){
+				std::cerr<<"MTreeReader::BuildColumnCache: no class "<<info.type<<" for branch "
+						 <<info.name<<"; please disable it or make a dictionary"<<std::endl;
+				return 0;
+			}
+		}
+		column_branches.push_back(branch_i);
+		column_classes.push_back(objclass);
+	}
+	size_t num_columns = column_branches.size();
+	
+	// read every entry as usual, appending the values of each column to one temporary file
+	// and the offsets of each entry to another. These are put together once we know their sizes.
+	std::vector<std::string> tempnames;
+	std::vector<std::unique_ptr<std::ofstream>> tempfiles;
+	for(size_t col_i=0; col_i<num_columns; ++col_i){
+		for(std::string suffix : {".data", ".offsets"}){
+			tempnames.push_back(cachefile+"."+std::to_string(col_i)+suffix);
+			tempfiles.emplace_back(new std::ofstream(tempnames.back(), std::ios::binary | std::ios::trunc));
+		}
+	}
+	std::vector<uint64_t> column_sizes(num_columns, 0);
+	for(size_t col_i=0; col_i<num_columns; ++col_i){
+		tempfiles[2*col_i+1]->write(reinterpret_cast<const char*>(&column_sizes[col_i]), sizeof(uint64_t));
+	}
+	long num_entries = thetree->GetEntries();
+	int success=1;
+	for(long entry=0; success && entry<num_entries; ++entry){
+		if(GetEntry(entry)<=0){
+			std::cerr<<"MTreeReader::BuildColumnCache error reading entry "<<entry<<std::endl;
+			success=0;
+			break;
+		}
+		for(size_t col_i=0; col_i<num_columns; ++col_i){
+			const BranchInfo& info = branch_infos[column_branches[col_i]];
+			if(info.isobject){
+				// objects are stored as they would be in a basket, but uncompressed
+				TBufferFile objbuffer(TBuffer::kWrite);
+				column_classes[col_i]->Streamer(reinterpret_cast<void*>(info.value_pointer), objbuffer);
+				tempfiles[2*col_i]->write(objbuffer.Buffer(), objbuffer.Length());
+				column_sizes[col_i] += objbuffer.Length();
+			} else {
+				// for arrays this is the total length over all dimensions, and for leaf lists over all leaves
+				size_t num_bytes = GetEntrySize(info.branch);
+				tempfiles[2*col_i]->write(reinterpret_cast<const char*>(info.value_pointer), num_bytes);
+				column_sizes[col_i] += num_bytes;
+			}
+			tempfiles[2*col_i+1]->write(reinterpret_cast<const char*>(&column_sizes[col_i]), sizeof(uint64_t));
+		}
+	}
+	for(auto&& atempfile : tempfiles){
+		atempfile->close();
+		if(atempfile->fail()) success=0;
+	}
+	
+	// put the header and the temporary files together.
+	// Write to a temporary name first, so that an interrupted build doesn't leave a partial cache.
+	std::string partname = cachefile+".part";
+	if(success){
+		std::ofstream cache(partname, std::ios::binary | std::ios::trunc);
+		cache<<column_cache_header<<"\n"<<cachekey<<"\n"<<num_entries<<" "<<num_columns<<"\n";
+		for(size_t col_i=0; col_i<num_columns; ++col_i){
+			cache<<branch_infos[column_branches[col_i]].name<<" "<<column_sizes[col_i]<<"\n";
+		}
+		cache<<"data\n";
+		const char padding[8] = {0};
+		for(auto&& atempname : tempnames){
+			uint64_t position = cache.tellp();
+			cache.write(padding, AlignColumn(position)-position);
+			std::ifstream atempfile(atempname, std::ios::binary);
+			if(atempfile.peek()!=std::ifstream::traits_type::eof()) cache<<atempfile.rdbuf();
+		}
+		cache.close();
+		if(cache.fail()){
+			std::cerr<<"MTreeReader::BuildColumnCache error writing "<<partname<<std::endl;
+			success=0;
+		}
+	}
+	for(auto&& atempname : tempnames) std::remove(atempname.c_str());
+	if(success && std::rename(partname.c_str(), cachefile.c_str())!=0){
+		std::cerr<<"MTreeReader::BuildColumnCache failed to move "<<partname<<" to "<<cachefile<<std::endl;
+		success=0;
+	}
+	if(not success) std::remove(partname.c_str());
+	
+	return success;
+}
+
+int MTreeReader::MapColumnCache(const std::string& cachefile, const std::string& cachekey){
+	// returns 0 without complaint if there's no usable cache: the caller should then build it
+	std::ifstream header(cachefile, std::ios::binary);
+	if(not header.is_open()) return 0;
+	std::string line, filekey;
+	std::getline(header, line);
+	std::getline(header, filekey);
+	if(line!=column_cache_header || filekey!=cachekey){
+		if(verbosity) std::cout<<"MTreeReader column cache "<<cachefile<<" is out of date"<<std::endl;
+		return 0;
+	}
+	long num_entries=0;
+	size_t num_columns=0;
+	header >> num_entries >> num_columns;
+	std::vector<std::pair<std::string,uint64_t>> columns(num_columns);
+	for(auto&& acolumn : columns) header >> acolumn.first >> acolumn.second;
+	std::getline(header, line);
+	std::getline(header, line);
+	if(not header.good() || line!="data"){
+		std::cerr<<"MTreeReader column cache "<<cachefile<<" has a malformed header"<<std::endl;
+		return 0;
+	}
+	uint64_t position = header.tellg();
+	header.close();
+	
+	int fd = open(cachefile.c_str(), O_RDONLY);
+	struct stat filestat;
+	if(fd<0 || fstat(fd, &filestat)!=0){
+		std::cerr<<"MTreeReader failed to open column cache "<<cachefile<<std::endl;
+		if(fd>=0) close(fd);
+		return 0;
+	}
+	// mapped privately, so that objects can be streamed from it without touching the file
+	void* mapped = mmap(nullptr, filestat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapped==MAP_FAILED){
+		std::cerr<<"MTreeReader failed to map column cache "<<cachefile<<std::endl;
+		return 0;
+	}
+	std::unique_ptr<MTreeColumnCache> cache(new MTreeColumnCache);
+	cache->mapped = mapped;
+	cache->mapped_size = filestat.st_size;
+	cache->num_entries = num_entries;
+	const char* base = static_cast<const char*>(mapped);
+	for(auto&& acolumn : columns){
+		MTreeColumnCache::Column column;
+		auto it = branch_indices.find(acolumn.first);
+		if(it==branch_indices.end()){
+			std::cerr<<"MTreeReader column cache "<<cachefile<<" has unknown branch "<<acolumn.first<<std::endl;
+			return 0;
+		}
+		column.branch_index = it->second;
+		const BranchInfo& info = branch_infos[column.branch_index];
+		if(info.isobject) column.objclass = TClass::GetClass(info.type.c_str());
+		position = AlignColumn(position);
+		column.data = base+position;
+		position = AlignColumn(position+acolumn.second);
+		column.offsets = reinterpret_cast<const uint64_t*>(base+position);
+		position += (num_entries+1)*sizeof(uint64_t);
+		if(position>cache->mapped_size){
+			std::cerr<<"MTreeReader column cache "<<cachefile<<" is truncated"<<std::endl;
+			return 0;
+		}
+		cache->columns.push_back(column);
+	}
+	column_cache = cache.release();
+	return 1;
+}
+
+int MTreeReader::GetCachedEntry(long entry_number){
+	if(entry_number<0 || entry_number>=column_cache->num_entries) return 0;
+	if(autoclear && not Clear()) return -10;
+	uint64_t bytesread=0;
+	for(auto&& acolumn : column_cache->columns){
+		BranchInfo& info = branch_infos[acolumn.branch_index];
+		uint64_t offset = acolumn.offsets[entry_number];
+		uint64_t num_bytes = acolumn.offsets[entry_number+1]-offset;
+		char* values = const_cast<char*>(acolumn.data+offset);
+		if(acolumn.objclass){
+			TBufferFile objbuffer(TBuffer::kRead, num_bytes, values, false);
+			acolumn.objclass->Streamer(reinterpret_cast<void*>(info.value_pointer), objbuffer);
+		} else {
+			info.value_pointer = reinterpret_cast<intptr_t>(values);
+		}
+		info.loaded_entry = entry_number;
+		bytesread += num_bytes;
+	}
+	currentEntryNumber = entry_number;
+	return (bytesread>0) ? bytesread : 1;
+}
+
+void MTreeReader::AccessBranch(BranchInfo& info){
+	// arrays also need the branches holding their dimensions
+	for(size_t dim_i=0; dim_i<info.dimensions.size(); ++dim_i){
+		if(info.dimensions[dim_i].first!="") AccessBranch(branch_infos[info.dim_branch_indices[dim_i]]);
+	}
+	// if we're learning, note that this branch is used
+	if(learning_entries>0) info.accessed = true;
+	
+	bool needs_read = lazy_reading;
+	if(info.learned_disabled){
+		// we were wrong about this branch being unused. Re-enable it and read it now.
+		std::cerr<<"MTreeReader warning: branch "<<info.name<<" was disabled as unused after learning, "
+				 <<"but has now been accessed. Re-enabling it; consider learning over more entries"<<std::endl;
+		SetBranchStatus(info, true);
+		info.learned_disabled = false;
+		needs_read = true;
+	}
+	
+	// read the branch if we haven't already for this entry
+	if(needs_read && info.loaded_entry!=static_cast<long>(currentEntryNumber)) ReadBranch(info);
+}
+
+int MTreeReader::ReadBranch(BranchInfo& info){
+	int bytesread = info.branch->GetEntry(currentLocalEntry);
+	if(bytesread<0){
+		std::cerr<<"MTreeReader error reading branch "<<info.name<<" for entry "
+				 <<currentEntryNumber<<std::endl;
+		return bytesread;
+	}
+	info.loaded_entry = currentEntryNumber;
+	// buffers may be (re)allocated on reading
+	UpdateBranchPointer(info);
+	return bytesread;
+}
+
+void MTreeReader::SetLazyReading(bool lazyin){
+	if(lazyin && prefetcher){
+		std::cerr<<"MTreeReader warning: lazy reading is not compatible with prefetching, "
+				 <<"ignoring SetLazyReading"<<std::endl;
+		return;
+	}
+	if(lazyin && column_cache){
+		std::cerr<<"MTreeReader warning: lazy reading is not compatible with a column cache, "
+				 <<"ignoring SetLazyReading"<<std::endl;
+		return;
+	}
+	lazy_reading = lazyin;
+	track_access = (lazy_reading || learning_entries>0);
+	if(lazy_reading) return;
+	// we may have skipped reading branches for the current entry: read them now
+	for(auto&& info : branch_infos){
+		if(info.enabled && info.loaded_entry!=static_cast<long>(currentEntryNumber)) ReadBranch(info);
+	}
+}
+
+bool MTreeReader::GetLazyReading(){
+	return lazy_reading;
+}
+
+void MTreeReader::LearnBranches(int num_entries){
+	if(column_cache){
+		std::cerr<<"MTreeReader warning: branches cannot be learned when reading from a column cache, "
+				 <<"ignoring LearnBranches"<<std::endl;
+		return;
+	}
+	learning_entries = num_entries;
+	for(auto&& info : branch_infos) info.accessed = false;
+	track_access = (lazy_reading || learning_entries>0);
+}
+
+std::vector<std::string> MTreeReader::GetAccessedBranches(){
+	std::vector<std::string> accessed;
+	for(auto&& info : branch_infos){
+		if(info.accessed) accessed.push_back(info.name);
+	}
+	return accessed;
+}
+
+void MTreeReader::StopLearning(){
+	// disable all branches that were not accessed while learning
+	int num_disabled=0;
+	for(auto&& info : branch_infos){
+		if(info.accessed || not info.enabled) continue;
+		SetBranchStatus(info, false);
+		info.learned_disabled = true;
+		++num_disabled;
+	}
+	learning_entries = 0;
+	// we still need to track accesses, to catch any branches we wrongly disabled
+	track_access = (lazy_reading || num_disabled>0);
+	
+	if(verbosity){
+		std::vector<std::string> accessed = GetAccessedBranches();
+		std::cout<<"MTreeReader finished learning: "<<accessed.size()<<" branches were used, "
+				 <<"disabling "<<num_disabled<<" unused branches"<<std::endl;
+		if(verbosity>1){
+			// print them in a form that can be used in a TreeReader config file
+			std::cout<<"StartInputBranchList\n";
+			for(auto&& abranch : accessed) std::cout<<abranch<<"\n";
+			std::cout<<"EndInputBranchList"<<std::endl;
+		}
+	}
+}
+
+BranchInfo* MTreeReader::GetColumnInfo(const std::string& branchname, const std::type_info& requested_type,
+                                       size_t type_size){
+	// check a branch can be read by ReadColumn as the requested type
+	BranchInfo* info = GetBranchInfo(branchname);
+	if(info==nullptr){
+		std::cerr<<"No such branch "<<branchname<<std::endl;
+		return nullptr;
+	}
+	if(info->isobject){
+		std::cerr<<"Branch "<<branchname<<" holds objects; ReadColumn only supports primitives"
+				 <<" and arrays of primitives"<<std::endl;
+		return nullptr;
+	}
+	if(not CheckBranchType(*info, requested_type)) return nullptr;
+	// we copy the raw values, so the sizes must match even if the type could not be checked
+	if(int(type_size)!=info->leaf->GetLenType()){
+		std::cerr<<"Branch "<<branchname<<" holds values of "<<info->leaf->GetLenType()
+				 <<" bytes, but ReadColumn was called with a type of "<<type_size<<" bytes"<<std::endl;
+		return nullptr;
+	}
+	return info;
+}
+
+int MTreeReader::ReadColumnData(BranchInfo& info, long first_entry, long num_entries, size_t type_size,
+                                const column_appender& append, std::vector<size_t>* offsets){
+	long last_entry = (num_entries<0) ? thetree->GetEntries() : first_entry+num_entries;
+	if(offsets){
+		offsets->clear();
+		offsets->push_back(0);
+	}
+	// when prefetching, our branches are those of the prefetch buffers. Use our own.
+	if(prefetcher) currentTreeNumber = -1;
+	
+	int success=1;
+	long entry = first_entry;
+	while(success && entry<last_entry){
+		// if processing a TChain, each TTree needs reading separately
+		long local_entry = thetree->LoadTree(entry);
+		if(local_entry<0){
+			std::cerr<<"MTreeReader::ReadColumn error loading entry "<<entry<<" for branch "
+					 <<info.name<<"; LoadTree returned "<<local_entry<<std::endl;
+			success=0;
+			break;
+		}
+		TTree* currenttree = thetree->GetTree();
+		// if we've moved to a new tree, our branches (and possibly buffers) need updating
+		if(currentTreeNumber!=thetree->GetTreeNumber()){
+			currentTreeNumber = thetree->GetTreeNumber();
+			thefile = thetree->GetCurrentFile();
+			if(not RefreshBranches()){
+				success=0;
+				break;
+			}
+		}
+		TBranch* br = info.branch;
+		TLeaf* lf = info.leaf;
+		long tree_first_entry = entry-local_entry;
+		long local_last = std::min<long>(currenttree->GetEntries(), last_entry-tree_first_entry);
+		
+#ifdef MTREEREADER_BULKIO
+		// scalars can be read a basket at a time
+		if(not info.isarray) local_entry = ReadColumnBulk(br, local_entry, local_last, type_size, append, offsets);
+#endif
+		// otherwise, or if bulk reading isn't supported for this branch, read entry by entry.
+		// we read just this branch (and its size branch, if any), regardless of branch status.
+		TBranch* sizebranch = (lf->GetLeafCount()) ? lf->GetLeafCount()->GetBranch() : nullptr;
+		size_t num_values = (offsets) ? offsets->back() : 0;
+		for(; local_entry<local_last; ++local_entry){
+			if((sizebranch && sizebranch->GetEntry(local_entry,1)<0) || br->GetEntry(local_entry,1)<0){
+				std::cerr<<"MTreeReader::ReadColumn error reading branch "<<info.name<<" entry "
+						 <<(tree_first_entry+local_entry)<<std::endl;
+				success=0;
+				break;
+			}
+			// for arrays this is the total length over all dimensions
+			size_t len = lf->GetLen();
+			std::memcpy(append(len), lf->GetValuePointer(), len*type_size);
+			num_values += len;
+			if(offsets) offsets->push_back(num_values);
+		}
+		entry = tree_first_entry+local_last;
+	}
+	
+	// we've been using our buffers; restore the current entry.
+	// (when prefetching, the current entry is in another set of buffers, so just switch back to it)
+	if(prefetcher==nullptr){
+		ReloadCurrentEntry();
+	} else if(prefetcher->current_slot>=0){
+		FlipBuffers(*prefetcher->slots[prefetcher->current_slot].reader);
+	}
+	
+	return success;
+}
+
+long MTreeReader::ReadColumnBulk(TBranch* br, long first_entry, long last_entry, size_t type_size,
+                                 const column_appender& append, std::vector<size_t>* offsets){
+	// read scalar values a basket at a time with ROOT's bulk I/O.
+	// returns the entry up to which we got, which is first_entry if bulk reading isn't supported.
+#ifdef MTREEREADER_BULKIO
+	TBufferFile buffer(TBuffer::kWrite, 32*1024);
+	// bulk reads must start from the first entry of a basket
+	Long64_t* basket_entries = br->GetBasketEntry();
+	Long64_t num_baskets = br->GetWriteBasket();
+	long entry = first_entry;
+	while(entry<last_entry){
+		Long64_t basket_i = TMath::BinarySearch(num_baskets, basket_entries, Long64_t(entry));
+		if(basket_i<0) break;
+		long basket_first = basket_entries[basket_i];
+		int num_read = br->GetBulkRead().GetBulkEntries(basket_first, buffer);
+		if(num_read<=0) break;
+		// skip any entries before the range we want, and stop at the end of the range
+		long skip = entry-basket_first;
+		long num_values = std::min<long>(num_read-skip, last_entry-entry);
+		if(num_values<=0) break;
+		std::memcpy(append(num_values), buffer.GetCurrent()+skip*type_size, num_values*type_size);
+		if(offsets){
+			for(long value_i=0; value_i<num_values; ++value_i) offsets->push_back(offsets->back()+1);
+		}
+		entry += num_values;
+	}
+	return entry;
+#else
+	return first_entry;
+#endif
+}
+
+int MTreeReader::BuildEventIndex(MTreeEventIndex& index, std::string sidecar_dir, std::vector<std::string> keynames){
+	if(keynames.size()!=3){
+		std::cerr<<"MTreeReader::BuildEventIndex requires the names of 3 leaves, for the run, subrun and"
+				 <<" event numbers, but was given "<<keynames.size()<<std::endl;
+		return 0;
+	}
+	index.Clear();
+	long total_entries = thetree->GetEntries();
+	long num_read=0;
+	int success=1;
+	long entry = 0;
+	std::vector<int> keys;
+	while(success && entry<total_entries){
+		// each file of a TChain has its own sidecar
+		long local_entry = thetree->LoadTree(entry);
+		if(local_entry<0){
+			std::cerr<<"MTreeReader::BuildEventIndex error loading entry "<<entry
+					 <<"; LoadTree returned "<<local_entry<<std::endl;
+			success=0;
+			break;
+		}
+		TTree* currenttree = thetree->GetTree();
+		TFile* currentfile = currenttree->GetCurrentFile();
+		long tree_entries = currenttree->GetEntries();
+		std::string filename = currentfile->GetName();
+		std::string sidecarname = filename;
+		if(sidecar_dir!=""){
+			sidecarname = sidecar_dir+"/"+filename.substr(filename.find_last_of('/')+1);
+		}
+		sidecarname += "."+std::string(currenttree->GetName())+".evtidx";
+		// the file is identified by the UUID written on creation and its size, which changes
+		// when it's updated. A checksum of the contents would need the whole file to be read.
+		std::string filekey = std::string(currentfile->GetUUID().AsString())+" "
+		                      +std::to_string(currentfile->GetSize())+" "
+		                      +keynames.at(0)+" "+keynames.at(1)+" "+keynames.at(2);
+		
+		if(not MTreeEventIndex::ReadSidecar(sidecarname, filekey, tree_entries, keys)){
+			// read just the branches holding the keys, regardless of branch status
+			if(not ReadLeaves(keynames, entry, tree_entries, keys)){
+				std::cerr<<"MTreeReader::BuildEventIndex failed to read the keys of file "<<filename<<std::endl;
+				success=0;
+				break;
+			}
+			num_read += tree_entries;
+			// failing to save the keys (e.g. to a read-only directory) just means reading them again next time
+			if(not MTreeEventIndex::WriteSidecar(sidecarname, filekey, keys) && verbosity){
+				std::cerr<<"MTreeReader::BuildEventIndex could not save the event index of "<<filename
+						 <<"; specify a writable directory to keep it"<<std::endl;
+			}
+		}
+		index.AddKeys(keys, entry);
+		entry += tree_entries;
+	}
+	if(success) index.Sort();
+	if(verbosity>1) std::cout<<"MTreeReader indexed "<<index.size()<<" entries, of which "<<num_read
+							 <<" were read from the tree"<<std::endl;
+	
+	// we've been using our buffers; restore the current entry.
+	// (when prefetching, our branches are those of the prefetch buffers and were not used)
+	if(prefetcher==nullptr) ReloadCurrentEntry();
+	
+	return success;
+}
+
+int MTreeReader::ReadLeafValues(std::vector<std::string> leafnames, long first_entry, long num_entries,
+                                std::vector<int>& values){
+	int success = ReadLeaves(leafnames, first_entry, num_entries, values);
+	
+	// we've been using our buffers; restore the current entry.
+	// (when prefetching, our branches are those of the prefetch buffers and were not used)
+	if(prefetcher==nullptr) ReloadCurrentEntry();
+	
+	return success;
+}
+
+int MTreeReader::ReadLeaves(const std::vector<std::string>& leafnames, long first_entry, long num_entries,
+                            std::vector<int>& values){
+	values.clear();
+	long total_entries = thetree->GetEntries();
+	if(first_entry<0 || first_entry>total_entries){
+		std::cerr<<"MTreeReader::ReadLeafValues called with first entry "<<first_entry
+				 <<" of a tree with "<<total_entries<<" entries"<<std::endl;
+		return 0;
+	}
+	if(num_entries<0 || (first_entry+num_entries)>total_entries) num_entries = total_entries-first_entry;
+	size_t num_leaves = leafnames.size();
+	values.resize(num_entries*num_leaves);
+	
+	long entry = first_entry;
+	long last_entry = first_entry+num_entries;
+	while(entry<last_entry){
+		// leaves must be looked up in each file of a TChain
+		long local_entry = thetree->LoadTree(entry);
+		if(local_entry<0){
+			std::cerr<<"MTreeReader::ReadLeafValues error loading entry "<<entry
+					 <<"; LoadTree returned "<<local_entry<<std::endl;
+			return 0;
+		}
+		TTree* currenttree = thetree->GetTree();
+		std::vector<TLeaf*> leaves;
+		std::vector<TBranch*> branches;
+		for(auto&& aleafname : leafnames){
+			TLeaf* lf = currenttree->FindLeaf(aleafname.c_str());
+			if(lf==nullptr){
+				std::cerr<<"MTreeReader::ReadLeafValues found no leaf "<<aleafname<<" in tree "
+						 <<currenttree->GetName()<<" of file "<<currenttree->GetCurrentFile()->GetName()<<std::endl;
+				return 0;
+			}
+			leaves.push_back(lf);
+			// leaves may be in the same branch
+			if(std::find(branches.begin(), branches.end(), lf->GetBranch())==branches.end()){
+				branches.push_back(lf->GetBranch());
+			}
+		}
+		long tree_last_entry = std::min(last_entry, long(entry-local_entry+currenttree->GetEntries()));
+		for(; entry<tree_last_entry; ++entry, ++local_entry){
+			for(auto&& abranch : branches){
+				if(abranch->GetEntry(local_entry,1)<0){
+					std::cerr<<"MTreeReader::ReadLeafValues error reading branch "<<abranch->GetName()
+							 <<" entry "<<entry<<std::endl;
+					return 0;
+				}
+			}
+			int* entry_values = values.data()+(entry-first_entry)*num_leaves;
+			for(size_t leaf_i=0; leaf_i<num_leaves; ++leaf_i){
+				entry_values[leaf_i] = static_cast<int>(leaves[leaf_i]->GetValue(0));
+			}
+		}
+	}
+	return 1;
+}
+
+std::pair<long,long> MTreeReader::GetShardRange(int shard_index, int num_shards, long first_entry, long last_entry){
+	if(num_shards<1 || shard_index<0 || shard_index>=num_shards){
+		std::cerr<<"MTreeReader::GetShardRange called for shard "<<shard_index<<" of "<<num_shards<<std::endl;
+		return std::pair<long,long>{-1,-1};
+	}
+	long total_entries = thetree->GetEntries();
+	if(last_entry<0 || last_entry>total_entries) last_entry = total_entries;
+	if(first_entry<0) first_entry = 0;
+	if(first_entry>=last_entry) return std::pair<long,long>{first_entry,first_entry};
+	
+	// the cluster boundaries within the range, over all files of a TChain.
+	// Only the tree metadata is needed for this.
+	std::vector<long> boundaries;
+	long entry = 0;
+	while(entry<last_entry){
+		if(thetree->LoadTree(entry)<0){
+			std::cerr<<"MTreeReader::GetShardRange error loading entry "<<entry<<std::endl;
+			break;
+		}
+		TTree* currenttree = thetree->GetTree();
+		long tree_entries = currenttree->GetEntries();
+		if(entry+tree_entries>first_entry){
+			TTree::TClusterIterator clusters = currenttree->GetClusterIterator(0);
+			long cluster_start;
+			while((cluster_start=clusters())<tree_entries){
+				long boundary = entry+cluster_start;
+				if(boundary>first_entry && boundary<last_entry) boundaries.push_back(boundary);
+			}
+		}
+		entry += tree_entries;
+	}
+	if(prefetcher==nullptr) ReloadCurrentEntry();
+	
+	// each shard starts on the first boundary at or after its share of the entries
+	auto shard_start = [&](int shard_i) -> long {
+		if(shard_i==0) return first_entry;
+		if(shard_i==num_shards) return last_entry;
+		long target = first_entry + ((last_entry-first_entry)*shard_i)/num_shards;
+		auto it = std::lower_bound(boundaries.begin(), boundaries.end(), target);
+		return (it==boundaries.end()) ? last_entry : *it;
+	};
+	return std::pair<long,long>{shard_start(shard_index), shard_start(shard_index+1)};
+}
+
 long MTreeReader::GetEntriesFast(){
 	return thetree->GetEntriesFast();
 }
@@ -457,6 +1759,8 @@ long MTreeReader::GetEntries(){
 }
 
 MTreeReader::~MTreeReader(){
+	StopPrefetchThread();
+	delete column_cache;
 	//if(thechain) thechain->ResetBranchAddresses();  // are these mutually exclusive?
 	if(thetree) thetree->ResetBranchAddresses();      // 
 	if(thefile) thefile->Close();
@@ -478,6 +1782,11 @@ void MTreeReader::SetVerbosity(int verbin){
 
 void MTreeReader::SetAutoClear(bool autoclearin){
 	autoclear=autoclearin;
+	// when prefetching, clearing is done by the readers of each buffer
+	if(prefetcher){
+		prefetcher->Drain();
+		for(auto&& aslot : prefetcher->slots) aslot.reader->SetAutoClear(autoclear);
+	}
 }
 
 // file/tree level getters
@@ -513,23 +1822,30 @@ uint64_t MTreeReader::GetEntryNumber(){
 	return currentEntryNumber;
 }
 
-// branch map getters
+// branch map getters - these are built on request, so are not intended for per-entry use
 std::map<std::string,std::string> MTreeReader::GetBranchTypes(){
+	std::map<std::string,std::string> branch_types;
+	for(auto&& info : branch_infos) branch_types.emplace(info.name, info.type);
 	return branch_types;
 }
 
 std::map<std::string,std::string> MTreeReader::GetBranchTitles(){
+	std::map<std::string,std::string> branch_titles;
+	for(auto&& info : branch_infos) branch_titles.emplace(info.name, info.title);
 	return branch_titles;
 }
 
 std::map<std::string, intptr_t> MTreeReader::GetBranchAddresses(){
+	std::map<std::string, intptr_t> branch_value_pointers;
+	for(auto&& info : branch_infos) branch_value_pointers.emplace(info.name, info.value_pointer);
 	return branch_value_pointers;
 }
 
 // specific branch getters
 TBranch* MTreeReader::GetBranch(std::string branchname){
-	if(branch_pointers.count(branchname)){
-		return branch_pointers.at(branchname);
+	const BranchInfo* info = GetBranchInfo(branchname);
+	if(info){
+		return info->branch;
 	} else {
 		std::cerr<<"No such branch "<<branchname<<std::endl;
 		return nullptr;
@@ -537,8 +1853,9 @@ TBranch* MTreeReader::GetBranch(std::string branchname){
 }
 
 std::string MTreeReader::GetBranchType(std::string branchname){
-	if(branch_types.count(branchname)){
-		return branch_types.at(branchname);
+	const BranchInfo* info = GetBranchInfo(branchname);
+	if(info){
+		return info->type;
 	} else {
 		std::cerr<<"No such branch "<<branchname<<std::endl;
 		return "";
@@ -550,8 +1867,9 @@ int MTreeReader::DisableBranches(std::vector<std::string> branchnames){
 	int success=1;
 	// disable branches by name
 	for(auto&& branchname : branchnames){
-		if(branch_pointers.count(branchname)){
-			branch_pointers.at(branchname)->SetStatus(0);
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info){
+			SetBranchStatus(*info, false);
 		} else {
 			std::cerr<<"No such branch "<<branchname<<std::endl;
 			success=0;
@@ -564,8 +1882,9 @@ int MTreeReader::EnableBranches(std::vector<std::string> branchnames){
 	int success=1;
 	// disable branches by name
 	for(auto&& branchname : branchnames){
-		if(branch_pointers.count(branchname)){
-			branch_pointers.at(branchname)->SetStatus(1);
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info){
+			SetBranchStatus(*info, true);
 		} else {
 			std::cerr<<"No such branch "<<branchname<<std::endl;
 			success=0;
@@ -577,12 +1896,12 @@ int MTreeReader::EnableBranches(std::vector<std::string> branchnames){
 int MTreeReader::OnlyDisableBranches(std::vector<std::string> branchnames){
 	// enable all branches except those named
 	int num_named_branches=branchnames.size();
-	for(auto&& abranch : branch_pointers){
-		if(std::find(branchnames.begin(),branchnames.end(),abranch.first)!=branchnames.end()){
-			abranch.second->SetStatus(0);
+	for(auto&& info : branch_infos){
+		if(std::find(branchnames.begin(),branchnames.end(),info.name)!=branchnames.end()){
+			SetBranchStatus(info, false);
 			--num_named_branches;
 		} else {
-			abranch.second->SetStatus(1);
+			SetBranchStatus(info, true);
 		}
 	}
 	// return whether we found all branches in the list given
@@ -592,18 +1911,42 @@ int MTreeReader::OnlyDisableBranches(std::vector<std::string> branchnames){
 int MTreeReader::OnlyEnableBranches(std::vector<std::string> branchnames){
 	// disable all branches except those named
 	int num_named_branches=branchnames.size();
-	for(auto&& abranch : branch_pointers){
-		if(std::find(branchnames.begin(),branchnames.end(),abranch.first)!=branchnames.end()){
-			abranch.second->SetStatus(1);
+	for(auto&& info : branch_infos){
+		if(std::find(branchnames.begin(),branchnames.end(),info.name)!=branchnames.end()){
+			SetBranchStatus(info, true);
 			--num_named_branches;
 		} else {
-			abranch.second->SetStatus(0);
+			SetBranchStatus(info, false);
 		}
 	}
 	// return whether we found all branches in the list given
 	return (num_named_branches==0);
 }
 
+int MTreeReader::SetBranchStatus(BranchInfo& info, bool status){
+	// set via the tree rather than the TBranch, so that for a TChain the status is also
+	// applied to subsequent trees, and so that it applies to any sub-branches of split objects
+	thetree->SetBranchStatus(info.name.c_str(), status);
+	info.enabled = status;
+	clear_list_stale = true;
+	// explicitly setting the status overrides anything learned
+	info.learned_disabled = false;
+	// the prefetch buffers need the same status. Stop background reading while we change it.
+	if(prefetcher){
+		prefetcher->Drain();
+		size_t branch_i = &info - branch_infos.data();
+		for(auto&& aslot : prefetcher->slots){
+			MTreeReader* slotreader = aslot.reader;
+			slotreader->SetBranchStatus(slotreader->branch_infos[branch_i], status);
+			// force any entry these buffers already hold to be read again
+			if(aslot.state!=MTreeReaderPrefetcher::SlotState::inuse){
+				slotreader->currentEntryNumber = static_cast<uint64_t>(-1);
+			}
+		}
+	}
+	return 1;
+}
+
 // for SKROOT files this is set in TreeReader tool... is this a good idea?
 void MTreeReader::SetMCFlag(bool MCin){
 	isMC = MCin;
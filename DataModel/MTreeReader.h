@@ -4,7 +4,15 @@
 
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <utility> // pair
+#include <typeinfo>
+#include <functional>
+#include <memory>  // shared_ptr
+#include <cstring> // memcpy
+#include <cstdint> // uint64_t
+#include <algorithm> // fill
 
 #include "basic_array.h"
 
@@ -13,8 +21,64 @@ class TChain;
 class TTree;
 class TBranch;
 class TLeaf;
+template<typename T> class BranchHandle;
+struct MTreeReaderPrefetcher;
+struct MTreeSchema;
+struct MTreeColumnCache;
+class MTreeEventIndex;
+
+// strip all pointers and extents from an array type to get the underlying element type
+// e.g. float* -> float, float(*)[3] -> float
+template<typename T> struct branch_element_type { typedef T type; };
+template<typename T> struct branch_element_type<T*> {
+	typedef typename branch_element_type<T>::type type;
+};
+template<typename T, std::size_t N> struct branch_element_type<T[N]> {
+	typedef typename branch_element_type<T>::type type;
+};
+
+// the dimensions of an array branch for one entry, stored inline so that they can be
+// cached without allocation
+struct BranchDims {
+	static const size_t max_dims=8;
+	size_t dims[max_dims];
+	size_t ndims=0;
+	size_t size() const { return ndims; }
+	size_t operator[](size_t dim_i) const { return dims[dim_i]; }
+	const size_t* data() const { return dims; }
+	const size_t* begin() const { return dims; }
+	const size_t* end() const { return dims+ndims; }
+};
+
+// everything we know about a branch. MTreeReader keeps these in one contiguous table,
+// so that per-entry loops over branches (Clear, UpdateBranchPointers...) walk a dense array.
+struct BranchInfo {
+	std::string name;
+	TBranch* branch=nullptr;
+	TLeaf* leaf=nullptr;
+	std::string title;                 // branch title (including type string)
+	std::string type;                  // string describing type - not good for arrays
+	intptr_t value_pointer=0;          // pointer to value, cast to intptr_t
+	bool isobject=false;               // does branch hold an object
+	bool isarray=false;                // does branch hold a (c-style) array
+	bool istobject=false;              // branch inherits from TObject so has Clear method
+	bool static_dims=false;            // array with only constant dimensions
+	bool enabled=true;                 // branch status
+	long loaded_entry=-1;              // entry number for which the branch was last read, in lazy mode
+	bool accessed=false;               // branch has been accessed, in learning mode
+	bool learned_disabled=false;       // branch was disabled as unused by learning mode
+	// dims of arrays: for each dimension, either the name of the branch holding its size
+	// (variable size) or "" and the size (constant size)
+	std::vector<std::pair<std::string,int>> dimensions;
+	std::vector<size_t> dim_branch_indices; // index in the branch table of the above size branches
+	BranchDims dims_cache;                  // dims of constant sized arrays, or for the current entry
+	uint64_t dims_generation=0;             // value of MTreeReader::dims_generation when dims_cache was filled
+	int tree_index=-1;                      // position in the tree's list of branches
+	std::vector<char> buffer;               // primitives and arrays are read into here
+};
 
 class MTreeReader {
+	template<typename T> friend class BranchHandle;
 	public:
 	
 	MTreeReader(std::string filename, std::string treename);
@@ -30,14 +94,16 @@ class MTreeReader {
 	// get a pointer to an object
 	template<typename T>
 	int GetBranchValue(std::string branchname, const T* &pointer_in){
-		if(branch_value_pointers.count(branchname)==0){
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info==nullptr){
 			std::cerr<<"No such branch "<<branchname<<std::endl;
 			std::cerr<<"known branches: {";
-			for(auto&& abranch : branch_value_pointers) std::cout<<abranch.first<<", ";
+			for(auto&& abranch : branch_infos) std::cout<<abranch.name<<", ";
 			std::cerr<<"\b\b}"<<std::endl;
 			return 0;
 		}
-		pointer_in = reinterpret_cast<const T*>(branch_value_pointers.at(branchname));
+		LoadBranch(*info);
+		pointer_in = reinterpret_cast<const T*>(info->value_pointer);
 		if(verbosity>3) std::cout<<"retrieved pointer to "<<type_name<T>()<<" at "<<pointer_in<<std::endl;
 		return 1;
 	}
@@ -46,12 +112,13 @@ class MTreeReader {
 	template<typename T>
 	int GetBranchValue(std::string branchname, T& ref_in){
 		// check we know this branch
-		if(branch_value_pointers.count(branchname)==0){
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info==nullptr){
 			std::cerr<<"No such branch "<<branchname<<std::endl;
 			return 0;
 		}
 		// check if the branch is a primitive
-		if(branch_isobject.at(branchname)||branch_isarray.at(branchname)){
+		if(info->isobject||info->isarray){
 			std::cerr<<"Branch "<<branchname
 				 <<" is not a primitive; please pass a suitable const pointer"
 				 <<" or basic_array to GetBranchValue()"<<std::endl;
@@ -60,7 +127,8 @@ class MTreeReader {
 			return 0;
 		}
 		// else for primitives, de-reference the pointer to allow the user a copy
-		T* objp = reinterpret_cast<T*>(branch_value_pointers.at(branchname));
+		LoadBranch(*info);
+		T* objp = reinterpret_cast<T*>(info->value_pointer);
 		ref_in = *objp;
 		return 1;
 	}
@@ -88,72 +156,78 @@ class MTreeReader {
 	// the above defer to this - copy the data to ther user's array
 	// (the user really ought not to pass us an array reference, as it requires
 	//  an unnecessary copy relative to just giving us a pointer we can direct,
-	//  but not accepting array references looks like a bug to the user)
+	//  but not accepting array references looks like a bug to the user.
+	//  For access without a copy, use a basic_array or BranchHandle<basic_array<...>>)
 	template<typename T>
 	int GetArrayBranchValue(std::string branchname, T* arr_in, std::size_t NCOL, std::size_t NROW=1, std::size_t NAISLE=1){
 		// check we know this branch
-		if(branch_value_pointers.count(branchname)==0){
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info==nullptr){
 			std::cerr<<"No such branch "<<branchname<<std::endl;
 			return 0;
 		}
 		// check if the branch is an array - this template specialization is only for arrays
-		if(not branch_isarray.at(branchname)){
+		if(not info->isarray){
 			std::cerr<<"Branch "<<branchname
 				 <<" is not an array; please check your datatype to GetBranchValue()"<<std::endl;
 			return 0;
 		}
-		// check the passed array has suitable dimensions.
-		// first we need to know the actual array dimensions
-		std::vector<size_t> branchdims = GetBranchDims(branchname);
+		// in lazy mode, read the branch if we haven't yet
+		LoadBranch(*info);
 		// for dynamic arrays we may need to update our pointer to the stored array
 		// not sure if we should bail if the user is trying to put a dynamic array
 		// into a static-sized array variable.... continue for now.
-		UpdateBranchPointer(branchname);
+		UpdateBranchPointer(*info);
 		
 		// the user's array must be at least as large as required
 		// first check the number of dimensions is sufficient
-		int ndims = 1;
+		std::size_t ndims = 1;
 		if(NROW>1) ++ndims;
 		if(NAISLE>1) ++ndims;
-		if(ndims!=branchdims.size()){
+		if(ndims!=info->dimensions.size()){
 			std::cerr<<"passed an array reference of dimensionality "<<ndims
 					 <<" for branch "<<branchname<<" which has dimensionality "
-					 <<branchdims.size()<<std::endl;
+					 <<info->dimensions.size()<<std::endl;
 			return 0;
 		}
 		
 		// next check each dimension has sufficient capacity
+		// (dimensions are outermost first, so the last is contiguous in memory)
+		std::size_t user_dims[3] = {NCOL, NROW, NAISLE};
+		std::size_t data_dims[3] = {1, 1, 1};
+		const BranchDims& branchdims = GetBranchDims(*info);
 		bool cap_ok = true;
-		if(NCOL<branchdims.at(0)) cap_ok = false;
-		if(ndims>1 && NROW<branchdims.at(1)) cap_ok = false;
-		if(ndims>2 && NAISLE<branchdims.at(2)) cap_ok = false;
+		for(std::size_t dim_i=0; dim_i<ndims; ++dim_i){
+			data_dims[dim_i] = branchdims[dim_i];
+			if(user_dims[dim_i]<data_dims[dim_i]) cap_ok = false;
+		}
 		if(not cap_ok){
 			std::cerr<<"passed an array with dimensions ["<<NCOL<<"]";
 			if(NROW>1) std::cerr<<"["<<NROW<<"]";
 			if(NAISLE>1) std::cerr<<"["<<NAISLE<<"] ";
 			std::cerr<<" which is insufficient for the data dimensions ";
-			for(int i=0; i<ndims; ++i) std::cerr<<"["<<branchdims.at(i)<<"]";
+			for(std::size_t i=0; i<ndims; ++i) std::cerr<<"["<<data_dims[i]<<"]";
 			std::cerr<<std::endl;
 			return 0;
 		}
 		
-		// copy the data to the user's array
-		int data_cols = branchdims.at(0);
-		int data_rows = (ndims>1) ? branchdims.at(1) : 1;
-		int data_aisles = (ndims>2) ? branchdims.at(2) : 1;
-		T* objp = reinterpret_cast<T*>(branch_value_pointers.at(branchname));
-		for(int aisle=0; aisle<NAISLE; ++aisle){
-			for(int row=0; row<NROW; ++row){
-				for(int col=0; col<NCOL; ++col){
-					std::size_t dest_flat_index = aisle*NCOL*NROW + row*NCOL + col;
-					std::size_t source_flat_index = aisle*data_rows*data_cols + row*data_cols + col;
-					if((col+1)>branchdims.at(0) ||
-					   (ndims>1 && (row+1)>branchdims.at(1)) ||
-					   (ndims>2 && (aisle+1)>branchdims.at(2))){
-						arr_in[dest_flat_index] = 0;
-					} else {
-						arr_in[dest_flat_index] = objp[source_flat_index];
-					}
+		// copy the data to the user's array, zeroing any excess capacity.
+		const T* objp = reinterpret_cast<const T*>(info->value_pointer);
+		std::size_t user_size = NCOL*NROW*NAISLE;
+		if(data_dims[1]==NROW && data_dims[2]==NAISLE){
+			// all but the outermost dimension match, so the data maps onto the start of the
+			// user's array, which is the case for 1D arrays and arrays of matching size
+			std::size_t data_size = data_dims[0]*data_dims[1]*data_dims[2];
+			std::memcpy(arr_in, objp, data_size*sizeof(T));
+			std::fill(arr_in+data_size, arr_in+user_size, T(0));
+		} else {
+			// otherwise each innermost row of data needs padding
+			std::fill(arr_in, arr_in+user_size, T(0));
+			for(std::size_t col=0; col<data_dims[0]; ++col){
+				for(std::size_t row=0; row<data_dims[1]; ++row){
+					std::size_t dest_flat_index = (col*NROW + row)*NAISLE;
+					std::size_t source_flat_index = (col*data_dims[1] + row)*data_dims[2];
+					std::memcpy(arr_in+dest_flat_index, objp+source_flat_index, data_dims[2]*sizeof(T));
 				}
 			}
 		}
@@ -164,22 +238,25 @@ class MTreeReader {
 	template<typename T>
 	int GetBranchValue(std::string branchname, basic_array<T>& ref_in){
 		// check we know this branch
-		if(branch_value_pointers.count(branchname)==0){
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info==nullptr){
 			std::cerr<<"No such branch "<<branchname<<std::endl;
 			return 0;
 		}
 		// check if the branch is an array - this template specialization is only for arrays
-		if(not branch_isarray.at(branchname)){
+		if(not info->isarray){
 			std::cerr<<"Branch "<<branchname
 				 <<" is not an array; please check your datatype to GetBranchValue()"<<std::endl;
 			return 0;
 		}
+		// in lazy mode, read the branch if we haven't yet
+		LoadBranch(*info);
 		// for dynamic arrays we may need to update our pointer to the stored array
-		UpdateBranchPointer(branchname);
+		UpdateBranchPointer(*info);
 		// next we need to know the array dimensions, which may vary by entry
-		std::vector<size_t> branchdims = GetBranchDims(branchname);
+		const BranchDims& branchdims = GetBranchDims(*info);
 		// finally construct and return the wrapper
-		ref_in = basic_array<T>(branch_value_pointers.at(branchname),branchdims);
+		ref_in = basic_array<T>(info->value_pointer, branchdims.data(), branchdims.size());
 		return 1;
 	}
 	
@@ -198,6 +275,117 @@ class MTreeReader {
 	int Get(std::string branchname, basic_array<T>& ref_in){
 		return GetBranchValue(branchname, ref_in);
 	}
+
+	// get a handle to a branch, for repeated retrieval of its value without name lookups.
+	// the lookup and type check are done here, once. See BranchHandle.h
+
+	// primitives and objects
+	template<typename T>
+	int GetBranchHandle(std::string branchname, BranchHandle<T>& handle_in){
+		// check we know this branch
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info==nullptr){
+			std::cerr<<"No such branch "<<branchname<<std::endl;
+			return 0;
+		}
+		if(info->isarray){
+			std::cerr<<"Branch "<<branchname
+				 <<" is an array; please use a BranchHandle<basic_array<...>>"<<std::endl;
+			return 0;
+		}
+		// check the requested type matches the branch type
+		if(not CheckBranchType(*info, typeid(T))) return 0;
+		handle_in.reader = this;
+		handle_in.info = info;
+		return 1;
+	}
+
+	// arrays
+	template<typename T, bool B>
+	int GetBranchHandle(std::string branchname, BranchHandle<basic_array<T,B>>& handle_in){
+		// check we know this branch
+		BranchInfo* info = GetBranchInfo(branchname);
+		if(info==nullptr){
+			std::cerr<<"No such branch "<<branchname<<std::endl;
+			return 0;
+		}
+		if(not info->isarray){
+			std::cerr<<"Branch "<<branchname
+				 <<" is not an array; please check your datatype to GetBranchHandle()"<<std::endl;
+			return 0;
+		}
+		// check the requested element type matches the branch type
+		if(not CheckBranchType(*info, typeid(typename branch_element_type<T>::type))) return 0;
+		// resolve the source of each dimension: either a constant, or the branch holding its size
+		std::vector<std::pair<const BranchInfo*, size_t>> dims;
+		for(size_t dim_i=0; dim_i<info->dimensions.size(); ++dim_i){
+			if(info->dimensions[dim_i].first==""){
+				dims.emplace_back(nullptr, info->dimensions[dim_i].second);
+			} else {
+				dims.emplace_back(&branch_infos[info->dim_branch_indices[dim_i]], 0);
+			}
+		}
+		handle_in.reader = this;
+		handle_in.info = info;
+		handle_in.dimensions = dims;
+		return 1;
+	}
+
+	// read the values of a branch over a range of entries into a contiguous vector, without going
+	// through GetEntry. Intended for scanning whole branches outside the entry loop: only this branch
+	// is read, and where the ROOT version and branch type allow, whole baskets are read at once
+	// using ROOT's bulk I/O. Passing num_entries<0 reads to the end of the tree.
+	// N.B. pointers (but not BranchHandles) obtained for the current entry are invalidated.
+	// See also ColumnIterator.h, for reading a branch in chunks.
+	
+	// primitives
+	template<typename T>
+	int ReadColumn(std::string branchname, long first_entry, long num_entries, std::vector<T>& values){
+		BranchInfo* info = GetColumnInfo(branchname, typeid(T), sizeof(T));
+		if(info==nullptr) return 0;
+		if(info->isarray){
+			std::cerr<<"Branch "<<branchname<<" is an array; please also pass a vector for the offsets"
+					 <<" to ReadColumn()"<<std::endl;
+			return 0;
+		}
+		values.clear();
+		return ReadColumnData(*info, first_entry, num_entries, sizeof(T), ColumnAppender(values), nullptr);
+	}
+	
+	// arrays: the values of all entries are concatenated. The values of entry first_entry+i
+	// are values[offsets[i]] to values[offsets[i+1]-1], with offsets.size()==num_entries+1.
+	// multi-dimensional arrays are flattened.
+	template<typename T>
+	int ReadColumn(std::string branchname, long first_entry, long num_entries, std::vector<T>& values,
+	               std::vector<size_t>& offsets){
+		BranchInfo* info = GetColumnInfo(branchname, typeid(T), sizeof(T));
+		if(info==nullptr) return 0;
+		values.clear();
+		return ReadColumnData(*info, first_entry, num_entries, sizeof(T), ColumnAppender(values), &offsets);
+	}
+	
+	// read the values of the named numeric leaves, which may be members of a split object branch
+	// (e.g. idtgsk of the SK HEADER branch), over a range of entries, converted to int.
+	// Only the branches of those leaves are read, regardless of branch status.
+	// The value of leaf i in entry first_entry+j is values[j*leafnames.size()+i].
+	// Passing num_entries<0 reads to the end of the tree. The same caveats as ReadColumn apply.
+	int ReadLeafValues(std::vector<std::string> leafnames, long first_entry, long num_entries,
+	                   std::vector<int>& values);
+	
+	// build an index of entry numbers by (run, subrun, event), with the keys read from the given
+	// leaves (by default those of the SK HEADER branch). Only the branches of those leaves are read.
+	// The keys of each file are saved to a sidecar file named <file>.<treename>.evtidx, placed
+	// alongside the file or in sidecar_dir if given, and are read from there on later calls
+	// for as long as the file is unchanged.
+	// N.B. as with ReadColumn, pointers (but not BranchHandles) obtained for the current entry are invalidated.
+	int BuildEventIndex(MTreeEventIndex& index, std::string sidecar_dir="",
+	                    std::vector<std::string> keynames={"nrunsk","nsubsk","nevsk"});
+	
+	// split entries [first_entry, last_entry) into num_shards consecutive ranges of similar size,
+	// for processing by separate jobs, and return the range [first, last) of the given shard.
+	// Range boundaries are on cluster boundaries, so that no two jobs read the same baskets.
+	// last_entry<0 means the end of the tree. With fewer clusters than shards, some shards are empty.
+	std::pair<long,long> GetShardRange(int shard_index, int num_shards, long first_entry=0, long last_entry=-1);
 	
 	// misc operations
 	void SetVerbosity(int verbin);
@@ -212,6 +400,11 @@ class MTreeReader {
 	// tree operations
 	int Clear();
 	void SetAutoClear(bool autoclearin);
+	// which TObject branches Clear() is called on: all of them, only enabled branches,
+	// or (the default) only those read for the current entry. The last is the same as
+	// 'enabled' unless lazy reading, when branches that weren't accessed are not cleared.
+	enum class ClearPolicy { all, enabled, loaded };
+	void SetClearPolicy(ClearPolicy policyin);
 	int GetEntry(long entry_number);
 	long GetEntriesFast();
 	long GetEntries();
@@ -220,6 +413,39 @@ class MTreeReader {
 	int OnlyEnableBranches(std::vector<std::string> branchnames);
 	int OnlyDisableBranches(std::vector<std::string> branchnames);
 	
+	// lazy reading: GetEntry only loads the tree, and each branch is read the first time
+	// it's accessed (by GetBranchValue or a BranchHandle) for that entry.
+	// N.B. branches must then be retrieved anew on each entry: a pointer obtained on a previous
+	// entry will still point to the correct object, but its contents will not have been read.
+	void SetLazyReading(bool lazyin);
+	bool GetLazyReading();
+	// learning: record which branches are accessed over the next N entries, then disable the rest.
+	// Branches that are later accessed after all will be re-enabled, with a warning.
+	void LearnBranches(int num_entries);
+	std::vector<std::string> GetAccessedBranches();
+	// prefetching: a background thread reads the next N entries while the current one is processed,
+	// each into its own set of buffers, so that GetEntry only has to switch to the next set.
+	// Values obtained for an entry remain valid until the next call to GetEntry.
+	// By default the entries following the requested one are prefetched; a function returning
+	// the upcoming entries may be given otherwise (e.g. MTreeSelection::GetUpcomingEntries).
+	// N.B. each set of buffers opens its own copy of the input file(s).
+	int EnablePrefetch(int num_entries);
+	void DisablePrefetch();
+	bool GetPrefetching();
+	void SetPrefetchSource(std::function<std::vector<long>(int)> upcoming_entries_fn);
+	// column cache: for repeated passes over the same entries, the values of all enabled branches
+	// are decoded once and written to a flat column file. Subsequent readers of the same files
+	// map that file into memory and GetEntry serves values from it, without reading or decompressing
+	// anything from the input files. Primitives and arrays are used in place, while objects are
+	// stored uncompressed and streamed back into the branch object on each GetEntry.
+	// The cache file is (re)built by reading every entry if it does not exist, or if the input files
+	// (by size and modification time) or the set of enabled branches have changed.
+	// N.B. branches must be enabled before the cache is, and branches not enabled are not available.
+	// Not compatible with lazy reading, learning or prefetching, which are turned off.
+	int EnableColumnCache(std::string cachefile);
+	void DisableColumnCache();
+	bool GetColumnCaching();
+	
 	// maps of branch properties
 	std::map<std::string,std::string> GetBranchTypes();
 	std::map<std::string,intptr_t> GetBranchAddresses();
@@ -237,29 +463,75 @@ class MTreeReader {
 	private:
 	// functions
 	int ParseBranches();
-	int ParseBranchDims(std::string branchname);
-	int UpdateBranchPointer(std::string branchname);
-	int UpdateBranchPointers();
+	int ParseBranchDims(BranchInfo& info);
+	int BindBranches();
+	int UpdateBranchPointer(BranchInfo& info);
+	int UpdateBranchPointers(bool all=false);
+	int CheckBranchType(const BranchInfo& info, const std::type_info& requested_type);
+	const BranchDims& GetBranchDims(BranchInfo& info);
+	BranchInfo* GetBranchInfo(const std::string& branchname);
+	int SetBranchStatus(BranchInfo& info, bool status);
+	int RefreshBranches();
+	void MakeClearList();
+	// note access to a branch, which in lazy mode also reads it. Called on every access,
+	// so the work is only done when lazy reading or learning is active.
+	void LoadBranch(BranchInfo& info){
+		if(track_access) AccessBranch(info);
+	}
+	void AccessBranch(BranchInfo& info);
+	int ReadBranch(BranchInfo& info);
+	void StopLearning();
+	void CountLearnedEntry();
+	int GetPrefetchedEntry(long entry_number);
+	void FlipBuffers(const MTreeReader& source);
+	void StopPrefetchThread();
+	int ReloadCurrentEntry();
+	std::string GetColumnCacheKey();
+	int BuildColumnCache(const std::string& cachefile, const std::string& cachekey);
+	int MapColumnCache(const std::string& cachefile, const std::string& cachekey);
+	int GetCachedEntry(long entry_number);
+	BranchInfo* GetColumnInfo(const std::string& branchname, const std::type_info& requested_type, size_t type_size);
+	// grows a vector by a given number of values, returning a pointer to the new space
+	typedef std::function<char*(size_t)> column_appender;
+	template<typename T>
+	column_appender ColumnAppender(std::vector<T>& values){
+		return [&values](size_t num_values){
+			size_t old_size = values.size();
+			values.resize(old_size+num_values);
+			return reinterpret_cast<char*>(values.data()+old_size);
+		};
+	}
+	int ReadLeaves(const std::vector<std::string>& leafnames, long first_entry, long num_entries,
+	               std::vector<int>& values);
+	int ReadColumnData(BranchInfo& info, long first_entry, long num_entries, size_t type_size,
+	                   const column_appender& append, std::vector<size_t>* offsets);
+	long ReadColumnBulk(TBranch* branch, long first_entry, long last_entry, size_t type_size,
+	                    const column_appender& append, std::vector<size_t>* offsets);
 	
 	// variables
-	std::map<std::string,TBranch*> branch_pointers;  // branch name to TBranch*
-	std::map<std::string,bool> branch_istobject;     // branch inherits from TObject so has Clear method
-	std::map<std::string,TLeaf*> leaf_pointers;      // branch name to TLeaf*
-	std::map<std::string,std::string> branch_titles; // branch name to title (including type string)
-	std::map<std::string,intptr_t> branch_value_pointers; // branch name to pointer to value, cast to intptr_t
-	std::map<std::string,std::string> branch_types;  // branch name to string describing type - not good for arrays
-	std::map<std::string,bool> branch_isobject;      // does branch hold an object
-	std::map<std::string,bool> branch_isarray;       // does branch hold a (c-style) array
-	std::map<std::string,std::vector<std::pair<std::string,int>>> branch_dimensions; // dims of variable size arrays
-	std::map<std::string,std::vector<size_t>> branch_dims_cache; // dims of constant sized arrays
+	// all branch properties. Note handles hold pointers into this, so it must not be
+	// resized once branches are parsed.
+	std::vector<BranchInfo> branch_infos;
+	std::unordered_map<std::string,size_t> branch_indices; // branch name to index in branch_infos
 	
 	TFile* thefile=nullptr;
 	TTree* thetree=nullptr;      // generic, if working with a tchain we cast it to a TTree
 	bool autoclear=true;  // call 'Clear' method on all object branches before GetEntry
+	ClearPolicy clear_policy=ClearPolicy::loaded;
+	std::vector<size_t> clear_list;  // indices of the branches to Clear, per the clear policy
+	bool clear_list_stale=true;      // clear_list needs remaking after a change in branch status
 	int verbosity=1; // TODO add to constructor
 	uint64_t currentEntryNumber=0;
 	int currentTreeNumber=0;
 	bool isMC=false;
+	long currentLocalEntry=0;  // entry number within the current tree, if processing a TChain
+	bool lazy_reading=false;   // only read branches when accessed
+	int learning_entries=0;    // num entries left over which to record which branches are accessed
+	bool track_access=false;   // whether branch accesses need to be noted
+	MTreeReaderPrefetcher* prefetcher=nullptr;  // background reading, if enabled
+	MTreeColumnCache* column_cache=nullptr;     // mapped column file, if enabled
+	uint64_t dims_generation=1;  // incremented on each GetEntry, invalidating cached array dims
+	std::shared_ptr<const MTreeSchema> schema;  // parsed branch properties, shared by trees of the same structure
 	
 };
 
@@ -298,4 +570,7 @@ struct has_clear {
 */
 
 
+// BranchHandle needs the complete MTreeReader
+#include "BranchHandle.h"
+
 #endif // defined MTreeReader_H
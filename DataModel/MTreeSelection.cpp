@@ -11,7 +11,15 @@
 #include "TObjArray.h"
 #include "TString.h"
 #include "TParameter.h"
-#include "TKey.h"
+#include "TObjString.h"
+#include "TNamed.h"
+#include "TEntryList.h"
+#include "TTree.h"
+
+#include <cstdio>  // std::remove
+#include <set>
+#include <algorithm>  // std::push_heap, std::pop_heap
+#include <functional> // std::greater
 
 MTreeSelection::MTreeSelection(){  // required to declare them in headers
 	serialise=true;
@@ -46,6 +54,10 @@ void MTreeSelection::MakeOutputFile(std::string fname){
 	outfile = new TFile(fname.c_str(),"RECREATE");
 }
 
+void MTreeSelection::SetFlatIndices(bool flat){
+	flat_indices = flat;
+}
+
 bool MTreeSelection::SetTreeReader(MTreeReader* treereaderin){
 	if(treereaderin==nullptr){
 		std::cerr<<"MTreeSelection::SetTreeReader called with nullptr!"<<std::endl;
@@ -56,32 +68,39 @@ bool MTreeSelection::SetTreeReader(MTreeReader* treereaderin){
 }
 
 bool MTreeSelection::NoteCut(std::string cutname){
+	if(cut_pass_entries.count(cutname)) return false;
 	cut_order.push_back(cutname);
 	cut_tracker.emplace(cutname,0);
-	did_pass_cut.emplace(cutname,false);
+	did_pass_cut.push_back(false);
 	// we must have an output file before we make the TTrees in the MTreeCut. 
-	auto it = cut_pass_entries.emplace(cutname, new MTreeCut(outfile, cutname));
-	return it.second; // true if new element, false if not
+	MTreeCut* newcut = new MTreeCut(outfile, cutname);
+	newcut->flat_layout = flat_indices;
+	cut_pass_entries.emplace(cutname, newcut);
+	cut_ids[cutname].index = cut_handles.size();
+	cut_handles.push_back(CutHandles{newcut, &cut_tracker.at(cutname)});
+	return true;
 }
 
-void MTreeSelection::AddCut(std::string cutname){
+CutId MTreeSelection::AddCut(std::string cutname){
 	bool ok = NoteCut(cutname);
 	if(not ok){
 		std::cerr<<"Failed to make cut "<<cutname<<", is cut name unique?"<<std::endl;
 	}
 	cut_pass_entries.at(cutname)->Initialize(0);
+	return GetCutId(cutname);
 }
 
-void MTreeSelection::AddCut(std::string cutname, std::string branchname){
+CutId MTreeSelection::AddCut(std::string cutname, std::string branchname){
 	bool ok = NoteCut(cutname);
 	if(not ok){
 		std::cerr<<"Failed to make cut "<<cutname<<", is cut name unique?"<<std::endl;
 	}
 	if(branchname=="") std::cerr<<"empty branchname passed for cut "<<cutname<<std::endl; // XXX
 	cut_pass_entries.at(cutname)->Initialize(1, branchname, FindLinkedBranches(branchname));
+	return GetCutId(cutname);
 }
 
-void MTreeSelection::AddCut(std::string cutname, std::vector<std::string> branchnames){
+CutId MTreeSelection::AddCut(std::string cutname, std::vector<std::string> branchnames){
 	bool ok = NoteCut(cutname);
 	if(not ok){
 		std::cerr<<"Failed to make cut "<<cutname<<", is cut name unique?"<<std::endl;
@@ -98,6 +117,22 @@ void MTreeSelection::AddCut(std::string cutname, std::vector<std::string> branch
 		}
 		cut_pass_entries.at(cutname)->Initialize(2, branchnames, linked_branch_lists);
 	}
+	return GetCutId(cutname);
+}
+
+CutId MTreeSelection::GetCutId(std::string cutname){
+	// returns an invalid id for unknown cuts
+	auto it = cut_ids.find(cutname);
+	return (it==cut_ids.end()) ? CutId{} : it->second;
+}
+
+bool MTreeSelection::CheckCutId(CutId cut, const char* caller) const {
+	if(cut.index<0 || size_t(cut.index)>=cut_handles.size()){
+		std::cerr<<"MTreeSelection::"<<caller<<" called with invalid CutId "<<cut.index
+				 <<"\nPlease get CutIds from MTreeSelection::AddCut or GetCutId"<<std::endl;
+		return false;
+	}
+	return true;
 }
 
 void MTreeSelection::PrintCuts(){
@@ -107,6 +142,22 @@ void MTreeSelection::PrintCuts(){
 	}
 }
 
+std::map<std::string, uint64_t> MTreeSelection::GetCutCounts(){
+	// the number of events passing each cut
+	return cut_tracker;
+}
+
+void MTreeSelection::AddCutCounts(const std::map<std::string, uint64_t>& counts){
+	// add event counts from elsewhere, e.g. when merging the cut flows of parallel selections
+	for(auto&& acount : counts){
+		if(cut_tracker.count(acount.first)==0){
+			std::cerr<<"MTreeSelection::AddCutCounts called with unknown cut "<<acount.first<<std::endl;
+			continue;
+		}
+		cut_tracker.at(acount.first) += acount.second;
+	}
+}
+
 void MTreeSelection::IncrementEventCount(std::string cutname){
 	// track remaining numbers of events after each cut
 	if(cut_tracker.count(cutname)==0){
@@ -116,6 +167,59 @@ void MTreeSelection::IncrementEventCount(std::string cutname){
 	}
 }
 
+void MTreeSelection::IncrementEventCount(CutId cut){
+	if(not CheckCutId(cut, "IncrementEventCount")) return;
+	++(*cut_handles[cut.index].count);
+}
+
+bool MTreeSelection::AddPassingEvent(CutId cut){
+	return AddPassingEvent(cut, treereader->GetTree(), treereader->GetEntryNumber());
+}
+
+bool MTreeSelection::AddPassingEvent(CutId cut, size_t index){
+	return AddPassingEvent(cut, treereader->GetTree(), treereader->GetEntryNumber(), index);
+}
+
+bool MTreeSelection::AddPassingEvent(CutId cut, const std::vector<size_t>& indices){
+	return AddPassingEvent(cut, treereader->GetTree(), treereader->GetEntryNumber(), indices);
+}
+
+bool MTreeSelection::AddPassingEvent(CutId cut, TTree* thetree, Long64_t entry_number){
+	if(not CheckCutId(cut, "AddPassingEvent")) return false;
+	// save the TTree entry number of the passing event
+	bool newentry = cut_handles[cut.index].cut->Enter(entry_number,thetree);
+	// increment number of events passing the cut
+	if(not newentry) return false;   // prevent double counting
+	++(*cut_handles[cut.index].count);
+	return true;
+}
+
+bool MTreeSelection::AddPassingEvent(CutId cut, TTree* thetree, Long64_t entry_number, size_t index){
+	if(not CheckCutId(cut, "AddPassingEvent")) return false;
+	// save the TTree entry number and the array index.
+	// A simple TEventList allows one to record which TTree entries passed a cut.
+	// But we have additional arguments this time, because here a 'passing event'
+	// is not just a TTree entry, but more specifically *one element of an array*
+	// within a single TTree entry. We need to record the TTree entry number,
+	// the branch name holding the array, and the array index.
+	bool newentry = cut_handles[cut.index].cut->Enter(entry_number, index, thetree);
+	// increment number of events passing the cut
+	if(not newentry) return false;  // prevent double counting
+	++(*cut_handles[cut.index].count);
+	return true;
+}
+
+// for an "event" specified by several array indices, give them in the order of the cut branches
+bool MTreeSelection::AddPassingEvent(CutId cut, TTree* thetree, Long64_t entry_number, const std::vector<size_t>& indices){
+	if(not CheckCutId(cut, "AddPassingEvent")) return false;
+	// save the TTree entry number and the array indices.
+	bool newentry = cut_handles[cut.index].cut->Enter(entry_number, indices, thetree);
+	// increment number of events passing the cut
+	if(not newentry) return false;  // prevent double counting
+	++(*cut_handles[cut.index].count);
+	return true;
+}
+
 bool MTreeSelection::AddPassingEvent(std::string cutname){
 	return AddPassingEvent(cutname, treereader->GetTree(), treereader->GetEntryNumber());
 }
@@ -134,14 +238,7 @@ bool MTreeSelection::AddPassingEvent(std::string cutname,TTree* thetree, Long64_
 		cut_pass_entries[cutname]->Initialize(0);
 	}
 	
-	// save the TTree entry number of the passing event
-	bool newentry = cut_pass_entries[cutname]->Enter(entry_number,thetree);
-	
-	// increment number of events passing the cut
-	if(not newentry) return false;   // prevent double counting
-	IncrementEventCount(cutname);
-	
-	return true;
+	return AddPassingEvent(GetCutId(cutname), thetree, entry_number);
 }
 
 // provided Initialize is called first we can skip most of the arguments
@@ -164,19 +261,7 @@ bool MTreeSelection::AddPassingEvent(std::string cutname, TTree* thetree, Long64
 		cut_pass_entries[cutname]->Initialize(1, branchname, FindLinkedBranches(branchname));
 	}
 	
-	// save the TTree entry number and the array index.
-	// A simple TEventList allows one to record which TTree entries passed a cut.
-	// But we have additional arguments this time, because here a 'passing event'
-	// is not just a TTree entry, but more specifically *one element of an array*
-	// within a single TTree entry. We need to record the TTree entry number,
-	// the branch name holding the array, and the array index.
-	bool newentry = cut_pass_entries[cutname]->Enter(entry_number, index, thetree);
-	
-	// increment number of events passing the cut
-	if(not newentry) return false;  // prevent double counting
-	IncrementEventCount(cutname);
-	
-	return true;
+	return AddPassingEvent(GetCutId(cutname), thetree, entry_number, index);
 }
 
 
@@ -206,14 +291,7 @@ bool MTreeSelection::AddPassingEvent(std::string cutname, TTree* thetree, Long64
 		cut_pass_entries[cutname]->Initialize(2, branchnames, linked_branch_lists);
 	}
 	
-	// save the TTree entry number and the array indices.
-	bool newentry = cut_pass_entries[cutname]->Enter(entry_number, indices, thetree);
-	
-	// increment number of events passing the cut
-	if(not newentry) return false;  // prevent double counting
-	IncrementEventCount(cutname);
-	
-	return true;
+	return AddPassingEvent(GetCutId(cutname), thetree, entry_number, indices);
 }
 
 //bool MTreeSelection::Write(std::string outfilename){
@@ -269,6 +347,147 @@ bool MTreeSelection::Write(){
 	return true;
 }
 
+bool MTreeSelection::MergeCutFiles(std::vector<std::string> shard_files, std::string outfilename){
+	// combine the cut files written by jobs that each processed a contiguous range of the same
+	// TChain, given in entry order. Passing entries are merged, cut counts are summed and the
+	// trees of additional indices are concatenated, so the result has the same contents as
+	// the cut file of one job processing all the entries.
+	if(shard_files.empty()){
+		std::cerr<<"MTreeSelection::MergeCutFiles called with no files to merge"<<std::endl;
+		return false;
+	}
+	TDirectory* currdir = gDirectory;  // so we can reset it
+	TFile* mergedfile = new TFile(outfilename.c_str(),"RECREATE");
+	if(mergedfile==nullptr || mergedfile->IsZombie()){
+		std::cerr<<"MTreeSelection::MergeCutFiles could not create "<<outfilename<<std::endl;
+		currdir->cd();
+		return false;
+	}
+
+	std::vector<std::string> merged_order;
+	std::map<std::string, Long64_t> merged_counts;
+	std::map<std::string, TEntryList*> merged_entrylists;
+	std::map<std::string, TTree*> merged_trees;
+	std::map<std::string, CompressedEntryBitmap> merged_bitmaps;
+	std::set<std::string> missing_bitmaps;   // cuts with a shard written before bitmaps were saved
+	bool success=true;
+	for(size_t shard_i=0; shard_i<shard_files.size() && success; ++shard_i){
+		const std::string& shardname = shard_files.at(shard_i);
+		TFile* shardfile = TFile::Open(shardname.c_str(), "READ");
+		if(shardfile==nullptr || shardfile->IsZombie()){
+			std::cerr<<"MTreeSelection::MergeCutFiles could not open "<<shardname<<std::endl;
+			if(shardfile) delete shardfile;
+			success=false;
+			break;
+		}
+		TObjArray* cut_order_obj = (TObjArray*)shardfile->Get("cut_order");
+		TObjArray* cut_tracker_obj = (TObjArray*)shardfile->Get("cut_tracker");
+		if(cut_order_obj==nullptr || cut_tracker_obj==nullptr){
+			std::cerr<<"MTreeSelection::MergeCutFiles found no cut_order or cut_tracker in "<<shardname
+					 <<"! Is this a valid MTreeSelection output?"<<std::endl;
+			success=false;
+		}
+
+		// all shards must have applied the same cuts in the same order
+		std::vector<std::string> shard_order;
+		for(int cut_i=0; success && cut_i<cut_order_obj->GetEntries(); ++cut_i){
+			shard_order.push_back(((TObjString*)cut_order_obj->At(cut_i))->GetName());
+		}
+		if(success && shard_i==0){
+			merged_order = shard_order;
+		} else if(success && shard_order!=merged_order){
+			std::cerr<<"MTreeSelection::MergeCutFiles: cuts in "<<shardname<<" do not match those in "
+					 <<shard_files.front()<<std::endl;
+			success=false;
+		}
+		for(int cut_i=0; success && cut_i<cut_tracker_obj->GetEntries(); ++cut_i){
+			TParameter<Long64_t>* current_cut = (TParameter<Long64_t>*)cut_tracker_obj->At(cut_i);
+			merged_counts[current_cut->GetName()] += current_cut->GetVal();
+		}
+
+		for(int cut_i=0; success && cut_i<int(merged_order.size()); ++cut_i){
+			const std::string& cutname = merged_order.at(cut_i);
+			// shards in which nothing passed the cut only have a "<cutname>_empty_write" flag
+			TEntryList* shard_entrylist = (TEntryList*)shardfile->Get(("TEntryList_"+cutname).c_str());
+			TTree* shard_tree = (TTree*)shardfile->Get(cutname.c_str());
+			if(shard_entrylist==nullptr || shard_tree==nullptr) continue;
+			mergedfile->cd();
+			if(merged_entrylists.count(cutname)==0){
+				// the first shard with passing entries provides the lists, and the tree with its metadata
+				TEntryList* merged_entrylist = (TEntryList*)shard_entrylist->Clone();
+				merged_entrylist->SetDirectory(nullptr);  // we write and delete it ourselves
+				merged_entrylists.emplace(cutname, merged_entrylist);
+				TTree* merged_tree = shard_tree->CloneTree(-1,"fast");
+				if(merged_tree==nullptr){
+					std::cerr<<"MTreeSelection::MergeCutFiles failed to copy tree "<<cutname
+							 <<" from "<<shardname<<std::endl;
+					success=false;
+					break;
+				}
+				merged_trees.emplace(cutname, merged_tree);
+			} else {
+				merged_entrylists.at(cutname)->Add(shard_entrylist);
+				// later shards only add their passing entries; their entries all come after ours
+				if(merged_trees.at(cutname)->CopyEntries(shard_tree,-1,"fast")<0){
+					std::cerr<<"MTreeSelection::MergeCutFiles failed to copy entries of tree "<<cutname
+							 <<" from "<<shardname<<std::endl;
+					success=false;
+					break;
+				}
+			}
+			// shard entry numbers are all of the same TChain, so their bitmaps just need combining
+			CompressedEntryBitmap shard_bitmap;
+			TTree* shard_bitmaptree = (TTree*)shardfile->Get(("CutBitmap_"+cutname).c_str());
+			if(shard_bitmaptree!=nullptr && shard_bitmap.Read(shard_bitmaptree)){
+				merged_bitmaps[cutname] = merged_bitmaps[cutname].Or(shard_bitmap);
+			} else {
+				missing_bitmaps.insert(cutname);  // readers will build it from the TEntryList instead
+			}
+		}
+
+		shardfile->Close();
+		delete shardfile;
+	}
+
+	if(success){
+		// write everything out as MTreeSelection::Write would
+		mergedfile->cd();
+		TObjArray cut_order_obj;
+		TObjArray cut_tracker_obj;
+		cut_order_obj.SetOwner(true);
+		cut_tracker_obj.SetOwner(true);
+		cut_order_obj.SetName("cut_order");
+		cut_tracker_obj.SetName("cut_tracker");
+		for(auto&& acutname : merged_order){
+			cut_order_obj.Add((TObject*)(new TObjString(acutname.c_str())));
+			cut_tracker_obj.Add((TObject*)(new TParameter<Long64_t>(acutname.c_str(), merged_counts[acutname])));
+		}
+		cut_order_obj.Write("cut_order", TObject::kSingleKey);
+		cut_tracker_obj.Write("cut_tracker", TObject::kSingleKey);
+		for(auto&& acutname : merged_order){
+			if(merged_entrylists.count(acutname)==0){
+				// nothing passed this cut in any shard
+				std::string flagstring = acutname+"_empty_write";
+				TNamed flag(flagstring.c_str(), flagstring.c_str());
+				flag.Write(flagstring.c_str(), TObject::kOverwrite);
+			} else {
+				merged_entrylists.at(acutname)->Write("",TObject::kOverwrite);
+				merged_trees.at(acutname)->Write("",TObject::kOverwrite);
+				if(missing_bitmaps.count(acutname)==0) merged_bitmaps.at(acutname).Write("CutBitmap_"+acutname);
+			}
+		}
+	}
+
+	mergedfile->Close();  // also deletes the merged trees
+	delete mergedfile;
+	for(auto&& alist : merged_entrylists) delete alist.second;
+	if(not success) std::remove(outfilename.c_str());
+
+	// reset ROOT directory
+	currdir->cd();
+	return success;
+}
+
 std::vector<std::string> MTreeSelection::FindLinkedBranches(std::string cut_branch){
 	
 	// when we're cutting out a particular index from an array in a branch,
@@ -337,6 +556,8 @@ std::vector<std::string> MTreeSelection::FindLinkedBranches(std::string cut_bran
 // ↓↓ Methods for Reading A Cut File ↓↓
 
 bool MTreeSelection::LoadCutFile(std::string cutfilename){
+	// only the list of cuts is read here: each cut is loaded from the file when it's first needed,
+	// so a selection following one cut never reads the others.
 	TDirectory* currdir = gDirectory;  // so we can reset it
 	
 	// open the input file
@@ -349,59 +570,10 @@ bool MTreeSelection::LoadCutFile(std::string cutfilename){
 	// The file contains two TObjArrays recording the cuts in this MTreeSelection,
 	// their order of application and how many events passed each cut
 	// a TObjArray with key "cut_order" stores TObjStrings with the cut names in order of application
-	TObjArray* cut_order_obj=nullptr;
+	TObjArray* cut_order_obj = (TObjArray*)cutfile->Get("cut_order");
 	// a TObjArray with key "cut_tracker" stores TParameter<Long64_t> with name=<cut_name>, value=# passing events
-	TObjArray* cut_tracker_obj=nullptr;
-	
-	// for each cut we also have a TEntryList and a TTree
-	// the TEntryList key is "TEntryList_<cutname>" and has title <cutname>
-	std::map<std::string, TEntryList*> cut_entrylists;
-	// the TTree key is <cutname> and stores meta info and subindices for passing events, if applicable
-	std::map<std::string, TTree*> cut_trees;
-	
-	// loop over the keys in the TFile and retrieve all this stuff
-	TKey *key=nullptr;
-	TIter getnextkey(cutfile->GetListOfKeys());
-	// loop over objects in file
-	while ((key = (TKey*)getnextkey())){
-		if(key==nullptr){
-			std::cerr<<"null key!"<<std::endl;
-			continue;
-		}
-		std::string keyname=key->GetName();
-		if(keyname=="cut_order"){
-			cut_order_obj = (TObjArray*)key->ReadObj();
-			continue;
-		}
-		if(keyname=="cut_tracker"){
-			cut_tracker_obj = (TObjArray*)key->ReadObj();
-			continue;
-		}
-		TClass *cl = gROOT->GetClass(key->GetClassName());
-		if(cl->InheritsFrom("TEntryList")){
-			std::string cutname = keyname.substr(keyname.find_first_of('_')+1,std::string::npos);
-			cut_entrylists.emplace(cutname,(TEntryList*)key->ReadObj());
-			continue;
-		}
-		if(cl->InheritsFrom("TTree")){
-			cut_trees[keyname]=(TTree*)key->ReadObj();  // override a nullptr from empty_write if necessary
-			continue;
-		}
-		// we may instead have a TNamed with key "<cutname>_empty_write" if no events passed the cut
-		// which indicates a Write() call was made to a cut that had no entries.... redundant?
-		// it does mean that we don't know the cut details (e.g. type, branch, etc.)
-		// TODO FIXME - just have a method to configure the cut branch(es) and then just have a
-		// AddPassingEvent method that takes a name and just Long64_t entry number and size_t ints
-		// (might need to disable the variadic expansion version for this...?)
-		// (or use enable_if to prevent it being used when the third parameter (first branch) is of type size_t)
-		size_t pos=keyname.find("_empty_write");
-		if(pos!=std::string::npos){
-			cut_trees.emplace(keyname.substr(0,pos),(TTree*)nullptr);  // will not override a valid entry if it exists
-			continue;
-		}
-		// otherwise... dunno what this key is.
-		std::cout<<"MTreeSelection ignoring unknown key in input file "<<keyname<<std::endl;
-	} // end loop over keys in file
+	TObjArray* cut_tracker_obj = (TObjArray*)cutfile->Get("cut_tracker");
+	// the objects of each cut are described in GetCut
 	
 	// ok, now need to parse the retrieved objects
 	if(cut_order_obj==nullptr){
@@ -424,19 +596,74 @@ bool MTreeSelection::LoadCutFile(std::string cutfilename){
 		}
 	}
 	
-	// build the MTreeCut objects
+	// note the cuts; their MTreeCut objects are made by GetCut
 	for(int cut_i=0; cut_i<cut_order.size(); ++cut_i){
 		std::string next_cut_name = cut_order.at(cut_i);
-		TEntryList* next_elist = cut_entrylists.at(next_cut_name);
-		TTree* next_tree = cut_trees.at(next_cut_name);
-		cut_pass_entries.emplace(next_cut_name, new MTreeCut(next_cut_name, next_elist, next_tree));
+		did_pass_cut.push_back(false);
+		cut_ids[next_cut_name].index = cut_handles.size();
+		cut_handles.push_back(CutHandles{nullptr, &cut_tracker[next_cut_name]});
 	}
+	// the union of all cuts and the merge over them are built when first needed
+	any_cut_entries_built = false;
+	merge_initialized = false;
 	
 	// reset ROOT directory
 	currdir->cd();
 	return true;
 }
 
+MTreeCut* MTreeSelection::GetCut(int cut_i){
+	CutHandles& handles = cut_handles[cut_i];
+	if(handles.cut!=nullptr) return handles.cut;
+	
+	// when reading, load the cut from the cut file on first use
+	TDirectory* currdir = gDirectory;  // so we can reset it
+	cutfile->cd();
+	std::string cutname = cut_order.at(cut_i);
+	// newer files have a TTree "CutBitmap_<cutname>" storing the passing entries as a CompressedEntryBitmap.
+	// Otherwise, or if the bitmap can't be read, they're rebuilt from the TEntryList with key
+	// "TEntryList_<cutname>", which is only read then.
+	TTree* cut_bitmap = (TTree*)cutfile->Get(("CutBitmap_"+cutname).c_str());
+	TEntryList* cut_entrylist = nullptr;
+	if(cut_bitmap==nullptr) cut_entrylist = (TEntryList*)cutfile->Get(("TEntryList_"+cutname).c_str());
+	// the TTree with key <cutname> stores meta info and subindices for passing events, if applicable.
+	// Only its header is read here; subindices are read an entry at a time as the cut moves to them.
+	TTree* cut_tree = (TTree*)cutfile->Get(cutname.c_str());
+	// if no events passed the cut we instead have just a TNamed with key "<cutname>_empty_write",
+	// and don't know the cut details (e.g. type, branch, etc.)
+	if(cut_bitmap==nullptr && cut_entrylist==nullptr && cutfile->GetKey((cutname+"_empty_write").c_str())==nullptr){
+		std::cerr<<"MTreeSelection::GetCut found no passing entries for cut "<<cutname
+		         <<" in the input file! Treating it as empty"<<std::endl;
+	}
+	handles.cut = new MTreeCut(cutname, cut_entrylist, cut_tree, cut_bitmap);
+	if(not handles.cut->EntriesRead()){
+		// the bitmap may be corrupt or partially written: fall back to the TEntryList
+		cut_entrylist = (TEntryList*)cutfile->Get(("TEntryList_"+cutname).c_str());
+		if(cut_entrylist!=nullptr){
+			handles.cut->RebuildEntries(cut_entrylist);
+		} else {
+			std::cerr<<"MTreeSelection::GetCut could not read the passing entries of cut "<<cutname
+			         <<" from its bitmap or TEntryList! Treating it as empty"<<std::endl;
+		}
+	}
+	cut_pass_entries.emplace(cutname, handles.cut);
+	currdir->cd();
+	
+	if(merge_initialized){
+		// join the merge over the cuts already loaded, at the current entry
+		if(current_entry>=0 && handles.cut->SeekEntry(current_entry)){
+			did_pass_cut[cut_i] = true;
+			passing_cuts.push_back(cut_i);
+		}
+		Long64_t next_entry = handles.cut->GetEntryBitmap().Next(current_entry+1);
+		if(next_entry>=0){
+			next_passing.emplace_back(next_entry, cut_i);
+			std::push_heap(next_passing.begin(), next_passing.end(), std::greater<std::pair<Long64_t,int>>());
+		}
+	}
+	return handles.cut;
+}
+
 Long64_t MTreeSelection::GetNextEntry(std::string cutname){
 	if(treereader!=nullptr){
 		/*
@@ -450,139 +677,199 @@ Long64_t MTreeSelection::GetNextEntry(std::string cutname){
 		*/
 		// loop over all cuts and see which have a current entry matching this entry
 		// this tells us whether this entry passed the cut or not.
-		for(auto&& acut : cut_pass_entries){
-			did_pass_cut[acut.first] = (acut.second->GetCurrentEntry()==current_entry);
+		for(size_t cut_i=0; cut_i<cut_handles.size(); ++cut_i){
+			did_pass_cut[cut_i] = (cut_handles[cut_i].cut->GetCurrentEntry()==current_entry);
 		}
-	} else if(cutname==""){
+	} else {
 		/*
-		advance to the next entry for which at least one of the active MTreeCuts has that entry in the TEntryList.
-		To do this, call MTreeCut->GetEntryList->GetNextEntry() on each active cut passing the last processed event.
-		so: the first time all cuts have nextentry=-1, so call getnextentry on all.
-		if returned numbers are 'cut_a:0, cut_b:0, cut_c:10, cut_d:120'
-		then the next active cuts are a and b, for both of which the next entry to process is entry 0.
-		Load the TTree entry 0, mark cuts a and b as 'passing' and the others as 'failing'. return.
-		On the next GetNextEntry, we call MTreeCut::GetNextEntry on all cuts whose status is 'passing'
-		(cuts a and b), since these have now been processed. then proceed as above -
-		if the returned numbers are cut_a:5, cut_b:10, then the next active entry is 5: load TTree entry 5,
-		mark cut a as passing, all others as failing.
-		on the subsequent GetNextEntry, advance only cut a - let's say the returned number is 10.
-		Now, cuts 0, 1 and 2 are all passing. Load TTree entry 10. And so on.
-		Other tools then process all indices of the passing cuts.
+		advance to the next entry after the current one that passes the requested cut, or any cut.
+		The next passing entry of every cut is kept in a min-heap, so the next entry passing any cut
+		is at its top, and only the cuts passing (or skipped over by) an entry are moved on from it.
 		*/
-		
-		// no specific cut: load the next entry that passes any of the cuts
-		std::map<Long64_t, std::vector<std::string>> current_entry_numbers;
-		for(auto&& acut : cut_pass_entries){
-			Long64_t the_entry_number = acut.second->GetCurrentEntry();
-			if(current_entry_numbers.count(the_entry_number)==0){
-				current_entry_numbers.emplace(the_entry_number, std::vector<std::string>{acut.first});
-			} else {
-				current_entry_numbers.at(the_entry_number).push_back(acut.first);
+		if(cutname!=""){
+			if(not GetCutId(cutname).IsValid()){
+				std::cerr<<"MTreeSelection::GetNextEntry called with unknown cut "<<cutname<<std::endl;
+				return -1;
 			}
+			return GetNextEntry(GetEntryBitmap(cutname));
 		}
-		// using the fact that maps are inherently ordered, the first entry is the lowest entry number.
-		// That'll be the one we just processed. Advance all the MTreeCuts that were holding that entry.
-		std::vector<std::string> cuts_to_advance = current_entry_numbers.begin()->second;
-		// remove the entry numbers for all cuts we're advancing
-		current_entry_numbers.erase(current_entry_numbers.begin());
-		for(std::string acut : cuts_to_advance){
-			// update as we go
-			Long64_t the_entry_number = cut_pass_entries[acut]->GetNextEntry();
-			if(current_entry_numbers.count(the_entry_number)==0){
-				current_entry_numbers.emplace(the_entry_number, std::vector<std::string>{acut});
-			} else {
-				current_entry_numbers.at(the_entry_number).push_back(acut);
-			}
+		if(end_of_selection) return -1;
+		// every cut is needed to find the next entry passing any cut
+		for(size_t cut_i=0; cut_i<cut_handles.size(); ++cut_i) GetCut(cut_i);
+		if(not merge_initialized) InitMerge();
+		return MoveToEntry(next_passing.empty() ? -1 : next_passing.front().first);
+	}
+	return current_entry;
+}
+
+Long64_t MTreeSelection::GetNextEntry(const CompressedEntryBitmap& entries){
+	if(treereader!=nullptr){
+		std::cerr<<"MTreeSelection::GetNextEntry with a set of entries can only be used when reading a cut file"<<std::endl;
+		return -1;
+	}
+	if(end_of_selection) return -1;
+	return MoveToEntry(entries.Next(current_entry+1));
+}
+
+void MTreeSelection::InitMerge(){
+	// note the next passing entry of each cut loaded so far after the current entry.
+	// Cuts loaded later join the merge in GetCut.
+	next_passing.clear();
+	for(size_t cut_i=0; cut_i<cut_handles.size(); ++cut_i){
+		if(cut_handles[cut_i].cut==nullptr) continue;
+		long next_entry = cut_handles[cut_i].cut->GetEntryBitmap().Next(current_entry+1);
+		if(next_entry>=0) next_passing.emplace_back(next_entry, int(cut_i));
+	}
+	std::make_heap(next_passing.begin(), next_passing.end(), std::greater<std::pair<Long64_t,int>>());
+	merge_initialized = true;
+}
+
+Long64_t MTreeSelection::MoveToEntry(Long64_t entry){
+	// mark which cuts the entry passes, and move those cuts to it so their indices are available.
+	// Entries only move forwards, so the cuts whose next passing entry is later are left alone.
+	if(not merge_initialized) InitMerge();
+	for(int cut_i : passing_cuts) did_pass_cut[cut_i] = false;
+	passing_cuts.clear();
+	current_entry = entry;
+	end_of_selection = (entry<0);
+	if(end_of_selection) return current_entry;
+	
+	std::greater<std::pair<Long64_t,int>> later;
+	while(not next_passing.empty() && next_passing.front().first<=entry){
+		std::pop_heap(next_passing.begin(), next_passing.end(), later);
+		std::pair<Long64_t,int>& next_cut = next_passing.back();
+		const CompressedEntryBitmap& cut_entries = cut_handles[next_cut.second].cut->GetEntryBitmap();
+		if(next_cut.first==entry){
+			cut_handles[next_cut.second].cut->SeekEntry(entry);
+			did_pass_cut[next_cut.second] = true;
+			passing_cuts.push_back(next_cut.second);
+			next_cut.first = cut_entries.Next(entry+1);
+		} else {
+			// skipped over, e.g. when following one cut: jump to its first passing entry from here
+			next_cut.first = cut_entries.Next(entry);
 		}
-		// the first entry is the lowest passing entry number, which will be the entry we'll now process
-		current_entry = current_entry_numbers.begin()->first;
-		// the value of the first entry is the name of all the cuts for which this entry passed.
-		// reinit the list of cuts that passed
-		for(auto&& acut : did_pass_cut) acut.second=false;
-		// and set those that did
-		for(auto&& apassedcut : current_entry_numbers.begin()->second) did_pass_cut[apassedcut]=true;
-		
-	} else {
-		/*
-		if we're interested in a specific cut, we should always call GetNextEntry on that cut.
-		then we need to advance any cuts that are now behind, before checking which are passing.
-		*/
-		
-		// load the next passing entry of the requested cut
-		current_entry = cut_pass_entries[cutname]->GetNextEntry();
-		if(current_entry<0) return -1; // end of TEntryList
-		// see which other cuts pass this. To do this we'll first need to find any cuts
-		// whose current entry is lower than the one we're now processing and advance them.
-		for(auto&& acut : cut_pass_entries){
-			if(acut.first==cutname) continue; // already did this one
-			Long64_t next_passing_entry = acut.second->GetCurrentEntry();
-			while((next_passing_entry<current_entry) && (next_passing_entry>=0)){
-				next_passing_entry = acut.second->GetNextEntry();
-			};
+		if(next_cut.first<0) next_passing.pop_back();
+		else std::push_heap(next_passing.begin(), next_passing.end(), later);
+	}
+	return current_entry;
+}
+
+const CompressedEntryBitmap& MTreeSelection::GetEntryBitmap(std::string cutname){
+	if(cutname!=""){
+		CutId cut = GetCutId(cutname);
+		if(not cut.IsValid()){
+			std::cerr<<"MTreeSelection::GetEntryBitmap called with unknown cut "<<cutname<<std::endl;
+			static const CompressedEntryBitmap no_entries;
+			return no_entries;
 		}
-		// now loop over all cuts and see which have a current entry matching this entry
-		// this tells us whether this entry passed the cut or not.
-		for(auto&& acut : cut_pass_entries){
-			did_pass_cut[acut.first] = (acut.second->GetCurrentEntry()==current_entry);
+		return GetCut(cut.index)->GetEntryBitmap();
+	}
+	// when writing, cuts are still being filled, so this is rebuilt every time
+	if(treereader!=nullptr || not any_cut_entries_built){
+		any_cut_entries.Clear();
+		for(size_t cut_i=0; cut_i<cut_handles.size(); ++cut_i){
+			any_cut_entries = any_cut_entries.Or(GetCut(cut_i)->GetEntryBitmap());
 		}
+		any_cut_entries_built = (treereader==nullptr);
 	}
-	return current_entry;
+	return any_cut_entries;
+}
+
+std::vector<long> MTreeSelection::GetUpcomingEntries(std::string cutname, int num_entries){
+	// get the next num_entries entries that GetNextEntry would return, without advancing.
+	// This lets an MTreeReader read them ahead of time.
+	std::vector<long> upcoming;
+	if(treereader!=nullptr) return upcoming; // we're not controlling the reading of the TTree
+	if(cutname!="" && not GetCutId(cutname).IsValid()){
+		std::cerr<<"MTreeSelection::GetUpcomingEntries called with unknown cut "<<cutname<<std::endl;
+		return upcoming;
+	}
+	if(end_of_selection) return upcoming;
+	const CompressedEntryBitmap& entries = GetEntryBitmap(cutname);
+	for(long next_entry=entries.Next(current_entry+1); next_entry>=0 && upcoming.size()<size_t(num_entries);
+	    next_entry=entries.Next(next_entry+1)){
+		upcoming.push_back(next_entry);
+	}
+	return upcoming;
 }
 
 bool MTreeSelection::GetPassesCut(std::string cutname){
-	if(did_pass_cut.count(cutname)==0){
+	CutId cut = GetCutId(cutname);
+	if(not cut.IsValid()){
 		std::cerr<<"MTreeSelection::GetPassesCut called with unknown cut "<<cutname<<std::endl;
 		return false;
 	}
-	return did_pass_cut[cutname];
+	return GetPassesCut(cut);
 }
 
 // TODO something to check that the indices are for the right branches, and in the right order?
 // maybe accept a branch pointer and check?
 // or in the case of multiple indices, re-order if necessary?
 bool MTreeSelection::GetPassesCut(std::string cutname, size_t index){
-	if(did_pass_cut.count(cutname)==0){
+	CutId cut = GetCutId(cutname);
+	if(not cut.IsValid()){
 		std::cerr<<"MTreeSelection::GetPassesCut called with unknown cut "<<cutname<<std::endl;
 		return false;
 	}
-	if(not did_pass_cut[cutname]) return false;
-	// otherwise check this index
-	return cut_pass_entries[cutname]->GetPassingIndexes().count(index);
+	return GetPassesCut(cut, index);
 }
 
 bool MTreeSelection::GetPassesCut(std::string cutname, std::vector<size_t> indices){
-	if(did_pass_cut.count(cutname)==0){
+	CutId cut = GetCutId(cutname);
+	if(not cut.IsValid()){
 		std::cerr<<"MTreeSelection::GetPassesCut called with unknown cut "<<cutname<<std::endl;
 		return false;
 	}
-	if(not did_pass_cut[cutname]) return false;
-	// otherwise check indices
-	return cut_pass_entries[cutname]->GetPassingIndices().count(indices);
+	return GetPassesCut(cut, indices);
+}
+
+bool MTreeSelection::GetPassesCut(CutId cut){
+	if(not CheckCutId(cut, "GetPassesCut")) return false;
+	GetCut(cut.index);  // when reading, cuts not yet loaded are loaded at the current entry
+	return did_pass_cut[cut.index];
+}
+
+bool MTreeSelection::GetPassesCut(CutId cut, size_t index){
+	if(not CheckCutId(cut, "GetPassesCut")) return false;
+	MTreeCut* thecut = GetCut(cut.index);
+	if(not did_pass_cut[cut.index]) return false;
+	return thecut->GetPassingIndexes().count(index);
+}
+
+bool MTreeSelection::GetPassesCut(CutId cut, const std::vector<size_t>& indices){
+	if(not CheckCutId(cut, "GetPassesCut")) return false;
+	MTreeCut* thecut = GetCut(cut.index);
+	if(not did_pass_cut[cut.index]) return false;
+	return thecut->GetPassingIndices().count(indices);
 }
 
-std::set<size_t> MTreeSelection::GetPassingIndexes(std::string cutname){
-	if(did_pass_cut.count(cutname)==0){
+MTreeIndexSpan MTreeSelection::GetPassingIndexes(std::string cutname){
+	CutId cut = GetCutId(cutname);
+	if(not cut.IsValid()){
 		std::cerr<<"MTreeSelection::GetPassingIndexes called with unknown cut "<<cutname<<std::endl;
-		return std::set<size_t>{};
+		return MTreeIndexSpan{};
 	}
-	if(did_pass_cut[cutname]){
-		return cut_pass_entries[cutname]->GetPassingIndexes();
+	MTreeCut* thecut = GetCut(cut.index);
+	if(did_pass_cut[cut.index]){
+		return thecut->GetPassingIndexes();
 	} else {
 		// if it didn't pass the cut, it has no indices this entry
-		return std::set<size_t>{};
+		return MTreeIndexSpan{};
 	}
 }
 
-std::set<std::vector<size_t>> MTreeSelection::GetPassingIndices(std::string cutname){
-	if(did_pass_cut.count(cutname)==0){
+MTreeIndexSpan MTreeSelection::GetPassingIndices(std::string cutname){
+	CutId cut = GetCutId(cutname);
+	if(not cut.IsValid()){
 		std::cerr<<"MTreeSelection::GetPassingIndices called with unknown cut "<<cutname<<std::endl;
-		return std::set<std::vector<size_t>>{};
+		return MTreeIndexSpan{};
 	}
-	if(did_pass_cut[cutname]){
-		return cut_pass_entries[cutname]->GetPassingIndices();
+	MTreeCut* thecut = GetCut(cut.index);
+	if(did_pass_cut[cut.index]){
+		return thecut->GetPassingIndices();
 	} else {
 		// if it didn't pass the cut, it has no indices this entry
-		return std::set<std::vector<size_t>>{};
+		return MTreeIndexSpan{};
 	}
 }
 
@@ -4,6 +4,7 @@
 #include <map>
 #include <utility>
 #include <string>
+#include <vector>
 #include <iostream>
 
 #include "MTreeCut.h"
@@ -26,6 +27,13 @@ class MTreeReader;
 //	pairBuilder(const std::string & name, std::initializer_list<pairBuilder> values) : cut_pair(create_cut_pair(name, values)) {};
 //};
 
+// A handle to a cut of an MTreeSelection, from AddCut or GetCutId. Filling and checking cuts
+// through a CutId rather than the cut name avoids building strings and looking up the cut per event.
+struct CutId {
+	int index=-1;
+	bool IsValid() const { return index>=0; }
+};
+
 class MTreeSelection : public SerialisableObject {
 	
 	friend class boost::serialization::access;
@@ -36,12 +44,23 @@ class MTreeSelection : public SerialisableObject {
 	MTreeSelection(std::string cutFilein);                       // for reading
 	~MTreeSelection();
 	void MakeOutputFile(std::string fname);
+	// store the indices of cuts added after this call as plain arrays (default) or STL sets
+	void SetFlatIndices(bool flat);
 	bool SetTreeReader(MTreeReader* treereaderin);
-	void AddCut(std::string cutname);
-	void AddCut(std::string cutname, std::string branchname); // type 1
-	void AddCut(std::string cutname, std::vector<std::string> branchnames);  // type 1 or 2
+	CutId AddCut(std::string cutname);
+	CutId AddCut(std::string cutname, std::string branchname); // type 1
+	CutId AddCut(std::string cutname, std::vector<std::string> branchnames);  // type 1 or 2
+	CutId GetCutId(std::string cutname);
 	void IncrementEventCount(std::string cutname);
+	void IncrementEventCount(CutId cut);
 	bool NoteCut(std::string cutname);
+	// the string versions look up the cut and call the CutId versions
+	bool AddPassingEvent(CutId cut);
+	bool AddPassingEvent(CutId cut, size_t index);
+	bool AddPassingEvent(CutId cut, const std::vector<size_t>& indices);
+	bool AddPassingEvent(CutId cut, TTree* thetree, Long64_t entry_number);
+	bool AddPassingEvent(CutId cut, TTree* thetree, Long64_t entry_number, size_t index);
+	bool AddPassingEvent(CutId cut, TTree* thetree, Long64_t entry_number, const std::vector<size_t>& indices);
 	bool AddPassingEvent(std::string cutname);
 	bool AddPassingEvent(std::string cutname, size_t index);
 	bool AddPassingEvent(std::string cutname, std::vector<size_t> indices);
@@ -73,25 +92,53 @@ class MTreeSelection : public SerialisableObject {
 	
 	std::string BranchAddressToName(intptr_t branchptr);
 	void PrintCuts();
+	std::map<std::string, uint64_t> GetCutCounts();
+	void AddCutCounts(const std::map<std::string, uint64_t>& counts);
 	bool Write();
+	// combine the cut files of jobs that each processed a consecutive part of the same TChain,
+	// given in entry order, into the cut file one job processing all of them would have written.
+	static bool MergeCutFiles(std::vector<std::string> shard_files, std::string outfilename);
 	
 	bool LoadCutFile(std::string cutFilein);
 	Long64_t GetNextEntry(std::string cutname="");
+	// the entries passing a cut, or any cut if cutname is "". These can be combined,
+	// e.g. GetEntryBitmap("X").AndNot(GetEntryBitmap("Y")) for the entries passing X but not Y,
+	// and the result iterated over with GetNextEntry.
+	const CompressedEntryBitmap& GetEntryBitmap(std::string cutname="");
+	Long64_t GetNextEntry(const CompressedEntryBitmap& entries);
+	std::vector<long> GetUpcomingEntries(std::string cutname, int num_entries);
 	bool GetPassesCut(std::string cutname);
 	bool GetPassesCut(std::string cutname, size_t index);
 	bool GetPassesCut(std::string cutname, std::vector<size_t> indices);
-	std::set<size_t> GetPassingIndexes(std::string cutname);
-	std::set<std::vector<size_t>> GetPassingIndices(std::string cutname);
+	bool GetPassesCut(CutId cut);
+	bool GetPassesCut(CutId cut, size_t index);
+	bool GetPassesCut(CutId cut, const std::vector<size_t>& indices);
+	// the passing indices of the current entry; valid until the next GetNextEntry call
+	MTreeIndexSpan GetPassingIndexes(std::string cutname);
+	MTreeIndexSpan GetPassingIndices(std::string cutname);
 	MTreeReader* GetTreeReader();
 	std::string GetTopCut();
 	
 	private:
 	std::vector<std::string> FindLinkedBranches(std::string cut_branch);
+	// the MTreeCut of a cut; when reading, loaded from the cut file the first time it's needed
+	MTreeCut* GetCut(int cut_i);
+	void InitMerge();
+	Long64_t MoveToEntry(Long64_t entry);
+	bool CheckCutId(CutId cut, const char* caller) const;
 	
 	// track num events passing cuts.
 	std::vector<std::string> cut_order;
 	std::map<std::string, uint64_t> cut_tracker;
 	std::map<std::string, MTreeCut*> cut_pass_entries;
+	// the cut and event count of each CutId, in order of cut_order.
+	// These point into the maps, whose elements never move. When reading, cuts are null until loaded.
+	struct CutHandles {
+		MTreeCut* cut;
+		uint64_t* count;
+	};
+	std::vector<CutHandles> cut_handles;
+	std::map<std::string, CutId> cut_ids;
 	
 	MTreeReader* treereader=nullptr;
 	std::map<intptr_t, std::string> branch_addresses;
@@ -100,11 +147,19 @@ class MTreeSelection : public SerialisableObject {
 	//BoostStore* outstore=nullptr;
 	TFile* outfile=nullptr;
 	bool initialized=false; // written initial meta-data  - FIXME redundant/broken? (order of cuts?)
+	bool flat_indices=true;
 	
 	// involved in reading
 	TFile* cutfile=nullptr;
 	Long64_t current_entry=-1;
-	std::map<std::string, bool> did_pass_cut;
+	std::vector<bool> did_pass_cut;         // whether the current entry passes each cut, by CutId
+	std::vector<int> passing_cuts;          // the CutIds that it passes
+	CompressedEntryBitmap any_cut_entries;   // union of the entries passing each cut
+	bool any_cut_entries_built=false;
+	bool end_of_selection=false;
+	// min-heap of the next entry passing each cut after the current entry, and its CutId
+	std::vector<std::pair<Long64_t,int>> next_passing;
+	bool merge_initialized=false;
 	
 	// for writing this class to a BoostStore
 	template<class Archive> void serialize(Archive & ar, const unsigned int version){
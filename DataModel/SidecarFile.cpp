@@ -0,0 +1,66 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "SidecarFile.h"
+
+#include <iostream>
+#include <sstream>
+#include <atomic>
+#include <cstdio>    // std::remove, std::rename
+#include <unistd.h>  // getpid
+
+int SidecarFile::Write(const std::string& sidecarname, const std::string& format, const std::string& filekey,
+                       long count, const void* payload, size_t payload_bytes){
+	// a temporary name unique to this process and call
+	static std::atomic<long> num_written{0};
+	std::string partname = sidecarname+".part"+std::to_string(getpid())+"_"+std::to_string(num_written++);
+	std::ofstream partfile(partname, std::ios::binary | std::ios::trunc);
+	if(not partfile.is_open()){
+		std::cerr<<"SidecarFile::Write failed to open "<<partname<<" for writing"<<std::endl;
+		return 0;
+	}
+	partfile<<format<<"\n"<<filekey<<"\n"<<count<<"\n";
+	partfile.write(static_cast<const char*>(payload), payload_bytes);
+	partfile.close();
+	if(partfile.fail()){
+		std::cerr<<"SidecarFile::Write error writing "<<partname<<std::endl;
+		std::remove(partname.c_str());
+		return 0;
+	}
+	if(std::rename(partname.c_str(), sidecarname.c_str())!=0){
+		std::cerr<<"SidecarFile::Write failed to move "<<partname<<" to "<<sidecarname<<std::endl;
+		std::remove(partname.c_str());
+		return 0;
+	}
+	return 1;
+}
+
+int SidecarFile::Open(const std::string& sidecarname, const std::string& format, const std::string& filekey){
+	name = sidecarname;
+	count = -1;
+	sidecar.close();
+	sidecar.clear();
+	sidecar.open(sidecarname, std::ios::binary);
+	if(not sidecar.is_open()) return 0;
+	std::string header, key, count_line;
+	std::getline(sidecar, header);
+	std::getline(sidecar, key);
+	std::getline(sidecar, count_line);
+	long sidecar_count=-1;
+	std::stringstream(count_line) >> sidecar_count;
+	if(header!=format || key!=filekey || sidecar_count<0) return 0;
+	count = sidecar_count;
+	return 1;
+}
+
+long SidecarFile::GetCount() const {
+	return count;
+}
+
+int SidecarFile::ReadPayload(void* payload, size_t payload_bytes){
+	if(count<0) return 0;
+	sidecar.read(static_cast<char*>(payload), payload_bytes);
+	if(sidecar.gcount()!=std::streamsize(payload_bytes)){
+		std::cerr<<"SidecarFile::ReadPayload: "<<name<<" is truncated"<<std::endl;
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,44 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef SidecarFile_H
+#define SidecarFile_H
+
+#include <string>
+#include <fstream>
+
+/*
+A SidecarFile holds something derived from an input file (an index, a bitmap...) so that it need
+only be built once per file. It has three header lines: the format, e.g. "EntryBitmap v1",
+a key identifying the contents of the input file, so that a stale sidecar is not used, and the
+number of items stored; then the binary payload.
+Sidecars are written to a temporary file which is then renamed, so that jobs sharing the input
+files (e.g. TreeReader shards) never read a partly written sidecar, nor overwrite one being read.
+
+Usage:
+	SidecarFile::Write("file.root.idx", "MyIndex v1", filekey, values.size(), values.data(), num_bytes);
+	SidecarFile sidecar;
+	if(sidecar.Open("file.root.idx", "MyIndex v1", filekey)){
+		values.resize(sidecar.GetCount());
+		sidecar.ReadPayload(values.data(), num_bytes);
+	}
+*/
+
+class SidecarFile {
+	public:
+	SidecarFile(){};
+
+	static int Write(const std::string& sidecarname, const std::string& format, const std::string& filekey,
+	                 long count, const void* payload, size_t payload_bytes);
+
+	// returns 0 without complaint if there's no usable sidecar: the caller should then build its contents
+	int Open(const std::string& sidecarname, const std::string& format, const std::string& filekey);
+	long GetCount() const;
+	// returns 0 if the sidecar is truncated
+	int ReadPayload(void* payload, size_t payload_bytes);
+
+	private:
+	std::ifstream sidecar;
+	std::string name;
+	long count=-1;
+};
+
+#endif // defined SidecarFile_H
@@ -0,0 +1,92 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "ZbsEntryCounter.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+
+// the FZ exchange format is a sequence of physical records, each starting with an 8 word
+// steering block: 4 words of magic numbers, the record length in words (lower 24 bits),
+// the record number, and the offset in words of the first logical record starting in it.
+// Logical records have a 2 word header: their length in words (excluding the header) and
+// their type. A logical record may continue over several physical records.
+static const uint32_t fz_magic[4] = {0x0123CDEF, 0x80708070, 0x4321ABCD, 0x80618061};
+static const uint32_t lrtyp_start = 2;    // the first logical record of a data structure (an event)
+static const uint32_t lrtyp_padding = 4;  // the rest of the physical record is padding
+
+// words are big-endian
+static uint32_t GetWord(const unsigned char* bytes){
+	return (uint32_t(bytes[0])<<24) | (uint32_t(bytes[1])<<16) | (uint32_t(bytes[2])<<8) | uint32_t(bytes[3]);
+}
+
+long ZbsEntryCounter::Count(const std::string& filename){
+	long num_entries = 0;
+	std::ifstream infile(filename, std::ios::binary);
+	if(not infile.is_open()){
+		std::cerr<<"ZbsEntryCounter::Count failed to open "<<filename<<std::endl;
+		return -1;
+	}
+	// files written with fortran sequential access have a 4-byte marker before and after each record
+	unsigned char head[8];
+	infile.read(reinterpret_cast<char*>(head), 8);
+	if(infile.gcount()!=8){
+		std::cerr<<"ZbsEntryCounter::Count: "<<filename<<" is too short to be a ZEBRA file"<<std::endl;
+		return -1;
+	}
+	size_t marker_bytes = 0;
+	if(GetWord(head)!=fz_magic[0]){
+		if(GetWord(head+4)!=fz_magic[0]){
+			std::cerr<<"ZbsEntryCounter::Count: "<<filename<<" is not a ZEBRA exchange format file"<<std::endl;
+			return -1;
+		}
+		marker_bytes = 4;
+	}
+	
+	std::vector<unsigned char> record;
+	int64_t record_start = 0;  // byte offset of the current physical record, including any marker
+	while(true){
+		infile.seekg(record_start+marker_bytes);
+		record.resize(8*4);
+		infile.read(reinterpret_cast<char*>(record.data()), record.size());
+		if(infile.gcount()==0) break;  // end of file
+		if(infile.gcount()!=std::streamsize(record.size())){
+			std::cerr<<"ZbsEntryCounter::Count: truncated physical record at byte "<<record_start
+					 <<" of "<<filename<<std::endl;
+			return -1;
+		}
+		for(int word_i=0; word_i<4; ++word_i){
+			if(GetWord(record.data()+4*word_i)!=fz_magic[word_i]){
+				std::cerr<<"ZbsEntryCounter::Count: bad steering block at byte "<<record_start
+						 <<" of "<<filename<<std::endl;
+				return -1;
+			}
+		}
+		uint32_t record_words = GetWord(record.data()+4*4) & 0xFFFFFF;
+		uint32_t first_lr = GetWord(record.data()+6*4);
+		if(record_words<8){
+			std::cerr<<"ZbsEntryCounter::Count: bad physical record length "<<record_words<<" at byte "
+					 <<record_start<<" of "<<filename<<std::endl;
+			return -1;
+		}
+		record.resize(record_words*4);
+		infile.read(reinterpret_cast<char*>(record.data()+8*4), record.size()-8*4);
+		if(infile.gcount()!=std::streamsize(record.size()-8*4)){
+			std::cerr<<"ZbsEntryCounter::Count: truncated physical record at byte "<<record_start
+					 <<" of "<<filename<<std::endl;
+			return -1;
+		}
+		// walk the logical records starting in this physical record
+		// (anything before the first is the continuation of one started in a previous record)
+		for(uint32_t word_i=first_lr; word_i>=8 && (word_i+1)<record_words; ){
+			uint32_t lr_words = GetWord(record.data()+4*word_i);
+			uint32_t lr_type = GetWord(record.data()+4*(word_i+1));
+			if(lr_type==lrtyp_padding) break;
+			if(lr_type==lrtyp_start) ++num_entries;
+			if(lr_words>=record_words) break;  // continues into the next physical record
+			word_i += 2+lr_words;
+		}
+		record_start += int64_t(record_words)*4 + 2*marker_bytes;
+	}
+	return num_entries;
+}
@@ -0,0 +1,23 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef ZbsEntryCounter_H
+#define ZbsEntryCounter_H
+
+#include <string>
+
+/*
+A ZbsEntryCounter counts the event records of a ZEBRA file (FZ exchange format, as read by skread),
+so that the number of entries of a file is known without reading it through ZEBRA.
+The count only reads the steering block of each physical record and the headers of the logical
+records; no data is unpacked. It gives no way to position skread at an entry: entries of a file
+can still only be reached by reading the ones before them.
+
+Usage:
+	long num_entries = ZbsEntryCounter::Count("/path/to/file.zbs");  // -1 on error
+*/
+
+class ZbsEntryCounter {
+	public:
+	static long Count(const std::string& filename);
+};
+
+#endif // defined ZbsEntryCounter_H
@@ -65,6 +65,10 @@ class basic_array /*: public generic_array*/ {
 		//std::cout<<"addr is of type "<<type_name<W*>()<<" and is at "<<addr<<std::endl;
 	}
 	
+	// dimensions given as a plain array, e.g. from an MTreeReader BranchDims
+	basic_array(intptr_t addr_in, const size_t* sizes, size_t ndims) :
+		basic_array(addr_in, size_t((ndims) ? sizes[0] : 0)){}
+	
 	// pointer to array
 	template<class X>
 	basic_array(X ptr_in, typename std::enable_if<std::is_same<typename std::remove_extent<typename std::remove_pointer<X>::type>::type, T>::value, bool>::type potato= true){
@@ -89,7 +93,7 @@ class basic_array /*: public generic_array*/ {
 	~basic_array(){};
 	
 	const W& at(int i) const {
-		if(i<0||i>a_size){
+		if(i<0||i>=int(a_size)){
 			throw std::out_of_range ("out of range exception requesting element "+std::to_string(i)+" in "+__FILE__+"::"+std::to_string(__LINE__));
 		}
 		return addr[i];
@@ -188,6 +192,11 @@ class basic_array<T,true> /*: public generic_array*/ {
 		//	 <<" while return type is "<<type_name<V>()<<std::endl;
 	}
 	
+	basic_array(intptr_t addr_in, const size_t* sizes, size_t ndims){
+		a_size = (ndims) ? sizes[0] : 0;
+		Init(addr_in, std::vector<size_t>(sizes+((ndims) ? 1 : 0), sizes+ndims));
+	}
+	
 	template<class X>
 	basic_array(X ref_in, typename std::enable_if<std::is_same<typename std::remove_extent<typename std::remove_pointer<X>::type>::type, T>::value, bool>::type potato= true){
 		//std::cout<<"reference constructor with arg type "<<type_name<X>()<<std::endl;
@@ -231,7 +240,7 @@ class basic_array<T,true> /*: public generic_array*/ {
 	~basic_array(){};
 	
 	const V& at(int i) const {
-		if(i<0||i>a_size){
+		if(i<0||i>=int(a_size)){
 			throw std::out_of_range ("out of range exception requesting element "+std::to_string(i)+" in "+__FILE__+"::"+std::to_string(__LINE__));
 		}
 		return subarray.at(i);
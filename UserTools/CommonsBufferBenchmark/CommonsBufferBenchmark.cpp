@@ -0,0 +1,112 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "CommonsBufferBenchmark.h"
+
+#include "TreeReader.h"  // the common blocks to buffer
+#include "fortran_routines.h"
+#include "Algorithms.h"
+#include "type_name_as_string.h"
+
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+
+CommonsBufferBenchmark::CommonsBufferBenchmark():Tool(){
+	// get the name of the tool from its class name
+	toolName=type_name<decltype(this)>(); toolName.pop_back();
+}
+
+bool CommonsBufferBenchmark::Initialise(std::string configfile, DataModel &data){
+
+	if(configfile!="")  m_variables.Initialise(configfile);
+	//m_variables.Print();
+
+	m_data= &data;
+
+	Log(toolName+": Initializing",v_debug,verbosity);
+
+	// Get the Tool configuration variables
+	// ------------------------------------
+	m_variables.Get("verbosity",verbosity);
+	m_variables.Get("numPairs",numPairs);
+	m_variables.Get("numHits",numHits);
+	m_variables.Get("bufferedCommons",bufferedCommons);
+
+	return true;
+}
+
+bool CommonsBufferBenchmark::Execute(){
+
+	std::vector<std::string> blocknames;
+	std::stringstream ss(bufferedCommons);
+	std::string aname;
+	while(std::getline(ss, aname, ',')) if(aname!="") blocknames.push_back(aname);
+
+	Log(toolName+" benchmarking "+toString(numPairs)+" SHE+AFT pairs with "+toString(numHits)
+	   +" hits per event",v_message,verbosity);
+
+	results.emplace_back("all common blocks, whole", TimePairs({}, false));
+	results.emplace_back("all common blocks, filled hits only", TimePairs({}, true));
+	results.emplace_back(bufferedCommons+", filled hits only", TimePairs(blocknames, true));
+
+	// all benchmarks are done in one go
+	m_data->vars.Set("StopLoop",1);
+
+	return true;
+}
+
+bool CommonsBufferBenchmark::Finalise(){
+
+	std::cout<<"\n"<<toolName<<" results for "<<numPairs<<" SHE+AFT pairs with "<<numHits<<" hits per event\n";
+	double baseline = (results.size()) ? results.front().second : 0;
+	for(auto&& aresult : results){
+		std::cout<<"\t"<<aresult.first<<": "<<toString(aresult.second,0)<<" pairs/s, x"
+		         <<toString(aresult.second/baseline,2)<<std::endl;
+	}
+
+	return true;
+}
+
+void CommonsBufferBenchmark::FillEvent(int num_hits, int trigger_bit){
+	// the parts of the common blocks that skread would fill for an event with num_hits ID hits
+	const int max_hits = sizeof(sktqz_.tiskz)/sizeof(sktqz_.tiskz[0]);
+	num_hits = std::min(num_hits, max_hits);
+	skhead_.idtgsk = (1<<trigger_bit);
+	skq_.nqisk = num_hits;
+	sktqz_.nqiskz = num_hits;
+	for(int hit_i=0; hit_i<num_hits; ++hit_i){
+		skchnl_.ihcab[hit_i] = hit_i+1;
+		sktqz_.icabiz[hit_i] = hit_i+1;
+		sktqz_.tiskz[hit_i] = 1000.f+hit_i;
+		sktqz_.qiskz[hit_i] = 1.f;
+	}
+}
+
+double CommonsBufferBenchmark::TimePairs(const std::vector<std::string>& blocknames, bool by_hits){
+	CommonBlockBuffer buffer;
+	TreeReader::AddCommonBlocks(buffer, blocknames, by_hits);
+	buffer.Allocate(2);
+
+	// time only the buffering, not the filling of the common blocks standing in for skread
+	std::chrono::steady_clock::duration buffering_time{0};
+	for(int pair_i=0; pair_i<numPairs; ++pair_i){
+		// read the SHE, and buffer it while the AFT is read
+		FillEvent(numHits, 28);
+		auto start = std::chrono::steady_clock::now();
+		buffer.Flush();
+		buffer.Push();
+		buffering_time += std::chrono::steady_clock::now()-start;
+		// the AFT has fewer hits
+		FillEvent(numHits/4, 29);
+		start = std::chrono::steady_clock::now();
+		// swap the SHE back in, then a downstream tool loads the AFT and returns to the SHE
+		buffer.Load(0);
+		buffer.Load(0);
+		buffer.Load(0);
+		buffering_time += std::chrono::steady_clock::now()-start;
+	}
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(buffering_time).count()/1.E6;
+	double pairs_per_second = (seconds>0) ? numPairs/seconds : 0;
+	Log(toolName+" buffering "+toString(buffer.GetBlockNames().size())+" common blocks"
+	   +(by_hits ? " by hits" : "")+": "+toString(pairs_per_second,0)+" pairs/s",v_message,verbosity);
+	return pairs_per_second;
+}
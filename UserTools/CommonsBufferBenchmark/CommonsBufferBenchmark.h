@@ -0,0 +1,65 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef CommonsBufferBenchmark_H
+#define CommonsBufferBenchmark_H
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <utility>
+
+#include "Tool.h"
+#include "CommonBlockBuffer.h"
+
+/**
+* \class CommonsBufferBenchmark
+*
+* A tool to measure the throughput of the fortran common block buffering used by the TreeReader
+* to hold SHE+AFT pairs. Synthetic events with a configurable number of hits are put into the
+* common blocks, and each pair is buffered and swapped as the TreeReader and downstream tools would.
+* Copying whole common blocks (as done previously) is compared with copying only the filled
+* part of the TQ arrays, and with buffering only a selected list of common blocks.
+* The whole benchmark is run in the first Execute call, after which the ToolChain is stopped.
+*
+* $Author: M.O'Flaherty $
+* $Date: 2021/03/22 $
+* Contact: marcus.o-flaherty@warwick.ac.uk
+*/
+class CommonsBufferBenchmark: public Tool {
+
+	public:
+	CommonsBufferBenchmark();         ///< Simple constructor
+	bool Initialise(std::string configfile,DataModel &data); ///< Initialise function for setting up Tool resources. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
+	bool Execute();   ///< Execute function used to perform Tool purpose.
+	bool Finalise();  ///< Finalise funciton used to clean up resources.
+
+	private:
+	// functions
+	// =========
+	// pairs per second, buffering the given common blocks (all if empty)
+	double TimePairs(const std::vector<std::string>& blocknames, bool by_hits);
+	void FillEvent(int num_hits, int trigger_bit);
+
+	// config variables
+	// ================
+	int numPairs=10000;
+	int numHits=2000;                                   // number of ID hits per event
+	std::string bufferedCommons="skhead,skq,skt,skchnl,sktqz";  // the selective benchmark's list
+
+	// tool variables
+	// ==============
+	std::string toolName;
+	std::vector<std::pair<std::string,double>> results;  // benchmark, pairs per second
+
+	// verbosity levels: if 'verbosity' < this level, the message type will be logged.
+	int verbosity=1;
+	int v_error=0;
+	int v_warning=1;
+	int v_message=2;
+	int v_debug=3;
+	std::string logmessage="";
+	int get_ok=0;
+
+};
+
+
+#endif
@@ -0,0 +1,175 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "CutIndicesBenchmark.h"
+
+#include "MTreeCut.h"
+#include "Algorithms.h"
+#include "type_name_as_string.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TEntryList.h"
+
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <cstdio>    // std::remove
+#include <algorithm> // std::max
+
+CutIndicesBenchmark::CutIndicesBenchmark():Tool(){
+	// get the name of the tool from its class name
+	toolName=type_name<decltype(this)>(); toolName.pop_back();
+}
+
+bool CutIndicesBenchmark::Initialise(std::string configfile, DataModel &data){
+
+	if(configfile!="")  m_variables.Initialise(configfile);
+	//m_variables.Print();
+
+	m_data= &data;
+
+	Log(toolName+": Initializing",v_debug,verbosity);
+
+	// Get the Tool configuration variables
+	// ------------------------------------
+	m_variables.Get("verbosity",verbosity);
+	m_variables.Get("numEntries",numEntries);
+	m_variables.Get("meanIndices",meanIndices);
+	m_variables.Get("maxIndex",maxIndex);
+	m_variables.Get("outputDir",outputDir);
+
+	if(maxIndex<1 || meanIndices<1 || numEntries<1){
+		Log(toolName+" numEntries, meanIndices and maxIndex must all be positive",v_error,verbosity);
+		return false;
+	}
+
+	return true;
+}
+
+bool CutIndicesBenchmark::Execute(){
+
+	Log(toolName+" benchmarking cuts on "+toString(numEntries)+" entries with on average "
+	   +toString(meanIndices)+" passing indices each",v_message,verbosity);
+
+	for(int cut_type=1; cut_type<=2; ++cut_type){
+		LayoutResult sets = TimeLayout(cut_type, false);
+		LayoutResult flat = TimeLayout(cut_type, true);
+		if(sets.checksum!=flat.checksum){
+			Log(toolName+" type "+toString(cut_type)+" cuts read back different indices with each layout!",
+			    v_error,verbosity);
+		}
+		results.push_back(sets);
+		results.push_back(flat);
+	}
+
+	// all benchmarks are done in one go
+	m_data->vars.Set("StopLoop",1);
+
+	return true;
+}
+
+bool CutIndicesBenchmark::Finalise(){
+
+	std::cout<<"\n"<<toolName<<" results for "<<numEntries<<" entries with on average "<<meanIndices
+	         <<" passing indices each\n";
+	for(size_t result_i=0; result_i<results.size(); ++result_i){
+		const LayoutResult& aresult = results.at(result_i);
+		// each flat layout is compared to the sets before it
+		const LayoutResult& baseline = results.at(result_i-(result_i%2));
+		std::cout<<"\t"<<aresult.name<<": "<<toString(aresult.file_kb,0)<<" kB (x"
+		         <<toString(aresult.file_kb/baseline.file_kb,2)<<"), write "<<toString(aresult.write_seconds,3)
+		         <<" s, read "<<toString(aresult.read_seconds,3)<<" s (x"
+		         <<toString((aresult.read_seconds>0) ? baseline.read_seconds/aresult.read_seconds : 0,2)
+		         <<" speed)"<<std::endl;
+	}
+
+	return true;
+}
+
+CutIndicesBenchmark::LayoutResult CutIndicesBenchmark::TimeLayout(int cut_type, bool flat){
+	LayoutResult aresult;
+	aresult.name = std::string((cut_type==1) ? "single indices" : "pairs of indices")
+	             + ((flat) ? ", flat arrays" : ", STL sets");
+	std::string filename = outputDir+"/"+toolName+"_type"+toString(cut_type)+((flat) ? "_flat" : "_sets")+".root";
+
+	auto start = std::chrono::steady_clock::now();
+	get_ok = WriteCut(filename, cut_type, flat);
+	aresult.write_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	if(not get_ok) return aresult;
+
+	std::ifstream written(filename, std::ios::binary | std::ios::ate);
+	aresult.file_kb = written.tellg()/1024.;
+	written.close();
+
+	start = std::chrono::steady_clock::now();
+	ReadCut(filename, cut_type, aresult.checksum);
+	aresult.read_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+	std::remove(filename.c_str());
+	Log(toolName+" "+aresult.name+": "+toString(aresult.file_kb,0)+" kB, write "+toString(aresult.write_seconds,3)
+	   +" s, read "+toString(aresult.read_seconds,3)+" s",v_message,verbosity);
+	return aresult;
+}
+
+bool CutIndicesBenchmark::WriteCut(std::string filename, int cut_type, bool flat){
+	TFile outfile(filename.c_str(),"RECREATE");
+	if(outfile.IsZombie()){
+		Log(toolName+" could not create "+filename,v_error,verbosity);
+		return false;
+	}
+	MTreeCut* acut = new MTreeCut(&outfile, "benchmark_cut");
+	acut->flat_layout = flat;
+	if(cut_type==1){
+		acut->Initialize(1, "mu_index", std::vector<std::string>{});
+	} else {
+		acut->Initialize(2, std::vector<std::string>{"mu_index","lowe_index"},
+		                 std::vector<std::vector<std::string>>(2));
+	}
+
+	// the same pseudo-random indices for each layout
+	std::mt19937 generator(12345);
+	std::uniform_int_distribution<int> num_dist(1, 2*meanIndices-1);
+	std::uniform_int_distribution<size_t> index_dist(0, maxIndex-1);
+	std::vector<size_t> indices(cut_type);
+	for(long entry_i=0; entry_i<numEntries; ++entry_i){
+		int num_passing = num_dist(generator);
+		for(int pass_i=0; pass_i<num_passing; ++pass_i){
+			for(auto&& anindex : indices) anindex = index_dist(generator);
+			if(cut_type==1) acut->Enter(entry_i, indices.front());
+			else acut->Enter(entry_i, indices);
+		}
+	}
+	acut->Write();
+	// the cut deletes its TTree, which the file would otherwise try to delete again on closing
+	delete acut;
+	outfile.Close();
+	return true;
+}
+
+bool CutIndicesBenchmark::ReadCut(std::string filename, int cut_type, size_t& checksum){
+	TFile* infile = TFile::Open(filename.c_str(),"READ");
+	if(infile==nullptr || infile->IsZombie()){
+		Log(toolName+" could not open "+filename,v_error,verbosity);
+		if(infile) delete infile;
+		return false;
+	}
+	TEntryList* elist = (TEntryList*)infile->Get("TEntryList_benchmark_cut");
+	TTree* indicestree = (TTree*)infile->Get("benchmark_cut");
+	if(elist==nullptr || indicestree==nullptr){
+		Log(toolName+" no cut found in "+filename,v_error,verbosity);
+		infile->Close();
+		delete infile;
+		return false;
+	}
+	checksum=0;
+	{
+		// as MTreeSelection::GetNextEntry and GetPassingIndexes would, visiting every index
+		MTreeCut acut("benchmark_cut", elist, indicestree);  // loads the first entry
+		for(Long64_t entry=acut.GetCurrentEntry(); entry>=0; entry=acut.GetNextEntry()){
+			MTreeIndexSpan passing = (cut_type==1) ? acut.GetPassingIndexes() : acut.GetPassingIndices();
+			for(UInt_t anindex : passing) checksum += anindex;
+		}
+	}
+	infile->Close();
+	delete infile;
+	return true;
+}
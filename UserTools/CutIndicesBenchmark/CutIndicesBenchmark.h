@@ -0,0 +1,72 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef CutIndicesBenchmark_H
+#define CutIndicesBenchmark_H
+
+#include <string>
+#include <iostream>
+#include <vector>
+
+#include "Tool.h"
+
+/**
+* \class CutIndicesBenchmark
+*
+* A tool to compare the two layouts an MTreeCut can use to store the passing array indices of each
+* TTree entry: STL sets, streamed by ROOT (as all cut files used to be written), and plain arrays
+* of the sorted indices. Synthetic cuts are written with each layout, for single indices (type 1)
+* and pairs of indices (type 2), and the file size, write time and read time are compared.
+* The whole benchmark is run in the first Execute call, after which the ToolChain is stopped.
+*
+* $Author: M.O'Flaherty $
+* $Date: 2021/03/22 $
+* Contact: marcus.o-flaherty@warwick.ac.uk
+*/
+class CutIndicesBenchmark: public Tool {
+
+	public:
+	CutIndicesBenchmark();         ///< Simple constructor
+	bool Initialise(std::string configfile,DataModel &data); ///< Initialise function for setting up Tool resources. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
+	bool Execute();   ///< Execute function used to perform Tool purpose.
+	bool Finalise();  ///< Finalise funciton used to clean up resources.
+
+	private:
+	struct LayoutResult {
+		std::string name;
+		double file_kb=0;
+		double write_seconds=0;
+		double read_seconds=0;
+		size_t checksum=0;       // sum of all indices read, which should not depend on the layout
+	};
+
+	// functions
+	// =========
+	// write and read back a cut of the given type (1 or 2), with the given layout
+	LayoutResult TimeLayout(int cut_type, bool flat);
+	bool WriteCut(std::string filename, int cut_type, bool flat);
+	bool ReadCut(std::string filename, int cut_type, size_t& checksum);
+
+	// config variables
+	// ================
+	long numEntries=100000;      // passing TTree entries
+	int meanIndices=10;          // mean passing indices (or pairs) per entry
+	int maxIndex=200;            // indices are drawn from [0, maxIndex)
+	std::string outputDir=".";   // where the cut files are written (they're removed afterwards)
+
+	// tool variables
+	// ==============
+	std::string toolName;
+	std::vector<LayoutResult> results;
+
+	// verbosity levels: if 'verbosity' < this level, the message type will be logged.
+	int verbosity=1;
+	int v_error=0;
+	int v_warning=1;
+	int v_message=2;
+	int v_debug=3;
+	std::string logmessage="";
+	int get_ok=0;
+
+};
+
+
+#endif
@@ -0,0 +1,227 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "CutSelectionBenchmark.h"
+
+#include "MTreeSelection.h"
+#include "MTreeCut.h"
+#include "Algorithms.h"
+#include "type_name_as_string.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TEntryList.h"
+
+#include <map>
+#include <chrono>
+#include <random>
+#include <cstdio>    // std::remove
+
+CutSelectionBenchmark::CutSelectionBenchmark():Tool(){
+	// get the name of the tool from its class name
+	toolName=type_name<decltype(this)>(); toolName.pop_back();
+}
+
+bool CutSelectionBenchmark::Initialise(std::string configfile, DataModel &data){
+
+	if(configfile!="")  m_variables.Initialise(configfile);
+	//m_variables.Print();
+
+	m_data= &data;
+
+	Log(toolName+": Initializing",v_debug,verbosity);
+
+	// Get the Tool configuration variables
+	// ------------------------------------
+	m_variables.Get("verbosity",verbosity);
+	m_variables.Get("numEntries",numEntries);
+	m_variables.Get("numCuts",numCuts);
+	m_variables.Get("passFraction",passFraction);
+	m_variables.Get("followCut",followCut);
+	m_variables.Get("outputDir",outputDir);
+
+	if(numEntries<1 || numCuts<1 || passFraction<=0 || passFraction>1){
+		Log(toolName+" numEntries and numCuts must be positive, and passFraction in (0,1]",v_error,verbosity);
+		return false;
+	}
+	if(followCut<0 || followCut>=numCuts){
+		Log(toolName+" followCut must be in [0, numCuts)",v_error,verbosity);
+		return false;
+	}
+
+	for(int cut_i=0; cut_i<numCuts; ++cut_i){
+		cut_names.push_back("benchmark_cut_"+toString(cut_i));
+	}
+
+	return true;
+}
+
+bool CutSelectionBenchmark::Execute(){
+
+	Log(toolName+" benchmarking "+toString(numCuts)+" cuts on "+toString(numEntries)
+	   +" entries, each passing a fraction "+toString(passFraction),v_message,verbosity);
+
+	std::string filename = outputDir+"/"+toolName+"_cuts.root";
+	get_ok = WriteCuts(filename);
+	if(get_ok){
+		// follow any cut, then a single cut
+		for(std::string cutname : std::vector<std::string>{"", cut_names.at(followCut)}){
+			SelectionResult reference = TimeReference(filename, cutname);
+			SelectionResult selection = TimeSelection(filename, cutname);
+			if(reference.num_entries!=selection.num_entries || reference.checksum!=selection.checksum){
+				Log(toolName+" "+selection.name+" visited different entries or passing cuts to "+reference.name+"!",
+				    v_error,verbosity);
+			}
+			results.push_back(reference);
+			results.push_back(selection);
+		}
+	}
+	std::remove(filename.c_str());
+
+	// all benchmarks are done in one go
+	m_data->vars.Set("StopLoop",1);
+
+	return get_ok;
+}
+
+bool CutSelectionBenchmark::Finalise(){
+
+	std::cout<<"\n"<<toolName<<" results for "<<numCuts<<" cuts on "<<numEntries
+	         <<" entries, each passing a fraction "<<passFraction<<"\n";
+	for(size_t result_i=0; result_i<results.size(); ++result_i){
+		const SelectionResult& aresult = results.at(result_i);
+		// each MTreeSelection result is compared to the reference before it
+		const SelectionResult& baseline = results.at(result_i-(result_i%2));
+		std::cout<<"\t"<<aresult.name<<": "<<aresult.num_entries<<" entries in "
+		         <<toString(aresult.seconds,3)<<" s (x"
+		         <<toString((aresult.seconds>0) ? baseline.seconds/aresult.seconds : 0,2)
+		         <<" speed)"<<std::endl;
+	}
+
+	return true;
+}
+
+bool CutSelectionBenchmark::WriteCuts(std::string filename){
+	// an MTreeSelection with no MTreeReader: passing entries are given explicitly
+	MTreeSelection selection(nullptr, filename);
+	std::vector<CutId> cut_ids;
+	for(auto&& acutname : cut_names) cut_ids.push_back(selection.AddCut(acutname));
+
+	// the gaps between the passing entries of each cut are geometrically distributed
+	std::mt19937 generator(12345);
+	std::geometric_distribution<long> gap_dist(passFraction);
+	for(auto&& acut : cut_ids){
+		for(long entry=gap_dist(generator); entry<numEntries; entry+=1+gap_dist(generator)){
+			selection.AddPassingEvent(acut, nullptr, entry);
+		}
+	}
+	return selection.Write();
+}
+
+CutSelectionBenchmark::SelectionResult CutSelectionBenchmark::TimeSelection(std::string filename, std::string cutname){
+	SelectionResult aresult;
+	aresult.name = ((cutname=="") ? std::string("any cut") : "cut "+cutname)+", MTreeSelection";
+
+	MTreeSelection selection(filename);
+	std::vector<CutId> cut_ids;
+	for(auto&& acutname : cut_names){
+		cut_ids.push_back(selection.GetCutId(acutname));
+		if(not cut_ids.back().IsValid()){
+			Log(toolName+" no cut "+acutname+" in "+filename,v_error,verbosity);
+			return aresult;
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for(Long64_t entry=selection.GetNextEntry(cutname); entry>=0; entry=selection.GetNextEntry(cutname)){
+		++aresult.num_entries;
+		aresult.checksum += entry;
+		for(size_t cut_i=0; cut_i<cut_ids.size(); ++cut_i){
+			if(selection.GetPassesCut(cut_ids[cut_i])) aresult.checksum += cut_i+1;
+		}
+	}
+	aresult.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+	Log(toolName+" "+aresult.name+": "+toString(aresult.num_entries)+" entries in "
+	   +toString(aresult.seconds,3)+" s",v_message,verbosity);
+	return aresult;
+}
+
+CutSelectionBenchmark::SelectionResult CutSelectionBenchmark::TimeReference(std::string filename, std::string cutname){
+	SelectionResult aresult;
+	aresult.name = ((cutname=="") ? std::string("any cut") : "cut "+cutname)+", map of current entries";
+
+	TFile* infile = TFile::Open(filename.c_str(),"READ");
+	if(infile==nullptr || infile->IsZombie()){
+		Log(toolName+" could not open "+filename,v_error,verbosity);
+		if(infile) delete infile;
+		return aresult;
+	}
+	std::map<std::string, MTreeCut*> cuts;   // each loads its first passing entry
+	std::map<std::string, bool> did_pass_cut;
+	for(auto&& acutname : cut_names){
+		TEntryList* elist = (TEntryList*)infile->Get(("TEntryList_"+acutname).c_str());
+		TTree* cuttree = (TTree*)infile->Get(acutname.c_str());
+		if(elist==nullptr || cuttree==nullptr){
+			Log(toolName+" no cut "+acutname+" in "+filename,v_error,verbosity);
+			break;
+		}
+		cuts.emplace(acutname, new MTreeCut(acutname, elist, cuttree));
+		did_pass_cut.emplace(acutname, false);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	bool first_entry=true;
+	while(cuts.size()==cut_names.size()){
+		Long64_t current_entry=-1;
+		if(cutname==""){
+			// group the cuts by their current entry. The lowest is the one just processed:
+			// advance the cuts holding it, and the new lowest is the next entry passing any cut.
+			std::map<Long64_t, std::vector<std::string>> current_entry_numbers;
+			for(auto&& acut : cuts){
+				Long64_t the_entry_number = acut.second->GetCurrentEntry();
+				if(the_entry_number>=0) current_entry_numbers[the_entry_number].push_back(acut.first);
+			}
+			if(not first_entry && not current_entry_numbers.empty()){
+				std::vector<std::string> cuts_to_advance = current_entry_numbers.begin()->second;
+				current_entry_numbers.erase(current_entry_numbers.begin());
+				for(auto&& acut : cuts_to_advance){
+					Long64_t the_entry_number = cuts.at(acut)->GetNextEntry();
+					if(the_entry_number>=0) current_entry_numbers[the_entry_number].push_back(acut);
+				}
+			}
+			if(current_entry_numbers.empty()) break;
+			current_entry = current_entry_numbers.begin()->first;
+			for(auto&& acut : did_pass_cut) acut.second=false;
+			for(auto&& apassedcut : current_entry_numbers.begin()->second) did_pass_cut[apassedcut]=true;
+		} else {
+			// advance the requested cut, then step every other cut up to its entry
+			MTreeCut* thecut = cuts.at(cutname);
+			current_entry = (first_entry) ? thecut->GetCurrentEntry() : thecut->GetNextEntry();
+			if(current_entry<0) break;
+			for(auto&& acut : cuts){
+				if(acut.first==cutname) continue;
+				Long64_t next_passing_entry = acut.second->GetCurrentEntry();
+				while((next_passing_entry<current_entry) && (next_passing_entry>=0)){
+					next_passing_entry = acut.second->GetNextEntry();
+				}
+			}
+			for(auto&& acut : cuts){
+				did_pass_cut[acut.first] = (acut.second->GetCurrentEntry()==current_entry);
+			}
+		}
+		first_entry=false;
+		++aresult.num_entries;
+		aresult.checksum += current_entry;
+		for(size_t cut_i=0; cut_i<cut_names.size(); ++cut_i){
+			if(did_pass_cut[cut_names[cut_i]]) aresult.checksum += cut_i+1;
+		}
+	}
+	aresult.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+	for(auto&& acut : cuts) delete acut.second;
+	infile->Close();
+	delete infile;
+
+	Log(toolName+" "+aresult.name+": "+toString(aresult.num_entries)+" entries in "
+	   +toString(aresult.seconds,3)+" s",v_message,verbosity);
+	return aresult;
+}
@@ -0,0 +1,73 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef CutSelectionBenchmark_H
+#define CutSelectionBenchmark_H
+
+#include <string>
+#include <iostream>
+#include <vector>
+
+#include "Tool.h"
+
+/**
+* \class CutSelectionBenchmark
+*
+* A tool to time MTreeSelection::GetNextEntry over a cut file with many sparse cuts, both following
+* any cut and following one cut, against the way it used to find the next entry: a std::map from
+* each cut's current entry to the cut names, rebuilt on every call, and stepping the other cuts
+* one passing entry at a time up to the entry of the followed cut.
+* The whole benchmark is run in the first Execute call, after which the ToolChain is stopped.
+*
+* $Author: M.O'Flaherty $
+* $Date: 2021/03/22 $
+* Contact: marcus.o-flaherty@warwick.ac.uk
+*/
+class CutSelectionBenchmark: public Tool {
+
+	public:
+	CutSelectionBenchmark();         ///< Simple constructor
+	bool Initialise(std::string configfile,DataModel &data); ///< Initialise function for setting up Tool resources. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
+	bool Execute();   ///< Execute function used to perform Tool purpose.
+	bool Finalise();  ///< Finalise funciton used to clean up resources.
+
+	private:
+	struct SelectionResult {
+		std::string name;
+		double seconds=0;
+		long num_entries=0;      // entries visited
+		size_t checksum=0;       // sum of the entries and the cuts each passes, the same for both methods
+	};
+
+	// functions
+	// =========
+	bool WriteCuts(std::string filename);
+	// iterate over the selection following any cut (cutname "") or one cut
+	SelectionResult TimeSelection(std::string filename, std::string cutname);
+	SelectionResult TimeReference(std::string filename, std::string cutname);
+
+	// config variables
+	// ================
+	long numEntries=10000000;    // TTree entries the cuts are applied to
+	int numCuts=30;              // number of cuts
+	double passFraction=0.001;   // fraction of entries passing each cut
+	int followCut=0;             // which cut to follow when following one cut
+	std::string outputDir=".";   // where the cut file is written (it's removed afterwards)
+
+	// tool variables
+	// ==============
+	std::string toolName;
+	std::vector<std::string> cut_names;
+	std::vector<SelectionResult> results;
+
+	// verbosity levels: if 'verbosity' < this level, the message type will be logged.
+	int verbosity=1;
+	int v_error=0;
+	int v_warning=1;
+	int v_message=2;
+	int v_debug=3;
+	std::string logmessage="";
+	int get_ok=0;
+
+};
+
+
+#endif
@@ -10,6 +10,8 @@ if (tool=="TruthNeutronCaptures_v2") ret=new TruthNeutronCaptures_v2;
 if (tool=="TruthNeutronCaptures_v3") ret=new TruthNeutronCaptures_v3;
 if (tool=="LoadFileList") ret=new LoadFileList;
 if (tool=="RootReadTest") ret=new RootReadTest;
+if (tool=="MTreeReaderBenchmark") ret=new MTreeReaderBenchmark;
+if (tool=="MTreeParallelBenchmark") ret=new MTreeParallelBenchmark;
 if (tool=="PlotNeutronCaptures") ret=new PlotNeutronCaptures;
 if (tool=="GracefulStop") ret=new GracefulStop;
 if (tool=="LoadBetaSpectraFluka") ret=new LoadBetaSpectraFluka;
@@ -24,6 +26,9 @@ if (tool=="TreeReaderDemo") ret=new TreeReaderDemo;
 if (tool=="PythonScript") ret=new PythonScript;
 if (tool=="lf_allfit_new") ret=new lf_allfit_new;
 if (tool=="evDisp") ret=new evDisp;
+if (tool=="CommonsBufferBenchmark") ret=new CommonsBufferBenchmark;
+if (tool=="CutIndicesBenchmark") ret=new CutIndicesBenchmark;
+if (tool=="CutSelectionBenchmark") ret=new CutSelectionBenchmark;
 return ret;
 }
 
@@ -57,6 +57,13 @@ bool FitLi9Lifetime::Initialise(std::string configfile, DataModel &data){
 	myTreeReader = m_data->Trees.at(treeReaderName);
 	myTreeSelections = m_data->Selectors.at(treeReaderName);
 	
+	// look up the branches we'll need, so that each Execute doesn't have to
+	get_ok = GetBranchHandles();
+	if(not get_ok){
+		Log(toolName+" failed to get handles to all required branches!",v_error,verbosity);
+		return false;
+	}
+	
 	return true;
 }
 
@@ -66,7 +73,7 @@ bool FitLi9Lifetime::Execute(){
 	GetBranchValues();
 	
 	// the following cuts are based on muon-lowe pair variables, so loop over muon-lowe pairs
-	std::set<size_t> spall_mu_indices = myTreeSelections->GetPassingIndexes("dlt_mu_lowe>200cm");
+	MTreeIndexSpan spall_mu_indices = myTreeSelections->GetPassingIndexes("dlt_mu_lowe>200cm");
 	Log(toolName+" Looping over "+toString(spall_mu_indices.size())
 				+" preceding muons to look for spallation events",v_debug,verbosity);
 	for(size_t mu_i : spall_mu_indices){
@@ -84,15 +91,23 @@ bool FitLi9Lifetime::Execute(){
 	return true;
 }
 
-bool FitLi9Lifetime::GetBranchValues(){
-	// retrieve variables from branches
+bool FitLi9Lifetime::GetBranchHandles(){
+	// resolve the branch names once up front
 	bool success = 
-	(myTreeReader->Get("LOWE", LOWE)) &&
-	(myTreeReader->Get("spadt", dt_mu_lowe));
+	(myTreeReader->GetBranchHandle("LOWE", LOWE_h)) &&
+	(myTreeReader->GetBranchHandle("spadt", dt_mu_lowe_h));
 	
 	return success;
 }
 
+bool FitLi9Lifetime::GetBranchValues(){
+	// retrieve variables from branches
+	LOWE = LOWE_h.Get();
+	dt_mu_lowe = dt_mu_lowe_h.Get();
+	
+	return true;
+}
+
 
 bool FitLi9Lifetime::Finalise(){
 	
@@ -7,6 +7,7 @@
 
 #include "Tool.h"
 #include "basic_array.h"
+#include "BranchHandle.h"
 #include "SkrootHeaders.h" // MCInfo, Header etc.
 
 class MTreeReader;
@@ -43,6 +44,7 @@ class FitLi9Lifetime: public Tool {
 	
 	// functions
 	// =========
+	bool GetBranchHandles();
 	bool GetBranchValues();
 	bool PlotLi9BetaEnergy();
 	bool PlotLi9LifetimeDt();
@@ -68,6 +70,10 @@ class FitLi9Lifetime: public Tool {
 	const LoweInfo *LOWE  = new LoweInfo;
 	basic_array<float*> dt_mu_lowe;                  // time between muon and lowe event [seconds]
 	
+	// handles to the above branches, resolved in Initialise
+	BranchHandle<LoweInfo> LOWE_h;
+	BranchHandle<basic_array<float*>> dt_mu_lowe_h;
+	
 	// variables to write out
 	// ======================
 	
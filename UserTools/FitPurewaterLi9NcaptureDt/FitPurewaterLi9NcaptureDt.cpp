@@ -52,6 +52,13 @@ bool FitPurewaterLi9NcaptureDt::Initialise(std::string configfile, DataModel &da
 	myTreeReader = m_data->Trees.at(treeReaderName);
 	myTreeSelections = m_data->Selectors.at(treeReaderName);
 	
+	// look up the branches we'll need, so that each Execute doesn't have to
+	get_ok = GetBranchHandles();
+	if(not get_ok){
+		Log(toolName+" failed to get handles to all required branches!",v_error,verbosity);
+		return false;
+	}
+	
 	return true;
 }
 
@@ -61,7 +68,7 @@ bool FitPurewaterLi9NcaptureDt::Execute(){
 	GetBranchValues();
 	
 	// the following cuts are based on muon-lowe pair variables, so loop over muon-lowe pairs
-	std::set<size_t> spall_mu_indices = myTreeSelections->GetPassingIndexes("dlt_mu_lowe>200cm");
+	MTreeIndexSpan spall_mu_indices = myTreeSelections->GetPassingIndexes("dlt_mu_lowe>200cm");
 	Log(toolName+" Looping over "+toString(spall_mu_indices.size())
 				+" preceding muons to look for spallation events",v_debug,verbosity);
 	for(size_t mu_i : spall_mu_indices){
@@ -85,15 +92,23 @@ bool FitPurewaterLi9NcaptureDt::Execute(){
 	return true;
 }
 
-bool FitPurewaterLi9NcaptureDt::GetBranchValues(){
-	// retrieve variables from branches
+bool FitPurewaterLi9NcaptureDt::GetBranchHandles(){
+	// resolve the branch names once up front
 	bool success = 
-	(myTreeReader->Get("np", num_neutron_candidates)) &&
-	(myTreeReader->Get("dt", dt_lowe_n));
+	(myTreeReader->GetBranchHandle("np", num_neutron_candidates_h)) &&
+	(myTreeReader->GetBranchHandle("dt", dt_lowe_n_h));
 	
 	return success;
 }
 
+bool FitPurewaterLi9NcaptureDt::GetBranchValues(){
+	// retrieve variables from branches
+	num_neutron_candidates = *num_neutron_candidates_h;
+	dt_lowe_n = dt_lowe_n_h.Get();
+	
+	return true;
+}
+
 bool FitPurewaterLi9NcaptureDt::Finalise(){
 	
 	// make a new file if given a filename, or if blank check there is a valid file open
@@ -8,6 +8,7 @@
 #include "Tool.h"
 #include "SkrootHeaders.h" // MCInfo, Header etc.
 #include "basic_array.h"
+#include "BranchHandle.h"
 
 class TH1F;
 class MTreeReader;
@@ -33,6 +34,7 @@ class FitPurewaterLi9NcaptureDt: public Tool {
 	private:
 	// functions
 	// =========
+	bool GetBranchHandles();
 	bool GetBranchValues();
 	bool PlotNcaptureDt();
 	double BinnedNcapDtChi2Fit(TH1F* li9_ncap_dt_hist);
@@ -64,6 +66,10 @@ class FitPurewaterLi9NcaptureDt: public Tool {
 	int num_neutron_candidates;                      // num pulses: i.e. num neutrons in AFT window
 	basic_array<float*> dt_lowe_n;                   // dt positron->neutron
 	
+	// handles to the above branches, resolved in Initialise
+	BranchHandle<int> num_neutron_candidates_h;
+	BranchHandle<basic_array<float*>> dt_lowe_n_h;
+	
 	// variables to write out
 	// ======================
 	
@@ -6,6 +6,7 @@
 #include "type_name_as_string.h"
 #include "MTreeReader.h"
 #include "MTreeSelection.h"
+#include "ColumnIterator.h"
 
 #include "TROOT.h"
 #include "TFile.h"
@@ -118,6 +119,7 @@ bool FitSpallationDt::Initialise(std::string configfile, DataModel &data){
 	// for when we're reading files without pre-selection
 	m_variables.Get("run_min",run_min);                  // debug, for when we're loading the dt data directly
 	m_variables.Get("run_max",run_max);                  // debug, for when we're loading the dt data directly
+	m_variables.Get("bulkRead",bulkRead);                // read all dt data in one go, rather than per Execute
 	
 	// various alterations on the fit process while we try to find the source of our discrepancy
 	// against previous versions of this study
@@ -160,6 +162,10 @@ bool FitSpallationDt::Execute(){
 	// the normal analysis using the 2020 spallation dataset directly
 	if(myTreeSelections!=nullptr){
 		Analyse();
+	} else if(bulkRead){
+		// laura's files have no pre-selection, so we can read everything we need in one pass
+		ReadColumnsLaura();
+		m_data->vars.Set("StopLoop",1);
 	} else {
 		// or, as part of debugging, files from laura's processing script
 		Analyse_Laura();
@@ -173,7 +179,7 @@ bool FitSpallationDt::Analyse(){
 	get_ok = GetBranchValues();
 	
 	// the following cuts are based on muon-lowe pair variables, so loop over muon-lowe pairs
-	std::set<size_t> spall_mu_indices = myTreeSelections->GetPassingIndexes("dlt_mu_lowe>200cm");
+	MTreeIndexSpan spall_mu_indices = myTreeSelections->GetPassingIndexes("dlt_mu_lowe>200cm");
 	Log(toolName+" Looping over "+toString(spall_mu_indices.size())
 				+" preceding muons to look for spallation events",v_debug,verbosity);
 	for(size_t mu_i : spall_mu_indices){
@@ -205,6 +211,25 @@ bool FitSpallationDt::Analyse_Laura(){
 	return true;
 }
 
+bool FitSpallationDt::ReadColumnsLaura(){
+	// equivalent to calling Analyse_Laura on every entry, but reading just the branches
+	// we need a chunk of entries at a time, without going through the ToolChain for each entry
+	Log(toolName+" reading dt values from all "+toString(myTreeReader->GetEntries())+" entries",
+		v_message,verbosity);
+	ColumnIterator<float> dt_vals(myTreeReader, "dt");
+	ColumnIterator<int> nrunsk_vals(myTreeReader, "nrunsk");
+	while(dt_vals.Next() && nrunsk_vals.Next()){
+		const std::vector<float>& dts = dt_vals.GetValues();
+		const std::vector<int>& runs = nrunsk_vals.GetValues();
+		for(size_t entry_i=0; entry_i<dts.size(); ++entry_i){
+			if((runs[entry_i]<run_min) || (runs[entry_i]>run_max)) continue;
+			dt_mu_lowe_vals.push_back(dts[entry_i]);
+		}
+	}
+	Log(toolName+" read "+toString(dt_mu_lowe_vals.size())+" dt values",v_debug,verbosity);
+	return true;
+}
+
 bool FitSpallationDt::GetBranchValues(){
 	bool success = (
 		(myTreeReader->Get("spadt",dt_mu_lowe))
@@ -40,6 +40,7 @@ class FitSpallationDt: public Tool {
 	bool GetBranchValues();
 	bool Analyse_Laura();
 	bool GetBranchValuesLaura();
+	bool ReadColumnsLaura();
 	bool GetEnergyCutEfficiencies();
 	bool PlotSpallationDt();
 	bool FitDtDistribution(TH1& dt_mu_lowe_hist_short, int rangenum);
@@ -72,6 +73,7 @@ class FitSpallationDt: public Tool {
 	
 	int run_min=1;
 	int run_max=9999999;
+	bool bulkRead=false;   // read laura's files in one pass, rather than one entry per Execute
 	
 	std::vector<float> dt_mu_lowe_vals;  // data to fit
 	double livetime=0;
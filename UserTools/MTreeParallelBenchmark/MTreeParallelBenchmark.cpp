@@ -0,0 +1,240 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "MTreeParallelBenchmark.h"
+
+#include "Algorithms.h"
+#include "FindFilesInDirectory.h"
+#include "type_name_as_string.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TRandom3.h"
+
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+MTreeParallelBenchmark::MTreeParallelBenchmark():Tool(){
+	// get the name of the tool from its class name
+	toolName=type_name<decltype(this)>(); toolName.pop_back();
+}
+
+bool MTreeParallelBenchmark::Initialise(std::string configfile, DataModel &data){
+
+	if(configfile!="")  m_variables.Initialise(configfile);
+	//m_variables.Print();
+
+	m_data= &data;
+
+	Log(toolName+": Initializing",v_debug,verbosity);
+
+	// Get the Tool configuration variables
+	// ------------------------------------
+	m_variables.Get("verbosity",verbosity);
+	m_variables.Get("inputDirectory",inputDirectory);
+	m_variables.Get("inputPattern",inputPattern);
+	m_variables.Get("treeName",treeName);
+	m_variables.Get("syntheticFilePrefix",syntheticFilePrefix);
+	m_variables.Get("numFiles",numFiles);
+	m_variables.Get("entriesPerFile",entriesPerFile);
+	m_variables.Get("maxThreads",maxThreads);
+	m_variables.Get("rangeEntries",rangeEntries);
+	m_variables.Get("run_min",run_min);
+	m_variables.Get("run_max",run_max);
+
+	// make files to benchmark on, if not given any
+	if(inputDirectory!=""){
+		FindFilesInDirectory(inputDirectory, inputPattern, filelist, false, 0, true);
+		if(filelist.empty()){
+			Log(toolName+" found no files matching "+inputPattern+" in "+inputDirectory,v_error,verbosity);
+			return false;
+		}
+	} else {
+		get_ok = MakeSyntheticFiles();
+		if(not get_ok) return false;
+	}
+
+	get_ok = myParallelReader.Load(filelist, treeName);
+	if(not get_ok){
+		Log(toolName+" failed to load "+toString(filelist.size())+" files",v_error,verbosity);
+		return false;
+	}
+	myParallelReader.SetVerbosity((verbosity>v_message) ? 1 : 0);
+	myParallelReader.SetRangeEntries(rangeEntries);
+	myParallelReader.SetActiveBranches({"nrunsk","bsenergy","nmusave_pre","spadt","spadlt",
+	                                    "mubitrack","np","neutron5"});
+	if(maxThreads<=0) maxThreads = std::max(1, int(std::thread::hardware_concurrency()));
+
+	return true;
+}
+
+bool MTreeParallelBenchmark::Execute(){
+
+	Log(toolName+" benchmarking "+toString(myParallelReader.GetEntries())+" entries in "
+	   +toString(filelist.size())+" files on up to "+toString(maxThreads)+" threads",v_message,verbosity);
+
+	// the single-threaded pass is done first, and gives the reference cut flow
+	for(int num_threads=1; num_threads<=maxThreads; num_threads*=2){
+		get_ok = RunSelection(num_threads);
+		if(not get_ok) break;
+		// make sure we always include the maximum
+		if(num_threads<maxThreads && num_threads*2>maxThreads) num_threads = maxThreads/2;
+	}
+
+	// all benchmarks are done in one go
+	m_data->vars.Set("StopLoop",1);
+
+	return get_ok;
+}
+
+bool MTreeParallelBenchmark::Finalise(){
+
+	std::cout<<"\n"<<toolName<<" results for "<<filelist.size()<<" files ("
+	         <<myParallelReader.GetEntries()<<" entries, "<<num_selected<<" selected muon-lowe pairs)\n";
+	for(auto&& acount : reference_counts){
+		std::cout<<"\t"<<acount.first<<": "<<acount.second<<std::endl;
+	}
+	double single_thread_time = (results.size()) ? results.front().second : 0;
+	for(auto&& aresult : results){
+		std::cout<<"\t"<<aresult.first<<" threads: "<<toString(aresult.second,2)<<" s, speedup x"
+		         <<toString(single_thread_time/aresult.second,2)<<std::endl;
+	}
+
+	return true;
+}
+
+bool MTreeParallelBenchmark::MakeSyntheticFiles(){
+	// make flat trees with the branches used by the spallation selection, with similar contents:
+	// a few preceding muons per lowe event, and occasionally some neutron candidates
+	Log(toolName+" making "+toString(numFiles)+" synthetic files with "+toString(entriesPerFile)
+	   +" entries each",v_message,verbosity);
+
+	const int max_muons = 100;
+	const int max_neutrons = 20;
+	int nrunsk;
+	float bsenergy;
+	int nmusave_pre;
+	float spadt[max_muons];
+	float spadlt[max_muons];
+	int mubitrack[max_muons];
+	int np;
+	float neutron5[max_neutrons];
+
+	TRandom3 rng;
+	for(int file_i=0; file_i<numFiles; ++file_i){
+		std::string filename = syntheticFilePrefix+toString(file_i)+".root";
+		TFile* fout = new TFile(filename.c_str(),"RECREATE");
+		if(fout==nullptr || fout->IsZombie()){
+			Log(toolName+" failed to create synthetic file "+filename,v_error,verbosity);
+			return false;
+		}
+		TTree* tree = new TTree(treeName.c_str(),"MTreeParallelReader benchmark tree");
+		tree->Branch("nrunsk", &nrunsk, "nrunsk/I");
+		tree->Branch("bsenergy", &bsenergy, "bsenergy/F");
+		tree->Branch("nmusave_pre", &nmusave_pre, "nmusave_pre/I");
+		tree->Branch("spadt", spadt, "spadt[nmusave_pre]/F");
+		tree->Branch("spadlt", spadlt, "spadlt[nmusave_pre]/F");
+		tree->Branch("mubitrack", mubitrack, "mubitrack[nmusave_pre]/I");
+		tree->Branch("np", &np, "np/I");
+		tree->Branch("neutron5", neutron5, "neutron5[np]/F");
+
+		// each file is a run
+		nrunsk = 60000+file_i*(80000-60000)/std::max(numFiles,1);
+		for(int entry_i=0; entry_i<entriesPerFile; ++entry_i){
+			bsenergy = rng.Exp(5.);
+			nmusave_pre = std::min(int(rng.Poisson(20)), max_muons);
+			// muons in the 30s preceding the lowe event, in time order
+			for(int mu_i=0; mu_i<nmusave_pre; ++mu_i){
+				spadt[mu_i] = -30.+30.*float(mu_i+rng.Uniform())/nmusave_pre;
+				spadlt[mu_i] = rng.Uniform(0.,1000.);
+				mubitrack[mu_i] = (rng.Uniform()<0.9) ? 0 : 1;
+			}
+			np = std::min(int(rng.Poisson(0.5)), max_neutrons);
+			for(int n_i=0; n_i<np; ++n_i) neutron5[n_i] = rng.Uniform();
+			tree->Fill();
+		}
+
+		tree->Write();
+		fout->Close();
+		delete fout;
+		filelist.push_back(filename);
+	}
+
+	return true;
+}
+
+bool MTreeParallelBenchmark::RunSelection(int num_threads){
+	myParallelReader.SetNumThreads(num_threads);
+	std::vector<std::map<std::string,uint64_t>> cut_counts(num_threads);
+	std::vector<std::vector<float>> dts(num_threads);
+
+	auto start = std::chrono::steady_clock::now();
+	get_ok = myParallelReader.ProcessEntries([this, &cut_counts, &dts](MTreeReader& reader, int worker_i){
+		return ApplyCuts(reader, cut_counts[worker_i], dts[worker_i]);
+	});
+	std::map<std::string,uint64_t> merged_counts = MTreeParallelReader::MergeCounts(cut_counts);
+	std::vector<float> merged_dts = MTreeParallelReader::MergeVectors(dts);
+	auto end = std::chrono::steady_clock::now();
+	if(not get_ok){
+		Log(toolName+" processing failed with "+toString(num_threads)+" threads",v_error,verbosity);
+		return false;
+	}
+
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count()/1.E6;
+	results.emplace_back(num_threads, seconds);
+	Log(toolName+" "+toString(num_threads)+" threads: "+toString(seconds,2)+" s",v_message,verbosity);
+
+	// the result must not depend on the number of threads
+	if(reference_counts.empty()){
+		reference_counts = merged_counts;
+		num_selected = merged_dts.size();
+	} else if(merged_counts!=reference_counts || merged_dts.size()!=num_selected){
+		Log(toolName+" cut flow with "+toString(num_threads)
+		   +" threads does not match the single-threaded cut flow!",v_error,verbosity);
+		return false;
+	}
+
+	return true;
+}
+
+bool MTreeParallelBenchmark::ApplyCuts(MTreeReader& reader, std::map<std::string,uint64_t>& cut_counts, std::vector<float>& dts){
+	// a flat-tree version of the PurewaterSpallAbundanceCuts selection
+	int nrunsk, nmusave_pre, np;
+	float bsenergy;
+	basic_array<float*> spadt, spadlt, neutron5;
+	basic_array<int*> mubitrack;
+	get_ok  = reader.GetBranchValue("nrunsk", nrunsk);
+	get_ok &= reader.GetBranchValue("bsenergy", bsenergy);
+	get_ok &= reader.GetBranchValue("nmusave_pre", nmusave_pre);
+	get_ok &= reader.GetBranchValue("spadt", spadt);
+	get_ok &= reader.GetBranchValue("spadlt", spadlt);
+	get_ok &= reader.GetBranchValue("mubitrack", mubitrack);
+	get_ok &= reader.GetBranchValue("np", np);
+	get_ok &= reader.GetBranchValue("neutron5", neutron5);
+	if(not get_ok) return false;
+
+	++cut_counts["all"];
+	if(nrunsk<=run_min || nrunsk>=run_max) return true;
+	++cut_counts[toString(run_min)+"<run<"+toString(run_max)];
+	if(bsenergy<6.f) return true;
+	++cut_counts["lowe_energy>6MeV"];
+
+	float max_ntag_FOM = (np>0) ? *std::max_element(neutron5.begin(), neutron5.end()) : 0.f;
+	for(int mu_i=0; mu_i<nmusave_pre; ++mu_i){
+		++cut_counts["mu_lowe_pairs"];
+		if(spadt[mu_i]>=0) break;
+		++cut_counts["pre-mu_dt<0"];
+		if(mubitrack[mu_i]>0) continue;
+		++cut_counts["muboy_index==0"];
+		if(spadlt[mu_i]>=200) continue;
+		++cut_counts["dlt_mu_lowe>200cm"];
+		if(bsenergy<=7.5 || bsenergy>=14.5) continue;
+		++cut_counts["lowe_energy_in_li9_range"];
+		if(spadt[mu_i]>-0.05 || spadt[mu_i]<-0.5) continue;
+		++cut_counts["dt_mu_lowe_in_li9_range"];
+		if(max_ntag_FOM<0.995) continue;
+		++cut_counts["ntag_FOM>0.995"];
+		dts.push_back(spadt[mu_i]);
+	}
+
+	return true;
+}
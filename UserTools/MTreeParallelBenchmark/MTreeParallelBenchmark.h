@@ -0,0 +1,78 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef MTreeParallelBenchmark_H
+#define MTreeParallelBenchmark_H
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstdint>
+
+#include "Tool.h"
+#include "MTreeParallelReader.h"
+
+/**
+* \class MTreeParallelBenchmark
+*
+* A tool to measure how MTreeParallelReader scales with the number of threads.
+* By default it generates a synthetic chain of files holding the branches used by the
+* PurewaterSpallAbundanceCuts selection, and applies a flat-tree version of that selection,
+* building the cut flow and the dt distribution of selected muon-lowe pairs.
+* The whole benchmark is run in the first Execute call, after which the ToolChain is stopped.
+*
+* $Author: M.O'Flaherty $
+* $Date: 2021/03/22 $
+* Contact: marcus.o-flaherty@warwick.ac.uk
+*/
+class MTreeParallelBenchmark: public Tool {
+
+	public:
+	MTreeParallelBenchmark();         ///< Simple constructor
+	bool Initialise(std::string configfile,DataModel &data); ///< Initialise function for setting up Tool resources. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
+	bool Execute();   ///< Execute function used to perform Tool purpose.
+	bool Finalise();  ///< Finalise funciton used to clean up resources.
+
+	private:
+	// functions
+	// =========
+	bool MakeSyntheticFiles();
+	bool RunSelection(int num_threads);   // returns false if processing failed
+	// the selection for one entry, with results accumulated into the given cut flow and dt values
+	bool ApplyCuts(MTreeReader& reader, std::map<std::string,uint64_t>& cut_counts, std::vector<float>& dts);
+
+	// config variables
+	// ================
+	std::string inputDirectory="";                     // directory of files to benchmark. If not given,
+	std::string inputPattern=".*\\.root";              // synthetic files are made
+	std::string treeName="data";
+	std::string syntheticFilePrefix="mtreeparallel_benchmark_";
+	int numFiles=100;                                  // synthetic files only
+	int entriesPerFile=2000;                           // synthetic files only
+	int maxThreads=0;                                  // 0: number of hardware threads
+	long rangeEntries=0;                               // 0: one range per file
+	int run_min=61525;
+	int run_max=73031;
+
+	// tool variables
+	// ==============
+	std::string toolName;
+	std::vector<std::string> filelist;
+	MTreeParallelReader myParallelReader;
+	std::vector<std::pair<int,double>> results;        // num threads, seconds
+	std::map<std::string,uint64_t> reference_counts;   // cut flow from the single-threaded pass
+	size_t num_selected=0;
+
+	// verbosity levels: if 'verbosity' < this level, the message type will be logged.
+	int verbosity=1;
+	int v_error=0;
+	int v_warning=1;
+	int v_message=2;
+	int v_debug=3;
+	std::string logmessage="";
+	int get_ok=0;
+
+};
+
+
+#endif
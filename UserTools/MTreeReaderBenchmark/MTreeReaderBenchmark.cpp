@@ -0,0 +1,346 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+#include "MTreeReaderBenchmark.h"
+
+#include "Algorithms.h"
+#include "type_name_as_string.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TClass.h"
+#include "TObject.h"
+#include "TVector3.h"
+#include "TRandom3.h"
+
+#include <chrono>
+#include <cstdio>  // std::remove
+
+MTreeReaderBenchmark::MTreeReaderBenchmark():Tool(){
+	// get the name of the tool from its class name
+	toolName=type_name<decltype(this)>(); toolName.pop_back();
+}
+
+bool MTreeReaderBenchmark::Initialise(std::string configfile, DataModel &data){
+
+	if(configfile!="")  m_variables.Initialise(configfile);
+	//m_variables.Print();
+
+	m_data= &data;
+
+	Log(toolName+": Initializing",v_debug,verbosity);
+
+	// Get the Tool configuration variables
+	// ------------------------------------
+	m_variables.Get("verbosity",verbosity);
+	m_variables.Get("inputFile",inputFile);
+	m_variables.Get("treeName",treeName);
+	m_variables.Get("syntheticFile",syntheticFile);
+	m_variables.Get("numBranches",numBranches);
+	m_variables.Get("numEntries",numEntries);
+	m_variables.Get("maxArraySize",maxArraySize);
+	m_variables.Get("numRepeats",numRepeats);
+	m_variables.Get("columnCacheFile",columnCacheFile);
+
+	// make a file to benchmark on, if not given one
+	if(inputFile==""){
+		get_ok = MakeSyntheticFile();
+		if(not get_ok) return false;
+		inputFile = syntheticFile;
+	}
+
+	get_ok = myTreeReader.Load(inputFile, treeName);
+	if(not get_ok){
+		Log(toolName+" failed to load tree "+treeName+" from file "+inputFile,v_error,verbosity);
+		return false;
+	}
+	myTreeReader.SetVerbosity(0);
+	num_entries = myTreeReader.GetEntries();
+
+	// sort branches by type, and get handles to all those we'll access
+	get_ok = GetBranchLists();
+
+	return get_ok;
+}
+
+bool MTreeReaderBenchmark::Execute(){
+
+	Log(toolName+" benchmarking "+toString(num_entries)+" entries x "+toString(numRepeats)+" repeats",
+		v_message,verbosity);
+
+	// time to read all entries, with all branches enabled
+	myTreeReader.OnlyDisableBranches({});
+	Report("GetEntry, all branches enabled", TimeGetEntry());
+
+	// with no branches enabled this is (approximately) just the MTreeReader overhead
+	myTreeReader.OnlyEnableBranches({});
+	Report("GetEntry, all branches disabled", TimeGetEntry());
+	myTreeReader.OnlyDisableBranches({});
+
+	// the components of that overhead: AutoClear, under each clear policy
+	Report("Clear, all object branches", TimeClear(MTreeReader::ClearPolicy::all), "call");
+	Report("Clear, enabled object branches", TimeClear(MTreeReader::ClearPolicy::enabled), "call");
+	Report("Clear, loaded object branches", TimeClear(MTreeReader::ClearPolicy::loaded), "call");
+
+	std::string nbranches = toString(int_branches.size()+float_branches.size()
+	                                +array_branches.size()+object_branches.size());
+	Report("GetBranchValue, "+nbranches+" branches by name", TimeGetBranchValues());
+	Report("BranchHandle, "+nbranches+" branches", TimeBranchHandles());
+
+	// reading from a column cache, which is built from a full pass over the tree
+	if(columnCacheFile!=""){
+		// the array values retrieved by name from the tree, to check those from the cache against
+		std::vector<double> tree_array_sums = SumArrayValues();
+		std::remove(columnCacheFile.c_str());
+		auto start = std::chrono::steady_clock::now();
+		get_ok = myTreeReader.EnableColumnCache(columnCacheFile);
+		auto end = std::chrono::steady_clock::now();
+		if(not get_ok){
+			Log(toolName+" failed to build column cache "+columnCacheFile,v_error,verbosity);
+		} else {
+			double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+			Report("Column cache build", ns/num_entries);
+			Report("GetEntry, from column cache", TimeGetEntry());
+			Report("BranchHandle, "+nbranches+" branches, from column cache", TimeBranchHandles());
+			std::vector<double> cache_array_sums = SumArrayValues();
+			for(long entry_i=0; entry_i<num_entries; ++entry_i){
+				if(cache_array_sums.at(entry_i)!=tree_array_sums.at(entry_i)){
+					Log(toolName+" array values of entry "+toString(entry_i)+" from the column cache"
+					   +" differ from those in the tree!",v_error,verbosity);
+					break;
+				}
+			}
+			myTreeReader.DisableColumnCache();
+		}
+	}
+
+	Log(toolName+" checksum "+toString(checksum),v_debug,verbosity);
+
+	// all benchmarks are done in one go
+	m_data->vars.Set("StopLoop",1);
+
+	return true;
+}
+
+bool MTreeReaderBenchmark::Finalise(){
+
+	std::cout<<"\n"<<toolName<<" results for "<<inputFile<<" ("<<num_entries<<" entries)\n";
+	for(auto&& aresult : results){
+		std::cout<<"\t"<<aresult.first<<": "<<toString(aresult.second,1)<<" ns"<<std::endl;
+	}
+
+	return true;
+}
+
+bool MTreeReaderBenchmark::MakeSyntheticFile(){
+	// make a flat tree with a mix of branch types, similar to a relic spallation tree:
+	// mostly scalars and variable-size arrays, with a few constant-size arrays and objects.
+	Log(toolName+" making synthetic file "+syntheticFile+" with "+toString(numBranches)
+	   +" branches and "+toString(numEntries)+" entries",v_message,verbosity);
+
+	TFile* fout = new TFile(syntheticFile.c_str(),"RECREATE");
+	if(fout==nullptr || fout->IsZombie()){
+		Log(toolName+" failed to create synthetic file "+syntheticFile,v_error,verbosity);
+		return false;
+	}
+	TTree* tree = new TTree(treeName.c_str(),"MTreeReader benchmark tree");
+
+	// the size branch for all variable size arrays
+	int array_size = 0;
+	tree->Branch("nhits", &array_size, "nhits/I");
+
+	std::vector<int> ints(numBranches);
+	std::vector<float> floats(numBranches);
+	std::vector<std::vector<float>> arrays(numBranches);
+	std::vector<TVector3*> objects(numBranches, nullptr);
+	for(int branch_i=0; branch_i<numBranches; ++branch_i){
+		std::string branchname = "b"+std::to_string(branch_i);
+		if((branch_i%50)==49){
+			objects.at(branch_i) = new TVector3;
+			tree->Branch(branchname.c_str(), &objects.at(branch_i));
+		} else if((branch_i%25)==24){
+			arrays.at(branch_i).resize(3);
+			tree->Branch(branchname.c_str(), arrays.at(branch_i).data(), (branchname+"[3]/F").c_str());
+		} else if((branch_i%3)==0){
+			ints.at(branch_i) = 0;
+			tree->Branch(branchname.c_str(), &ints.at(branch_i), (branchname+"/I").c_str());
+		} else if((branch_i%3)==1){
+			tree->Branch(branchname.c_str(), &floats.at(branch_i), (branchname+"/F").c_str());
+		} else {
+			arrays.at(branch_i).resize(maxArraySize);
+			tree->Branch(branchname.c_str(), arrays.at(branch_i).data(), (branchname+"[nhits]/F").c_str());
+		}
+	}
+
+	TRandom3 rng;
+	for(int entry_i=0; entry_i<numEntries; ++entry_i){
+		array_size = rng.Integer(maxArraySize);
+		for(int branch_i=0; branch_i<numBranches; ++branch_i){
+			ints.at(branch_i) = rng.Integer(1000);
+			floats.at(branch_i) = rng.Uniform();
+			for(auto&& aval : arrays.at(branch_i)) aval = rng.Uniform();
+			if(objects.at(branch_i)) objects.at(branch_i)->SetXYZ(rng.Uniform(),rng.Uniform(),rng.Uniform());
+		}
+		tree->Fill();
+	}
+
+	tree->Write();
+	fout->Close();
+	delete fout;
+	for(auto&& anobject : objects) if(anobject) delete anobject;
+
+	return true;
+}
+
+bool MTreeReaderBenchmark::GetBranchLists(){
+	// we can only retrieve a subset of types, since types must be known at compile time.
+	// other branches are still read by GetEntry, but not included in the access benchmarks.
+	std::map<std::string,std::string> branch_types = myTreeReader.GetBranchTypes();
+	for(auto&& abranch : branch_types){
+		const std::string& branchname = abranch.first;
+		const std::string& branchtype = abranch.second;
+		if(branchtype=="Int_t"){
+			int_branches.push_back(branchname);
+			int_handles.emplace_back();
+			get_ok = myTreeReader.GetBranchHandle(branchname, int_handles.back());
+		} else if(branchtype=="Float_t"){
+			float_branches.push_back(branchname);
+			float_handles.emplace_back();
+			get_ok = myTreeReader.GetBranchHandle(branchname, float_handles.back());
+		} else if(branchtype.substr(0,8)=="Float_t[" &&
+		          branchtype.find_first_of('[')==branchtype.find_last_of('[')){
+			// 1D float arrays only
+			array_branches.push_back(branchname);
+			array_handles.emplace_back();
+			get_ok = myTreeReader.GetBranchHandle(branchname, array_handles.back());
+		} else {
+			TClass* branchclass = TClass::GetClass(branchtype.c_str());
+			if(branchclass==nullptr || not branchclass->InheritsFrom("TObject")) continue;
+			object_branches.push_back(branchname);
+			object_handles.emplace_back();
+			get_ok = myTreeReader.GetBranchHandle(branchname, object_handles.back());
+		}
+		if(not get_ok){
+			Log(toolName+" failed to get handle for branch "+branchname,v_error,verbosity);
+			return false;
+		}
+	}
+	Log(toolName+" will access "+toString(int_branches.size())+" int, "
+	   +toString(float_branches.size())+" float, "+toString(array_branches.size())+" float array and "
+	   +toString(object_branches.size())+" object branches of "+toString(branch_types.size()),
+	   v_message,verbosity);
+
+	return true;
+}
+
+double MTreeReaderBenchmark::TimeGetEntry(){
+	auto start = std::chrono::steady_clock::now();
+	for(int repeat_i=0; repeat_i<numRepeats; ++repeat_i){
+		for(long entry_i=0; entry_i<num_entries; ++entry_i){
+			myTreeReader.GetEntry(entry_i);
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+	return ns/(double(num_entries)*numRepeats);
+}
+
+double MTreeReaderBenchmark::TimeClear(MTreeReader::ClearPolicy policy){
+	// time Clear as called before each GetEntry, for a typical analysis that enables only half
+	// the branches and, reading lazily, accesses only half of those on each entry
+	std::vector<std::string> disabled_branches;
+	for(size_t branch_i=1; branch_i<object_branches.size(); branch_i+=2){
+		disabled_branches.push_back(object_branches.at(branch_i));
+	}
+	myTreeReader.OnlyDisableBranches(disabled_branches);
+	myTreeReader.SetLazyReading(true);
+	myTreeReader.SetClearPolicy(policy);
+	
+	double ns = 0;
+	for(int repeat_i=0; repeat_i<numRepeats; ++repeat_i){
+		for(long entry_i=0; entry_i<num_entries; ++entry_i){
+			myTreeReader.GetEntry(entry_i);
+			for(size_t branch_i=0; branch_i<object_handles.size(); branch_i+=4){
+				checksum += (object_handles.at(branch_i).Get()!=nullptr);
+			}
+			auto start = std::chrono::steady_clock::now();
+			myTreeReader.Clear();
+			auto end = std::chrono::steady_clock::now();
+			ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+		}
+	}
+	
+	myTreeReader.SetLazyReading(false);
+	myTreeReader.OnlyDisableBranches({});
+	myTreeReader.SetClearPolicy(MTreeReader::ClearPolicy::loaded);
+	return ns/(double(num_entries)*numRepeats);
+}
+
+double MTreeReaderBenchmark::TimeGetBranchValues(){
+	// time only the retrieval, not the reading of data from file
+	double ns = 0;
+	int anint;
+	float afloat;
+	basic_array<float*> anarray;
+	const TObject* anobject=nullptr;
+	for(int repeat_i=0; repeat_i<numRepeats; ++repeat_i){
+		for(long entry_i=0; entry_i<num_entries; ++entry_i){
+			myTreeReader.GetEntry(entry_i);
+			auto start = std::chrono::steady_clock::now();
+			for(auto&& branchname : int_branches){
+				myTreeReader.GetBranchValue(branchname, anint);
+				checksum += anint;
+			}
+			for(auto&& branchname : float_branches){
+				myTreeReader.GetBranchValue(branchname, afloat);
+				checksum += afloat;
+			}
+			for(auto&& branchname : array_branches){
+				myTreeReader.GetBranchValue(branchname, anarray);
+				checksum += anarray.size();
+			}
+			for(auto&& branchname : object_branches){
+				myTreeReader.GetBranchValue(branchname, anobject);
+				checksum += (anobject!=nullptr);
+			}
+			auto end = std::chrono::steady_clock::now();
+			ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+		}
+	}
+	return ns/(double(num_entries)*numRepeats);
+}
+
+double MTreeReaderBenchmark::TimeBranchHandles(){
+	// time only the retrieval, not the reading of data from file
+	double ns = 0;
+	for(int repeat_i=0; repeat_i<numRepeats; ++repeat_i){
+		for(long entry_i=0; entry_i<num_entries; ++entry_i){
+			myTreeReader.GetEntry(entry_i);
+			auto start = std::chrono::steady_clock::now();
+			for(auto&& ahandle : int_handles) checksum += *ahandle;
+			for(auto&& ahandle : float_handles) checksum += *ahandle;
+			for(auto&& ahandle : array_handles) checksum += ahandle.Get().size();
+			for(auto&& ahandle : object_handles) checksum += (ahandle.Get()!=nullptr);
+			auto end = std::chrono::steady_clock::now();
+			ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+		}
+	}
+	return ns/(double(num_entries)*numRepeats);
+}
+
+std::vector<double> MTreeReaderBenchmark::SumArrayValues(){
+	// the sum of the values in all benchmarked array branches of each entry, retrieved by name
+	std::vector<double> sums(num_entries, 0);
+	basic_array<float*> anarray;
+	for(long entry_i=0; entry_i<num_entries; ++entry_i){
+		myTreeReader.GetEntry(entry_i);
+		for(auto&& branchname : array_branches){
+			myTreeReader.GetBranchValue(branchname, anarray);
+			for(auto&& aval : anarray) sums.at(entry_i) += aval;
+		}
+	}
+	return sums;
+}
+
+void MTreeReaderBenchmark::Report(std::string benchmark, double ns, std::string per){
+	results.emplace_back(benchmark+" (per "+per+")", ns);
+	Log(toolName+" "+benchmark+": "+toString(ns,1)+" ns per "+per,v_message,verbosity);
+}
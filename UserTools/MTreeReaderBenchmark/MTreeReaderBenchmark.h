@@ -0,0 +1,88 @@
+/* vim:set noexpandtab tabstop=4 wrap filetype=cpp */
+#ifndef MTreeReaderBenchmark_H
+#define MTreeReaderBenchmark_H
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <utility>
+
+#include "Tool.h"
+#include "MTreeReader.h"
+
+class TObject;
+
+/**
+* \class MTreeReaderBenchmark
+*
+* A tool to measure the per-entry overhead of the MTreeReader.
+* By default it benchmarks a synthetic flat TTree with a mix of ~300 primitive, array
+* and object branches, similar to our relic spallation trees.
+* The whole benchmark is run in the first Execute call, after which the ToolChain is stopped.
+*
+* $Author: M.O'Flaherty $
+* $Date: 2021/03/22 $
+* Contact: marcus.o-flaherty@warwick.ac.uk
+*/
+class MTreeReaderBenchmark: public Tool {
+
+	public:
+	MTreeReaderBenchmark();         ///< Simple constructor
+	bool Initialise(std::string configfile,DataModel &data); ///< Initialise function for setting up Tool resources. @param configfile The path and name of the dynamic configuration file to read in. @param data A reference to the transient data class used to pass information between Tools.
+	bool Execute();   ///< Execute function used to perform Tool purpose.
+	bool Finalise();  ///< Finalise funciton used to clean up resources.
+
+	private:
+	// functions
+	// =========
+	bool MakeSyntheticFile();
+	bool GetBranchLists();
+	double TimeGetEntry();          // ns per entry
+	double TimeClear(MTreeReader::ClearPolicy policy);  // ns per call
+	double TimeGetBranchValues();   // ns per entry, looking up all benchmarked branches by name
+	double TimeBranchHandles();     // ns per entry, retrieving all benchmarked branches by handle
+	std::vector<double> SumArrayValues();  // per entry, to check the column cache against the tree
+	void Report(std::string benchmark, double ns, std::string per="entry");
+
+	// config variables
+	// ================
+	std::string inputFile="";                // if not given, a synthetic file will be generated
+	std::string treeName="data";
+	std::string syntheticFile="mtreereader_benchmark.root";
+	int numBranches=300;                     // synthetic file only
+	int numEntries=2000;                     // synthetic file only
+	int maxArraySize=200;                    // synthetic file only
+	int numRepeats=5;                        // number of passes over the tree for each benchmark
+	std::string columnCacheFile="";          // if given, also benchmark reading from a column cache
+
+	// tool variables
+	// ==============
+	std::string toolName;
+	MTreeReader myTreeReader;
+	long num_entries=0;
+	double checksum=0;                       // accumulate retrieved values so nothing is optimized away
+	std::vector<std::pair<std::string,double>> results;
+
+	// branches to access in the access benchmarks, by type
+	std::vector<std::string> int_branches;
+	std::vector<std::string> float_branches;
+	std::vector<std::string> array_branches;
+	std::vector<std::string> object_branches;
+	std::vector<BranchHandle<int>> int_handles;
+	std::vector<BranchHandle<float>> float_handles;
+	std::vector<BranchHandle<basic_array<float*>>> array_handles;
+	std::vector<BranchHandle<TObject>> object_handles;
+
+	// verbosity levels: if 'verbosity' < this level, the message type will be logged.
+	int verbosity=1;
+	int v_error=0;
+	int v_warning=1;
+	int v_message=2;
+	int v_debug=3;
+	std::string logmessage="";
+	int get_ok=0;
+
+};
+
+
+#endif
@@ -39,6 +39,17 @@ bool PlotMuonDtDlt::Initialise(std::string configfile, DataModel &data){
 	
 	myTreeReader = m_data->Trees.at(treeReaderName);
 	myTreeSelections = m_data->Selectors.at(treeReaderName);
+	for(int dt_cut_i=0; dt_cut_i<num_dt_cuts; ++dt_cut_i){
+		pre_mu_dt_cuts.push_back(myTreeSelections->GetCutId("pre_mu_dt_cut_"+toString(dt_cut_i)));
+		post_mu_dt_cuts.push_back(myTreeSelections->GetCutId("post_mu_dt_cut_"+toString(dt_cut_i)));
+	}
+	
+	// look up the branches we'll need, so that each Execute doesn't have to
+	get_ok = GetBranchHandles();
+	if(not get_ok){
+		Log(toolName+" failed to get handles to all required branches!",v_error,verbosity);
+		return false;
+	}
 	
 	return true;
 }
@@ -50,7 +61,7 @@ bool PlotMuonDtDlt::Execute(){
 	
 	// pre muons
 	// only consider first muboy muon (only for multi-mu events?)
-	std::set<size_t> pre_muboy_first_muons = myTreeSelections->GetPassingIndexes("pre_muon_muboy_i==0");
+	MTreeIndexSpan pre_muboy_first_muons = myTreeSelections->GetPassingIndexes("pre_muon_muboy_i==0");
 	for(size_t mu_i : pre_muboy_first_muons){
 		Log(toolName+" filling spallation dt and dlt distributions",v_debug+2,verbosity);
 		dlt_vals_pre.at(mu_class[mu_i]).push_back(dlt_mu_lowe[mu_i]);   // FIXME weight by num_pre_muons
@@ -61,7 +72,7 @@ bool PlotMuonDtDlt::Execute(){
 		// the total - post-muon sample, record both pre- and post- muon samples with various dt cuts
 		for(int dt_cut_i=0; dt_cut_i<num_dt_cuts; ++dt_cut_i){
 			Log(toolName+" checking nominal dlt cut systematic",v_debug+2,verbosity);
-			if(myTreeSelections->GetPassesCut("pre_mu_dt_cut_"+toString(dt_cut_i),mu_i)){
+			if(myTreeSelections->GetPassesCut(pre_mu_dt_cuts[dt_cut_i],mu_i)){
 				Log(toolName+" filling spallation dlt distribution for dt cut "
 				            +toString(dt_cut_i),v_debug+2,verbosity);
 				dlt_systematic_dt_cuts_pre.at(dt_cut_i).push_back(dt_mu_lowe[mu_i]);
@@ -69,7 +80,7 @@ bool PlotMuonDtDlt::Execute(){
 		}
 	}
 	// post muons
-	std::set<size_t> post_muboy_first_muons = myTreeSelections->GetPassingIndexes("post_muon_muboy_i==0");
+	MTreeIndexSpan post_muboy_first_muons = myTreeSelections->GetPassingIndexes("post_muon_muboy_i==0");
 	for(size_t mu_i : post_muboy_first_muons){
 		Log(toolName+" filling spallation dt and dlt distributions",v_debug+2,verbosity);
 		dlt_vals_post.at(mu_class[mu_i]).push_back(dlt_mu_lowe[mu_i]);   // FIXME weight by num_post_muons
@@ -77,7 +88,7 @@ bool PlotMuonDtDlt::Execute(){
 		
 		for(int dt_cut_i=0; dt_cut_i<num_dt_cuts; ++dt_cut_i){
 			Log(toolName+" checking nominal dlt cut systematic",v_debug+2,verbosity);
-			if(myTreeSelections->GetPassesCut("post_mu_dt_cut_"+toString(dt_cut_i),mu_i)){
+			if(myTreeSelections->GetPassesCut(post_mu_dt_cuts[dt_cut_i],mu_i)){
 				Log(toolName+" filling spallation dlt distribution for dt cut "
 				            +toString(dt_cut_i),v_debug+2,verbosity);
 				dlt_systematic_dt_cuts_post.at(dt_cut_i).push_back(dt_mu_lowe[mu_i]);
@@ -90,16 +101,25 @@ bool PlotMuonDtDlt::Execute(){
 	return true;
 }
 
-bool PlotMuonDtDlt::GetBranchValues(){
-	// retrieve variables from branches
+bool PlotMuonDtDlt::GetBranchHandles(){
+	// resolve the branch names once up front
 	bool success = 
-	(myTreeReader->Get("mubstatus", mu_class)) &&
-	(myTreeReader->Get("spadt", dt_mu_lowe)) &&
-	(myTreeReader->Get("spadlt", dlt_mu_lowe));
+	(myTreeReader->GetBranchHandle("mubstatus", mu_class_h)) &&
+	(myTreeReader->GetBranchHandle("spadt", dt_mu_lowe_h)) &&
+	(myTreeReader->GetBranchHandle("spadlt", dlt_mu_lowe_h));
 	
 	return success;
 }
 
+bool PlotMuonDtDlt::GetBranchValues(){
+	// retrieve variables from branches
+	mu_class = mu_class_h.Get();
+	dt_mu_lowe = dt_mu_lowe_h.Get();
+	dlt_mu_lowe = dlt_mu_lowe_h.Get();
+	
+	return true;
+}
+
 bool PlotMuonDtDlt::Finalise(){
 	
 	// make a new file if given a filename, or if blank check there is a valid file open
@@ -8,9 +8,10 @@
 #include "Tool.h"
 #include "SkrootHeaders.h" // MCInfo, Header etc.
 #include "basic_array.h"
+#include "BranchHandle.h"
+#include "MTreeSelection.h"  // CutId
 
 class MTreeReader;
-class MTreeSelection;
 class THStack;
 
 /**
@@ -33,6 +34,7 @@ class PlotMuonDtDlt: public Tool {
 	private:
 	// functions
 	// =========
+	bool GetBranchHandles();
 	bool GetBranchValues();
 	bool PlotMuonDt();
 	bool PlotMuonDlt();
@@ -60,6 +62,8 @@ class PlotMuonDtDlt: public Tool {
 	// TODO retrieve the list of cuts from the MTreeSelection, count how many we have of this type?
 	std::vector<std::vector<float>> dlt_systematic_dt_cuts_pre{5};
 	std::vector<std::vector<float>> dlt_systematic_dt_cuts_post{5};
+	std::vector<CutId> pre_mu_dt_cuts;   // the "pre/post_mu_dt_cut_%d" cuts, looked up once
+	std::vector<CutId> post_mu_dt_cuts;
 	// each entry is a different dt cut, inner vector is the dlts of passing events
 	// for a given dt cut, the difference between values gives the distribution of *spallation* dlt.
 	// across the various dt cuts, the difference between spallation dlt distributions gives
@@ -82,6 +86,11 @@ class PlotMuonDtDlt: public Tool {
 	basic_array<float*> dt_mu_lowe;                  // time between muon and lowe event [seconds]
 	basic_array<float*> dlt_mu_lowe;                 // transverse distance between muon and lowe event [cm]
 	
+	// handles to the above branches, resolved in Initialise
+	BranchHandle<basic_array<int*>> mu_class_h;
+	BranchHandle<basic_array<float*>> dt_mu_lowe_h;
+	BranchHandle<basic_array<float*>> dlt_mu_lowe_h;
+	
 	// variables to write out
 	// ======================
 	
@@ -45,6 +45,13 @@ bool PurewaterSpallAbundanceCuts::Initialise(std::string configfile, DataModel &
 	// get the reader for accessing input file branches
 	myTreeReader = m_data->Trees.at(treeReaderName);
 	
+	// look up the branches we'll need, so that each Execute doesn't have to
+	get_ok = GetBranchHandles();
+	if(not get_ok){
+		Log(toolName+" failed to get handles to all required branches!",v_error,verbosity);
+		return false;
+	}
+	
 	// Set up the tree selector to operate on entries in this tree
 	myTreeSelections.SetTreeReader(myTreeReader);
 	myTreeSelections.MakeOutputFile(outputFile);
@@ -93,6 +100,27 @@ bool PurewaterSpallAbundanceCuts::Initialise(std::string configfile, DataModel &
 		{"mu_lowe_ntag_triplets",		{"spadt","dt"}}
 	};
 	for(auto&& acut : cut_names) myTreeSelections.AddCut(acut.first, acut.second);
+	// look up the cuts once, so that Analyse doesn't find them by name for every event
+	cut_all              = myTreeSelections.GetCutId("all");
+	cut_run_range        = myTreeSelections.GetCutId("61525<run<73031");
+	cut_dwall            = myTreeSelections.GetCutId("dwall>200cm");
+	cut_dt_mu_lowe       = myTreeSelections.GetCutId("dt_mu_lowe>50us");
+	cut_lowe_energy      = myTreeSelections.GetCutId("lowe_energy>6MeV");
+	cut_pre_muboy_first  = myTreeSelections.GetCutId("pre_muon_muboy_i==0");
+	cut_post_muboy_first = myTreeSelections.GetCutId("post_muon_muboy_i==0");
+	cut_mu_lowe_pairs    = myTreeSelections.GetCutId("mu_lowe_pairs");
+	cut_pre_mu_dt_neg    = myTreeSelections.GetCutId("pre-mu_dt<0");
+	cut_muboy_index      = myTreeSelections.GetCutId("muboy_index==0");
+	cut_dlt_mu_lowe      = myTreeSelections.GetCutId("dlt_mu_lowe>200cm");
+	cut_li9_energy       = myTreeSelections.GetCutId("lowe_energy_in_li9_range");
+	cut_li9_dt           = myTreeSelections.GetCutId("dt_mu_lowe_in_li9_range");
+	cut_closest_other_mu = myTreeSelections.GetCutId("closest_other_mu_dt>1ms");
+	cut_ntag_FOM         = myTreeSelections.GetCutId("ntag_FOM>0.995");
+	cut_triplets         = myTreeSelections.GetCutId("mu_lowe_ntag_triplets");
+	for(size_t dt_cut_i=0; dt_cut_i<spall_lifetimes.size(); ++dt_cut_i){
+		cut_pre_mu_dt.push_back(myTreeSelections.GetCutId("pre_mu_dt_cut_"+toString(dt_cut_i)));
+		cut_post_mu_dt.push_back(myTreeSelections.GetCutId("post_mu_dt_cut_"+toString(dt_cut_i)));
+	}
 	
 	// pass the TreeSelections to downstream tools so they can see which events passed which selections
 	intptr_t myTreeSelectionsPtr = reinterpret_cast<intptr_t>(&myTreeSelections);
@@ -128,28 +156,49 @@ bool PurewaterSpallAbundanceCuts::Finalise(){
 	return true;
 }
 
-bool PurewaterSpallAbundanceCuts::GetBranchValues(){
+bool PurewaterSpallAbundanceCuts::GetBranchHandles(){
 	
-	// retrieve variables from TTree to member variables
+	// resolve the branch names once up front
 	int success = 
-	(myTreeReader->Get("HEADER", HEADER)) &&
-	(myTreeReader->Get("LOWE", LOWE)) &&
-	(myTreeReader->Get("ThirdRed", thirdredvars)) &&
-	(myTreeReader->Get("np", num_neutron_candidates)) &&
-	(myTreeReader->Get("N200M", max_hits_200ns_AFT)) &&
-	(myTreeReader->Get("neutron5", ntag_FOM)) &&
-	(myTreeReader->Get("nmusave_pre", num_pre_muons)) &&
-	(myTreeReader->Get("nmusave_post", num_post_muons)) &&
-	(myTreeReader->Get("mubstatus", mu_class)) &&
-	(myTreeReader->Get("mubitrack", mu_index)) &&
-	(myTreeReader->Get("mubgood", mu_fit_goodness)) &&
-	(myTreeReader->Get("spadt", dt_mu_lowe)) &&
-	(myTreeReader->Get("spadlt", dlt_mu_lowe)) &&
-	(myTreeReader->Get("multispa_dist", closest_lowe_60s));
+	(myTreeReader->GetBranchHandle("HEADER", HEADER_h)) &&
+	(myTreeReader->GetBranchHandle("LOWE", LOWE_h)) &&
+	(myTreeReader->GetBranchHandle("ThirdRed", thirdredvars_h)) &&
+	(myTreeReader->GetBranchHandle("np", num_neutron_candidates_h)) &&
+	(myTreeReader->GetBranchHandle("N200M", max_hits_200ns_AFT_h)) &&
+	(myTreeReader->GetBranchHandle("neutron5", ntag_FOM_h)) &&
+	(myTreeReader->GetBranchHandle("nmusave_pre", num_pre_muons_h)) &&
+	(myTreeReader->GetBranchHandle("nmusave_post", num_post_muons_h)) &&
+	(myTreeReader->GetBranchHandle("mubstatus", mu_class_h)) &&
+	(myTreeReader->GetBranchHandle("mubitrack", mu_index_h)) &&
+	(myTreeReader->GetBranchHandle("mubgood", mu_fit_goodness_h)) &&
+	(myTreeReader->GetBranchHandle("spadt", dt_mu_lowe_h)) &&
+	(myTreeReader->GetBranchHandle("spadlt", dlt_mu_lowe_h)) &&
+	(myTreeReader->GetBranchHandle("multispa_dist", closest_lowe_60s_h));
 	
 	return success;
 }
 
+bool PurewaterSpallAbundanceCuts::GetBranchValues(){
+	
+	// retrieve variables from TTree to member variables
+	HEADER = HEADER_h.Get();
+	LOWE = LOWE_h.Get();
+	thirdredvars = thirdredvars_h.Get();
+	num_neutron_candidates = *num_neutron_candidates_h;
+	max_hits_200ns_AFT = *max_hits_200ns_AFT_h;
+	ntag_FOM = ntag_FOM_h.Get();
+	num_pre_muons = *num_pre_muons_h;
+	num_post_muons = *num_post_muons_h;
+	mu_class = mu_class_h.Get();
+	mu_index = mu_index_h.Get();
+	mu_fit_goodness = mu_fit_goodness_h.Get();
+	dt_mu_lowe = dt_mu_lowe_h.Get();
+	dlt_mu_lowe = dlt_mu_lowe_h.Get();
+	closest_lowe_60s = closest_lowe_60s_h.Get();
+	
+	return true;
+}
+
 // #####################################################################
 
 // main body of the tool
@@ -157,7 +206,7 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 	// This gets called for each Execute iteration, to process one lowe event
 	// Apply all cuts in sequence, noting which events pass each cut
 	
-	myTreeSelections.AddPassingEvent("all");
+	myTreeSelections.AddPassingEvent(cut_all);
 	entry_number = myTreeReader->GetEntryNumber();
 	Log(toolName+" entry "+toString(entry_number)+" run "+toString(HEADER->nrunsk),v_debug,verbosity);
 	
@@ -170,7 +219,7 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 		return false;
 	}
 	//if (HEADER->nrunsk > 74781) return false;  // WIT started after this run. What's the significance of this?
-	myTreeSelections.AddPassingEvent("61525<run<73031");
+	myTreeSelections.AddPassingEvent(cut_run_range);
 	
 	IncrementLivetime();
 	
@@ -189,14 +238,14 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 	// dwall > 2m
 	Log(toolName+" checking dwall cut",v_debug+1,verbosity);
 	if(thirdredvars->dwall < 200.) return false;
-	myTreeSelections.AddPassingEvent("dwall>200cm");
+	myTreeSelections.AddPassingEvent(cut_dwall);
 	
 	// dt_muon_lowe > 50us
 	// check the closest preceding muon.
 	// n.b. if muboy found multiple, they all have the same time, so we don't neeed to scan
 	Log(toolName+" checking afterpulsing cut",v_debug+1,verbosity);
 	if(fabs(dt_mu_lowe[num_pre_muons-1]) < 50e-6) return false;
-	myTreeSelections.AddPassingEvent("dt_mu_lowe>50us");
+	myTreeSelections.AddPassingEvent(cut_dt_mu_lowe);
 	
 //	// new set of cuts from atmospheric analysis TODO enable?
 //	Log(toolName+" checking third reduction cuts",v_debug+1,verbosity);
@@ -229,7 +278,7 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 	// cut all lowe events with energy < 6 MeV (mostly non-spallation)
 	Log(toolName+" checking lowe energy > 6 MeV",v_debug+1,verbosity);
 	if( LOWE->bsenergy < 6.f ) return false;
-	myTreeSelections.AddPassingEvent("lowe_energy>6MeV");
+	myTreeSelections.AddPassingEvent(cut_lowe_energy);
 	
 	// find muons within 30 prior to lowe events ( muons identified by: >1000pe in ID ) ✅
 	// find muons within 30s post lowe events    ( muons identified by: >1000pe in ID ) ✅
@@ -244,7 +293,7 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 		// only consider first muboy muon (only for multi-mu events?)
 		Log(toolName+" checking muboy index==0",v_debug+2,verbosity);
 		if(mu_index[mu_i] > 0) continue;
-		myTreeSelections.AddPassingEvent("pre_muon_muboy_i==0",mu_i);
+		myTreeSelections.AddPassingEvent(cut_pre_muboy_first,mu_i);
 		
 		// to evaluate systematic on lt cut, apply various dt cuts and see how the lt cut efficiency varies
 		// since we're interested in the effect on the spallation sample, which is given by
@@ -252,7 +301,7 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 		for(int dt_cut_i=0; dt_cut_i<spall_lifetimes.size(); ++dt_cut_i){
 			Log(toolName+" checking nominal dlt cut",v_debug+2,verbosity);
 			if(fabs(dt_mu_lowe[mu_i]) < spall_lifetimes.at(dt_cut_i)){
-				myTreeSelections.AddPassingEvent(std::string("pre_mu_dt_cut_")+toString(dt_cut_i),mu_i);
+				myTreeSelections.AddPassingEvent(cut_pre_mu_dt[dt_cut_i],mu_i);
 			}
 		}
 	}
@@ -260,12 +309,12 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 	for(size_t mu_i=num_pre_muons; mu_i<(num_pre_muons+num_post_muons); ++mu_i){
 		Log(toolName+" checking muboy index==0",v_debug+2,verbosity);
 		if (mu_index[mu_i] > 0) continue;
-		myTreeSelections.AddPassingEvent("post_muon_muboy_i==0",mu_i);
+		myTreeSelections.AddPassingEvent(cut_post_muboy_first,mu_i);
 		
 		for(int dt_cut_i=0; dt_cut_i<spall_lifetimes.size(); ++dt_cut_i){
 			Log(toolName+" checking nominal dlt cut",v_debug+2,verbosity);
 			if(dt_mu_lowe[mu_i] < spall_lifetimes.at(dt_cut_i)){
-				myTreeSelections.AddPassingEvent(std::string("post_mu_dt_cut_")+toString(dt_cut_i),mu_i);
+				myTreeSelections.AddPassingEvent(cut_post_mu_dt[dt_cut_i],mu_i);
 			}
 		}
 	}
@@ -276,23 +325,23 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 	Log(toolName+" Looping over "+toString(num_pre_muons)
 				+" preceding muons to look for spallation events",v_debug,verbosity);
 	for(size_t mu_i=0; mu_i<num_pre_muons; ++mu_i){
-		myTreeSelections.AddPassingEvent("mu_lowe_pairs", mu_i);
+		myTreeSelections.AddPassingEvent(cut_mu_lowe_pairs, mu_i);
 		
 		// safety check: should not consider muons after lowe event
 		Log(toolName+" checking dt of pre-muon <0",v_debug+2,verbosity);
 		if (dt_mu_lowe[mu_i] >= 0) break;
-		myTreeSelections.AddPassingEvent("pre-mu_dt<0", mu_i);
+		myTreeSelections.AddPassingEvent(cut_pre_mu_dt_neg, mu_i);
 		
 		Log(toolName+" checking muboy index==0",v_debug+2,verbosity);
 		if (mu_index[mu_i] > 0) continue;
-		myTreeSelections.AddPassingEvent("muboy_index==0", mu_i);
+		myTreeSelections.AddPassingEvent(cut_muboy_index, mu_i);
 		
 		// Apply nominal lt cut, unless muon type was misfit or a poorly fit single muon
 		Log(toolName+" checking nominal dlt cut",v_debug+2,verbosity);
 		if(not (dlt_mu_lowe[mu_i] < 200 || mu_class[mu_i] == constants::muboy_classes::misfit || 
 			   (mu_class[mu_i] == constants::muboy_classes::single_thru_going && mu_fit_goodness[mu_i] < 0.4)))
 			    continue;
-		myTreeSelections.AddPassingEvent("dlt_mu_lowe>200cm", mu_i);
+		myTreeSelections.AddPassingEvent(cut_dlt_mu_lowe, mu_i);
 		
 		// That's all for assessing the amount of general spallation isotopes
 		// ------------------------------------------------------------------
@@ -301,12 +350,12 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 		// apply Li9 energy range cut
 		Log(toolName+" checking li9 energy range cut",v_debug+2,verbosity);
 		if ( LOWE->bsenergy <= 7.5 || LOWE->bsenergy >= li9_endpoint ) continue;
-		myTreeSelections.AddPassingEvent("lowe_energy_in_li9_range");
+		myTreeSelections.AddPassingEvent(cut_li9_energy);
 		
 		// apply Li9 lifetime cut
 		Log(toolName+" checking li9 lifetime cut",v_debug+2,verbosity);
 		if( dt_mu_lowe[mu_i] > -0.05 || dt_mu_lowe[mu_i] < -0.5 ) continue;
-		myTreeSelections.AddPassingEvent("dt_mu_lowe_in_li9_range", mu_i);
+		myTreeSelections.AddPassingEvent(cut_li9_dt, mu_i);
 		
 		// no other mu within 1ms of this lowe event
 		Log(toolName+" checking for another muon within 1ms",v_debug+2,verbosity);
@@ -319,7 +368,7 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 			}
 		}
 		if(other_muon_within_1ms) continue;
-		myTreeSelections.AddPassingEvent("closest_other_mu_dt>1ms");
+		myTreeSelections.AddPassingEvent(cut_closest_other_mu);
 		
 		// search for ncapture candidates: >7 hits within 10ns T-TOF in 50ns-535us after lowe events ✅
 		
@@ -328,7 +377,7 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 		if( (num_neutron_candidates==0) || 
 			(*std::max_element(ntag_FOM.begin(), ntag_FOM.end())<ntag_FOM_threshold)) continue;
 		// XXX as reference, we should have 116 remaining candidate events here
-		myTreeSelections.AddPassingEvent("ntag_FOM>0.995");
+		myTreeSelections.AddPassingEvent(cut_ntag_FOM);
 		
 		// apparently in Zhang study no events had multiple ntag candidates
 		if(num_neutron_candidates>1){
@@ -339,7 +388,9 @@ bool PurewaterSpallAbundanceCuts::Analyse(){
 		// plot distribution of beta->ntag dt from passing triplets, compare to fig 5
 		// Zhang had no events with >1 ntag candidate: should we only take the first? XXX
 		for(size_t neutron_i=0; neutron_i<num_neutron_candidates; ++neutron_i){
-			myTreeSelections.AddPassingEvent("mu_lowe_ntag_triplets", {mu_i, neutron_i});
+			triplet_indices[0] = mu_i;
+			triplet_indices[1] = neutron_i;
+			myTreeSelections.AddPassingEvent(cut_triplets, triplet_indices);
 		}
 		
 	} // end loop over muons
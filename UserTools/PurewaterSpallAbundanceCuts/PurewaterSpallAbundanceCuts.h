@@ -3,6 +3,7 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
 
 #include "Tool.h"
 
@@ -42,6 +43,28 @@ class PurewaterSpallAbundanceCuts: public Tool {
 	int entry_number=0;                                         // input TTree entry
 	std::string outputFile="li9_cuts.root";                     // output file to write
 	
+	// handles to the cuts, looked up once in Initialise
+	// =================================================
+	CutId cut_all;
+	CutId cut_run_range;
+	CutId cut_dwall;
+	CutId cut_dt_mu_lowe;
+	CutId cut_lowe_energy;
+	CutId cut_pre_muboy_first;
+	std::vector<CutId> cut_pre_mu_dt;                          // one for each of spall_lifetimes
+	CutId cut_post_muboy_first;
+	std::vector<CutId> cut_post_mu_dt;
+	CutId cut_mu_lowe_pairs;
+	CutId cut_pre_mu_dt_neg;
+	CutId cut_muboy_index;
+	CutId cut_dlt_mu_lowe;
+	CutId cut_li9_energy;
+	CutId cut_li9_dt;
+	CutId cut_closest_other_mu;
+	CutId cut_ntag_FOM;
+	CutId cut_triplets;
+	std::vector<size_t> triplet_indices{0,0};                   // muon and neutron, reused for each triplet
+	
 	// cut configurations
 	// ==================
 	int run_min=0;
@@ -52,6 +75,7 @@ class PurewaterSpallAbundanceCuts: public Tool {
 	
 	// functions
 	// =========
+	bool GetBranchHandles();          // look up tree branches, once
 	bool GetBranchValues();           // retrieve tree branches
 	bool Analyse();                   // main body
 	bool apply_third_reduction(const ThirdRed *th, const LoweInfo *LOWE);
@@ -97,6 +121,22 @@ class PurewaterSpallAbundanceCuts: public Tool {
 //	basic_array<float*> neutdiff;                    // ?
 	basic_array<float*> closest_lowe_60s;            // closest distance to another lowe event within 60s??
 	
+	// handles to the above branches, resolved in Initialise
+	BranchHandle<Header> HEADER_h;
+	BranchHandle<LoweInfo> LOWE_h;
+	BranchHandle<ThirdRed> thirdredvars_h;
+	BranchHandle<int> num_neutron_candidates_h;
+	BranchHandle<int> max_hits_200ns_AFT_h;
+	BranchHandle<basic_array<float*>> ntag_FOM_h;
+	BranchHandle<int> num_pre_muons_h;
+	BranchHandle<int> num_post_muons_h;
+	BranchHandle<basic_array<int*>> mu_class_h;
+	BranchHandle<basic_array<int*>> mu_index_h;
+	BranchHandle<basic_array<float*>> mu_fit_goodness_h;
+	BranchHandle<basic_array<float*>> dt_mu_lowe_h;
+	BranchHandle<basic_array<float*>> dlt_mu_lowe_h;
+	BranchHandle<basic_array<float*>> closest_lowe_60s_h;
+	
 	// crude livetime tracker
 	// ======================
 	struct tm runstart = {0};
@@ -1,14 +1,19 @@
 /* vim:set noexpandtab tabstop=4 wrap */
 #include "TreeReader.h"
 #include "TTree.h"
+#include "TFile.h"
 #include <set>
 #include <bitset>
 #include <algorithm> // std::reverse
+#include <sstream>
+#include <limits>
+#include <cstddef>   // offsetof
 
 #include "Algorithms.h"
 #include "Constants.h"
 #include "type_name_as_string.h"
 #include "MTreeSelection.h"
+#include "HitView.h"
 #include "fortran_routines.h"
 
 // helper function
@@ -78,6 +83,16 @@ bool TreeReader::Initialise(std::string configfile, DataModel &data){
 	// ------------------------------------
 	LoadConfig(configfile);
 	
+	// allocate buffers for copies of the fortran common blocks, if we'll need them
+	if(loadSheAftPairs || entriesPerExecute>1){
+		get_ok = InitCommonsBuffer();
+		if(not get_ok){
+			Log(toolName+" failed to allocate common block buffers",v_error,verbosity);
+			m_data->vars.Set("StopLoop",1);
+			return false;
+		}
+	}
+	
 	// safety check that we were given an input file
 	if(inputFile=="" && FileListName==""){
 		// unless we are working in SKROOT write mode...
@@ -250,8 +265,6 @@ bool TreeReader::Initialise(std::string configfile, DataModel &data){
 			// Despite the name i can't see how 'rflist' actually supports a list,
 			// (possibly as some environmental variable..????)
 			// so we'll have to invoke skopenf for each file as we go until we have none left.
-			// One way we can do this is reverse the list and use pop_back until we run out.
-			std::reverse(list_of_files.begin(), list_of_files.end());
 			
 			// Load the first file
 			LoadNextZbsFile();
@@ -341,10 +354,7 @@ bool TreeReader::Initialise(std::string configfile, DataModel &data){
 				}
 				const Header* header;
 				myTreeReader.Get("HEADER", header);
-				get_ok &= ((header->nrunsk==0 && header->mdrnsk!=0 && header->mdrnsk!= 999999) ||
-				           (std::bitset<8*sizeof(int)>(header->ifevsk).test(19)) ||
-				           (header->nrunsk==0 && header->sk_geometry==0 && header->ifevsk!=0) );
-				if(get_ok==0){
+				if(IsPhysicsHeader(header->nrunsk, header->mdrnsk, header->ifevsk, header->sk_geometry)){
 					// physics entry!
 					isMC = (header->mdrnsk==0 || header->mdrnsk==999999);
 					break;
@@ -378,9 +388,12 @@ bool TreeReader::Initialise(std::string configfile, DataModel &data){
 			std::cout<<"doing isMC check"<<std::endl;
 			while(true){
 				skcread_(&LUN, &get_ok); // get_ok = 0 (physics entry), 1 (error), 2 (EOF), other (non-physics)
+				++zbsNextEntry;
 				Log(toolName + " next isMC scan entry returned "+toString(get_ok),v_debug,verbosity);
 				if(get_ok==0 || get_ok==2) break;
 			}
+			// the first Execute call can use this entry rather than reading it again
+			zbsEntryLoaded = (get_ok==0);
 			std::cout<<"run is "<<skhead_.nrunsk<<", mdrnsk is "<<skhead_.mdrnsk<<std::endl;
 			bool isMC = (skhead_.mdrnsk==0 || skhead_.mdrnsk==999999);
 			m_data->vars.Set("inputIsMC",isMC);
@@ -412,6 +425,43 @@ bool TreeReader::Initialise(std::string configfile, DataModel &data){
 			// and the key "*" was not specified.
 			myTreeReader.OnlyEnableBranches(ActiveInputBranches);
 		}
+		
+		// optionally serve entries from a cache of the decoded values of the enabled branches,
+		// built by reading every entry on first use. There's then nothing left to read lazily or in advance.
+		if(columnCache!=""){
+			if(lazyReading || learnBranches>0 || prefetchEntries>0){
+				Log(toolName+" lazyReading, learnBranches and prefetchEntries are ignored when using a columnCache",
+					v_warning,verbosity);
+				lazyReading = false;
+				learnBranches = 0;
+				prefetchEntries = 0;
+			}
+			Log(toolName+" reading from column cache "+columnCache,v_debug,verbosity);
+			get_ok = myTreeReader.EnableColumnCache(columnCache);
+			if(not get_ok){
+				Log(toolName+" failed to enable column cache "+columnCache+", continuing without",
+					v_warning,verbosity);
+			}
+		}
+		// optionally only read branches as they're accessed by downstream tools
+		if(lazyReading){
+			Log(toolName+" enabling lazy reading",v_debug,verbosity);
+			myTreeReader.SetLazyReading(true);
+		}
+		// optionally work out which branches are used, and disable the rest
+		if(learnBranches>0){
+			Log(toolName+" learning which branches are used over the first "
+				+toString(learnBranches)+" entries",v_debug,verbosity);
+			myTreeReader.LearnBranches(learnBranches);
+		}
+		// optionally read upcoming entries in the background while downstream tools process the current one
+		if(prefetchEntries>0){
+			Log(toolName+" prefetching "+toString(prefetchEntries)+" entries",v_debug,verbosity);
+			get_ok = myTreeReader.EnablePrefetch(prefetchEntries);
+			if(not get_ok){
+				Log(toolName+" failed to enable prefetching, continuing without",v_warning,verbosity);
+			}
+		}
 	}
 	
 	// put the reader into the DataModel, if we have one
@@ -433,6 +483,42 @@ bool TreeReader::Initialise(std::string configfile, DataModel &data){
 		m_data->RegisterReader(readerName, hasAFT, loadSHE, loadAFT, loadCommons);
 	}
 	
+	// with SKROOT files we check whether an SHE is followed by an AFT from the trigger words
+	// of upcoming entries, read in bulk, rather than reading the HEADER of each following entry
+	useTriggerWords = (loadSheAftPairs && skrootMode!=SKROOTMODE::NONE &&
+	                   skrootMode!=SKROOTMODE::ZEBRA && skrootMode!=SKROOTMODE::WRITE);
+	// similarly we find which entries are pedestal or status entries from the HEADER branch,
+	// so that we don't need to call skread on them to find out
+	usePhysicsEntries = (skip_ped_evts && skrootMode!=SKROOTMODE::NONE &&
+	                     skrootMode!=SKROOTMODE::ZEBRA && skrootMode!=SKROOTMODE::WRITE);
+	
+	// if given a run range or an event to start from, look up the corresponding entries
+	// in an index of run and event numbers, rather than scanning through the tree
+	if(run_min>=0 || run_max>=0 || firstEvent!=""){
+		get_ok = SetEntryRangeFromIndex();
+		if(not get_ok) return false;
+	}
+	
+	// with ZEBRA files, counting the entries of each file lets us start from any entry, read only
+	// selected entries, and split the files between several jobs
+	if(skrootMode==SKROOTMODE::ZEBRA && (firstEntry>0 || numShards>1 || selectionsFile!="")){
+		get_ok = CountZbsEntries();
+		if(not get_ok) return false;
+	}
+	
+	// if this is one of several jobs sharing the input, restrict ourselves to our share of the entries
+	if(numShards>1){
+		get_ok = SetShardEntryRange();
+		if(not get_ok) return false;
+	}
+	
+	// if reading several entries per Execute call, also provide them as a batch
+	if(entriesPerExecute>1 && skrootMode!=SKROOTMODE::NONE && skrootMode!=SKROOTMODE::WRITE){
+		// a typical low-e event has ~2000 hits, including those outside the trigger window
+		eventBatch.Reserve(entriesPerExecute, entriesPerExecute*2000);
+		m_data->Batches.emplace(readerName,&eventBatch);
+	}
+	
 	// get first entry to process
 	entrynum = (firstEntry<0) ? 0 : firstEntry;
 	
@@ -456,13 +542,38 @@ bool TreeReader::Initialise(std::string configfile, DataModel &data){
 			Log(toolName+" scanning to first passing entry",v_debug,verbosity);
 			do {
 				entrynum = myTreeSelections->GetNextEntry(cutName);
-			} while(entrynum>0 && entrynum<firstEntry);
-			if(entrynum<0){
+			} while(entrynum>=0 && entrynum<firstEntry);
+			if(entrynum<0 && numShards>1){
+				// nothing in our shard passed the cut, but we still run so that our outputs can be merged
+				Log(toolName+" no entries of shard "+toString(shardIndex)+" pass cut "+cutName,v_warning,verbosity);
+				entrynum = lastEntry;
+			} else if(entrynum<0){
 				Log(toolName+" was given both a selections file and a firstEntry,"
 					+" but no passing entries were found after the specified starting entry!",v_error,verbosity);
 				return false;
 			}
 			Log(toolName+" reading from entry "+toString(entrynum),v_debug,verbosity);
+			
+			// if prefetching, read ahead the entries that will pass the cut, rather than the next entries
+			if(myTreeReader.GetPrefetching()){
+				std::function<std::vector<long>(int)> upcomingEntries
+					= std::bind(std::mem_fn(&MTreeSelection::GetUpcomingEntries), myTreeSelections,
+					            cutName, std::placeholders::_1);
+				myTreeReader.SetPrefetchSource(upcomingEntries);
+			}
+		}
+	}
+	
+	// go to the first entry to read in the ZEBRA files
+	if(zbsEntriesCounted){
+		if(myTreeSelections && loadSheAftPairs){
+			Log(toolName+" readSheAftTogether is not supported with a selectionsFile for ZBS files",
+				v_error,verbosity);
+			return false;
+		}
+		if(entrynum<zbsFileFirstEntries.back()){
+			get_ok = SkipToZbsEntry(entrynum);
+			if(not get_ok) return false;
 		}
 	}
 	
@@ -474,21 +585,78 @@ bool TreeReader::Execute(){
 	// nothing to do in write mode
 	if(skrootMode==SKROOTMODE::WRITE) return true;
 	
+	// nothing to do if our range of entries is empty, as may be the case for a shard
+	if(lastEntry>=0 && entrynum>=lastEntry){
+		m_data->vars.Set("Skip",true);
+		m_data->vars.Set("StopLoop",1);
+		return true;
+	}
+	
 	Log(toolName+" getting entry "+toString(entrynum),v_debug,verbosity);
 	
 	// optionally buffer N entries per Execute call
-	if(entriesPerExecute>1) FlushCommons();
+	if(entriesPerExecute>1){
+		FlushCommons();
+		eventBatch.Clear();
+	}
 	for(int buffer_entry_i=0; buffer_entry_i<entriesPerExecute; ++buffer_entry_i){
 		
+		long aft_entry=-1;  // entry of any AFT we read along with an SHE
+		
 		// For SKROOT files most entries are pedestal or status entries that don't actually
 		// contain detector data relating to a physics event. We'll usually want to skip these,
 		// so if requested (on by default) keep reading until we get an event entry.
 		do {
+			// if the requested runs aren't in entry order, skip entries of other runs without reading them
+			if(not runEntries.empty() && myTreeSelections==nullptr){
+				entrynum = NextRunEntry(entrynum);
+				if(entrynum>=lastEntry){
+					// no more entries of the requested runs
+					get_ok = 0;
+					break;
+				}
+			}
+			
+			// with SKROOT files, skip pedestal and status entries without reading them
+			bool is_physics_entry = true;
+			if(usePhysicsEntries){
+				if(myTreeSelections==nullptr){
+					entrynum = NextPhysicsEntry(entrynum);
+					if(lastEntry>=0 && entrynum>=lastEntry){
+						// no more physics entries in our range
+						get_ok = 0;
+						break;
+					}
+				} else {
+					is_physics_entry = (NextPhysicsEntry(entrynum)==entrynum);
+				}
+			}
+			// (skipping to a physics entry, or following a cut, may land on an entry of another run.
+			// Entries past the end of the run range are left to the checks on lastEntry)
+			bool in_run_range = (runEntries.empty() || entrynum<0 || entrynum>=lastEntry
+			                     || NextRunEntry(entrynum)==entrynum);
+			
+			// with SKROOT files, get the trigger words of this entry and the next before reading them
+			bool have_trigger_words = (useTriggerWords && in_run_range && UpdateTriggerWords(entrynum));
+			
+			// with counted ZEBRA entries, go to the requested entry rather than reading the next.
+			// (SHE+AFT pairs are read sequentially from the starting entry)
+			if(zbsEntriesCounted && not loadSheAftPairs) SkipToZbsEntry(entrynum);
+			
 			// load next entry
-			if(skrootMode==SKROOTMODE::ZEBRA && entrynum>firstEntry){
-				// skip the first read in zebra mode as we already loaded it when checking if MC in Initialize
-				Log(toolName+" skipping very first read as we got it from Initialize",v_debug,verbosity);
-				get_ok = 1;
+			if(not in_run_range){
+				Log(toolName+" entry "+toString(entrynum)+" is not in the requested runs, skipping",
+					v_debug+10,verbosity);
+				get_ok = -999;
+			} else if(not is_physics_entry){
+				Log(toolName+" entry "+toString(entrynum)+" is a pedestal or status entry, skipping",
+					v_debug+10,verbosity);
+				get_ok = -99;
+			} else if(have_trigger_words && onlyPairs && not IsShePair(entrynum)){
+				// we know from the trigger words that this entry isn't an SHE with an AFT: don't read it
+				Log(toolName+" entry "+toString(entrynum)+" is not the SHE of an SHE+AFT pair, skipping",
+					v_debug+10,verbosity);
+				get_ok = -999;
 			} else {
 				Log(toolName+"Reading entry "+toString(entrynum),v_debug,verbosity);
 				get_ok = ReadEntry(entrynum, false);
@@ -496,21 +664,29 @@ bool TreeReader::Execute(){
 				// read the next entry as well to look for SHE+AFT pairs, if applicable
 				if(get_ok==-103){
 					Log(toolName+" Re-Invoking ReadEntry to check next entry",v_debug,verbosity);
-					ReadEntry(entrynum, true);
-					Log(toolName+" Follow-up read returned "+toString(get_ok),v_debug,verbosity);
+					// the AFT is the next entry (zebra files are in any case read sequentially)
+					aft_entry = entrynum+1;
+					int aft_ok = ReadEntry(aft_entry, true);
+					Log(toolName+" Follow-up read returned "+toString(aft_ok),v_debug,verbosity);
 				}
 			}
 			
-			// get the index of the next entry to read.
+			// get the index of the next entry to read, skipping an AFT we've already read.
+			// (with zebra files, if the next entry wasn't an AFT it's buffered to be returned next)
+			bool read_aft = (aft_entry>=0 && (skrootMode!=SKROOTMODE::ZEBRA || has_aft));
 			if(myTreeSelections==nullptr){
 				entrynum++;
+				if(read_aft && entrynum==aft_entry) entrynum++;
 			} else {
 				entrynum = myTreeSelections->GetNextEntry(cutName);
+				if(read_aft && entrynum>=0 && entrynum==aft_entry){
+					entrynum = myTreeSelections->GetNextEntry(cutName);
+				}
 			}
 			
 			// if we're processing ZBS files and have hit the end of this file,
 			// load the next file so we can continue if required.
-			if(get_ok==0 && skrootMode==SKROOTMODE::ZEBRA && list_of_files.size()>0){
+			if(get_ok==0 && skrootMode==SKROOTMODE::ZEBRA && (zbsFileIndex+1)<int(list_of_files.size())){
 				skclosef_(&LUN);
 				LoadNextZbsFile();
 				get_ok = -999;
@@ -519,8 +695,12 @@ bool TreeReader::Execute(){
 		} while((skip_ped_evts && get_ok==-99) || get_ok==-999);
 		// continue to next entry if this is a pedestal/status entry, or if we needed to open a new file.
 		
-		if(entriesPerExecute>1) PushCommons();
 		if(get_ok==0) break;
+		if(entriesPerExecute>1){
+			PushCommons();
+			if(m_data->Batches.count(readerName)) AddBatchEvent();
+		}
+		if(lastEntry>=0 && entrynum>=lastEntry) break;  // end of the requested run range
 	} // read and buffer loop
 	
 	// when processing SKROOT files we can't rely on LoadTree(next_entry)
@@ -540,6 +720,11 @@ bool TreeReader::Execute(){
 		Log(toolName+" hit max events, setting StopLoop",v_message,verbosity);
 		m_data->vars.Set("StopLoop",1);
 	}
+	// check if we've passed the end of the requested run range
+	else if(lastEntry>=0 && entrynum>=lastEntry){
+		Log(toolName+" reached end of run range, setting StopLoop",v_message,verbosity);
+		m_data->vars.Set("StopLoop",1);
+	}
 	// use LoadTree to check if the next entry is valid without loading it
 	// (this checks whether we've hit the end of the TTree/TChain)
 	else if(myTreeReader.GetTree()){  // only possible if we have a TreeReader
@@ -631,18 +816,22 @@ int TreeReader::ReadEntry(long entry_number, bool load_aft){
 				bytesread=0;
 			}
 		} else {
-			// no idea how to specify the entry to read in zebra mode... TODO
-			// for now we'll only support sequential reads
+			// zebra files can only be read sequentially. With counted entries we may have
+			// skipped to another entry beforehand (see SkipToZbsEntry), otherwise we read the next one.
 		}
 		
-		if(skrootMode==SKROOTMODE::ZEBRA && load_aft==false && skhead_vec.size()>0){
+		if(skrootMode==SKROOTMODE::ZEBRA && load_aft==false && commonsBuffer.size()>0){
 			Log(toolName+" buffered ZEBRA entry, it isn't AFT, using in place of read",v_debug,verbosity);
 			// if we have a buffered entry in hand, but it is not marked as an AFT trigger
 			// for the current readout, then the buffered entry is an unprocessed event.
 			// bypass the read and just load in the buffered data into the common blocks.
 			LoadCommons(0);
 			// then pop off the buffered data
-			PopCommons();
+			PopCommons(true);
+		} else if(skrootMode==SKROOTMODE::ZEBRA && load_aft==false && zbsEntryLoaded){
+			// the entry read in Initialise when checking whether this is MC
+			Log(toolName+" using the ZEBRA entry read in Initialise",v_debug,verbosity);
+			zbsEntryLoaded = false;
 		} else {
 			Log(toolName+" reading next entry from file",v_debug,verbosity);
 			// use skread / skrawread to get the next TTree entry and populate Fortran common blocks
@@ -691,6 +880,8 @@ int TreeReader::ReadEntry(long entry_number, bool load_aft){
 			if(skrootMode!=SKROOTMODE::ZEBRA){
 				Log(toolName+" calling skroot_get_entry",v_debug,verbosity);
 				skroot_get_entry_(&LUN);
+			} else {
+				++zbsNextEntry;
 			}
 		}
 		
@@ -829,16 +1020,14 @@ int TreeReader::ReadEntry(long entry_number, bool load_aft){
 					// otherwise no need to check for AFT, just return it for processing.
 				} else {
 					Log(toolName+" prompt event is SHE, peeking at next entry for AFT check",v_debug,verbosity);
-					// this event is SHE. Peek at the next TTree entry to see if it's an associated AFT.
-					get_ok = myTreeReader.GetTree()->GetBranch("HEAD")->GetEntry(entry_number+1);
-					const Header* header;
-					myTreeReader.Get("HEADER", header);
-					std::bitset<sizeof(int)*8> next_trigger_bits = header->idtgsk;
-					get_ok = myTreeReader.GetTree()->GetBranch("HEAD")->GetEntry(entry_number);
+					// this event is SHE. Check the trigger word of the next TTree entry
+					// to see if it's an associated AFT.
+					std::bitset<sizeof(int)*8> next_trigger_bits = GetTriggerWord(entry_number+1);
 					if(next_trigger_bits.test(29)){
 						Log(toolName+" next entry is AFT, requesting follow-up read",v_debug,verbosity);
 						// The next entry is indeed an AFT. We need to read it in properly now,
-						// so buffer the current SHE data...
+						// so buffer the current SHE data, replacing the AFT of any previous pair...
+						if(entriesPerExecute==1) FlushCommons();
 						PushCommons();
 						// ... and indicate that we want to re-run ReadEntry to get the AFT entry.
 						bytesread=-103;
@@ -875,6 +1064,7 @@ int TreeReader::LoadConfig(std::string configfile){
 	
 	bool settingInputBranchNames=false;
 	bool settingOutputBranchNames=false;
+	bool settingBufferedCommons=false;
 	bool skFile=false;
 	
 	// scan over lines in the config file
@@ -907,6 +1097,15 @@ int TreeReader::LoadConfig(std::string configfile){
 		else if(settingInputBranchNames){
 			ActiveInputBranches.push_back(Line);
 		}
+		else if (thekey=="StartBufferedCommonsList"){
+			settingBufferedCommons = true;
+		}
+		else if(thekey=="EndBufferedCommonsList"){
+			settingBufferedCommons = false;
+		}
+		else if(settingBufferedCommons){
+			bufferedCommons.push_back(Line);
+		}
 		else if (thekey=="StartOutputBranchList"){
 			settingOutputBranchNames = true;
 		}
@@ -938,6 +1137,16 @@ int TreeReader::LoadConfig(std::string configfile){
 		else if(thekey=="readSheAftTogether") loadSheAftPairs = stoi(thevalue);
 		else if(thekey=="onlySheAftPairs") onlyPairs = stoi(thevalue);
 		else if(thekey=="entriesPerExecute") entriesPerExecute = stoi(thevalue);
+		else if(thekey=="lazyReading") lazyReading = stoi(thevalue);
+		else if(thekey=="learnBranches") learnBranches = stoi(thevalue);
+		else if(thekey=="prefetchEntries") prefetchEntries = stoi(thevalue);
+		else if(thekey=="run_min") run_min = stoi(thevalue);
+		else if(thekey=="run_max") run_max = stoi(thevalue);
+		else if(thekey=="firstEvent") firstEvent = thevalue;
+		else if(thekey=="eventIndexDir") eventIndexDir = thevalue;
+		else if(thekey=="columnCache") columnCache = thevalue;
+		else if(thekey=="shardIndex") shardIndex = stoi(thevalue);
+		else if(thekey=="numShards") numShards = stoi(thevalue);
 		else {
 			Log(toolName+" error parsing config file line: \""+LineCopy
 				+"\" - unrecognised variable \""+thekey+"\"",v_error,verbosity);
@@ -964,6 +1173,92 @@ int TreeReader::LoadConfig(std::string configfile){
 	return 1;
 }
 
+int TreeReader::SetEntryRangeFromIndex(){
+	// convert a run range and/or starting event into TTree entries
+	if(myTreeReader.GetTree()==nullptr){
+		Log(toolName+" run_min, run_max and firstEvent are only supported for ROOT files",v_error,verbosity);
+		return 0;
+	}
+	Log(toolName+" building event index",v_debug,verbosity);
+	get_ok = myTreeReader.BuildEventIndex(eventIndex, eventIndexDir);
+	if(not get_ok){
+		Log(toolName+" failed to build event index",v_error,verbosity);
+		return 0;
+	}
+	
+	if(run_min>=0 || run_max>=0){
+		int first_run = (run_min>=0) ? run_min : std::numeric_limits<int>::min();
+		int last_run = (run_max>=0) ? run_max : std::numeric_limits<int>::max();
+		std::pair<long,long> entries = eventIndex.GetEntryRange(first_run, last_run);
+		if(entries.first<0){
+			Log(toolName+" found no entries in runs "+toString(run_min)+" to "+toString(run_max),
+				v_error,verbosity);
+			return 0;
+		}
+		Log(toolName+" runs "+toString(run_min)+" to "+toString(run_max)+" are in entries "
+			+toString(entries.first)+" to "+toString(entries.second),v_message,verbosity);
+		firstEntry = std::max(long(firstEntry), entries.first);
+		lastEntry = entries.second;
+		// if the runs aren't in entry order, that range includes entries of other runs: note which to read
+		std::vector<long> run_entries = eventIndex.GetEntries(first_run, last_run);
+		if(long(run_entries.size())<(entries.second-entries.first)){
+			Log(toolName+" runs are not in entry order, skipping "
+				+toString(entries.second-entries.first-long(run_entries.size()))
+				+" entries of other runs in that range",v_message,verbosity);
+			runEntries = std::move(run_entries);
+		}
+	}
+	
+	if(firstEvent!=""){
+		int run, subrun, event;
+		std::stringstream ss(firstEvent);
+		if(not (ss >> run >> subrun >> event)){
+			Log(toolName+" could not parse firstEvent '"+firstEvent+"', expected 'run subrun event'",
+				v_error,verbosity);
+			return 0;
+		}
+		long entry = eventIndex.FindEntry(run, subrun, event);
+		if(entry<0){
+			Log(toolName+" found no entry for firstEvent "+firstEvent,v_error,verbosity);
+			return 0;
+		}
+		firstEntry = entry;
+	}
+	
+	return 1;
+}
+
+int TreeReader::SetShardEntryRange(){
+	// split the entries to process (possibly already limited to a run range) between numShards jobs.
+	// Each gets a consecutive range of whole clusters, so that together they read each entry once.
+	if(myTreeReader.GetTree()==nullptr && not zbsEntriesCounted){
+		Log(toolName+" shardIndex and numShards are only supported for ROOT and ZBS files",v_error,verbosity);
+		return 0;
+	}
+	if(shardIndex<0 || shardIndex>=numShards){
+		Log(toolName+" invalid shardIndex "+toString(shardIndex)+" for "+toString(numShards)+" shards",
+			v_error,verbosity);
+		return 0;
+	}
+	if(maxEntries>0){
+		Log(toolName+" maxEntries applies to each shard, outputs will not match those of an unsharded run",
+			v_warning,verbosity);
+	}
+	std::pair<long,long> entries;
+	if(zbsEntriesCounted) entries = GetZbsShardRange();
+	else entries = myTreeReader.GetShardRange(shardIndex, numShards, firstEntry, lastEntry);
+	if(entries.first<0) return 0;
+	Log(toolName+" shard "+toString(shardIndex)+" of "+toString(numShards)+" will process entries "
+		+toString(entries.first)+" to "+toString(entries.second),v_message,verbosity);
+	if(entries.first==entries.second){
+		Log(toolName+" shard "+toString(shardIndex)+" has no entries to process",v_warning,verbosity);
+	}
+	firstEntry = entries.first;
+	lastEntry = entries.second;
+	
+	return 1;
+}
+
 // return a new LUN. We accept a hint, but will only apply it if not already assigned.
 int TreeReader::GenerateNewLUN(){
 	// each LUN (logic unit number, a fortran file handle (ID) and/or an ID used
@@ -1017,14 +1312,26 @@ void TreeReader::CloseLUN(){
 }
 
 bool TreeReader::LoadNextZbsFile(){
-	// get the next file
-	std::string next_file = list_of_files.back();
-	list_of_files.pop_back();
+	return OpenZbsFile(zbsFileIndex+1);
+}
+
+std::string TreeReader::ResolveZbsPath(std::string filename){
 	// resolve any environmental variables and symlinks
-	std::string cmd = std::string("readlink -f ")+next_file;
+	std::string cmd = std::string("readlink -f ")+filename;
 	Log(toolName+" getting return from command '"+cmd+"'",v_debug+1,verbosity);
-	//next_file = getOutputFromFunctionCall(system, cmd.c_str());  // was crashing???
-	next_file = getOutputFromFunctionCall(safeSystemCall, cmd);
+	//filename = getOutputFromFunctionCall(system, cmd.c_str());  // was crashing???
+	filename = getOutputFromFunctionCall(safeSystemCall, cmd);
+	return filename;
+}
+
+bool TreeReader::OpenZbsFile(int file_i){
+	if(file_i<0 || file_i>=int(list_of_files.size())){
+		Log(toolName+" no ZBS file "+toString(file_i)+" of "+toString(list_of_files.size()),v_error,verbosity);
+		return false;
+	}
+	zbsFileIndex = file_i;
+	if(zbsEntriesCounted) zbsNextEntry = zbsFileFirstEntries.at(file_i);
+	std::string next_file = ResolveZbsPath(list_of_files.at(file_i));
 	Log(toolName+": next ZBS file "+next_file,v_debug,verbosity);
 	
 	// ok now actually open the ZBS file.
@@ -1067,216 +1374,366 @@ bool TreeReader::LoadNextZbsFile(){
 	
 }
 
-int TreeReader::PushCommons(){
-	// make a buffered copy of the current state of event-wise fortran common blocks
-	// so that the user may access both SHE and AFT (or potentially arbitrary) events
+int TreeReader::CountZbsEntries(){
+	// count the entries of each ZBS file from its record structure, without unpacking them
+	zbsFileFirstEntries.assign(1,0);
+	for(auto&& afile : list_of_files){
+		std::string filename = ResolveZbsPath(afile);
+		long num_entries = ZbsEntryCounter::Count(filename);
+		if(num_entries<0){
+			Log(toolName+" failed to count the entries of ZBS file "+filename,v_error,verbosity);
+			return 0;
+		}
+		Log(toolName+" ZBS file "+filename+" has "+toString(num_entries)+" entries",v_debug,verbosity);
+		zbsFileFirstEntries.push_back(zbsFileFirstEntries.back()+num_entries);
+	}
+	Log(toolName+" counted "+toString(zbsFileFirstEntries.back())+" entries in "
+		+toString(list_of_files.size())+" ZBS files",v_message,verbosity);
+	zbsEntriesCounted = true;
+	return 1;
+}
+
+int TreeReader::SkipToZbsEntry(long entry_number){
+	// make the given entry the next one read from the ZBS files. Files before it are not opened,
+	// but zebra files can only be read sequentially, so earlier entries of its file are read
+	// (and unpacked) to get there, from the start of the file if we've already passed it.
+	if(zbsEntryLoaded && entry_number==(zbsNextEntry-1)) return 1;  // we already have it
+	zbsEntryLoaded = false;
+	if(entry_number==zbsNextEntry) return 1;
+	if(entry_number<0 || entry_number>=zbsFileFirstEntries.back()){
+		// nothing to seek to; the next read will report the end of the input
+		return 0;
+	}
+	int file_i = std::upper_bound(zbsFileFirstEntries.begin(), zbsFileFirstEntries.end(), entry_number)
+	             - zbsFileFirstEntries.begin() - 1;
+	// go back to the start of the file if it's not the current one or we've passed the entry
+	if(file_i!=zbsFileIndex || entry_number<zbsNextEntry){
+		Log(toolName+" opening ZBS file "+toString(file_i)+" for entry "+toString(entry_number),v_debug,verbosity);
+		skclosef_(&LUN);
+		if(not OpenZbsFile(file_i)) return 0;
+	}
+	while(zbsNextEntry<entry_number){
+		skcread_(&LUN, &get_ok);
+		++zbsNextEntry;
+		if(get_ok==1 || get_ok==2){
+			Log(toolName+" error skipping to entry "+toString(entry_number)+" of the ZBS files",v_error,verbosity);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+std::pair<long,long> TreeReader::GetZbsShardRange(){
+	// split entries [firstEntry, lastEntry) of the ZBS files into numShards consecutive ranges.
+	// Where there are enough files, ranges start at file boundaries, so no job skips through
+	// entries of a file read by another. Otherwise files are split between jobs.
+	long first_entry = std::max(0, firstEntry);
+	long last_entry = zbsFileFirstEntries.back();
+	if(lastEntry>=0 && lastEntry<last_entry) last_entry = lastEntry;
+	if(first_entry>=last_entry) return std::pair<long,long>{first_entry,first_entry};
+	std::vector<long> boundaries;
+	for(auto&& file_start : zbsFileFirstEntries){
+		if(file_start>first_entry && file_start<last_entry) boundaries.push_back(file_start);
+	}
+	bool by_file = (int(boundaries.size())+1>=numShards);
+	auto shard_start = [&](int shard_i) -> long {
+		if(shard_i==0) return first_entry;
+		if(shard_i==numShards) return last_entry;
+		long target = first_entry + ((last_entry-first_entry)*shard_i)/numShards;
+		if(not by_file) return target;
+		auto it = std::lower_bound(boundaries.begin(), boundaries.end(), target);
+		return (it==boundaries.end()) ? last_entry : *it;
+	};
+	return std::pair<long,long>{shard_start(shardIndex), shard_start(shardIndex+1)};
+}
+
+int TreeReader::UpdateTriggerWords(long entry_number){
+	// make sure we have the trigger words of the given entry and the next, if there is one.
+	// If not, read those of the rest of its file (and the start of the next) in one pass.
+	// Returns 0 if the entry is past the end of the tree, or on error.
+	long last_word = triggerWordsStart+long(triggerWords.size());
+	if(entry_number>=triggerWordsStart && (entry_number+1)<last_word) return 1;
+	TTree* thetree = myTreeReader.GetTree();
+	long local_entry = thetree->LoadTree(entry_number);
+	if(local_entry<0) return 0;
+	long num_entries = thetree->GetTree()->GetEntries()-local_entry+1;
+	Log(toolName+" reading trigger words of entries "+toString(entry_number)+" to "
+		+toString(entry_number+num_entries),v_debug,verbosity);
+	get_ok = myTreeReader.ReadLeafValues({"idtgsk"}, entry_number, num_entries, triggerWords);
+	if(not get_ok){
+		Log(toolName+" error reading trigger words from the HEADER branch",v_error,verbosity);
+		triggerWords.clear();
+		m_data->vars.Set("StopLoop",1);
+		return 0;
+	}
+	triggerWordsStart = entry_number;
+	return 1;
+}
+
+int TreeReader::GetTriggerWord(long entry_number){
+	// 0 if we don't have it, e.g. it's past the end of the tree
+	if(entry_number<triggerWordsStart || entry_number>=(triggerWordsStart+long(triggerWords.size()))) return 0;
+	return triggerWords[entry_number-triggerWordsStart];
+}
+
+bool TreeReader::IsShePair(long entry_number){
+	// is this entry an SHE, followed by an AFT?
+	std::bitset<sizeof(int)*8> trigger_bits = GetTriggerWord(entry_number);
+	std::bitset<sizeof(int)*8> next_trigger_bits = GetTriggerWord(entry_number+1);
+	return (trigger_bits.test(28) && next_trigger_bits.test(29));
+}
+
+long TreeReader::NextRunEntry(long entry_number){
+	// the first entry of runs [run_min, run_max] at or after the given one, or lastEntry if there are none
+	auto next_entry = std::lower_bound(runEntries.begin(), runEntries.end(), entry_number);
+	return (next_entry==runEntries.end()) ? lastEntry : *next_entry;
+}
+
+long TreeReader::NextPhysicsEntry(long entry_number){
+	// the first physics entry at or after the given one. If there are no more,
+	// returns the number of entries, so that the read will hit the end of the tree.
+	while(usePhysicsEntries){
+		if(entry_number<physicsEntriesStart || entry_number>=(physicsEntriesStart+physicsEntries.size())){
+			if(not LoadPhysicsEntries(entry_number)) break;
+		}
+		long next_entry = physicsEntries.Next(entry_number-physicsEntriesStart);
+		if(next_entry>=0) return physicsEntriesStart+next_entry;
+		// none in the rest of this file, try the next one
+		entry_number = physicsEntriesStart+physicsEntries.size();
+	}
+	return entry_number;
+}
+
+int TreeReader::LoadPhysicsEntries(long entry_number){
+	// get which entries of the file containing the given entry are physics entries,
+	// from its sidecar file if we have one, otherwise from the HEADER branch.
+	// Returns 0 if the entry is past the end of the tree, or on error.
+	TTree* thetree = myTreeReader.GetTree();
+	long local_entry = thetree->LoadTree(entry_number);
+	if(local_entry<0) return 0;
+	TTree* currenttree = thetree->GetTree();
+	TFile* currentfile = currenttree->GetCurrentFile();
+	long tree_entries = currenttree->GetEntries();
+	physicsEntriesStart = entry_number-local_entry;
+	
+	// sidecar files are kept alongside the event index ones
+	std::string filename = currentfile->GetName();
+	std::string sidecarname = filename;
+	if(eventIndexDir!=""){
+		sidecarname = eventIndexDir+"/"+filename.substr(filename.find_last_of('/')+1);
+	}
+	sidecarname += "."+std::string(currenttree->GetName())+".physidx";
+	std::string filekey = std::string(currentfile->GetUUID().AsString())+" "
+	                      +std::to_string(currentfile->GetSize())+" headsk";
+	if(physicsEntries.ReadSidecar(sidecarname, filekey, tree_entries)){
+		Log(toolName+" read physics entries of "+filename+" from "+sidecarname,v_debug,verbosity);
+		return 1;
+	}
+	
+	std::vector<int> values;
+	get_ok = myTreeReader.ReadLeafValues({"nrunsk","mdrnsk","ifevsk","sk_geometry"},
+	                                     physicsEntriesStart, tree_entries, values);
+	if(not get_ok){
+		// we can still find them with skread
+		Log(toolName+" error reading the HEADER branch of "+filename+"; pedestal and status entries"
+			+" will be found by reading them",v_error,verbosity);
+		physicsEntries.Clear();
+		usePhysicsEntries = false;
+		return 0;
+	}
+	physicsEntries.Clear();
+	physicsEntries.Resize(tree_entries);
+	for(long tree_entry=0; tree_entry<tree_entries; ++tree_entry){
+		const int* header = values.data()+4*tree_entry;
+		if(IsPhysicsHeader(header[0], header[1], header[2], header[3])) physicsEntries.Set(tree_entry);
+	}
+	Log(toolName+" "+toString(physicsEntries.Count())+" of "+toString(tree_entries)+" entries of "
+		+filename+" are physics entries",v_debug,verbosity);
+	// failing to save them (e.g. to a read-only directory) just means reading them again next time
+	if(not physicsEntries.WriteSidecar(sidecarname, filekey)){
+		Log(toolName+" could not save the physics entries of "+filename
+			+"; specify a writable eventIndexDir to keep them",v_warning,verbosity);
+	}
+	return 1;
+}
+
+bool TreeReader::IsPhysicsHeader(int nrunsk, int mdrnsk, int ifevsk, int sk_geometry){
+	// pedestal and runinfo entries
+	if(nrunsk==0 && mdrnsk!=0 && mdrnsk!=999999) return false;
+	if(std::bitset<8*sizeof(int)>(ifevsk).test(19)) return false;
+	if(nrunsk==0 && sk_geometry==0 && ifevsk!=0) return false;
+	return true;
+}
+
+void TreeReader::AddBatchEvent(){
+	// copy the entry just read from the fortran common blocks into the batch.
+	// If it has an AFT, that's not included: it's still available via LoadEntry.
+	size_t event_i = eventBatch.AddEvent();
+	eventBatch.run[event_i] = skhead_.nrunsk;
+	eventBatch.subrun[event_i] = skhead_.nsubsk;
+	eventBatch.event[event_i] = skhead_.nevsk;
+	eventBatch.trigger_word[event_i] = skhead_.idtgsk;
+	
+	eventBatch.bs_x[event_i] = skroot_lowe_.bsvertex[0];
+	eventBatch.bs_y[event_i] = skroot_lowe_.bsvertex[1];
+	eventBatch.bs_z[event_i] = skroot_lowe_.bsvertex[2];
+	eventBatch.bs_t[event_i] = skroot_lowe_.bsvertex[3];
+	eventBatch.bs_dir_x[event_i] = skroot_lowe_.bsdir[0];
+	eventBatch.bs_dir_y[event_i] = skroot_lowe_.bsdir[1];
+	eventBatch.bs_dir_z[event_i] = skroot_lowe_.bsdir[2];
+	eventBatch.bs_energy[event_i] = skroot_lowe_.bsenergy;
+	eventBatch.bs_goodness[event_i] = skroot_lowe_.bsgood[1];
+	eventBatch.bs_n50[event_i] = skroot_lowe_.bsn50;
+	
+	// all hits, including those outside the trigger window
+	for(const HitView::Hit& ahit : HitView::FromCommons()){
+		eventBatch.AddHit(ahit.t, ahit.q, ahit.cable, ahit.flags);
+	}
+}
+
+int TreeReader::InitCommonsBuffer(){
+	// buffer the event-wise fortran common blocks, or only those listed in bufferedCommons
+	std::vector<std::string> unknown = AddCommonBlocks(commonsBuffer, bufferedCommons);
+	for(auto&& aname : unknown){
+		Log(toolName+" unknown common block "+aname+" in the list of common blocks to buffer",
+			v_warning,verbosity);
+	}
+	
+	// an SHE and its AFT need one buffered entry; buffering N entries per Execute needs N,
+	// and pairs may be looked for within them.
+	size_t capacity = std::max(entriesPerExecute,1);
+	if(loadSheAftPairs) capacity *= 2;
+	Log(toolName+" buffering "+toString(capacity)+" copies of "+toString(commonsBuffer.GetBlockNames().size())
+		+" common blocks",v_debug,verbosity);
+	return commonsBuffer.Allocate(capacity);
+}
+
+std::vector<std::string> TreeReader::AddCommonBlocks(CommonBlockBuffer& buffer, const std::vector<std::string>& blocknames,
+                                                     bool by_hits){
+	// register the event-wise fortran common blocks that may be populated by skread,
+	// so that the user may access both SHE and AFT (or potentially arbitrary) events.
+	// Each is only added if listed in blocknames, or if that list is empty.
 	// TODO remove any that are not set by skread and used by reco algorithms
+	std::vector<std::string> registered;
+	auto addCommon = [&buffer, &blocknames, &registered](std::string name, void* common, size_t size){
+		registered.push_back(name);
+		if(blocknames.size() && std::find(blocknames.begin(), blocknames.end(), name)==blocknames.end()) return;
+		buffer.AddBlock(name, common, size);
+	};
 	
 	// event header - run, event numbers, trigger info...
-	skhead_vec.emplace_back(skhead_);            // skhead_common
-	skheada_vec.emplace_back(skheada_);          // skheada_common
-	skheadg_vec.emplace_back(skheadg_);          // skheadg_common
-	skheadf_vec.emplace_back(skheadf_);          // skheadf_common
-	skheadc_vec.emplace_back(skheadc_);          // skheadc_common
-	skheadqb_vec.emplace_back(skheadqb_);        // skheadqb_common
+	addCommon("skhead", &skhead_, sizeof(skhead_));
+	addCommon("skheada", &skheada_, sizeof(skheada_));
+	addCommon("skheadg", &skheadg_, sizeof(skheadg_));
+	addCommon("skheadf", &skheadf_, sizeof(skheadf_));
+	addCommon("skheadc", &skheadc_, sizeof(skheadc_));
+	addCommon("skheadqb", &skheadqb_, sizeof(skheadqb_));
 	
 	// low-e event variables
-	skroot_lowe_vec.emplace_back(skroot_lowe_);  // skroot_lowe_common
-	skroot_mu_vec.emplace_back(skroot_mu_);      // skroot_mu_common
-	skroot_sle_vec.emplace_back(skroot_sle_);    // skroot_sle_common
+	addCommon("skroot_lowe", &skroot_lowe_, sizeof(skroot_lowe_));
+	addCommon("skroot_mu", &skroot_mu_, sizeof(skroot_mu_));
+	addCommon("skroot_sle", &skroot_sle_, sizeof(skroot_sle_));
 	
 	// commons containing arrays of T, Q, ICAB....
 	// not sure which of these may be populated by skread
-	skq_vec.emplace_back(skq_);                  // skq_common
-	skqa_vec.emplace_back(skqa_);                // skqa_common
-	skt_vec.emplace_back(skt_);                  // skt_common
-	skta_vec.emplace_back(skta_);                // skta_common
-	skchnl_vec.emplace_back(skchnl_);            // skchnl_common
-	skthr_vec.emplace_back(skthr_);              // skthr_common
-	sktqz_vec.emplace_back(sktqz_);              // sktqz_common
-	sktqaz_vec.emplace_back(sktqaz_);            // sktqaz_common
-	rawtqinfo_vec.emplace_back(rawtqinfo_);      // rawtqinfo_common
-	
-	sktrighit_vec.emplace_back(sktrighit_);      // sktrighit_common
-	skqv_vec.emplace_back(skqv_);                // skqv_common
-	sktv_vec.emplace_back(sktv_);                // sktv_common
-	skchlv_vec.emplace_back(skchlv_);            // skchlv_common
-	skthrv_vec.emplace_back(skthrv_);            // skthrv_common
-	skhitv_vec.emplace_back(skhitv_);            // skhitv_common
-	skpdstv_vec.emplace_back(skpdstv_);          // skpdstv_common
-	skatmv_vec.emplace_back(skatmv_);            // skatmv_common
+	addCommon("skq", &skq_, sizeof(skq_));
+	addCommon("skqa", &skqa_, sizeof(skqa_));
+	addCommon("skt", &skt_, sizeof(skt_));
+	addCommon("skta", &skta_, sizeof(skta_));
+	addCommon("skchnl", &skchnl_, sizeof(skchnl_));
+	addCommon("skthr", &skthr_, sizeof(skthr_));
+	addCommon("sktqz", &sktqz_, sizeof(sktqz_));
+	addCommon("sktqaz", &sktqaz_, sizeof(sktqaz_));
+	addCommon("rawtqinfo", &rawtqinfo_, sizeof(rawtqinfo_));
+	
+	addCommon("sktrighit", &sktrighit_, sizeof(sktrighit_));
+	addCommon("skqv", &skqv_, sizeof(skqv_));
+	addCommon("sktv", &sktv_, sizeof(sktv_));
+	addCommon("skchlv", &skchlv_, sizeof(skchlv_));
+	addCommon("skthrv", &skthrv_, sizeof(skthrv_));
+	addCommon("skhitv", &skhitv_, sizeof(skhitv_));
+	addCommon("skpdstv", &skpdstv_, sizeof(skpdstv_));
+	addCommon("skatmv", &skatmv_, sizeof(skatmv_));
 	
 	// OD mask....? nhits, charge, flag...?
-	odmaskflag_vec.emplace_back(odmaskflag_);    // odmaskflag_common
+	addCommon("odmaskflag", &odmaskflag_, sizeof(odmaskflag_));
 	
 	// hardware trigger variables; counters, trigger words, prevt0...
 	// no idea how many, if any, of these are populated by skread,
 	// or moreover how many are needed by reconstruction algorithms.
 	
 	// spacer and trigger info.
-	skdbstat_vec.emplace_back(skdbstat_);        // skdbstat_common
-	skqbstat_vec.emplace_back(skqbstat_);        // skqbstat_common
-	skspacer_vec.emplace_back(skspacer_);        // skspacer_common
+	addCommon("skdbstat", &skdbstat_, sizeof(skdbstat_));
+	addCommon("skqbstat", &skqbstat_, sizeof(skqbstat_));
+	addCommon("skspacer", &skspacer_, sizeof(skspacer_));
 	
 	// gps word and time.
-	skgps_vec.emplace_back(skgps_);              // skgps_common
-	t2kgps_vec.emplace_back(t2kgps_);            // t2kgps_common
+	addCommon("skgps", &skgps_, sizeof(skgps_));
+	addCommon("t2kgps", &t2kgps_, sizeof(t2kgps_));
 	
 	// hw counter difference to previous event.
-	prevt0_vec.emplace_back(prevt0_);            // prevt0_common
-	tdiff_vec.emplace_back(tdiff_);              // tdiff_common
-	mintdiff_vec.emplace_back(mintdiff_);        // mintdiff_common
+	addCommon("prevt0", &prevt0_, sizeof(prevt0_));
+	addCommon("tdiff", &tdiff_, sizeof(tdiff_));
+	addCommon("mintdiff", &mintdiff_, sizeof(mintdiff_));
 	
 	// trigger hardware counters, word, spacer length...
-	sktrg_vec.emplace_back(sktrg_);              // sktrg_common
+	addCommon("sktrg", &sktrg_, sizeof(sktrg_));
 	
 	// MC particles and vertices, event-wise.
-	vcvrtx_vec.emplace_back(vcvrtx_);            // vcvrtx_common
-	vcwork_vec.emplace_back(vcwork_);            // vcwork_common
+	addCommon("vcvrtx", &vcvrtx_, sizeof(vcvrtx_));
+	addCommon("vcwork", &vcwork_, sizeof(vcwork_));
+	
+	// the TQ arrays of hits are only filled up to the number of hits, so only copy that much.
+	// The arrays of skq_ and skt_ are indexed by cable number, so are copied whole.
+	if(by_hits){
+		buffer.AddHitArray("skchnl", offsetof(skchnl_common, ihcab), sizeof(skchnl_.ihcab[0]),
+		                   sizeof(skchnl_.ihcab)/sizeof(skchnl_.ihcab[0]), &skq_.nqisk);
+		buffer.AddHitArray("sktqz", offsetof(sktqz_common, tiskz), sizeof(sktqz_.tiskz[0]),
+		                   sizeof(sktqz_.tiskz)/sizeof(sktqz_.tiskz[0]), &sktqz_.nqiskz);
+		buffer.AddHitArray("sktqz", offsetof(sktqz_common, qiskz), sizeof(sktqz_.qiskz[0]),
+		                   sizeof(sktqz_.qiskz)/sizeof(sktqz_.qiskz[0]), &sktqz_.nqiskz);
+		buffer.AddHitArray("sktqz", offsetof(sktqz_common, icabiz), sizeof(sktqz_.icabiz[0]),
+		                   sizeof(sktqz_.icabiz)/sizeof(sktqz_.icabiz[0]), &sktqz_.nqiskz);
+	}
 	
-	return skhead_vec.size();
+	std::vector<std::string> unknown;
+	for(auto&& aname : blocknames){
+		if(std::find(registered.begin(), registered.end(), aname)==registered.end()) unknown.push_back(aname);
+	}
+	return unknown;
 }
 
-int TreeReader::PopCommons(){
+int TreeReader::PushCommons(){
+	// make a buffered copy of the current state of event-wise fortran common blocks
+	if(not commonsBuffer.Push()){
+		Log(toolName+" Error! Failed to buffer common blocks, buffer holds "+toString(commonsBuffer.size())
+			+" of "+toString(commonsBuffer.capacity())+" entries",v_error,verbosity);
+	}
+	return commonsBuffer.size();
+}
+
+int TreeReader::PopCommons(bool oldest){
 	// drop an entry from the buffered common blocks
-	// TODO remove any that are not set by skread and used by reco algorithms
-	
-	skhead_vec.pop_back();
-	skheada_vec.pop_back();
-	skheadg_vec.pop_back();
-	skheadf_vec.pop_back();
-	skheadc_vec.pop_back();
-	skheadqb_vec.pop_back();
-	skroot_lowe_vec.pop_back();
-	skroot_mu_vec.pop_back();
-	skroot_sle_vec.pop_back();
-	skq_vec.pop_back();
-	skqa_vec.pop_back();
-	skt_vec.pop_back();
-	skta_vec.pop_back();
-	skchnl_vec.pop_back();
-	skthr_vec.pop_back();
-	sktqz_vec.pop_back();
-	sktqaz_vec.pop_back();
-	rawtqinfo_vec.pop_back();
-	sktrighit_vec.pop_back();
-	skqv_vec.pop_back();
-	sktv_vec.pop_back();
-	skchlv_vec.pop_back();
-	skthrv_vec.pop_back();
-	skhitv_vec.pop_back();
-	skpdstv_vec.pop_back();
-	skatmv_vec.pop_back();
-	odmaskflag_vec.pop_back();
-	skdbstat_vec.pop_back();
-	skqbstat_vec.pop_back();
-	skspacer_vec.pop_back();
-	skgps_vec.pop_back();
-	t2kgps_vec.pop_back();
-	prevt0_vec.pop_back();
-	tdiff_vec.pop_back();
-	mintdiff_vec.pop_back();
-	sktrg_vec.pop_back();
-	vcvrtx_vec.pop_back();
-	vcwork_vec.pop_back();
-	
-	return skhead_vec.size();
+	commonsBuffer.Pop(oldest);
+	return commonsBuffer.size();
 }
 
 int TreeReader::FlushCommons(){
 	// drop all entries from the buffered common blocks
-	// TODO remove any that are not set by skread and used by reco algorithms
-	
-	skhead_vec.clear();
-	skheada_vec.clear();
-	skheadg_vec.clear();
-	skheadf_vec.clear();
-	skheadc_vec.clear();
-	skheadqb_vec.clear();
-	skroot_lowe_vec.clear();
-	skroot_mu_vec.clear();
-	skroot_sle_vec.clear();
-	skq_vec.clear();
-	skqa_vec.clear();
-	skt_vec.clear();
-	skta_vec.clear();
-	skchnl_vec.clear();
-	skthr_vec.clear();
-	sktqz_vec.clear();
-	sktqaz_vec.clear();
-	rawtqinfo_vec.clear();
-	sktrighit_vec.clear();
-	skqv_vec.clear();
-	sktv_vec.clear();
-	skchlv_vec.clear();
-	skthrv_vec.clear();
-	skhitv_vec.clear();
-	skpdstv_vec.clear();
-	skatmv_vec.clear();
-	odmaskflag_vec.clear();
-	skdbstat_vec.clear();
-	skqbstat_vec.clear();
-	skspacer_vec.clear();
-	skgps_vec.clear();
-	t2kgps_vec.clear();
-	prevt0_vec.clear();
-	tdiff_vec.clear();
-	mintdiff_vec.clear();
-	sktrg_vec.clear();
-	vcvrtx_vec.clear();
-	vcwork_vec.clear();
-	
+	commonsBuffer.Flush();
 	return 1;
 }
 
 bool TreeReader::LoadCommons(int buffer_i){
 	// check we have such a buffered entry
-	if(buffer_i>=skhead_vec.size()){
+	if(buffer_i<0 || buffer_i>=int(commonsBuffer.size())){
 		Log(toolName+" Error! Asked to load common block buffer entry "+toString(buffer_i)
-			+" out of range 0->"+skhead_vec.size()+"!",v_error,verbosity);
+			+" out of range 0->"+toString(commonsBuffer.size())+"!",v_error,verbosity);
 		return false;
 	}
 	
-	std::swap(skhead_, skhead_vec.at(buffer_i));
-	std::swap(skheada_, skheada_vec.at(buffer_i));
-	std::swap(skheadg_, skheadg_vec.at(buffer_i));
-	std::swap(skheadf_, skheadf_vec.at(buffer_i));
-	std::swap(skheadc_, skheadc_vec.at(buffer_i));
-	std::swap(skheadqb_, skheadqb_vec.at(buffer_i));
-	std::swap(skroot_lowe_,skroot_lowe_vec.at(buffer_i));
-	std::swap(skroot_mu_,skroot_mu_vec.at(buffer_i));
-	std::swap(skroot_sle_,skroot_sle_vec.at(buffer_i));
-	std::swap(skq_, skq_vec.at(buffer_i));
-	std::swap(skqa_, skqa_vec.at(buffer_i));
-	std::swap(skt_, skt_vec.at(buffer_i));
-	std::swap(skta_, skta_vec.at(buffer_i));
-	std::swap(skchnl_, skchnl_vec.at(buffer_i));
-	std::swap(skthr_, skthr_vec.at(buffer_i));
-	std::swap(sktqz_, sktqz_vec.at(buffer_i));
-	std::swap(sktqaz_, sktqaz_vec.at(buffer_i));
-	std::swap(rawtqinfo_, rawtqinfo_vec.at(buffer_i));
-	std::swap(sktrighit_, sktrighit_vec.at(buffer_i));
-	std::swap(skqv_, skqv_vec.at(buffer_i));
-	std::swap(sktv_, sktv_vec.at(buffer_i));
-	std::swap(skchlv_, skchlv_vec.at(buffer_i));
-	std::swap(skthrv_, skthrv_vec.at(buffer_i));
-	std::swap(skhitv_, skhitv_vec.at(buffer_i));
-	std::swap(skpdstv_, skpdstv_vec.at(buffer_i));
-	std::swap(skatmv_, skatmv_vec.at(buffer_i));
-	std::swap(odmaskflag_, odmaskflag_vec.at(buffer_i));
-	std::swap(skdbstat_, skdbstat_vec.at(buffer_i));
-	std::swap(skqbstat_, skqbstat_vec.at(buffer_i));
-	std::swap(skspacer_, skspacer_vec.at(buffer_i));
-	std::swap(skgps_, skgps_vec.at(buffer_i));
-	std::swap(t2kgps_, t2kgps_vec.at(buffer_i));
-	std::swap(prevt0_, prevt0_vec.at(buffer_i));
-	std::swap(tdiff_, tdiff_vec.at(buffer_i));
-	std::swap(mintdiff_, mintdiff_vec.at(buffer_i));
-	std::swap(sktrg_, sktrg_vec.at(buffer_i));
-	std::swap(vcvrtx_, vcvrtx_vec.at(buffer_i));
-	std::swap(vcwork_, vcwork_vec.at(buffer_i));
-	
-	return true;
+	// swap the buffered entry with the current contents of the common blocks
+	return commonsBuffer.Load(buffer_i);
 }
 
 bool TreeReader::HasAFT(){
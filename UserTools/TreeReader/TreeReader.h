@@ -7,6 +7,11 @@
 
 #include "Tool.h"
 #include "MTreeReader.h"
+#include "MTreeEventIndex.h"
+#include "CommonBlockBuffer.h"
+#include "EntryBitmap.h"
+#include "EventBatch.h"
+#include "ZbsEntryCounter.h"
 #include "SkrootHeaders.h" // MCInfo, Header etc.
 #include "Constants.h"
 
@@ -33,12 +38,20 @@ class TreeReader: public Tool {
 	bool HasAFT();
 	bool LoadAFT();
 	bool LoadSHE();
+	// register the event-wise fortran common blocks with a buffer, or only those named.
+	// by_hits: only copy the filled part of arrays of hits. Returns any unknown names.
+	static std::vector<std::string> AddCommonBlocks(CommonBlockBuffer& buffer,
+	                                                const std::vector<std::string>& blocknames,
+	                                                bool by_hits=true);
 	
 	private:
 	// functions
 	// =========
 	int ReadEntry(long entry_number, bool load_aft=false);
 	int LoadConfig(std::string configfile);
+	int SetEntryRangeFromIndex();
+	long NextRunEntry(long entry_number);
+	int SetShardEntryRange();
 	int GenerateNewLUN();
 	void CloseLUN();
 	
@@ -53,6 +66,7 @@ class TreeReader: public Tool {
 	std::string readerName;
 	int maxEntries=-1;
 	int firstEntry=0;
+	long lastEntry=-1;                // stop before this entry, if >=0 (set from run_max or numShards)
 	int entrynum=0;
 	int readEntries=0;                // count how many entries we've actually returned
 	SKROOTMODE skrootMode=SKROOTMODE::READ;  // default to read
@@ -68,6 +82,18 @@ class TreeReader: public Tool {
 	bool loadSheAftPairs=false;       // should we load and buffer the AFT for an SHE event, if there is one?
 	bool onlyPairs=false;             // should we only return pairs of SHE+AFT events
 	int entriesPerExecute=1;          // alternatively, read and buffer N entries per Execute call
+	bool lazyReading=false;           // only read branches when they're accessed (plain ROOT files only)
+	int learnBranches=0;              // learn which branches are used over N entries, then disable the rest
+	int prefetchEntries=0;            // read N entries ahead in a background thread (plain ROOT files only)
+	std::string columnCache="";       // file of decoded branch values to read entries from (plain ROOT files only)
+	int run_min=-1;                   // only read entries of runs in [run_min, run_max], found via an
+	int run_max=-1;                   // index of run and event numbers. -1: no limit.
+	std::string firstEvent="";        // "run subrun event" of the entry to start from, found via the index
+	std::string eventIndexDir="";     // where to keep the index sidecar files, if not alongside the inputs
+	MTreeEventIndex eventIndex;
+	std::vector<long> runEntries;     // entries of runs [run_min, run_max], if they're not in entry order
+	int shardIndex=0;                 // when splitting the input over numShards jobs, this job's share of
+	int numShards=1;                  // the entries (plain ROOT files only). Outputs can be merged with MergeShards.
 	
 	std::vector<std::string> list_of_files;
 	
@@ -92,78 +118,66 @@ class TreeReader: public Tool {
 	
 	// functions involved in buffering common blocks
 	// to load SHE+AFT pairs together
+	int InitCommonsBuffer();
 	int PushCommons();
-	int PopCommons();
+	int PopCommons(bool oldest=false);
 	int FlushCommons();
 	bool LoadCommons(int buffer_i);
 	bool LoadNextZbsFile();
 	
+	// reading ZEBRA files
+	// ===================
+	bool OpenZbsFile(int file_i);
+	std::string ResolveZbsPath(std::string filename);
+	// with an index of the records of each file, entries can be read in any order
+	int CountZbsEntries();
+	int SkipToZbsEntry(long entry_number);
+	std::pair<long,long> GetZbsShardRange();
+	int zbsFileIndex=-1;                   // index in list_of_files of the open file
+	long zbsNextEntry=0;                   // the entry the next read will return
+	bool zbsEntryLoaded=false;             // the last entry read hasn't been returned yet
+	bool zbsEntriesCounted=false;
+	std::vector<long> zbsFileFirstEntries; // first entry of each file, and the total
+	
 	// common blocks to buffer
 	// =======================
-	// TODO trim down this list, almost certainly many of these are either
-	// not populated by skread/skrawread, or are not used by reconstruction algorithms
-	// and therefore do not need to be buffered.
-	// TODO right now these do not really need to be vectors, since we only ever fill
-	// them with at most one entry. Generlizing for storing buffering many entries,
-	// but ... simplify if this is not useful.
-	
-	// event header - run, event numbers, trigger info...
-	std::vector<skhead_common> skhead_vec;
-	std::vector<skheada_common> skheada_vec;
-	std::vector<skheadg_common> skheadg_vec;
-	std::vector<skheadf_common> skheadf_vec;
-	std::vector<skheadc_common> skheadc_vec;
-	std::vector<skheadqb_common> skheadqb_vec;
-	
-	// low-e event variables
-	std::vector<skroot_lowe_common> skroot_lowe_vec;
-	std::vector<skroot_mu_common> skroot_mu_vec;
-	std::vector<skroot_sle_common> skroot_sle_vec;
-	
-	// commons containing arrays of T, Q, ICAB....
-	std::vector<skq_common> skq_vec;
-	std::vector<skqa_common> skqa_vec;
-	std::vector<skt_common> skt_vec;
-	std::vector<skta_common> skta_vec;
-	std::vector<skchnl_common> skchnl_vec;
-	std::vector<skthr_common> skthr_vec;
-	std::vector<sktqz_common> sktqz_vec;
-	std::vector<sktqaz_common> sktqaz_vec;
-	std::vector<rawtqinfo_common> rawtqinfo_vec;
-	
-	std::vector<sktrighit_common> sktrighit_vec;
-	std::vector<skqv_common> skqv_vec;
-	std::vector<sktv_common> sktv_vec;
-	std::vector<skchlv_common> skchlv_vec;
-	std::vector<skthrv_common> skthrv_vec;
-	std::vector<skhitv_common> skhitv_vec;
-	std::vector<skpdstv_common> skpdstv_vec;
-	std::vector<skatmv_common> skatmv_vec;
-	
-	// OD mask....? nhits, charge, flag...
-	std::vector<odmaskflag_common> odmaskflag_vec;
-	
-	// hardware trigger variables; counters, trigger words, prevt0...
-	// spacer and trigger info.
-	std::vector<skdbstat_common> skdbstat_vec;
-	std::vector<skqbstat_common> skqbstat_vec;
-	std::vector<skspacer_common> skspacer_vec;
-	
-	// gps word and time.
-	std::vector<skgps_common> skgps_vec;
-	std::vector<t2kgps_common> t2kgps_vec;
-	
-	// hw counter difference to previous event.
-	std::vector<prevt0_common> prevt0_vec;
-	std::vector<tdiff_common> tdiff_vec;
-	std::vector<mintdiff_common> mintdiff_vec;
-	
-	// trigger hardware counters, word, spacer length...
-	std::vector<sktrg_common> sktrg_vec;
-	
-	// MC particles and vertices, event-wise.
-	std::vector<vcvrtx_common> vcvrtx_vec;
-	std::vector<vcwork_common> vcwork_vec;
+	// copies of the event-wise fortran common blocks, in storage allocated once in Initialise.
+	// By default all blocks that may be populated by skread are buffered, but the list can be
+	// limited to those actually used downstream with StartBufferedCommonsList/EndBufferedCommonsList.
+	CommonBlockBuffer commonsBuffer;
+	std::vector<std::string> bufferedCommons;
+	
+	// trigger words for SHE+AFT pairing
+	// =================================
+	// the idtgsk trigger words of the entries from triggerWordsStart, read in one pass over
+	// the HEADER branch, so that the entry after an SHE can be checked for an AFT without reading it.
+	// Only used with SKROOT files.
+	int UpdateTriggerWords(long entry_number);
+	int GetTriggerWord(long entry_number);
+	bool IsShePair(long entry_number);
+	bool useTriggerWords=false;
+	long triggerWordsStart=0;
+	std::vector<int> triggerWords;
+	
+	// physics entries
+	// ===============
+	// which entries of the current file are physics events rather than pedestal or status entries,
+	// from the HEADER branch, so that skread need only be called for physics events.
+	// Only used with SKROOT files. Saved per file in a sidecar file, as for the event index.
+	long NextPhysicsEntry(long entry_number);
+	int LoadPhysicsEntries(long entry_number);
+	// the checks for pedestal and runinfo entries at the top of headsk.F
+	static bool IsPhysicsHeader(int nrunsk, int mdrnsk, int ifevsk, int sk_geometry);
+	bool usePhysicsEntries=false;
+	long physicsEntriesStart=0;       // entry number of the first entry of the file
+	EntryBitmap physicsEntries;
+	
+	// batch of events
+	// ===============
+	// with entriesPerExecute>1 (SK files only), the hits and main header and lowe values of the
+	// entries read in each Execute call, published as m_data->Batches.at(readerName)
+	void AddBatchEvent();
+	EventBatch eventBatch;
 	
 };
 
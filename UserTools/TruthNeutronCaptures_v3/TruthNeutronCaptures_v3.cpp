@@ -49,6 +49,10 @@ bool TruthNeutronCaptures_v3::Initialise(std::string configfile, DataModel &data
 	// ------------------------------
 	get_ok = myTreeReader.Load(inputFile, "data"); // official ntuple TTree is descriptively known as 'h1'
 	DisableUnusedBranches();
+	if(get_ok){
+		get_ok = (myTreeReader.GetBranchHandle("SECONDARY",sec_info_h)) &&
+				 (myTreeReader.GetBranchHandle("MC",mc_info_h));
+	}
 	entry_number = 0;
 	if(get_ok) ReadEntryNtuple(entry_number);
 	
@@ -615,8 +619,9 @@ int TruthNeutronCaptures_v3::ReadEntryNtuple(long entry_number){
 	int bytesread = myTreeReader.GetEntry(entry_number);
 	if(bytesread<=0) return bytesread;
 	
-	int success = (myTreeReader.GetBranchValue("SECONDARY",sec_info)) &&
-				  (myTreeReader.GetBranchValue("MC",mc_info));
+	sec_info = sec_info_h.Get();
+	mc_info = mc_info_h.Get();
+	int success = (sec_info!=nullptr) && (mc_info!=nullptr);
 	
 	// Print method should have been const-qualified. Hack around it.
 	//MCInfo* mci = const_cast<MCInfo*>(mc_info);
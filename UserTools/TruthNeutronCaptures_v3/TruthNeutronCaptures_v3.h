@@ -84,6 +84,8 @@ class TruthNeutronCaptures_v3: public Tool {
 	
 	const MCInfo* mc_info = nullptr;
 	const SecondaryInfo* sec_info = nullptr;
+	BranchHandle<MCInfo> mc_info_h;                             // handles to the above branches,
+	BranchHandle<SecondaryInfo> sec_info_h;                     // resolved once on Load
 	
 	// run meta info
 	//int simulation version??
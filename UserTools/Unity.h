@@ -4,6 +4,8 @@
 #include "TruthNeutronCaptures_v3.h"
 #include "LoadFileList.h"
 #include "RootReadTest.h"
+#include "MTreeReaderBenchmark.h"
+#include "MTreeParallelBenchmark.h"
 #include "PlotNeutronCaptures.h"
 #include "GracefulStop.h"
 #include "LoadBetaSpectraFluka.h"
@@ -18,3 +20,6 @@
 #include "PythonScript.h"
 #include "lf_allfit_new.h"
 #include "evDisp.h"
+#include "CommonsBufferBenchmark.h"
+#include "CutIndicesBenchmark.h"
+#include "CutSelectionBenchmark.h"
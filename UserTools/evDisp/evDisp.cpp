@@ -13,6 +13,7 @@
 #include "ConnectionTable.h"
 #include "TableReader.h"
 #include "TableEntry.h"
+#include "HitView.h"
 
 evDisp::evDisp():Tool(){
 	// get the name of the tool from its class name
@@ -102,24 +103,26 @@ bool evDisp::Execute(){
 	}
 	if(dataSrc==1) GetData();  // get data from TreeReader if not using SK common blocks
 	
+	// view the hits where they are, rather than copying them
+	HitView hits;
 	switch (dataSrc){
 		case 0: {
 			// sktqz_ common block
-			totalPMTsActivated = sktqz_.nqiskz;
+			hits = HitView::FromCommons();
 			break;
 		}
 		case 1: {
 			// TQReal branch
-			totalPMTsActivated = myTQReal->cables.size();
+			hits = HitView::FromTQReal(myTQReal);
 			break;
 		}
 		default: {
 			// unknown
 			Log(toolName+" unknown dataSrc: "+std::to_string(dataSrc),v_error,verbosity);
-			totalPMTsActivated = 0;
 			break;
 		}
 	}
+	totalPMTsActivated = hits.size();
 	
 	// resize internal arrays of TGraph2Ds
 	if(topCapHitMap)    topCapHitMap->Set(totalPMTsActivated);
@@ -127,29 +130,9 @@ bool evDisp::Execute(){
 	if(barrelHitMap)    barrelHitMap->Set(totalPMTsActivated);
 	
 	for (int pmtNumber = 0; pmtNumber < totalPMTsActivated; ++pmtNumber){
-		switch (dataSrc){
-			case 0: {
-				// sktqz_ common block
-				cableNumber = sktqz_.icabiz[pmtNumber];
-				charge = sktqz_.qiskz[pmtNumber];
-				time = sktqz_.tiskz[pmtNumber];
-				break;
-			}
-			case 1: {
-				// TQReal branch
-				cableNumber = myTQReal->cables.at(pmtNumber);
-				charge = myTQReal->Q.at(pmtNumber);
-				time = myTQReal->T.at(pmtNumber);
-				break;
-			}
-			default: {
-				// unknown
-				Log(toolName+" unknown dataSrc: "+std::to_string(dataSrc),v_error,verbosity);
-				totalPMTsActivated = 0;
-				break;
-			}
-		}
-		
+		cableNumber = hits.Cable(pmtNumber);
+		charge = hits.Q(pmtNumber);
+		time = hits.T(pmtNumber);
 		
 		//std::cout << "cable number is: " << cableNumber << std::endl;
 		/*
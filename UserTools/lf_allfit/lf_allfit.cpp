@@ -8,6 +8,16 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm> // std::min
+#include <cstdio>    // std::remove, fflush
+#include <cerrno>
+#include <csignal>   // signal, SIGPIPE
+#include <unistd.h>  // fork, pipe, read, write, close, _exit
+#include <sys/wait.h>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TFileMerger.h"
 
 // declarations and #includes for SK fortran routines
 #include "fortran_routines.h"
@@ -31,9 +41,26 @@ bool lf_allfit::Initialise(std::string configfile, DataModel &data){
 	m_variables.Get("verbosity",verbosity);            // how verbose to be
 	m_variables.Get("fname_in",fname_in);
 	m_variables.Get("fname_out",fname_out);
+	m_variables.Get("numWorkers",numWorkers);              // >1 to fit in that many processes
+	m_variables.Get("farmChunkEntries",farmChunkEntries);  // entries per range handed to a worker
+	m_variables.Get("farmTempDir",farmTempDir);            // where workers put their output files
 	
 	lun = 10;  // TODO we should track these in ToolAnalysis to ensure uniqueness
 	
+	if(numWorkers>1){
+		// the files are opened by the worker processes, see RunFarm
+		Log(toolName+" will fit "+fname_in+" with "+toString(numWorkers)+" worker processes",v_message,verbosity);
+		return true;
+	}
+	
+	if(not OpenFiles(fname_out)) return false;
+	InitFitters();
+	
+	return true;
+}
+
+bool lf_allfit::OpenFiles(std::string outfile){
+	
 	// set up branches we don't need to read on input or write out
 	std::vector<std::string> in_branches_to_skip
 		{"SPACERS", "QBEESTATUS", "DBSTATUS", "MISMATCHEDHITS", "ATMPD", "UPMU"};
@@ -42,7 +69,7 @@ bool lf_allfit::Initialise(std::string configfile, DataModel &data){
 		"PEDESTALS","EVENTHEADER","GPSLIST","PREVT0","SLE","T2KGPSLIST"};
 	
 	// open input file
-	skroot_open_(&lun, fname_out.c_str(), fname_out.size());
+	skroot_open_(&lun, outfile.c_str(), outfile.size());
 	skroot_set_input_file_(&lun, fname_in.c_str(), fname_in.size());
 	
 	// disable unused input branches
@@ -61,6 +88,11 @@ bool lf_allfit::Initialise(std::string configfile, DataModel &data){
 	// skroot_init.F is mostly just a wrapper around skroot_initialize_,
 	// but also sets the variable `SK_FILE_FORMAT = 1` in common block /SKHEADF/
 	
+	return true;
+}
+
+void lf_allfit::InitFitters(){
+	
 	// initialize data structure (zbs)
 	kzinit_();
 	std::string options = "31,30,26,25";
@@ -82,12 +114,27 @@ bool lf_allfit::Initialise(std::string configfile, DataModel &data){
 	// initialize bonsai
 	cfbsinit_(&MAXPM_var, xyzpm);
 	
-	return true;
+	fitters_initialised = true;
 }
 
 
 bool lf_allfit::Execute(){
 	
+	if(numWorkers>1){
+		// the workers fit the whole file in one go
+		get_ok = RunFarm();
+		m_data->vars.Set("StopLoop",1);
+		return get_ok;
+	}
+	
+	get_ok = ProcessEntry();
+	if(get_ok==2) m_data->vars.Set("StopLoop",1);
+	
+	return true;
+}
+
+int lf_allfit::ProcessEntry(){
+	
 	if((nread%10000)==0) std::cout<<"nrunsk/nread = "<<skhead_.nrunsk<<"/"<<nread<<std::endl;
 	++nread;
 	
@@ -96,31 +143,27 @@ bool lf_allfit::Execute(){
 	skcrawread_(&lun, &ierr);
 	if(ierr==1){
 		std::cerr<<"read error"<<std::endl;
-		m_data->vars.Set("StopLoop",1);
-		return true;
+		return 2;
 	} else if(ierr==2){
-		m_data->vars.Set("StopLoop",1);
-		return true;
+		return 2;
 	} else if(ierr!=0) {
 		//std::cout<<"possibly some recoverable error? continuing"<<std::endl;
 		// this happens a lot...
-		return true;
+		return 1;
 	}
 	// same now for SKREAD...
 	int neglun = -lun;  // is used to indicate to SKREAD that it's a root file not zbs
 	skcread_(&neglun, &ierr);
 	if(ierr==1){
 		std::cerr<<"read error"<<std::endl;
-		m_data->vars.Set("StopLoop",1);
-		return true;
+		return 2;
 	} else if(ierr==2){
 		std::cerr<<"end of file"<<std::endl;
-		m_data->vars.Set("StopLoop",1);
-		return true;
+		return 2;
 	} else if(ierr!=0) {
 		//std::cout<<"possibly some recoverable error? continuing"<<std::endl;
 		// this happens a lot (or, one of them does)
-		return true;
+		return 1;
 	}
 	
 	// once per run water transparency
@@ -188,20 +231,279 @@ bool lf_allfit::Execute(){
 	// output root file - another fortran interface function we can call directly.
 	skroot_fill_tree_(&lun);
 	
-	return true;
+	return 0;
 }
 
 
 bool lf_allfit::Finalise(){
 	
-	// close input skroot files, delete the TTreeManager
-	skroot_close_(&lun);
-	// delete the SuperManager
-	skroot_end_();
+	if(numWorkers<=1){
+		// close input skroot files, delete the TTreeManager
+		skroot_close_(&lun);
+		// delete the SuperManager
+		skroot_end_();
+	}
 	
 	// terminate bonsai
-	cfbsexit_();
+	if(fitters_initialised) cfbsexit_();
 	
 	return true;
 }
 
+// =========
+// Farm mode
+// =========
+// The fortran fitters aren't thread-safe, so to fit in parallel we fork worker processes,
+// each with its own copy of the fortran state. The coordinator (this process) splits the input
+// into ranges of entries and hands them out one at a time as workers become free. Each range is
+// fitted into its own output file, and at the end these are concatenated in entry order.
+
+// messages sent over the pipes between coordinator and workers. Both are smaller than PIPE_BUF,
+// so writes are atomic and messages from different workers on the shared pipe don't interleave.
+struct FarmTask {
+	int range_i;        // -1 for no more ranges
+	long first_entry;
+	long last_entry;
+};
+
+struct FarmResult {
+	int worker_i;
+	int range_i;
+	int status;         // 0 on success
+	long entries;       // entries processed
+};
+
+static bool ReadMessage(int fd, void* message, size_t size){
+	// returns false at end of input, i.e. once all writers have closed the pipe
+	char* pos = static_cast<char*>(message);
+	while(size>0){
+		ssize_t nread = read(fd, pos, size);
+		if(nread<0 && errno==EINTR) continue;
+		if(nread<=0) return false;
+		pos += nread;
+		size -= nread;
+	}
+	return true;
+}
+
+static bool WriteMessage(int fd, const void* message, size_t size){
+	const char* pos = static_cast<const char*>(message);
+	while(size>0){
+		ssize_t nwritten = write(fd, pos, size);
+		if(nwritten<0 && errno==EINTR) continue;
+		if(nwritten<=0) return false;
+		pos += nwritten;
+		size -= nwritten;
+	}
+	return true;
+}
+
+std::vector<std::pair<long,long>> lf_allfit::GetFarmRanges(){
+	// split the input entries into ranges of about farmChunkEntries, starting on TTree clusters
+	// so that no two workers need to read and decompress the same baskets
+	std::vector<std::pair<long,long>> ranges;
+	TFile* infile = TFile::Open(fname_in.c_str());
+	if(infile==nullptr || infile->IsZombie()){
+		Log(toolName+" failed to open input file "+fname_in,v_error,verbosity);
+		if(infile) delete infile;
+		return ranges;
+	}
+	TTree* intree = (TTree*)infile->Get("data");
+	if(intree==nullptr){
+		Log(toolName+" no 'data' tree in input file "+fname_in,v_error,verbosity);
+		infile->Close();
+		delete infile;
+		return ranges;
+	}
+	long num_entries = intree->GetEntries();
+	long range_start = 0;
+	TTree::TClusterIterator clusters = intree->GetClusterIterator(0);
+	while(clusters()<num_entries){
+		long cluster_end = std::min(long(clusters.GetNextEntry()), num_entries);
+		if((cluster_end-range_start)>=farmChunkEntries || cluster_end==num_entries){
+			ranges.emplace_back(range_start, cluster_end);
+			range_start = cluster_end;
+		}
+	}
+	if(range_start<num_entries) ranges.emplace_back(range_start, num_entries);
+	infile->Close();
+	delete infile;
+	Log(toolName+" split "+toString(num_entries)+" entries into "+toString(ranges.size())+" ranges",
+		v_debug,verbosity);
+	return ranges;
+}
+
+std::string lf_allfit::GetPartFileName(int range_i){
+	std::string base = fname_out;
+	if(base.size()>5 && base.substr(base.size()-5)==".root") base.erase(base.size()-5);
+	if(farmTempDir!=""){
+		if(base.find('/')!=std::string::npos) base = base.substr(base.find_last_of('/')+1);
+		base = farmTempDir+"/"+base;
+	}
+	return base+"_part"+toString(range_i)+".root";
+}
+
+bool lf_allfit::RunFarm(){
+	
+	std::vector<std::pair<long,long>> ranges = GetFarmRanges();
+	if(ranges.empty()) return false;
+	int num_workers = std::min(numWorkers, int(ranges.size()));
+	
+	// each worker gets its own pipe for tasks, and all share one for results
+	int result_pipe[2];
+	if(pipe(result_pipe)!=0){
+		Log(toolName+" failed to create pipe for farm results",v_error,verbosity);
+		return false;
+	}
+	std::vector<int> task_fds;
+	std::vector<pid_t> pids;
+	// anything buffered would otherwise be printed again by each worker
+	std::cout.flush();
+	fflush(stdout);
+	for(int worker_i=0; worker_i<num_workers; ++worker_i){
+		int task_pipe[2];
+		if(pipe(task_pipe)!=0){
+			Log(toolName+" failed to create pipe for farm worker "+toString(worker_i),v_error,verbosity);
+			break;
+		}
+		pid_t pid = fork();
+		if(pid==0){
+			// worker: keep only our ends of our own pipes
+			close(task_pipe[1]);
+			close(result_pipe[0]);
+			for(auto&& afd : task_fds) close(afd);
+			RunFarmWorker(worker_i, task_pipe[0], result_pipe[1]);  // does not return
+		}
+		close(task_pipe[0]);
+		if(pid<0){
+			Log(toolName+" failed to fork farm worker "+toString(worker_i),v_error,verbosity);
+			close(task_pipe[1]);
+			break;
+		}
+		task_fds.push_back(task_pipe[1]);
+		pids.push_back(pid);
+	}
+	close(result_pipe[1]);
+	Log(toolName+" started "+toString(pids.size())+" farm workers for "+toString(ranges.size())+" ranges",
+		v_message,verbosity);
+	
+	// a worker that dies would make a later write to its task pipe raise SIGPIPE
+	auto old_sigpipe = signal(SIGPIPE, SIG_IGN);
+	
+	// hand out a range to each worker, then the next range to whichever worker finishes first
+	size_t next_range=0;
+	auto send_task = [&](int worker_i){
+		FarmTask atask{-1,0,0};
+		if(next_range<ranges.size()){
+			atask.range_i = next_range;
+			atask.first_entry = ranges.at(next_range).first;
+			atask.last_entry = ranges.at(next_range).second;
+			++next_range;
+		}
+		if(not WriteMessage(task_fds.at(worker_i), &atask, sizeof(atask))){
+			Log(toolName+" failed to send range to farm worker "+toString(worker_i),v_error,verbosity);
+			if(atask.range_i>=0) --next_range;  // offer it to the next free worker
+		}
+	};
+	for(int worker_i=0; worker_i<int(task_fds.size()); ++worker_i) send_task(worker_i);
+	
+	// collect results until all workers have exited and closed their end of the pipe
+	std::vector<int> range_status(ranges.size(), -1);
+	long entries_done=0;
+	FarmResult aresult;
+	while(ReadMessage(result_pipe[0], &aresult, sizeof(aresult))){
+		range_status.at(aresult.range_i) = aresult.status;
+		entries_done += aresult.entries;
+		Log(toolName+" farm worker "+toString(aresult.worker_i)+" finished range "+toString(aresult.range_i)
+			+" with status "+toString(aresult.status)+"; "+toString(entries_done)+" entries done",
+			(aresult.status==0) ? v_debug : v_error, verbosity);
+		send_task(aresult.worker_i);
+	}
+	close(result_pipe[0]);
+	for(auto&& afd : task_fds) close(afd);
+	signal(SIGPIPE, old_sigpipe);
+	
+	bool all_ok = true;
+	for(size_t worker_i=0; worker_i<pids.size(); ++worker_i){
+		int stat=0;
+		waitpid(pids.at(worker_i), &stat, 0);
+		if(not (WIFEXITED(stat) && WEXITSTATUS(stat)==0)){
+			Log(toolName+" farm worker "+toString(worker_i)+" failed",v_error,verbosity);
+			all_ok = false;
+		}
+	}
+	for(size_t range_i=0; range_i<ranges.size(); ++range_i){
+		if(range_status.at(range_i)!=0){
+			Log(toolName+" entries "+toString(ranges.at(range_i).first)+" to "+toString(ranges.at(range_i).second)
+				+" were not fitted",v_error,verbosity);
+			all_ok = false;
+		}
+	}
+	if(not all_ok){
+		// leave the worker outputs for inspection
+		Log(toolName+" farm failed; worker outputs are not merged",v_error,verbosity);
+		return false;
+	}
+	
+	return MergePartFiles(ranges.size());
+}
+
+void lf_allfit::RunFarmWorker(int worker_i, int task_fd, int result_fd){
+	// fit each range we're given into its own output file, until told there are no more
+	lun = 10+worker_i;
+	int exit_code=0;
+	FarmTask atask;
+	while(ReadMessage(task_fd, &atask, sizeof(atask)) && atask.range_i>=0){
+		FarmResult aresult{worker_i, atask.range_i, 0, 0};
+		if(not OpenFiles(GetPartFileName(atask.range_i))){
+			aresult.status = 1;
+		} else {
+			if(not fitters_initialised) InitFitters();
+			// this sets the TreeManager to the entry before, and skcrawread advances to it
+			int entry_temp = static_cast<int>(atask.first_entry);
+			int ierr=0;
+			skroot_jump_entry_(&lun, &entry_temp, &ierr);
+			for(long entry_i=atask.first_entry; entry_i<atask.last_entry; ++entry_i){
+				if(ProcessEntry()==2){
+					aresult.status = 2;
+					break;
+				}
+				++aresult.entries;
+			}
+			skroot_close_(&lun);
+		}
+		if(aresult.status!=0) exit_code = 1;
+		if(not WriteMessage(result_fd, &aresult, sizeof(aresult))) break;
+	}
+	close(task_fd);
+	close(result_fd);
+	if(fitters_initialised) cfbsexit_();
+	skroot_end_();
+	std::cout.flush();
+	fflush(stdout);
+	// skip the ToolChain's cleanup, which belongs to the coordinator
+	_exit(exit_code);
+}
+
+bool lf_allfit::MergePartFiles(int num_ranges){
+	// concatenate the outputs of each range, in entry order
+	TFileMerger merger(false, false);
+	if(not merger.OutputFile(fname_out.c_str(), "RECREATE")){
+		Log(toolName+" could not create output file "+fname_out,v_error,verbosity);
+		return false;
+	}
+	for(int range_i=0; range_i<num_ranges; ++range_i){
+		if(not merger.AddFile(GetPartFileName(range_i).c_str(), false)){
+			Log(toolName+" could not open farm output "+GetPartFileName(range_i),v_error,verbosity);
+			return false;
+		}
+	}
+	if(not merger.Merge()){
+		Log(toolName+" failed to merge farm outputs into "+fname_out,v_error,verbosity);
+		return false;
+	}
+	for(int range_i=0; range_i<num_ranges; ++range_i) std::remove(GetPartFileName(range_i).c_str());
+	Log(toolName+" merged "+toString(num_ranges)+" farm outputs into "+fname_out,v_message,verbosity);
+	return true;
+}
+
@@ -4,6 +4,8 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
+#include <utility> // std::pair
 
 #include "Tool.h"
 #include "SkrootHeaders.h" // MCInfo, Header etc.
@@ -33,6 +35,16 @@ class lf_allfit: public Tool {
 	private:
 	// functions
 	// =========
+	bool OpenFiles(std::string outfile);   // open the input with a new output file, on LUN lun
+	void InitFitters();                    // once per process
+	int ProcessEntry();                    // read and fit the next entry. 0=done, 1=skipped, 2=end or error
+	
+	// farm mode: fork numWorkers processes, each fitting ranges of entries handed out by this one
+	bool RunFarm();
+	std::vector<std::pair<long,long>> GetFarmRanges();
+	void RunFarmWorker(int worker_i, int task_fd, int result_fd);
+	std::string GetPartFileName(int range_i);
+	bool MergePartFiles(int num_ranges);
 	
 	// tool variables
 	// ==============
@@ -49,6 +61,11 @@ class lf_allfit: public Tool {
 	int nread=0;          // just track num loops for printing
 	int nrunsk_last=0;    // to know when to read in new transparency data at start of each new run
 	float watert;         // water transparency
+	bool fitters_initialised=false;
+	
+	int numWorkers=1;            // >1 for farm mode
+	long farmChunkEntries=10000; // approximate entries per range handed to a worker
+	std::string farmTempDir="";  // where workers write their outputs, if not alongside fname_out
 	
 	// verbosity levels: if 'verbosity' < this level, the message type will be logged.
 	int verbosity=1;
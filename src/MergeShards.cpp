@@ -0,0 +1,161 @@
+/* vim:set noexpandtab tabstop=4 wrap */
+// Combine the outputs of ToolChain jobs that each processed one shard of the input
+// (see the shardIndex and numShards options of TreeReader) into the outputs of a single job.
+// Shard outputs must be given in shard order.
+//
+// Usage:
+//	MergeShards selections <merged.root> <shard_0.root> <shard_1.root> ...
+//		MTreeSelection cut files: passing entries, cut counts and additional indices
+//	MergeShards histograms <merged.root> <shard_0.root> <shard_1.root> ...
+//		ROOT files of histograms (and trees), as hadd: histograms are added, trees concatenated
+//	MergeShards values <merged.bs> [-k key:mode:type ...] <shard_0.bs> <shard_1.bs> ...
+//		BoostStore values files. mode is 'sum' (scalars), 'concat' (std::vectors) or 'first';
+//		type is int, float or double. Without -k, the keys of FitSpallationDt values files are used.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <memory>  // unique_ptr
+
+#include "TFileMerger.h"
+
+#include "BoostStore.h"
+#include "MTreeSelection.h"
+#include "Constants.h"
+
+struct ValueKey {
+	std::string name;
+	std::string mode;
+	std::string type;
+};
+
+template<typename T>
+bool MergeValue(std::vector<std::unique_ptr<BoostStore>>& shards, BoostStore& merged, const ValueKey& akey){
+	if(akey.mode=="concat"){
+		std::vector<T> merged_values;
+		for(auto&& ashard : shards){
+			std::vector<T> shard_values;
+			if(not ashard->Get(akey.name, shard_values)) return false;
+			merged_values.insert(merged_values.end(), shard_values.begin(), shard_values.end());
+		}
+		merged.Set(akey.name, merged_values);
+	} else {
+		T merged_value = T(0);
+		for(size_t shard_i=0; shard_i<shards.size(); ++shard_i){
+			T shard_value;
+			if(not shards.at(shard_i)->Get(akey.name, shard_value)) return false;
+			if(akey.mode=="first"){
+				merged_value = shard_value;
+				break;
+			}
+			merged_value += shard_value;
+		}
+		merged.Set(akey.name, merged_value);
+	}
+	return true;
+}
+
+bool MergeValues(std::vector<std::string> shard_files, std::string outfilename, std::vector<ValueKey> keys){
+	if(keys.empty()){
+		// the values saved by FitSpallationDt with valuesFileMode 'write'
+		keys.push_back(ValueKey{"livetime","sum","double"});
+		keys.push_back(ValueKey{"dt_mu_lowe_vals","concat","float"});
+	}
+	std::vector<std::unique_ptr<BoostStore>> shards;
+	for(auto&& ashardfile : shard_files){
+		shards.emplace_back(new BoostStore(true,constants::BOOST_STORE_BINARY_FORMAT));
+		if(not shards.back()->Initialise(ashardfile.c_str())){
+			std::cerr<<"MergeShards could not read values file "<<ashardfile<<std::endl;
+			return false;
+		}
+	}
+	BoostStore merged(true,constants::BOOST_STORE_BINARY_FORMAT);
+	for(auto&& akey : keys){
+		bool ok=false;
+		if(akey.mode!="sum" && akey.mode!="concat" && akey.mode!="first"){
+			std::cerr<<"MergeShards: unknown merge mode '"<<akey.mode<<"' for key "<<akey.name<<std::endl;
+			return false;
+		}
+		if(akey.type=="int") ok = MergeValue<int>(shards, merged, akey);
+		else if(akey.type=="float") ok = MergeValue<float>(shards, merged, akey);
+		else if(akey.type=="double") ok = MergeValue<double>(shards, merged, akey);
+		else {
+			std::cerr<<"MergeShards: unknown type '"<<akey.type<<"' for key "<<akey.name<<std::endl;
+			return false;
+		}
+		if(not ok){
+			std::cerr<<"MergeShards failed to get "<<akey.name<<" as "<<akey.type
+					 <<((akey.mode=="concat") ? " vector" : "")<<" from all shards"<<std::endl;
+			return false;
+		}
+	}
+	merged.Save(outfilename.c_str());
+	merged.Close(); // necessary to complete the file write!
+	return true;
+}
+
+bool MergeHistograms(std::vector<std::string> shard_files, std::string outfilename){
+	// TFileMerger adds the contents of the files in the order they're given
+	TFileMerger merger(false, false);
+	if(not merger.OutputFile(outfilename.c_str(), "RECREATE")){
+		std::cerr<<"MergeShards could not create "<<outfilename<<std::endl;
+		return false;
+	}
+	for(auto&& ashardfile : shard_files){
+		if(not merger.AddFile(ashardfile.c_str(), false)){
+			std::cerr<<"MergeShards could not open "<<ashardfile<<std::endl;
+			return false;
+		}
+	}
+	return merger.Merge();
+}
+
+int main(int argc, char* argv[]){
+
+	if(argc<4){
+		std::cerr<<"usage: "<<argv[0]<<" <selections|histograms|values> <merged file>"
+				 <<" [-k key:mode:type ...] <shard files, in shard order...>"<<std::endl;
+		return 1;
+	}
+	std::string filetype = argv[1];
+	std::string outfilename = argv[2];
+	std::vector<std::string> shard_files;
+	std::vector<ValueKey> keys;
+	for(int arg_i=3; arg_i<argc; ++arg_i){
+		std::string arg = argv[arg_i];
+		if(arg=="-k" && (arg_i+1)<argc){
+			// key:mode:type
+			ValueKey akey;
+			std::stringstream ss(argv[++arg_i]);
+			if(not (std::getline(ss, akey.name, ':') && std::getline(ss, akey.mode, ':')
+			     && std::getline(ss, akey.type))){
+				std::cerr<<"MergeShards: could not parse key '"<<ss.str()<<"', expected key:mode:type"<<std::endl;
+				return 1;
+			}
+			keys.push_back(akey);
+		} else {
+			shard_files.push_back(arg);
+		}
+	}
+	if(shard_files.empty()){
+		std::cerr<<"MergeShards: no shard files given"<<std::endl;
+		return 1;
+	}
+
+	bool ok=false;
+	if(filetype=="selections") ok = MTreeSelection::MergeCutFiles(shard_files, outfilename);
+	else if(filetype=="histograms") ok = MergeHistograms(shard_files, outfilename);
+	else if(filetype=="values") ok = MergeValues(shard_files, outfilename, keys);
+	else {
+		std::cerr<<"MergeShards: unknown file type '"<<filetype<<"', expected selections, histograms or values"<<std::endl;
+		return 1;
+	}
+	if(not ok){
+		std::cerr<<"MergeShards failed to merge "<<shard_files.size()<<" "<<filetype<<" files"<<std::endl;
+		return 1;
+	}
+	std::cout<<"MergeShards merged "<<shard_files.size()<<" "<<filetype<<" files into "<<outfilename<<std::endl;
+
+	return 0;
+}